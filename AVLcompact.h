@@ -0,0 +1,342 @@
+/**
+ * @file AVLcompact.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains compactBST, an AVL tree whose nodes live in one array and link
+ * to each other by 32-bit index instead of by pointer. A node is its key, its value and two
+ * indices, nothing else: the balance factors take 2 bits per node in a separate array that
+ * only updates read, and the cached height and size of balancedBST are gone. A set of
+ * uint64_t keys takes 16 bytes per key instead of a 40-byte node plus its malloc header:
+ *
+ *     avl_compact_set<uint64_t> ids;
+ *     ids.insertNode(7);
+ *     bool found = ids.searchItem(7);
+ *     avl_memory_usage usage = ids.memory_usage();    // usage.bytes_per_key()
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLCOMPACT_H
+#define AVLCOMPACT_H
+
+/* --- IMPORTS --- */
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "AVLtrees.h"
+#include "AVLlinked.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- COMPACT TREE CLASS --- */
+/**
+ * @brief This class is an AVL tree stored in a vector of nodes linked by uint32_t indices.
+ * Index 0xFFFFFFFF is the null link, so it holds up to 2^32 - 1 (about 4.29 billion) keys.
+ * Freed slots are kept on a free list, threaded through their left links, and reused by
+ * later inserts. Growing the vector moves the nodes, so iterators and searchValue
+ * pointers are invalidated by inserts. The rebalancing is avl_linked_core's, with the
+ * tree as its storage: nodes are changed in place, so writable() is the identity.
+ *
+ * @tparam Key: the key type, ordered by Compare
+ * @tparam Value: the mapped value type (avl_no_value for sets)
+ * @tparam Compare: strict weak ordering on keys
+ * @tparam Alloc: allocator, rebound to the node type
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key> >
+class compactBST {
+
+public:
+	// the null link
+	static const uint32_t NIL = 0xFFFFFFFFu;
+
+	typedef Key key_type;		// type of the keys
+	typedef Value mapped_type;	// type of the mapped values (avl_no_value for sets)
+
+private:
+	friend struct avl_linked_core<uint32_t, compactBST>;
+	typedef avl_linked_core<uint32_t, compactBST> Core;
+
+	// a node: the key, the value (nothing for sets) and the two links
+	struct Node : avl_value<Value> {
+		Key data;			// store data
+		uint32_t left;		// index of the left subtree
+		uint32_t right;		// index of the right subtree
+
+		Node (const Key &key, const Value &value) : avl_value<Value>(value), data(key), left(NIL), right(NIL) {};
+	};
+
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+
+	vector<Node, NodeAlloc> nodes;		// every slot, live or free
+	vector<uint8_t> balances;			// four 2-bit balance factors per byte, by node index
+	uint32_t root;						// index of the root, or NIL
+	uint32_t freeList;					// first free slot, or NIL
+	size_t count;						// number of keys
+	Compare comp;						// key ordering
+
+	/* --- Storage Functions (for avl_linked_core) --- */
+
+	/**
+	 * @brief Reaches a node by index.
+	 */
+	Node& node (uint32_t i) {return nodes[i];};
+	const Node& node (uint32_t i) const {return nodes[i];};
+
+	/**
+	 * @brief Reads and writes the balance factor of a node.
+	 */
+	avl_balance balance (uint32_t i) const {return (avl_balance)((balances[i >> 2] >> ((i & 3) * 2)) & 3);};
+	void set_balance (uint32_t i, avl_balance b)
+		{uint8_t &bits = balances[i >> 2]; bits = (uint8_t)((bits & ~(3 << ((i & 3) * 2))) | (b << ((i & 3) * 2)));};
+
+	/**
+	 * @brief Takes a slot from the free list, or appends one, and puts a new node in it.
+	 *
+	 * @param key: (Key) the key
+	 * @param value: (Value) the value mapped to the key
+	 * @return uint32_t: the new node's index
+	 */
+	uint32_t create_node (const Key &key, const Value &value);
+
+	/**
+	 * @brief Puts a node's slot on the free list.
+	 *
+	 * @param i: (uint32_t) the node's index
+	 * @return void
+	 */
+	void release_node (uint32_t i) {nodes[i].left = freeList; freeList = i; count--;};
+
+	/**
+	 * @brief Nodes are changed in place.
+	 *
+	 * @param i: (uint32_t) the node's index
+	 * @return uint32_t: i
+	 */
+	uint32_t writable (uint32_t i) const {return i;};
+
+	/* --- End of Storage Functions --- */
+
+public:
+	/**
+	 * @brief In-order iterator. It keeps the ancestors still to be visited in a fixed array of
+	 * AVL_MAX_DEPTH indices, so stepping never allocates, and yields what avl_entry yields
+	 * for balancedBST.
+	 */
+	template <bool Const>
+	class compact_iterator {
+
+		friend class compactBST;
+		template <bool> friend class compact_iterator;
+		typedef avl_entry<Key, Value, Const> Entry;
+		typedef typename conditional<Const, const Node, Node>::type Slot;
+
+		Slot * base;						// the node array
+		uint32_t path[AVL_MAX_DEPTH];		// the current node and the ancestors it is left of
+		int depth;							// entries in path, 0 at the end
+
+		// pushes i and its chain of left children
+		void descend (uint32_t i) {
+			while (i != NIL) {
+				path[depth++] = i;
+				i = base[i].left;
+			}
+		};
+
+		compact_iterator (Slot *nodes, uint32_t root) : base(nodes), depth(0) {descend(root);};
+
+	public:
+		typedef forward_iterator_tag iterator_category;
+		typedef typename Entry::value_type value_type;
+		typedef typename Entry::reference reference;
+		typedef typename Entry::pointer pointer;
+		typedef ptrdiff_t difference_type;
+
+		compact_iterator () : base(nullptr), depth(0) {};
+		// const_iterator from iterator
+		compact_iterator (const compact_iterator<false> &other) : base(other.base), depth(other.depth)
+			{copy(other.path, other.path + other.depth, path);};
+
+		reference operator* () const {return Entry::get(&base[path[depth - 1]]);};
+		pointer operator-> () const {return Entry::arrow(&base[path[depth - 1]]);};
+
+		compact_iterator& operator++ () {uint32_t right = base[path[--depth]].right; descend(right); return *this;};
+		compact_iterator operator++ (int) {compact_iterator before = *this; ++*this; return before;};
+
+		bool operator== (const compact_iterator &other) const
+			{return depth == other.depth && (depth == 0 || path[depth - 1] == other.path[depth - 1]);};
+		bool operator!= (const compact_iterator &other) const {return !(*this == other);};
+	};
+
+	typedef compact_iterator<false> iterator;
+	typedef compact_iterator<true> const_iterator;
+	typedef typename avl_entry<Key, Value, true>::value_type value_type;
+
+	// constructor
+	explicit compactBST (const Compare &compare = Compare(), const Alloc &alloc = Alloc())
+		: nodes(NodeAlloc(alloc)), root(NIL), freeList(NIL), count(0), comp(compare) {};
+
+	/**
+	 * @brief Inserts a key, mapped to a value for maps. Does nothing if the key is already there.
+	 * Throws length_error when the tree already holds 2^32 - 1 nodes.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 */
+	void insertNode (const Key &key, const Value &value = Value()) {bool grew; root = Core::insert(*this, root, key, value, grew);};
+
+	/**
+	 * @brief Removes a key. Does nothing if the key is not there.
+	 *
+	 * @param key: (Key) the key to remove
+	 */
+	void deleteNode (const Key &key) {bool shrunk; root = Core::erase(*this, root, key, shrunk);};
+
+	/**
+	 * @brief Checks whether a key is in the tree.
+	 *
+	 * @param key: (Key) the key to find
+	 * @return bool
+	 */
+	bool searchItem (const Key &key) const {return Core::lookup(*this, root, key) != NIL;};
+
+	/**
+	 * @brief Finds the value mapped to a key (maps only).
+	 *
+	 * @param key: (Key) the key to find
+	 * @return Value*: the value, or nullptr if the key is not in the tree
+	 */
+	Value* searchValue (const Key &key) {uint32_t i = Core::lookup(*this, root, key); return i == NIL ? nullptr : &nodes[i].value;};
+
+	/**
+	 * @brief Get the number of keys.
+	 *
+	 * @return size_t
+	 */
+	size_t treeNodeCount () const {return count;};
+	bool empty () const {return count == 0;};
+
+	/**
+	 * @brief Finds the height (leaf = 0, empty = -1) by following the taller child of each node,
+	 * in O(log n), since heights are not stored.
+	 *
+	 * @return int
+	 */
+	int height () const {return Core::height(*this, root);};
+
+	/**
+	 * @brief Removes every key and gives the memory back.
+	 *
+	 * @return void
+	 */
+	void clear ();
+
+	/**
+	 * @brief Makes room for n keys in total, so that inserts up to n do not move the nodes.
+	 *
+	 * @param n: (size_t) the number of keys
+	 * @return void
+	 */
+	void reserve (size_t n) {nodes.reserve(n); balances.reserve((n + 3) / 4);};
+
+	/**
+	 * @brief Reports the memory the tree holds: the live nodes, and as extra the free slots,
+	 * the unused capacity, the balance array and the tree object. There are two blocks.
+	 *
+	 * @return avl_memory_usage
+	 */
+	avl_memory_usage memory_usage () const;
+
+	/* --- Iterator Functions --- */
+
+	iterator begin () {return iterator(nodes.data(), root);};
+	iterator end () {return iterator();};
+	const_iterator begin () const {return const_iterator(nodes.data(), root);};
+	const_iterator end () const {return const_iterator();};
+
+	/* --- End of Iterator Functions --- */
+};
+/* --- End of COMPACT TREE CLASS --- */
+
+/* --- ALIASES --- */
+/**
+ * @brief compactBST as a map and as a set.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_compact_map = compactBST<Key, Value, Compare, Alloc>;
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_compact_set = compactBST<Key, avl_no_value, Compare, Alloc>;
+/* --- End of ALIASES --- */
+
+/* --- COMPACT TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Puts a new node in a free slot, or at the end of the array.
+ *
+ * A reused slot is overwritten in place. A new slot also takes a new byte of balance factors
+ * every fourth node. Both start out even.
+ *
+ * @param key The key.
+ * @param value The value mapped to the key.
+ * @return uint32_t The new node's index.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+uint32_t compactBST<Key, Value, Compare, Alloc>::create_node(const Key &key, const Value &value) {
+	uint32_t i;
+	if (freeList != NIL) {
+		i = freeList;
+		freeList = nodes[i].left;
+		nodes[i] = Node(key, value);
+	}
+	else {
+		if (nodes.size() >= NIL) {
+			throw length_error("compactBST: more than 2^32 - 1 nodes");
+		}
+		i = (uint32_t)nodes.size();
+		nodes.push_back(Node(key, value));
+		if ((i & 3) == 0) {
+			balances.push_back(0);
+		}
+	}
+	set_balance(i, AVL_EVEN);
+	count++;
+	return i;
+}
+
+/**
+ * @brief Empties the tree and frees both arrays.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void compactBST<Key, Value, Compare, Alloc>::clear() {
+	vector<Node, NodeAlloc>(nodes.get_allocator()).swap(nodes);
+	vector<uint8_t>().swap(balances);
+	root = NIL;
+	freeList = NIL;
+	count = 0;
+}
+
+/**
+ * @brief Reports the memory held.
+ *
+ * @return avl_memory_usage The report.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+avl_memory_usage compactBST<Key, Value, Compare, Alloc>::memory_usage() const {
+	size_t held = nodes.capacity() * sizeof(Node) + balances.capacity() + sizeof(*this);
+	avl_memory_usage usage = {count, count * sizeof(Node), held - count * sizeof(Node), 2};
+	return usage;
+}
+
+/* --- End of COMPACT TREE IMPLEMENTATION --- */
+
+#endif // AVLCOMPACT_H
@@ -0,0 +1,1510 @@
+/**
+ * @file AVLconcurrent.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains concurrentBST, an AVL tree that many threads can update at once.
+ * It follows the relaxed-balance concurrent AVL tree of Bronson, Casper, Chafi and
+ * Olukotun ("A Practical Concurrent Binary Search Tree", PPoPP 2010):
+ *  - every node has its own lock, and updates lock only the one or two nodes they change;
+ *  - lookups take no locks, and instead check per-node version numbers hand over hand,
+ *    retrying from the parent when a rotation moved the subtree they were in;
+ *  - deleting a node with two children only clears its value, leaving a routing node;
+ *  - rebalancing walks up from the changed node, locking a parent, a node and at most
+ *    two of its children for each rotation, and may lag behind the updates (relaxed
+ *    balance); once the tree is quiescent every node is balanced again.
+ * Unlinked nodes are freed by epoch-based reclamation. Every thread works through its
+ * own session:
+ *
+ *     concurrentBST<uint64_t, uint64_t> tree;
+ *     concurrentBST<uint64_t, uint64_t>::session s(tree);   // once per thread
+ *     s.insertNode(7, 100);
+ *     bool found = s.searchItem(7);
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLCONCURRENT_H
+#define AVLCONCURRENT_H
+
+/* --- IMPORTS --- */
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- CONCURRENT TREE CLASS --- */
+/**
+ * @brief This class is a concurrent AVL map or set with fine-grained locking.
+ * Inserts never overwrite: insertNode on a present key returns false, like cowBST.
+ * All operations are linearizable. The allocator is called from every thread, so it
+ * must be thread-safe (std::allocator is; avl_node_pool is not). Keys must be default
+ * constructible, for the sentinel above the root.
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key> >
+class concurrentBST {
+
+private:
+	// a tree node; height counts nodes (leaf = 1) as in the paper, unlike balancedBST
+	struct TreeNode {
+		Key data;						// key, never changes
+		atomic<Value*> value;			// nullptr for a routing node
+		atomic<TreeNode*> left;			// link to left subtree
+		atomic<TreeNode*> right;		// link to right subtree
+		atomic<TreeNode*> parent;		// link to parent, nullptr for the sentinel
+		atomic<int> height;				// height, possibly out of date while rebalancing
+		atomic<unsigned long long> version;	// see the version bits below
+		atomic<bool> locked;			// spin lock
+
+		TreeNode (const Key &key, Value *v, TreeNode *p)
+			: data(key), value(v), left(nullptr), right(nullptr), parent(p), height(1), version(0), locked(false) {};
+
+		atomic<TreeNode*>& child (int dir) {return dir < 0 ? left : right;};
+	};
+
+	// locks a node for the lifetime of the guard
+	struct node_lock {
+		TreeNode *node;
+
+		explicit node_lock (TreeNode *n) : node(n) {
+			while (node->locked.exchange(true, memory_order_acquire)) {
+				while (node->locked.load(memory_order_relaxed)) {
+					this_thread::yield();
+				}
+			}
+		};
+		~node_lock () {node->locked.store(false, memory_order_release);};
+	};
+
+	// Version bits: a node being rotated down is "shrinking" (readers inside its subtree
+	// may miss keys and must wait and retry); each finished rotation adds VERSION_STEP;
+	// an unlinked node's version is UNLINKED for good.
+	static const unsigned long long UNLINKED = 1;
+	static const unsigned long long SHRINKING = 2;
+	static const unsigned long long VERSION_STEP = 4;
+
+	// results of one optimistic attempt
+	enum attempt {RETRY = -1, FAILED = 0, DONE = 1};
+
+	// what a node needs after a change below it
+	enum condition {NOTHING_REQUIRED = -3, REBALANCE_REQUIRED = -2, UNLINK_REQUIRED = -1};
+
+	// one session's epoch slot, padded to its own cache line
+	struct SessionSlot {
+		atomic<unsigned long long> epoch;	// epoch seen when the operation began, 0 outside one
+		atomic<bool> claimed;				// owned by a session
+		char pad[64 - sizeof(atomic<unsigned long long>) - sizeof(atomic<bool>)];
+
+		SessionSlot () : epoch(0), claimed(false) {};
+	};
+
+	// an unlinked node or a replaced value, and the epoch it was retired in
+	struct Retired {
+		unsigned long long epoch;
+		TreeNode * node;
+		Value * box;
+	};
+
+	// allocators rebound to the node and value types
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<TreeNode> NodeAlloc;
+	typedef allocator_traits<NodeAlloc> NodeAllocTraits;
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<Value> ValueAlloc;
+	typedef allocator_traits<ValueAlloc> ValueAllocTraits;
+
+	// sets share one placeholder value instead of allocating one per key
+	typedef typename is_same<Value, avl_no_value>::type is_set;
+
+	// a session checks for reclaimable memory once it has retired this many items
+	static const size_t RECLAIM_BATCH = 64;
+
+	Compare comp;							// key ordering
+	NodeAlloc nodeAlloc;					// node allocator
+	ValueAlloc valueAlloc;					// value allocator
+	TreeNode * holder;						// sentinel whose right child is the root
+	atomic<long long> count;				// number of keys
+	atomic<unsigned long long> globalEpoch;	// starts at 1; 0 marks an idle slot
+	unique_ptr<SessionSlot[]> slots;		// one per session
+	size_t slotCount;						// length of slots
+	mutex orphanLock;						// guards orphans
+	vector<Retired> orphans;				// retired items left behind by ended sessions
+
+public:
+	class session;
+
+private:
+	/* --- Helper Functions --- */
+
+	static int height (TreeNode *node) {return node == nullptr ? 0 : node->height.load();};
+
+	/**
+	 * @brief Compares a key with a node's key.
+	 *
+	 * @return int: -1, 0 or 1 for less, equal or greater
+	 */
+	int compare (const Key &key, const TreeNode *node) const
+		{return comp(key, node->data) ? -1 : comp(node->data, key) ? 1 : 0;};
+
+	TreeNode* create_node (const Key &key, Value *box, TreeNode *parent);
+	void destroy_node (TreeNode *node);
+	Value* create_box (const Value &value) {return create_box(value, is_set());};
+	Value* create_box (const Value &value, false_type);
+	Value* create_box (const Value &, true_type) {static Value placeholder; return &placeholder;};
+	void destroy_box (Value *box) {destroy_box(box, is_set());};
+	void destroy_box (Value *box, false_type);
+	void destroy_box (Value *, true_type) {};
+
+	/**
+	 * @brief Waits until a rotation that is shrinking a node has finished.
+	 *
+	 * @param node: (TreeNode*) the node
+	 * @param version: (unsigned long long) the version that was read; returns at once if
+	 * it was not shrinking
+	 * @return void
+	 */
+	static void wait_until_not_changing (TreeNode *node, unsigned long long version);
+
+	/**
+	 * @brief One optimistic lookup below node, whose version must still be nodeVersion.
+	 *
+	 * @param key: (Key) the key
+	 * @param node: (TreeNode*) the node to search below
+	 * @param dir: (int) which child of node to search, -1 left, 1 right
+	 * @param nodeVersion: (unsigned long long) the version node had when it was reached
+	 * @param box: (Value*&) set to the key's value if found
+	 * @return attempt: DONE if found, FAILED if absent, RETRY if node changed
+	 */
+	attempt attempt_get (const Key &key, TreeNode *node, int dir, unsigned long long nodeVersion, Value *&box) const;
+
+	/**
+	 * @brief One optimistic insert or delete below node, whose version must still be
+	 * nodeVersion. box is the value to insert, or nullptr to delete.
+	 *
+	 * @return attempt: DONE if the tree changed, FAILED if not, RETRY if node changed
+	 */
+	attempt attempt_update (const Key &key, Value *box, TreeNode *parent, TreeNode *node, unsigned long long nodeVersion, session &s);
+
+	/**
+	 * @brief Inserts or deletes at the node that holds the key.
+	 *
+	 * @return attempt: DONE if the tree changed, FAILED if not, RETRY if node changed
+	 */
+	attempt attempt_node_update (Value *box, TreeNode *parent, TreeNode *node, session &s);
+
+	/**
+	 * @brief Unlinks a node with at most one child. Both nodes must be locked.
+	 *
+	 * @return bool: false if the node is no longer a child of parent or has two children
+	 */
+	bool attempt_unlink (TreeNode *parent, TreeNode *node);
+
+	/**
+	 * @brief Works out what a node needs: nothing, a new height, a rotation, or (for a
+	 * routing node with at most one child) unlinking.
+	 *
+	 * @return int: a condition, or the new height
+	 */
+	int node_condition (TreeNode *node);
+
+	/**
+	 * @brief Fixes the height of a locked node.
+	 *
+	 * @return TreeNode*: the next node that may need work, or nullptr
+	 */
+	TreeNode* fix_height (TreeNode *node);
+
+	/**
+	 * @brief Walks up from node, fixing heights, rotating and unlinking routing nodes
+	 * until nothing more is needed.
+	 *
+	 * @return void
+	 */
+	void fix_height_and_rebalance (TreeNode *node, session &s);
+
+	/**
+	 * @brief Rebalances or unlinks a node. The parent and the node must be locked.
+	 *
+	 * @return TreeNode*: the next node that may need work, or nullptr
+	 */
+	TreeNode* rebalance (TreeNode *parent, TreeNode *node, session &s);
+
+	/**
+	 * @brief Fixes a left-heavy or right-heavy node with a single or double rotation,
+	 * locking the children it moves.
+	 *
+	 * @return TreeNode*: the next node that may need work, or nullptr
+	 */
+	TreeNode* rebalance_to_right (TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, session &s);
+	TreeNode* rebalance_to_left (TreeNode *parent, TreeNode *node, TreeNode *nodeRight, int leftHeight, session &s);
+
+	/**
+	 * @brief Rotations. L_rotate pivots on node's left child and R_rotate on its right,
+	 * as in balancedBST; LR_rotate and RL_rotate are the double rotations. The node is
+	 * marked shrinking while its links change, since keys leave its subtree. A double
+	 * rotation that leaves the middle node as a routing node with one child unlinks it
+	 * right away, while it is still locked.
+	 *
+	 * @return TreeNode*: the next node that may need work, or nullptr
+	 */
+	TreeNode* L_rotate (TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, int leftLeftHeight, TreeNode *leftRight, int leftRightHeight);
+	TreeNode* R_rotate (TreeNode *parent, TreeNode *node, int leftHeight, TreeNode *nodeRight, TreeNode *rightLeft, int rightLeftHeight, int rightRightHeight);
+	TreeNode* LR_rotate (TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, int leftLeftHeight, TreeNode *leftRight, int leftRightLeftHeight, session &s);
+	TreeNode* RL_rotate (TreeNode *parent, TreeNode *node, int leftHeight, TreeNode *nodeRight, TreeNode *rightLeft, int rightRightHeight, int rightLeftRightHeight, session &s);
+
+	/**
+	 * @brief Advances the global epoch if every session inside an operation has seen it.
+	 *
+	 * @return unsigned long long: the global epoch afterwards
+	 */
+	unsigned long long try_advance ();
+
+	/**
+	 * @brief Gets the entry of a node, a key for sets and a (key, value) pair for maps.
+	 *
+	 * @return reference: the entry
+	 */
+	typedef typename avl_entry<Key, Value, true>::reference reference;
+	static reference entry (const TreeNode *node, false_type) {return reference(node->data, *node->value.load());};
+	static reference entry (const TreeNode *node, true_type) {return node->data;};
+
+	/**
+	 * @brief Checks one subtree for validate().
+	 *
+	 * @return int: the subtree's height, or -2 if it is broken
+	 */
+	int validate (TreeNode *node, const Key *low, const Key *high) const;
+
+	/* --- End of Helper Functions --- */
+
+public:
+	typedef Key key_type;
+	typedef Value mapped_type;
+
+	/**
+	 * @brief A thread's handle on the tree. It claims one epoch slot for its lifetime,
+	 * so create one per thread and reuse it; it must not outlive the tree and must not be
+	 * shared between threads.
+	 */
+	class session {
+		friend class concurrentBST;
+
+		concurrentBST * tree;
+		size_t slot;
+		vector<Retired> retired;	// this session's unlinked nodes and replaced values
+
+		// marks the slot as inside an operation for the lifetime of the guard
+		struct pin {
+			SessionSlot &s;
+			pin (SessionSlot &ss, const atomic<unsigned long long> &epoch) : s(ss) {s.epoch.store(epoch.load());};
+			~pin () {s.epoch.store(0, memory_order_release);};
+		};
+
+		/**
+		 * @brief Queues a node or a value to be freed once no operation can reach it.
+		 *
+		 * @return void
+		 */
+		void retire (TreeNode *node, Value *box);
+
+		/**
+		 * @brief Frees whatever this session retired at least two epochs ago.
+		 *
+		 * @return void
+		 */
+		void reclaim ();
+
+	public:
+		/**
+		 * @brief Claims a session slot.
+		 * Throws length_error if every slot given to the tree's constructor is in use.
+		 *
+		 * @param t: (concurrentBST&) the tree to use
+		 */
+		explicit session (concurrentBST &t);
+
+		/**
+		 * @brief Releases the slot. Retired items that are not free yet go to the tree.
+		 */
+		~session ();
+
+		session (const session &) = delete;
+		session& operator= (const session &) = delete;
+
+		/**
+		 * @brief Inserts a key if it is absent.
+		 *
+		 * @param key: (Key) the key
+		 * @param value: (Value) the value mapped to it
+		 * @return bool: true if inserted, false if the key was already present
+		 */
+		bool insertNode (const Key &key, const Value &value = Value());
+
+		/**
+		 * @brief Deletes a key.
+		 *
+		 * @param key: (Key) the key
+		 * @return bool: true if deleted, false if the key was missing
+		 */
+		bool deleteNode (const Key &key);
+
+		/**
+		 * @brief Checks if a key is present.
+		 *
+		 * @param key: (Key) the key
+		 * @return bool: true if present
+		 */
+		bool searchItem (const Key &key) {pin guard(tree->slots[slot], tree->globalEpoch); Value *box; return find(key, box);};
+
+		/**
+		 * @brief Copies the value mapped to a key.
+		 *
+		 * @param key: (Key) the key
+		 * @param value: (Value&) receives the value if the key is present
+		 * @return bool: true if present
+		 */
+		bool get (const Key &key, Value &value);
+
+	private:
+		bool find (const Key &key, Value *&box);
+	};
+
+	/**
+	 * @brief Construct a new concurrentBST object.
+	 *
+	 * @param maxSessions: (size_t) how many sessions can exist at once
+	 * @param compare: (Compare) the key ordering
+	 * @param alloc: (Alloc) the allocator, which must be thread-safe
+	 */
+	explicit concurrentBST (size_t maxSessions = 128, const Compare &compare = Compare(), const Alloc &alloc = Alloc());
+
+	/**
+	 * @brief Destroy the concurrentBST object. No session may be alive.
+	 */
+	~concurrentBST ();
+
+	concurrentBST (const concurrentBST &) = delete;
+	concurrentBST& operator= (const concurrentBST &) = delete;
+
+	/**
+	 * @brief Get the number of keys. Exact when no update is running.
+	 *
+	 * @return size_t: the number of keys
+	 */
+	size_t treeNodeCount () const {return (size_t)count.load();};
+
+	/**
+	 * @brief Get the height of the tree, counting edges like balancedBST (empty = -1).
+	 * Routing nodes count too. Only meaningful when no update is running.
+	 *
+	 * @return int: the height
+	 */
+	int height () const {return concurrentBST::height(holder->right.load()) - 1;};
+
+	/**
+	 * @brief Calls fn on every key in order, or on every (key, value) pair for maps.
+	 * Only call it when no update is running.
+	 *
+	 * @param fn: (Fn) the function to call
+	 * @return void
+	 */
+	template <class Fn>
+	void for_each (Fn fn) const;
+
+	/**
+	 * @brief Checks the structure: key order, parent links, cached heights, and the AVL
+	 * balance of every node. Only call it when no update is running; rebalancing is
+	 * complete by then.
+	 *
+	 * @return bool: true if the tree is a valid AVL tree
+	 */
+	bool validate () const {return validate(holder->right.load(), nullptr, nullptr) != -2;};
+};
+
+/**
+ * @brief Shorthands for concurrent maps and sets.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_concurrent_map = concurrentBST<Key, Value, Compare, Alloc>;
+
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_concurrent_set = concurrentBST<Key, avl_no_value, Compare, Alloc>;
+/* --- End of CONCURRENT TREE CLASS --- */
+
+/* --- CONCURRENT TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Construct a new concurrentBST object.
+ *
+ * @param maxSessions The number of session slots.
+ * @param compare The key ordering.
+ * @param alloc The allocator.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+concurrentBST<Key, Value, Compare, Alloc>::concurrentBST(size_t maxSessions, const Compare &compare, const Alloc &alloc)
+	: comp(compare), nodeAlloc(alloc), valueAlloc(alloc), holder(nullptr), count(0), globalEpoch(1),
+	  slots(new SessionSlot[maxSessions]), slotCount(maxSessions) {
+	holder = create_node(Key(), nullptr, nullptr);
+}
+
+/**
+ * @brief Destroy the concurrentBST object, every node and every retired item.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+concurrentBST<Key, Value, Compare, Alloc>::~concurrentBST() {
+	vector<TreeNode*> stack(1, holder);
+	while (!stack.empty()) {
+		TreeNode *node = stack.back();
+		stack.pop_back();
+		if (node->left.load() != nullptr) {
+			stack.push_back(node->left.load());
+		}
+		if (node->right.load() != nullptr) {
+			stack.push_back(node->right.load());
+		}
+		if (node->value.load() != nullptr) {
+			destroy_box(node->value.load());
+		}
+		destroy_node(node);
+	}
+
+	for (size_t i = 0; i < orphans.size(); i++) {
+		if (orphans[i].node != nullptr) {
+			destroy_node(orphans[i].node);
+		}
+		if (orphans[i].box != nullptr) {
+			destroy_box(orphans[i].box);
+		}
+	}
+}
+
+/**
+ * @brief Allocates a node.
+ *
+ * @param key The key.
+ * @param box The value, or nullptr for a routing node.
+ * @param parent The parent.
+ * @return TreeNode* The new node.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::create_node(const Key &key, Value *box, TreeNode *parent) -> TreeNode* {
+	TreeNode *node = NodeAllocTraits::allocate(nodeAlloc, 1);
+	try {
+		NodeAllocTraits::construct(nodeAlloc, node, key, box, parent);
+	}
+	catch (...) {
+		NodeAllocTraits::deallocate(nodeAlloc, node, 1);
+		throw;
+	}
+	return node;
+}
+
+/**
+ * @brief Frees a node.
+ *
+ * @param node The node.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::destroy_node(TreeNode *node) {
+	NodeAllocTraits::destroy(nodeAlloc, node);
+	NodeAllocTraits::deallocate(nodeAlloc, node, 1);
+}
+
+/**
+ * @brief Allocates a value for a map.
+ *
+ * @param value The value.
+ * @return Value* The new value.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+Value* concurrentBST<Key, Value, Compare, Alloc>::create_box(const Value &value, false_type) {
+	Value *box = ValueAllocTraits::allocate(valueAlloc, 1);
+	try {
+		ValueAllocTraits::construct(valueAlloc, box, value);
+	}
+	catch (...) {
+		ValueAllocTraits::deallocate(valueAlloc, box, 1);
+		throw;
+	}
+	return box;
+}
+
+/**
+ * @brief Frees a value of a map.
+ *
+ * @param box The value.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::destroy_box(Value *box, false_type) {
+	ValueAllocTraits::destroy(valueAlloc, box);
+	ValueAllocTraits::deallocate(valueAlloc, box, 1);
+}
+
+/**
+ * @brief Waits until a rotation that is shrinking a node has finished.
+ *
+ * @param node The node.
+ * @param version The version that showed it shrinking.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::wait_until_not_changing(TreeNode *node, unsigned long long version) {
+	while ((version & SHRINKING) && node->version.load() == version) {
+		this_thread::yield();
+	}
+}
+
+/**
+ * @brief One optimistic lookup below a node.
+ *
+ * Hand-over-hand validation: after reading a child link, the parent's version is checked again.
+ * If it changed, a rotation may have moved the key out of the subtree being entered, so the
+ * caller retries from the grandparent. A child that is shrinking is waited for, and an unlinked
+ * child is skipped by rereading the link.
+ *
+ * @param key The key.
+ * @param node The node to search below.
+ * @param dir Which child to search.
+ * @param nodeVersion The version node had when it was reached.
+ * @param box Set to the value if the key is found.
+ * @return attempt DONE, FAILED or RETRY.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::attempt_get(const Key &key, TreeNode *node, int dir, unsigned long long nodeVersion, Value *&box) const -> attempt {
+	while (true) {
+		TreeNode *child = node->child(dir).load();
+		if (node->version.load() != nodeVersion) {
+			return RETRY;
+		}
+		if (child == nullptr) {
+			return FAILED;
+		}
+
+		int nextDir = compare(key, child);
+		if (nextDir == 0) {
+			box = child->value.load();
+			return box != nullptr ? DONE : FAILED;
+		}
+
+		unsigned long long childVersion = child->version.load();
+		if (childVersion & SHRINKING) {
+			wait_until_not_changing(child, childVersion);
+		}
+		else if (!(childVersion & UNLINKED) && child == node->child(dir).load()) {
+			if (node->version.load() != nodeVersion) {
+				return RETRY;
+			}
+			attempt result = attempt_get(key, child, nextDir, childVersion, box);
+			if (result != RETRY) {
+				return result;
+			}
+		}
+	}
+}
+
+/**
+ * @brief One optimistic insert or delete below a node.
+ *
+ * The descent is validated like attempt_get. When the key is absent and an insert reaches an
+ * empty link, that single node is locked, its version and the link are checked again, and the
+ * new leaf is attached.
+ *
+ * @param key The key.
+ * @param box The value to insert, or nullptr to delete.
+ * @param parent The parent of node.
+ * @param node The node reached so far.
+ * @param nodeVersion The version node had when it was reached.
+ * @param s The calling session.
+ * @return attempt DONE, FAILED or RETRY.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::attempt_update(const Key &key, Value *box, TreeNode *parent, TreeNode *node, unsigned long long nodeVersion, session &s) -> attempt {
+	int dir = compare(key, node);
+	if (dir == 0) {
+		return attempt_node_update(box, parent, node, s);
+	}
+
+	while (true) {
+		TreeNode *child = node->child(dir).load();
+		if (node->version.load() != nodeVersion) {
+			return RETRY;
+		}
+
+		// The key is absent: deleting fails, inserting attaches a leaf here.
+		if (child == nullptr) {
+			if (box == nullptr) {
+				return FAILED;
+			}
+
+			TreeNode *damaged = nullptr;
+			bool attached = false;
+			{
+				node_lock guard(node);
+				if (node->version.load() != nodeVersion) {
+					return RETRY;
+				}
+				if (node->child(dir).load() == nullptr) {
+					node->child(dir).store(create_node(key, box, node));
+					attached = true;
+					damaged = fix_height(node);
+				}
+			}
+			if (attached) {
+				fix_height_and_rebalance(damaged, s);
+				return DONE;
+			}
+			continue;
+		}
+
+		unsigned long long childVersion = child->version.load();
+		if (childVersion & SHRINKING) {
+			wait_until_not_changing(child, childVersion);
+		}
+		else if (!(childVersion & UNLINKED) && child == node->child(dir).load()) {
+			if (node->version.load() != nodeVersion) {
+				return RETRY;
+			}
+			attempt result = attempt_update(key, box, node, child, childVersion, s);
+			if (result != RETRY) {
+				return result;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Inserts or deletes at the node that holds the key.
+ *
+ * An insert revives a routing node by giving it a value. A delete of a node with at most one
+ * child locks the parent and the node and unlinks it; a node with two children just loses its
+ * value and stays as a routing node. The value pointer is the linearization point of both.
+ *
+ * @param box The value to insert, or nullptr to delete.
+ * @param parent The parent of node.
+ * @param node The node that holds the key.
+ * @param s The calling session.
+ * @return attempt DONE, FAILED or RETRY.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::attempt_node_update(Value *box, TreeNode *parent, TreeNode *node, session &s) -> attempt {
+	// Insert into a routing node, or fail if the key is present.
+	if (box != nullptr) {
+		node_lock guard(node);
+		if (node->version.load() & UNLINKED) {
+			return RETRY;
+		}
+		if (node->value.load() != nullptr) {
+			return FAILED;
+		}
+		node->value.store(box);
+		return DONE;
+	}
+
+	if (node->value.load() == nullptr) {
+		return FAILED;
+	}
+
+	// Delete a node with at most one child by unlinking it.
+	if (node->left.load() == nullptr || node->right.load() == nullptr) {
+		TreeNode *damaged;
+		Value *previous;
+		{
+			node_lock parentGuard(parent);
+			if ((parent->version.load() & UNLINKED) || node->parent.load() != parent) {
+				return RETRY;
+			}
+			{
+				node_lock guard(node);
+				previous = node->value.load();
+				if (previous == nullptr) {
+					return FAILED;
+				}
+				if (!attempt_unlink(parent, node)) {
+					return RETRY;
+				}
+			}
+			damaged = fix_height(parent);
+		}
+		fix_height_and_rebalance(damaged, s);
+		s.retire(node, previous);
+		return DONE;
+	}
+
+	// Delete a node with two children by turning it into a routing node.
+	Value *previous;
+	{
+		node_lock guard(node);
+		if (node->version.load() & UNLINKED) {
+			return RETRY;
+		}
+		previous = node->value.load();
+		if (previous == nullptr) {
+			return FAILED;
+		}
+		if (node->left.load() == nullptr || node->right.load() == nullptr) {
+			return RETRY;
+		}
+		node->value.store(nullptr);
+	}
+	s.retire(nullptr, previous);
+	return DONE;
+}
+
+/**
+ * @brief Unlinks a node with at most one child, splicing the child into its place.
+ *
+ * @param parent The locked parent.
+ * @param node The locked node.
+ * @return bool False if the node moved or has two children.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool concurrentBST<Key, Value, Compare, Alloc>::attempt_unlink(TreeNode *parent, TreeNode *node) {
+	TreeNode *parentLeft = parent->left.load();
+	TreeNode *parentRight = parent->right.load();
+	if (parentLeft != node && parentRight != node) {
+		return false;
+	}
+
+	TreeNode *left = node->left.load();
+	TreeNode *right = node->right.load();
+	if (left != nullptr && right != nullptr) {
+		return false;
+	}
+
+	TreeNode *splice = left != nullptr ? left : right;
+	(parentLeft == node ? parent->left : parent->right).store(splice);
+	if (splice != nullptr) {
+		splice->parent.store(parent);
+	}
+	node->version.store(UNLINKED);
+	node->value.store(nullptr);
+	return true;
+}
+
+/**
+ * @brief Works out what a node needs after a change below it.
+ *
+ * @param node The node.
+ * @return int A condition, or the node's new height.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+int concurrentBST<Key, Value, Compare, Alloc>::node_condition(TreeNode *node) {
+	TreeNode *left = node->left.load();
+	TreeNode *right = node->right.load();
+
+	// A routing node with at most one child should go.
+	if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) {
+		return UNLINK_REQUIRED;
+	}
+
+	int leftHeight = height(left);
+	int rightHeight = height(right);
+	int balance = leftHeight - rightHeight;
+	if (balance < -1 || balance > 1) {
+		return REBALANCE_REQUIRED;
+	}
+
+	int newHeight = 1 + max(leftHeight, rightHeight);
+	return newHeight != node->height.load() ? newHeight : NOTHING_REQUIRED;
+}
+
+/**
+ * @brief Fixes the height of a locked node.
+ *
+ * @param node The node.
+ * @return TreeNode* The node if it needs a rotation or unlinking, its parent if its height
+ * changed, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::fix_height(TreeNode *node) -> TreeNode* {
+	int condition = node_condition(node);
+	switch (condition) {
+		case REBALANCE_REQUIRED:
+		case UNLINK_REQUIRED:
+			return node;
+		case NOTHING_REQUIRED:
+			return nullptr;
+		default:
+			node->height.store(condition);
+			return node->parent.load();
+	}
+}
+
+/**
+ * @brief Walks up from a node, fixing heights and rebalancing.
+ *
+ * A height fix needs only the node's lock. A rotation or an unlink locks the parent first and
+ * then the node, always top-down, so the locks cannot deadlock. The walk stops at the sentinel.
+ *
+ * A rotation can hand back a node below the one it fixed, when that node is now unbalanced or a
+ * routing node to unlink. Fixing it may change the height of the rotated subtree, so the parent
+ * the rotation ran under is remembered and the walk resumes there when the lower branch ends.
+ *
+ * @param node The first node that may need work.
+ * @param s The calling session, which retires unlinked routing nodes.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::fix_height_and_rebalance(TreeNode *node, session &s) {
+	vector<TreeNode*> resume;
+
+	while (true) {
+		// This branch of the walk is done; go back to a parent a rotation left behind.
+		if (node == nullptr || node->parent.load() == nullptr || (node->version.load() & UNLINKED)) {
+			if (resume.empty()) {
+				return;
+			}
+			node = resume.back();
+			resume.pop_back();
+			continue;
+		}
+
+		int condition = node_condition(node);
+		if (condition == NOTHING_REQUIRED) {
+			node = nullptr;
+			continue;
+		}
+
+		if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+			node_lock guard(node);
+			node = fix_height(node);
+			continue;
+		}
+
+		TreeNode *parent = node->parent.load();
+		node_lock parentGuard(parent);
+		if (!(parent->version.load() & UNLINKED) && node->parent.load() == parent) {
+			node_lock guard(node);
+			if (resume.empty() || resume.back() != parent) {
+				resume.push_back(parent);
+			}
+			node = rebalance(parent, node, s);
+		}
+	}
+}
+
+/**
+ * @brief Rebalances or unlinks a node.
+ *
+ * @param parent The locked parent.
+ * @param node The locked node.
+ * @param s The calling session.
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::rebalance(TreeNode *parent, TreeNode *node, session &s) -> TreeNode* {
+	TreeNode *left = node->left.load();
+	TreeNode *right = node->right.load();
+
+	// Unlink a routing node with at most one child.
+	if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) {
+		if (attempt_unlink(parent, node)) {
+			s.retire(node, nullptr);
+			return fix_height(parent);
+		}
+		return node;
+	}
+
+	int leftHeight = height(left);
+	int rightHeight = height(right);
+	int newHeight = 1 + max(leftHeight, rightHeight);
+	int balance = leftHeight - rightHeight;
+
+	if (balance > 1) {
+		return rebalance_to_right(parent, node, left, rightHeight, s);
+	}
+	if (balance < -1) {
+		return rebalance_to_left(parent, node, right, leftHeight, s);
+	}
+	if (newHeight != node->height.load()) {
+		node->height.store(newHeight);
+		return fix_height(parent);
+	}
+	return nullptr;
+}
+
+/**
+ * @brief Fixes a left-heavy node.
+ *
+ * The left child is locked and its height checked again. A single rotation is used when the
+ * left-left subtree is at least as tall as the left-right one; otherwise the left-right child is
+ * locked too and a double rotation is used, unless it would leave the left child unbalanced, in
+ * which case the left child is first rotated on its own.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::rebalance_to_right(TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, session &s) -> TreeNode* {
+	node_lock leftGuard(nodeLeft);
+	int leftHeight = nodeLeft->height.load();
+	if (leftHeight - rightHeight <= 1) {
+		return node;
+	}
+
+	TreeNode *leftRight = nodeLeft->right.load();
+	int leftLeftHeight = height(nodeLeft->left.load());
+	int leftRightHeight = height(leftRight);
+	if (leftLeftHeight >= leftRightHeight) {
+		return L_rotate(parent, node, nodeLeft, rightHeight, leftLeftHeight, leftRight, leftRightHeight);
+	}
+
+	{
+		node_lock leftRightGuard(leftRight);
+		leftRightHeight = leftRight->height.load();
+		if (leftLeftHeight >= leftRightHeight) {
+			return L_rotate(parent, node, nodeLeft, rightHeight, leftLeftHeight, leftRight, leftRightHeight);
+		}
+
+		int leftRightLeftHeight = height(leftRight->left.load());
+		int balance = leftLeftHeight - leftRightLeftHeight;
+		if (balance >= -1 && balance <= 1) {
+			return LR_rotate(parent, node, nodeLeft, rightHeight, leftLeftHeight, leftRight, leftRightLeftHeight, s);
+		}
+	}
+	return rebalance_to_left(node, nodeLeft, leftRight, leftLeftHeight, s);
+}
+
+/**
+ * @brief Fixes a right-heavy node; the mirror image of rebalance_to_right.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::rebalance_to_left(TreeNode *parent, TreeNode *node, TreeNode *nodeRight, int leftHeight, session &s) -> TreeNode* {
+	node_lock rightGuard(nodeRight);
+	int rightHeight = nodeRight->height.load();
+	if (leftHeight - rightHeight >= -1) {
+		return node;
+	}
+
+	TreeNode *rightLeft = nodeRight->left.load();
+	int rightLeftHeight = height(rightLeft);
+	int rightRightHeight = height(nodeRight->right.load());
+	if (rightRightHeight >= rightLeftHeight) {
+		return R_rotate(parent, node, leftHeight, nodeRight, rightLeft, rightLeftHeight, rightRightHeight);
+	}
+
+	{
+		node_lock rightLeftGuard(rightLeft);
+		rightLeftHeight = rightLeft->height.load();
+		if (rightRightHeight >= rightLeftHeight) {
+			return R_rotate(parent, node, leftHeight, nodeRight, rightLeft, rightLeftHeight, rightRightHeight);
+		}
+
+		int rightLeftRightHeight = height(rightLeft->right.load());
+		int balance = rightRightHeight - rightLeftRightHeight;
+		if (balance >= -1 && balance <= 1) {
+			return RL_rotate(parent, node, leftHeight, nodeRight, rightLeft, rightRightHeight, rightLeftRightHeight, s);
+		}
+	}
+	return rebalance_to_right(node, nodeRight, rightLeft, rightRightHeight, s);
+}
+
+/**
+ * @brief Rotates a node with its left child. Locks: parent, node, nodeLeft.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::L_rotate(TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, int leftLeftHeight, TreeNode *leftRight, int leftRightHeight) -> TreeNode* {
+	unsigned long long nodeVersion = node->version.load();
+	TreeNode *parentLeft = parent->left.load();
+
+	node->version.store(nodeVersion | SHRINKING);
+	node->left.store(leftRight);
+	if (leftRight != nullptr) {
+		leftRight->parent.store(node);
+	}
+	nodeLeft->right.store(node);
+	node->parent.store(nodeLeft);
+	(parentLeft == node ? parent->left : parent->right).store(nodeLeft);
+	nodeLeft->parent.store(parent);
+
+	int newHeight = 1 + max(leftRightHeight, rightHeight);
+	node->height.store(newHeight);
+	nodeLeft->height.store(1 + max(leftLeftHeight, newHeight));
+	node->version.store(nodeVersion + VERSION_STEP);
+
+	// Report whichever node still needs work.
+	int balance = leftRightHeight - rightHeight;
+	if (balance < -1 || balance > 1) {
+		return node;
+	}
+	if ((leftRight == nullptr || rightHeight == 0) && node->value.load() == nullptr) {
+		return node;
+	}
+	balance = leftLeftHeight - newHeight;
+	if (balance < -1 || balance > 1) {
+		return nodeLeft;
+	}
+	if (leftLeftHeight == 0 && nodeLeft->value.load() == nullptr) {
+		return nodeLeft;
+	}
+	return fix_height(parent);
+}
+
+/**
+ * @brief Rotates a node with its right child. Locks: parent, node, nodeRight.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::R_rotate(TreeNode *parent, TreeNode *node, int leftHeight, TreeNode *nodeRight, TreeNode *rightLeft, int rightLeftHeight, int rightRightHeight) -> TreeNode* {
+	unsigned long long nodeVersion = node->version.load();
+	TreeNode *parentLeft = parent->left.load();
+
+	node->version.store(nodeVersion | SHRINKING);
+	node->right.store(rightLeft);
+	if (rightLeft != nullptr) {
+		rightLeft->parent.store(node);
+	}
+	nodeRight->left.store(node);
+	node->parent.store(nodeRight);
+	(parentLeft == node ? parent->left : parent->right).store(nodeRight);
+	nodeRight->parent.store(parent);
+
+	int newHeight = 1 + max(leftHeight, rightLeftHeight);
+	node->height.store(newHeight);
+	nodeRight->height.store(1 + max(newHeight, rightRightHeight));
+	node->version.store(nodeVersion + VERSION_STEP);
+
+	// Report whichever node still needs work.
+	int balance = rightLeftHeight - leftHeight;
+	if (balance < -1 || balance > 1) {
+		return node;
+	}
+	if ((rightLeft == nullptr || leftHeight == 0) && node->value.load() == nullptr) {
+		return node;
+	}
+	balance = rightRightHeight - newHeight;
+	if (balance < -1 || balance > 1) {
+		return nodeRight;
+	}
+	if (rightRightHeight == 0 && nodeRight->value.load() == nullptr) {
+		return nodeRight;
+	}
+	return fix_height(parent);
+}
+
+/**
+ * @brief Rotates the left-right grandchild of a node up to its place. Locks: parent, node,
+ * nodeLeft, leftRight. Both node and nodeLeft lose keys, so both are marked shrinking.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::LR_rotate(TreeNode *parent, TreeNode *node, TreeNode *nodeLeft, int rightHeight, int leftLeftHeight, TreeNode *leftRight, int leftRightLeftHeight, session &s) -> TreeNode* {
+	unsigned long long nodeVersion = node->version.load();
+	unsigned long long leftVersion = nodeLeft->version.load();
+	TreeNode *parentLeft = parent->left.load();
+	TreeNode *leftRightLeft = leftRight->left.load();
+	TreeNode *leftRightRight = leftRight->right.load();
+	int leftRightRightHeight = height(leftRightRight);
+
+	node->version.store(nodeVersion | SHRINKING);
+	nodeLeft->version.store(leftVersion | SHRINKING);
+
+	node->left.store(leftRightRight);
+	if (leftRightRight != nullptr) {
+		leftRightRight->parent.store(node);
+	}
+	nodeLeft->right.store(leftRightLeft);
+	if (leftRightLeft != nullptr) {
+		leftRightLeft->parent.store(nodeLeft);
+	}
+	leftRight->left.store(nodeLeft);
+	nodeLeft->parent.store(leftRight);
+	leftRight->right.store(node);
+	node->parent.store(leftRight);
+	(parentLeft == node ? parent->left : parent->right).store(leftRight);
+	leftRight->parent.store(parent);
+
+	int newHeight = 1 + max(leftRightRightHeight, rightHeight);
+	node->height.store(newHeight);
+	int newLeftHeight = 1 + max(leftLeftHeight, leftRightLeftHeight);
+	nodeLeft->height.store(newLeftHeight);
+	leftRight->height.store(1 + max(newLeftHeight, newHeight));
+
+	node->version.store(nodeVersion + VERSION_STEP);
+	nodeLeft->version.store(leftVersion + VERSION_STEP);
+
+	// A routing nodeLeft may have lost a child; its new parent is locked, so unlink it now.
+	if (nodeLeft->value.load() == nullptr && (nodeLeft->left.load() == nullptr || nodeLeft->right.load() == nullptr)) {
+		attempt_unlink(leftRight, nodeLeft);
+		s.retire(nodeLeft, nullptr);
+		newLeftHeight = height(leftRight->left.load());
+		leftRight->height.store(1 + max(newLeftHeight, newHeight));
+	}
+
+	// Report whichever node still needs work.
+	int balance = leftRightRightHeight - rightHeight;
+	if (balance < -1 || balance > 1) {
+		return node;
+	}
+	if ((leftRightRight == nullptr || rightHeight == 0) && node->value.load() == nullptr) {
+		return node;
+	}
+	balance = newLeftHeight - newHeight;
+	if (balance < -1 || balance > 1) {
+		return leftRight;
+	}
+	return fix_height(parent);
+}
+
+/**
+ * @brief Rotates the right-left grandchild of a node up to its place; the mirror image of
+ * LR_rotate.
+ *
+ * @return TreeNode* The next node that may need work, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto concurrentBST<Key, Value, Compare, Alloc>::RL_rotate(TreeNode *parent, TreeNode *node, int leftHeight, TreeNode *nodeRight, TreeNode *rightLeft, int rightRightHeight, int rightLeftRightHeight, session &s) -> TreeNode* {
+	unsigned long long nodeVersion = node->version.load();
+	unsigned long long rightVersion = nodeRight->version.load();
+	TreeNode *parentLeft = parent->left.load();
+	TreeNode *rightLeftLeft = rightLeft->left.load();
+	TreeNode *rightLeftRight = rightLeft->right.load();
+	int rightLeftLeftHeight = height(rightLeftLeft);
+
+	node->version.store(nodeVersion | SHRINKING);
+	nodeRight->version.store(rightVersion | SHRINKING);
+
+	node->right.store(rightLeftLeft);
+	if (rightLeftLeft != nullptr) {
+		rightLeftLeft->parent.store(node);
+	}
+	nodeRight->left.store(rightLeftRight);
+	if (rightLeftRight != nullptr) {
+		rightLeftRight->parent.store(nodeRight);
+	}
+	rightLeft->right.store(nodeRight);
+	nodeRight->parent.store(rightLeft);
+	rightLeft->left.store(node);
+	node->parent.store(rightLeft);
+	(parentLeft == node ? parent->left : parent->right).store(rightLeft);
+	rightLeft->parent.store(parent);
+
+	int newHeight = 1 + max(leftHeight, rightLeftLeftHeight);
+	node->height.store(newHeight);
+	int newRightHeight = 1 + max(rightLeftRightHeight, rightRightHeight);
+	nodeRight->height.store(newRightHeight);
+	rightLeft->height.store(1 + max(newHeight, newRightHeight));
+
+	node->version.store(nodeVersion + VERSION_STEP);
+	nodeRight->version.store(rightVersion + VERSION_STEP);
+
+	// A routing nodeRight may have lost a child; its new parent is locked, so unlink it now.
+	if (nodeRight->value.load() == nullptr && (nodeRight->left.load() == nullptr || nodeRight->right.load() == nullptr)) {
+		attempt_unlink(rightLeft, nodeRight);
+		s.retire(nodeRight, nullptr);
+		newRightHeight = height(rightLeft->right.load());
+		rightLeft->height.store(1 + max(newHeight, newRightHeight));
+	}
+
+	// Report whichever node still needs work.
+	int balance = rightLeftLeftHeight - leftHeight;
+	if (balance < -1 || balance > 1) {
+		return node;
+	}
+	if ((rightLeftLeft == nullptr || leftHeight == 0) && node->value.load() == nullptr) {
+		return node;
+	}
+	balance = newRightHeight - newHeight;
+	if (balance < -1 || balance > 1) {
+		return rightLeft;
+	}
+	return fix_height(parent);
+}
+
+/**
+ * @brief Advances the global epoch if every session inside an operation has seen it.
+ *
+ * @return unsigned long long The global epoch afterwards.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+unsigned long long concurrentBST<Key, Value, Compare, Alloc>::try_advance() {
+	unsigned long long epoch = globalEpoch.load();
+	for (size_t i = 0; i < slotCount; i++) {
+		unsigned long long seen = slots[i].epoch.load();
+		if (seen != 0 && seen != epoch) {
+			return epoch;
+		}
+	}
+
+	// Another session may have advanced it already; either way it has moved on.
+	globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+	return globalEpoch.load();
+}
+
+/**
+ * @brief Checks one subtree: keys strictly between low and high, parent links, cached heights
+ * and balance. Routing nodes are allowed only with two children.
+ *
+ * @param node The root of the subtree.
+ * @param low The exclusive lower bound, or nullptr.
+ * @param high The exclusive upper bound, or nullptr.
+ * @return int The height of the subtree, or -2 if it is broken.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+int concurrentBST<Key, Value, Compare, Alloc>::validate(TreeNode *node, const Key *low, const Key *high) const {
+	if (node == nullptr) {
+		return 0;
+	}
+	if ((low != nullptr && !comp(*low, node->data)) || (high != nullptr && !comp(node->data, *high))) {
+		return -2;
+	}
+
+	TreeNode *left = node->left.load();
+	TreeNode *right = node->right.load();
+	if ((left != nullptr && left->parent.load() != node) || (right != nullptr && right->parent.load() != node)) {
+		return -2;
+	}
+	if (node->value.load() == nullptr && (left == nullptr || right == nullptr)) {
+		return -2;
+	}
+
+	int leftHeight = validate(left, low, &node->data);
+	int rightHeight = validate(right, &node->data, high);
+	if (leftHeight == -2 || rightHeight == -2 || leftHeight - rightHeight > 1 || rightHeight - leftHeight > 1) {
+		return -2;
+	}
+	int nodeHeight = 1 + max(leftHeight, rightHeight);
+	return nodeHeight == node->height.load() ? nodeHeight : -2;
+}
+
+/**
+ * @brief Calls fn on every entry in order, skipping routing nodes.
+ *
+ * @param fn The function to call.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+template <class Fn>
+void concurrentBST<Key, Value, Compare, Alloc>::for_each(Fn fn) const {
+	vector<TreeNode*> path;
+	TreeNode *node = holder->right.load();
+
+	while (node != nullptr || !path.empty()) {
+		while (node != nullptr) {
+			path.push_back(node);
+			node = node->left.load();
+		}
+
+		node = path.back();
+		path.pop_back();
+		if (node->value.load() != nullptr) {
+			fn(entry(node, is_set()));
+		}
+		node = node->right.load();
+	}
+}
+
+/**
+ * @brief Claims the first free session slot.
+ *
+ * @param t The tree to use.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+concurrentBST<Key, Value, Compare, Alloc>::session::session(concurrentBST &t) : tree(&t), slot(0) {
+	for (; slot < tree->slotCount; slot++) {
+		bool expected = false;
+		if (!tree->slots[slot].claimed.load() && tree->slots[slot].claimed.compare_exchange_strong(expected, true)) {
+			return;
+		}
+	}
+	throw length_error("concurrentBST: more sessions than maxSessions");
+}
+
+/**
+ * @brief Frees what it can and hands the rest of its retired items to the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+concurrentBST<Key, Value, Compare, Alloc>::session::~session() {
+	reclaim();
+	if (!retired.empty()) {
+		lock_guard<mutex> guard(tree->orphanLock);
+		tree->orphans.insert(tree->orphans.end(), retired.begin(), retired.end());
+	}
+	tree->slots[slot].claimed.store(false, memory_order_release);
+}
+
+/**
+ * @brief Queues a node or a value to be freed once no operation can reach it.
+ *
+ * The epoch is read after the item was unlinked, so any operation that can still reach it
+ * announced that epoch or an older one.
+ *
+ * @param node The unlinked node, or nullptr.
+ * @param box The replaced value, or nullptr.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::session::retire(TreeNode *node, Value *box) {
+	Retired entry = {tree->globalEpoch.load(), node, box};
+	retired.push_back(entry);
+	if (retired.size() % RECLAIM_BATCH == 0) {
+		reclaim();
+	}
+}
+
+/**
+ * @brief Frees whatever this session retired at least two epochs ago.
+ *
+ * The epoch only advances once every session inside an operation has seen the current one, so
+ * two advances after an item was retired, every operation that could reach it has finished.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void concurrentBST<Key, Value, Compare, Alloc>::session::reclaim() {
+	unsigned long long epoch = tree->try_advance();
+
+	size_t kept = 0;
+	for (size_t i = 0; i < retired.size(); i++) {
+		if (retired[i].epoch + 2 > epoch) {
+			retired[kept++] = retired[i];
+			continue;
+		}
+		if (retired[i].node != nullptr) {
+			tree->destroy_node(retired[i].node);
+		}
+		if (retired[i].box != nullptr) {
+			tree->destroy_box(retired[i].box);
+		}
+	}
+	retired.resize(kept);
+}
+
+/**
+ * @brief Inserts a key if it is absent.
+ *
+ * An empty tree gets its root under the sentinel's lock. Otherwise the insert starts from the
+ * root, validated against the sentinel, and retries from there whenever an attempt has to.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @return bool True if inserted.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool concurrentBST<Key, Value, Compare, Alloc>::session::insertNode(const Key &key, const Value &value) {
+	pin guard(tree->slots[slot], tree->globalEpoch);
+	Value *box = tree->create_box(value);
+	TreeNode *holder = tree->holder;
+
+	while (true) {
+		TreeNode *top = holder->right.load();
+
+		// Empty tree: the key becomes the root.
+		if (top == nullptr) {
+			node_lock holderGuard(holder);
+			if (holder->right.load() == nullptr) {
+				holder->right.store(tree->create_node(key, box, holder));
+				holder->height.store(2);
+				tree->count++;
+				return true;
+			}
+			continue;
+		}
+
+		unsigned long long topVersion = top->version.load();
+		if (topVersion & (SHRINKING | UNLINKED)) {
+			wait_until_not_changing(top, topVersion);
+		}
+		else if (top == holder->right.load()) {
+			attempt result = tree->attempt_update(key, box, holder, top, topVersion, *this);
+			if (result == DONE) {
+				tree->count++;
+				return true;
+			}
+			if (result == FAILED) {
+				tree->destroy_box(box);
+				return false;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Deletes a key.
+ *
+ * @param key The key.
+ * @return bool True if deleted.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool concurrentBST<Key, Value, Compare, Alloc>::session::deleteNode(const Key &key) {
+	pin guard(tree->slots[slot], tree->globalEpoch);
+	TreeNode *holder = tree->holder;
+
+	while (true) {
+		TreeNode *top = holder->right.load();
+		if (top == nullptr) {
+			return false;
+		}
+
+		unsigned long long topVersion = top->version.load();
+		if (topVersion & (SHRINKING | UNLINKED)) {
+			wait_until_not_changing(top, topVersion);
+		}
+		else if (top == holder->right.load()) {
+			attempt result = tree->attempt_update(key, nullptr, holder, top, topVersion, *this);
+			if (result == DONE) {
+				tree->count--;
+				return true;
+			}
+			if (result == FAILED) {
+				return false;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Finds the value of a key.
+ *
+ * @param key The key.
+ * @param box Set to the value if the key is present.
+ * @return bool True if present.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool concurrentBST<Key, Value, Compare, Alloc>::session::find(const Key &key, Value *&box) {
+	while (true) {
+		attempt result = tree->attempt_get(key, tree->holder, 1, 0, box);
+		if (result != RETRY) {
+			return result == DONE;
+		}
+	}
+}
+
+/**
+ * @brief Copies the value mapped to a key.
+ *
+ * @param key The key.
+ * @param value Receives the value if the key is present.
+ * @return bool True if present.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool concurrentBST<Key, Value, Compare, Alloc>::session::get(const Key &key, Value &value) {
+	pin guard(tree->slots[slot], tree->globalEpoch);
+	Value *box;
+	if (!find(key, box)) {
+		return false;
+	}
+	value = *box;
+	return true;
+}
+
+/* --- End of CONCURRENT TREE IMPLEMENTATION --- */
+
+#endif // AVLCONCURRENT_H
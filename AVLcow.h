@@ -0,0 +1,908 @@
+/**
+ * @file AVLcow.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains cowBST, a copy-on-write AVL tree for many readers and one writer.
+ * An update never changes a node that readers can see. It copies the nodes on the
+ * root-to-leaf path it touches, rebalances the copies, and publishes the new root with
+ * one atomic store. Readers load the root once and traverse an unchanging version
+ * without taking any lock. Replaced nodes are freed by epoch-based reclamation once no
+ * reader can still reach them:
+ *
+ *     cowBST<uint64_t, uint64_t> prices;
+ *     prices.insertNode(7, 100);                      // writer thread
+ *
+ *     cowBST<uint64_t, uint64_t>::reader r(prices);   // once per reader thread
+ *     uint64_t price;
+ *     bool found = r.get(7, price);
+ *
+ *     cowBST<uint64_t, uint64_t>::snapshot_view frozen = prices.snapshot();   // O(log s)
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLCOW_H
+#define AVLCOW_H
+
+/* --- IMPORTS --- */
+#include <atomic>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- COPY-ON-WRITE TREE CLASS --- */
+/**
+ * @brief This class is an AVL tree whose published nodes are never modified.
+ * Writers are serialized by a mutex and copy every node they would change. Readers
+ * register once through a reader object, which owns one slot of the epoch table, and
+ * then read with no locks and no writes to shared memory other than their own slot.
+ *
+ * Reclamation: every replaced node is retired with the global epoch at the time. The
+ * writer advances the epoch only when every reader inside a read has seen the current
+ * one, and frees nodes retired two epochs ago, which no reader can still reach.
+ * A snapshot is a read that lasts as long as its handle: it holds the epoch back, so
+ * it keeps exactly the nodes replaced since it was taken, and nothing else.
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key> >
+class cowBST {
+
+private:
+	// a tree node; immutable once published
+	struct TreeNode : avl_value<Value> {
+		Key data;					// key
+		TreeNode * left;			// link to left subtree
+		TreeNode * right;			// link to right subtree
+		int height;					// cached height (leaf = 0)
+		size_t size;				// cached number of nodes in the subtree
+		unsigned long long birth;	// the update that created this node
+
+		TreeNode (const Key &key, const Value &value, unsigned long long version)
+			: avl_value<Value>(value), data(key), left(nullptr), right(nullptr), height(0), size(1), birth(version) {};
+	};
+
+	// one reader's announced epoch, padded to its own cache line
+	struct ReaderSlot {
+		atomic<unsigned long long> epoch;	// epoch seen when the read began, 0 outside a read
+		atomic<bool> claimed;				// owned by a reader object
+		char pad[64 - sizeof(atomic<unsigned long long>) - sizeof(atomic<bool>)];
+
+		ReaderSlot () : epoch(0), claimed(false) {};
+	};
+
+	// a replaced node and the epoch it was retired in
+	struct Retired {
+		unsigned long long epoch;
+		TreeNode * node;
+	};
+
+	// allocator rebound to the node type
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<TreeNode> NodeAlloc;
+	typedef allocator_traits<NodeAlloc> NodeAllocTraits;
+
+	// retired nodes are only checked for reclamation once this many have piled up
+	static const size_t RECLAIM_BATCH = 64;
+
+	atomic<TreeNode*> root;					// the published version
+	Compare comp;							// key ordering
+	NodeAlloc nodeAlloc;					// node allocator
+	mutex writeLock;						// serializes writers
+	unsigned long long version;				// number of updates so far, stamps new nodes
+	size_t count;							// number of keys in the published version
+	atomic<unsigned long long> globalEpoch;	// starts at 1; 0 marks an idle reader slot
+	unique_ptr<ReaderSlot[]> slots;			// one per reader object
+	size_t slotCount;						// length of slots
+	deque<Retired> retired;					// replaced nodes, oldest first
+	multiset<unsigned long long> snapshots;	// the epoch each live snapshot was taken in
+
+	/* --- Helper Functions --- */
+
+	static int height (const TreeNode *node) {return node == nullptr ? -1 : node->height;};
+	static size_t size (const TreeNode *node) {return node == nullptr ? 0 : node->size;};
+
+	/**
+	 * @brief Recomputes the cached height and size of a node from its children.
+	 *
+	 * @param node: (TreeNode*) a node of the current update
+	 * @return void
+	 */
+	static void update_node (TreeNode *node);
+
+	/**
+	 * @brief Finds the node that holds a key.
+	 *
+	 * @param node: (TreeNode*) the root of the version to search
+	 * @param key: (Key) the key to find
+	 * @return TreeNode*: the node, or nullptr
+	 */
+	const TreeNode* search (const TreeNode *node, const Key &key) const;
+
+	TreeNode* create_node (const Key &key, const Value &value);
+	void destroy_node (TreeNode *node);
+	void destroy_tree (TreeNode *node);
+
+	/**
+	 * @brief Gets a node that the current update may change: the node itself if this
+	 * update created it, otherwise a copy, in which case the original is retired.
+	 *
+	 * @param node: (TreeNode*) the node
+	 * @return TreeNode*: a node of the current update with the same contents
+	 */
+	TreeNode* writable (TreeNode *node);
+
+	/**
+	 * @brief Drops a node that is no longer part of the new version. Nodes of the
+	 * current update were never seen by readers and are freed at once; older ones are
+	 * retired.
+	 *
+	 * @param node: (TreeNode*) the node
+	 * @return void
+	 */
+	void discard (TreeNode *node);
+
+	/**
+	 * @brief Rotations and rebalancing, on nodes of the current update only.
+	 * R_rotate pivots on the right child and L_rotate on the left, as in balancedBST.
+	 * balanceTree first makes writable whichever children the rotation will change.
+	 *
+	 * @param node: (TreeNode*) a node of the current update
+	 * @return TreeNode*: the root of the rebalanced subtree
+	 */
+	TreeNode* R_rotate (TreeNode *node);
+	TreeNode* L_rotate (TreeNode *node);
+	TreeNode* balanceTree (TreeNode *node);
+
+	/**
+	 * @brief Path-copying insert and delete. The key must be absent (insert) or
+	 * present (delete); the public functions check first so that a no-op update
+	 * copies nothing.
+	 *
+	 * @return TreeNode*: the root of the new version of the subtree
+	 */
+	TreeNode* insertNode (const Key &key, const Value &value, TreeNode *node);
+	TreeNode* deleteNode (const Key &key, TreeNode *node);
+	TreeNode* removeMin (TreeNode *node, TreeNode *&removed);
+
+	/**
+	 * @brief Publishes a new root and tries to reclaim retired nodes.
+	 *
+	 * @param newRoot: (TreeNode*) the root of the new version
+	 * @return void
+	 */
+	void publish (TreeNode *newRoot);
+
+	/**
+	 * @brief Advances the global epoch if every reader inside a read has seen it, then
+	 * frees the nodes retired at least two epochs ago.
+	 *
+	 * @return void
+	 */
+	void reclaim ();
+
+	/* --- End of Helper Functions --- */
+
+public:
+	typedef Key key_type;
+	typedef Value mapped_type;
+
+	/**
+	 * @brief A consistent, read-only version of the tree, valid only inside reader::read.
+	 */
+	class view {
+		friend class cowBST;
+
+		const cowBST * tree;
+		const TreeNode * top;
+
+	protected:
+		view (const cowBST *t, const TreeNode *r) : tree(t), top(r) {};
+
+	public:
+		/**
+		 * @brief Checks if a key is in this version.
+		 *
+		 * @param key: (Key) the key to look for
+		 * @return bool: true if it is
+		 */
+		bool contains (const Key &key) const {return tree->search(top, key) != nullptr;};
+
+		/**
+		 * @brief Gets the value mapped to a key in this version.
+		 *
+		 * @param key: (Key) the key to look for
+		 * @return const Value*: the value, or nullptr if the key is missing
+		 */
+		const Value* find (const Key &key) const
+			{const TreeNode *node = tree->search(top, key); return node == nullptr ? nullptr : &node->value;};
+
+		/**
+		 * @brief Get the number of keys in this version.
+		 *
+		 * @return size_t: the number of keys
+		 */
+		size_t size () const {return cowBST::size(top);};
+
+		/**
+		 * @brief Calls fn on every key in order, or on every (key, value) pair for maps.
+		 *
+		 * @param fn: (Fn) the function to call
+		 * @return void
+		 */
+		template <class Fn>
+		void for_each (Fn fn) const;
+	};
+
+	/**
+	 * @brief A version of the tree frozen by snapshot(). It stays readable, from any thread,
+	 * while writers go on; later updates copy the paths they change instead of touching its
+	 * nodes. It must be destroyed before the tree.
+	 */
+	class snapshot_view : public view {
+		friend class cowBST;
+
+		cowBST * owner;										// nullptr once moved from
+		typename multiset<unsigned long long>::iterator pin;	// this snapshot's epoch
+
+		snapshot_view (cowBST *t, const TreeNode *r, typename multiset<unsigned long long>::iterator p)
+			: view(t, r), owner(t), pin(p) {};
+
+	public:
+		snapshot_view (snapshot_view &&other) : view(other), owner(other.owner), pin(other.pin) {other.owner = nullptr;};
+
+		/**
+		 * @brief Releases the version, letting the nodes replaced since it was taken be freed.
+		 */
+		~snapshot_view () {if (owner != nullptr) {lock_guard<mutex> guard(owner->writeLock); owner->snapshots.erase(pin);}};
+
+		snapshot_view (const snapshot_view &) = delete;
+		snapshot_view& operator= (const snapshot_view &) = delete;
+	};
+
+	/**
+	 * @brief A reader thread's handle on the tree. It claims one epoch slot for its
+	 * lifetime, so create one per thread and reuse it; it must not outlive the tree and
+	 * must not be shared between threads.
+	 */
+	class reader {
+		cowBST * tree;
+		size_t slot;
+
+		// marks the slot as inside a read for the lifetime of the guard
+		struct pin {
+			ReaderSlot &s;
+			pin (ReaderSlot &rs, const atomic<unsigned long long> &epoch) : s(rs) {s.epoch.store(epoch.load());};
+			~pin () {s.epoch.store(0, memory_order_release);};
+		};
+
+	public:
+		/**
+		 * @brief Claims a reader slot.
+		 * Throws length_error if every slot given to the tree's constructor is in use.
+		 *
+		 * @param t: (cowBST&) the tree to read
+		 */
+		explicit reader (cowBST &t);
+
+		/**
+		 * @brief Releases the reader slot.
+		 */
+		~reader () {tree->slots[slot].claimed.store(false, memory_order_release);};
+
+		reader (const reader &) = delete;
+		reader& operator= (const reader &) = delete;
+
+		/**
+		 * @brief Runs fn on the current version of the tree. Every node fn can reach stays
+		 * allocated until fn returns, however many updates happen meanwhile.
+		 *
+		 * @param fn: (Fn) called with a const view&
+		 * @return whatever fn returns
+		 */
+		template <class Fn>
+		auto read (Fn fn) -> decltype(fn(declval<const view&>())) {
+			pin guard(tree->slots[slot], tree->globalEpoch);
+			view current(tree, tree->root.load());
+			return fn(current);
+		};
+
+		/**
+		 * @brief Checks if a key is in the current version.
+		 *
+		 * @param key: (Key) the key to look for
+		 * @return bool: true if it is
+		 */
+		bool contains (const Key &key) {return read([&key](const view &v) {return v.contains(key);});};
+
+		/**
+		 * @brief Copies the value mapped to a key in the current version.
+		 *
+		 * @param key: (Key) the key to look for
+		 * @param value: (Value&) receives the value if the key is present
+		 * @return bool: true if the key is present
+		 */
+		bool get (const Key &key, Value &value);
+	};
+
+	/**
+	 * @brief Construct a new cowBST object.
+	 *
+	 * @param maxReaders: (size_t) how many reader objects can exist at once
+	 * @param compare: (Compare) the key ordering
+	 * @param alloc: (Alloc) the allocator for nodes
+	 */
+	explicit cowBST (size_t maxReaders = 128, const Compare &compare = Compare(), const Alloc &alloc = Alloc());
+
+	/**
+	 * @brief Destroy the cowBST object. No reader or snapshot may be alive.
+	 */
+	~cowBST ();
+
+	cowBST (const cowBST &) = delete;
+	cowBST& operator= (const cowBST &) = delete;
+
+	/**
+	 * @brief Inserts a key, copying only the path to its position, and publishes the
+	 * new version. Safe to call from several threads; updates run one at a time.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 * @return bool: true if inserted, false if the key was already present
+	 */
+	bool insertNode (const Key &key, const Value &value = Value());
+
+	/**
+	 * @brief Deletes a key, copying only the path to it, and publishes the new version.
+	 *
+	 * @param key: (Key) the key to delete
+	 * @return bool: true if deleted, false if the key was missing
+	 */
+	bool deleteNode (const Key &key);
+
+	/**
+	 * @brief Freezes the latest version in O(log s), for s live snapshots: no node is copied,
+	 * and its epoch goes into the multiset of live snapshots. The snapshot shares
+	 * every node with the live tree; each later update copies only its own path, and those
+	 * replaced nodes are kept until the snapshot is destroyed.
+	 *
+	 * @return snapshot_view: the frozen version
+	 */
+	snapshot_view snapshot ()
+		{lock_guard<mutex> guard(writeLock); return snapshot_view(this, root.load(memory_order_relaxed), snapshots.insert(globalEpoch.load()));};
+
+	/**
+	 * @brief Removes every key. The old nodes are retired, not freed, since readers may
+	 * still be inside them.
+	 *
+	 * @return void
+	 */
+	void clear ();
+
+	/**
+	 * @brief Get the number of keys in the latest version.
+	 *
+	 * @return size_t: the number of keys
+	 */
+	size_t treeNodeCount () {lock_guard<mutex> guard(writeLock); return count;};
+
+	/**
+	 * @brief Get the number of replaced nodes that are still waiting to be freed.
+	 *
+	 * @return size_t: the number of retired nodes
+	 */
+	size_t pending_reclaim () {lock_guard<mutex> guard(writeLock); return retired.size();};
+};
+
+/**
+ * @brief Shorthands for copy-on-write maps and sets.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_cow_map = cowBST<Key, Value, Compare, Alloc>;
+
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_cow_set = cowBST<Key, avl_no_value, Compare, Alloc>;
+/* --- End of COPY-ON-WRITE TREE CLASS --- */
+
+/* --- COPY-ON-WRITE TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Construct a new cowBST object.
+ *
+ * @param maxReaders The number of reader slots.
+ * @param compare The key ordering.
+ * @param alloc The allocator for nodes.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+cowBST<Key, Value, Compare, Alloc>::cowBST(size_t maxReaders, const Compare &compare, const Alloc &alloc)
+	: root(nullptr), comp(compare), nodeAlloc(alloc), version(1), count(0), globalEpoch(1),
+	  slots(new ReaderSlot[maxReaders]), slotCount(maxReaders) {}
+
+/**
+ * @brief Destroy the cowBST object and every node, live or retired.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+cowBST<Key, Value, Compare, Alloc>::~cowBST() {
+	destroy_tree(root.load());
+	for (size_t i = 0; i < retired.size(); i++) {
+		destroy_node(retired[i].node);
+	}
+}
+
+/**
+ * @brief Claims the first free reader slot.
+ *
+ * @param t The tree to read.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+cowBST<Key, Value, Compare, Alloc>::reader::reader(cowBST &t) : tree(&t), slot(0) {
+	for (; slot < tree->slotCount; slot++) {
+		bool expected = false;
+		if (!tree->slots[slot].claimed.load() && tree->slots[slot].claimed.compare_exchange_strong(expected, true)) {
+			return;
+		}
+	}
+	throw length_error("cowBST: more readers than maxReaders");
+}
+
+/**
+ * @brief Copies the value mapped to a key in the current version.
+ *
+ * @param key The key to look for.
+ * @param value Receives the value if the key is present.
+ * @return bool True if the key is present.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool cowBST<Key, Value, Compare, Alloc>::reader::get(const Key &key, Value &value) {
+	return read([&key, &value](const view &v) {
+		const Value *found = v.find(key);
+		if (found != nullptr) {
+			value = *found;
+		}
+		return found != nullptr;
+	});
+}
+
+/**
+ * @brief Calls fn on every entry of the version in order.
+ *
+ * The walk keeps the path on a fixed stack of AVL_MAX_DEPTH nodes, like the iterators of
+ * balancedBST, so it never allocates.
+ *
+ * @param fn The function to call.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+template <class Fn>
+void cowBST<Key, Value, Compare, Alloc>::view::for_each(Fn fn) const {
+	typedef avl_entry<Key, Value, true> Entry;
+	const TreeNode *path[AVL_MAX_DEPTH];
+	int depth = 0;
+	const TreeNode *node = top;
+
+	while (node != nullptr || depth > 0) {
+		// Go as far left as possible.
+		while (node != nullptr) {
+			path[depth++] = node;
+			node = node->left;
+		}
+
+		// Visit the node, then its right subtree.
+		node = path[--depth];
+		fn(Entry::get(node));
+		node = node->right;
+	}
+}
+
+/**
+ * @brief Recomputes the cached height and size of a node.
+ *
+ * @param node The node.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::update_node(TreeNode *node) {
+	node->height = 1 + max(height(node->left), height(node->right));
+	node->size = 1 + size(node->left) + size(node->right);
+}
+
+/**
+ * @brief Finds the node that holds a key.
+ *
+ * @param node The root of the version to search.
+ * @param key The key to find.
+ * @return TreeNode* The node, or nullptr.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::search(const TreeNode *node, const Key &key) const -> const TreeNode* {
+	while (node != nullptr) {
+		if (comp(key, node->data)) {
+			node = node->left;
+		}
+		else if (comp(node->data, key)) {
+			node = node->right;
+		}
+		else {
+			return node;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * @brief Allocates a node stamped with the current update.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @return TreeNode* The new node.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::create_node(const Key &key, const Value &value) -> TreeNode* {
+	TreeNode *node = NodeAllocTraits::allocate(nodeAlloc, 1);
+	try {
+		NodeAllocTraits::construct(nodeAlloc, node, key, value, version);
+	}
+	catch (...) {
+		NodeAllocTraits::deallocate(nodeAlloc, node, 1);
+		throw;
+	}
+	return node;
+}
+
+/**
+ * @brief Frees a node.
+ *
+ * @param node The node.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::destroy_node(TreeNode *node) {
+	NodeAllocTraits::destroy(nodeAlloc, node);
+	NodeAllocTraits::deallocate(nodeAlloc, node, 1);
+}
+
+/**
+ * @brief Frees a whole subtree, with an explicit stack.
+ *
+ * @param node The root of the subtree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::destroy_tree(TreeNode *node) {
+	TreeNode *path[AVL_MAX_DEPTH];
+	int depth = 0;
+	if (node != nullptr) {
+		path[depth++] = node;
+	}
+
+	// A subtree is never deeper than its height, so the children always fit.
+	while (depth > 0) {
+		node = path[--depth];
+		if (node->left != nullptr) {
+			path[depth++] = node->left;
+		}
+		if (node->right != nullptr) {
+			path[depth++] = node->right;
+		}
+		destroy_node(node);
+	}
+}
+
+/**
+ * @brief Gets a node that the current update may change.
+ *
+ * @param node The node.
+ * @return TreeNode* The node itself if the current update created it, otherwise a copy.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::writable(TreeNode *node) -> TreeNode* {
+	if (node->birth == version) {
+		return node;
+	}
+
+	TreeNode *copy = create_node(node->data, node->mapped());
+	copy->left = node->left;
+	copy->right = node->right;
+	copy->height = node->height;
+	copy->size = node->size;
+	discard(node);
+	return copy;
+}
+
+/**
+ * @brief Drops a node that is no longer part of the new version.
+ *
+ * @param node The node.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::discard(TreeNode *node) {
+	if (node->birth == version) {
+		destroy_node(node);
+		return;
+	}
+	Retired entry = {globalEpoch.load(memory_order_relaxed), node};
+	retired.push_back(entry);
+}
+
+/**
+ * @brief Rotates a node of the current update with its right child, which must also be one.
+ *
+ * @param node The node.
+ * @return TreeNode* The new root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::R_rotate(TreeNode *node) -> TreeNode* {
+	TreeNode *pivot = node->right;
+	node->right = pivot->left;
+	pivot->left = node;
+	update_node(node);
+	update_node(pivot);
+	return pivot;
+}
+
+/**
+ * @brief Rotates a node of the current update with its left child, which must also be one.
+ *
+ * @param node The node.
+ * @return TreeNode* The new root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::L_rotate(TreeNode *node) -> TreeNode* {
+	TreeNode *pivot = node->left;
+	node->left = pivot->right;
+	pivot->right = node;
+	update_node(node);
+	update_node(pivot);
+	return pivot;
+}
+
+/**
+ * @brief Rebalances a node of the current update.
+ *
+ * The cases are the same as in balancedBST::balanceTree. Before rotating, the child (and for a
+ * double rotation the grandchild) whose links change is made writable, so published nodes are
+ * never touched.
+ *
+ * @param node The node.
+ * @return TreeNode* The root of the rebalanced subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::balanceTree(TreeNode *node) -> TreeNode* {
+	int balance = height(node->left) - height(node->right);
+
+	// Left heavy
+	if (balance > 1) {
+		node->left = writable(node->left);
+		if (height(node->left->left) < height(node->left->right)) {
+			node->left->right = writable(node->left->right);
+			node->left = R_rotate(node->left);
+		}
+		return L_rotate(node);
+	}
+
+	// Right heavy
+	if (balance < -1) {
+		node->right = writable(node->right);
+		if (height(node->right->left) > height(node->right->right)) {
+			node->right->left = writable(node->right->left);
+			node->right = L_rotate(node->right);
+		}
+		return R_rotate(node);
+	}
+
+	return node;
+}
+
+/**
+ * @brief Inserts an absent key by copying the path to it.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @param node The root of the subtree.
+ * @return TreeNode* The root of the new version of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::insertNode(const Key &key, const Value &value, TreeNode *node) -> TreeNode* {
+	if (node == nullptr) {
+		return create_node(key, value);
+	}
+
+	node = writable(node);
+	if (comp(key, node->data)) {
+		node->left = insertNode(key, value, node->left);
+	}
+	else {
+		node->right = insertNode(key, value, node->right);
+	}
+	update_node(node);
+	return balanceTree(node);
+}
+
+/**
+ * @brief Deletes a present key by copying the path to it.
+ *
+ * A node with two children is replaced by a copy of its in-order successor, which removeMin
+ * unlinks from the right subtree.
+ *
+ * @param key The key.
+ * @param node The root of the subtree.
+ * @return TreeNode* The root of the new version of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::deleteNode(const Key &key, TreeNode *node) -> TreeNode* {
+	if (comp(key, node->data)) {
+		node = writable(node);
+		node->left = deleteNode(key, node->left);
+	}
+	else if (comp(node->data, key)) {
+		node = writable(node);
+		node->right = deleteNode(key, node->right);
+	}
+	else {
+		TreeNode *left = node->left;
+		TreeNode *right = node->right;
+		discard(node);
+		if (left == nullptr || right == nullptr) {
+			return left == nullptr ? right : left;
+		}
+
+		// Move a copy of the successor into the deleted node's place.
+		TreeNode *successor = nullptr;
+		right = removeMin(right, successor);
+		node = writable(successor);
+		node->left = left;
+		node->right = right;
+	}
+	update_node(node);
+	return balanceTree(node);
+}
+
+/**
+ * @brief Unlinks the smallest node of a subtree by copying the path to it.
+ *
+ * @param node The root of the subtree.
+ * @param removed Set to the unlinked node, which is not copied or retired here.
+ * @return TreeNode* The root of the new version of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+auto cowBST<Key, Value, Compare, Alloc>::removeMin(TreeNode *node, TreeNode *&removed) -> TreeNode* {
+	if (node->left == nullptr) {
+		removed = node;
+		return node->right;
+	}
+
+	node = writable(node);
+	node->left = removeMin(node->left, removed);
+	update_node(node);
+	return balanceTree(node);
+}
+
+/**
+ * @brief Publishes a new root and tries to reclaim retired nodes.
+ *
+ * The store makes every node of the update visible before the root that reaches it, and is
+ * ordered against the epoch announcements of readers (all of them are sequentially consistent).
+ *
+ * @param newRoot The root of the new version.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::publish(TreeNode *newRoot) {
+	root.store(newRoot, memory_order_seq_cst);
+	count = size(newRoot);
+	version++;
+	if (retired.size() >= RECLAIM_BATCH) {
+		reclaim();
+	}
+}
+
+/**
+ * @brief Advances the global epoch and frees what no reader can reach.
+ *
+ * A reader inside a read announces the epoch it saw before loading the root. A node retired in
+ * epoch e was unlinked before the epoch moved past e, so only readers that announced e or less
+ * can reach it. The epoch moves from e to e + 1 only once no reader still announces anything
+ * older than e, so once it reaches e + 2 every such reader has finished. A snapshot counts as a
+ * reader that announced the epoch it was taken in, so while it lives the epoch stops one past it.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::reclaim() {
+	unsigned long long epoch = globalEpoch.load();
+
+	// Advance only if every active reader and every snapshot has seen the current epoch.
+	bool advance = snapshots.empty() || *snapshots.begin() == epoch;
+	for (size_t i = 0; i < slotCount && advance; i++) {
+		unsigned long long seen = slots[i].epoch.load();
+		advance = seen == 0 || seen == epoch;
+	}
+	if (advance) {
+		globalEpoch.store(++epoch);
+	}
+
+	// Free everything retired two or more epochs ago.
+	while (!retired.empty() && retired.front().epoch + 2 <= epoch) {
+		destroy_node(retired.front().node);
+		retired.pop_front();
+	}
+}
+
+/**
+ * @brief Inserts a key and publishes the new version.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @return bool True if inserted, false if the key was already present.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool cowBST<Key, Value, Compare, Alloc>::insertNode(const Key &key, const Value &value) {
+	lock_guard<mutex> guard(writeLock);
+	TreeNode *current = root.load(memory_order_relaxed);
+	if (search(current, key) != nullptr) {
+		return false;
+	}
+	publish(insertNode(key, value, current));
+	return true;
+}
+
+/**
+ * @brief Deletes a key and publishes the new version.
+ *
+ * @param key The key.
+ * @return bool True if deleted, false if the key was missing.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool cowBST<Key, Value, Compare, Alloc>::deleteNode(const Key &key) {
+	lock_guard<mutex> guard(writeLock);
+	TreeNode *current = root.load(memory_order_relaxed);
+	if (search(current, key) == nullptr) {
+		return false;
+	}
+	publish(deleteNode(key, current));
+	return true;
+}
+
+/**
+ * @brief Removes every key, retiring all the old nodes.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void cowBST<Key, Value, Compare, Alloc>::clear() {
+	lock_guard<mutex> guard(writeLock);
+	TreeNode *old = root.load(memory_order_relaxed);
+	root.store(nullptr, memory_order_seq_cst);
+
+	// Retire every node, walking the old version with an explicit stack.
+	TreeNode *path[AVL_MAX_DEPTH];
+	int depth = 0;
+	if (old != nullptr) {
+		path[depth++] = old;
+	}
+	while (depth > 0) {
+		TreeNode *node = path[--depth];
+		if (node->left != nullptr) {
+			path[depth++] = node->left;
+		}
+		if (node->right != nullptr) {
+			path[depth++] = node->right;
+		}
+		discard(node);
+	}
+	publish(nullptr);
+}
+
+/* --- End of COPY-ON-WRITE TREE IMPLEMENTATION --- */
+
+#endif // AVLCOW_H
@@ -0,0 +1,972 @@
+/**
+ * @file AVLdurable.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains durableBST, a balancedBST whose updates survive a crash.
+ * Every insert and delete appends a small binary record to a write-ahead log in a
+ * directory, and a background thread syncs the log to disk in batches (group commit).
+ * Checkpoints write the whole tree as an image, in a forked child while updates go on,
+ * and opening the directory again loads the latest image and replays the log after it:
+ *
+ *     avl_durable_map<uint64_t, uint64_t> prices("prices.db");   // recovers what is there
+ *     prices.insertNode(7, 100);             // returns once the record is on disk
+ *     prices.checkpoint_async();             // optional; also started as the log grows
+ *
+ * Keys and values are written as raw bytes, so both must be trivially copyable.
+ * The log is synced with fdatasync, so this file needs a POSIX system.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLDURABLE_H
+#define AVLDURABLE_H
+
+/* --- IMPORTS --- */
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- DURABLE TREE CLASS --- */
+/**
+ * @brief Format of the log files. The version goes up whenever the record layout changes.
+ */
+static const char AVL_WAL_MAGIC[8] = {'A', 'V', 'L', 'W', 'A', 'L', 'O', 'G'};
+static const uint32_t AVL_WAL_VERSION = 1;
+
+/**
+ * @brief Pending log bytes at which the commit thread syncs without waiting out the commit
+ * interval, so a burst of writes cannot pile up an unbounded batch.
+ */
+static const size_t AVL_WAL_BATCH_BYTES = 1 << 20;
+
+/**
+ * @brief The header at the start of a log file. A log of another version, byte order or
+ * key and value size is refused, as an image would be.
+ */
+struct avl_wal_header {
+	char magic[8];			// AVL_WAL_MAGIC
+	uint32_t version;		// AVL_WAL_VERSION
+	uint32_t byteOrder;		// AVL_IMAGE_BYTE_ORDER as written
+	uint32_t keyBytes;		// sizeof(Key)
+	uint32_t valueBytes;	// sizeof(Value), or 0 for sets
+};
+
+/**
+ * @brief The kind of a log record, its first byte.
+ */
+enum avl_wal_op : uint8_t {
+	AVL_WAL_INSERT = 1,		// followed by the key and, for maps, the value
+	AVL_WAL_DELETE = 2		// followed by the key
+};
+
+/**
+ * @brief This class keeps a balancedBST in memory and makes its updates durable.
+ *
+ * The directory holds the log, in numbered segments wal.1.log, wal.2.log, ..., and
+ * checkpoint.img, an image of the whole tree in the format of avl_frozen::save. A segment is
+ * a header and then one record per update: the op byte, the key, the value (inserts into maps
+ * only) and a 32-bit checksum of those bytes. Records go to the newest segment.
+ *
+ * Updates apply to the tree and append their record to a buffer under one lock. The commit
+ * thread writes the buffer to the log and syncs it: it waits until the oldest buffered record
+ * is commitInterval old, or the buffer holds AVL_WAL_BATCH_BYTES, so that every record that
+ * arrives meanwhile shares the same sync. With waitForSync an update returns only once its
+ * record is synced, so a larger interval trades latency for fewer syncs; without it, updates
+ * return at once and a crash loses at most the last interval. Updates that change nothing
+ * write no record, but still wait for the records before them.
+ *
+ * A checkpoint writes the image with balancedBST::save, which syncs it before renaming it
+ * over checkpoint.img, and then deletes the segments it covers. checkpoint() writes it in the
+ * calling thread while updates wait. checkpoint_async() starts a new segment and lets a forked
+ * child (balancedBST::checkpoint_async) write the tree as it was at the fork, while updates go
+ * on into the new segment; the older segments are deleted once the child has succeeded. When
+ * the newest segment grows past checkpointBytes, one is started in the background.
+ *
+ * A crash before the covered segments are gone leaves records that the image already holds.
+ * Replaying them is harmless: replaying a log onto the tree left by any prefix of it ends
+ * where replaying the whole log would, since every key ends at its last delete or the first
+ * insert after it, or, with neither, where the tree had it. Opening a directory replays the
+ * segments in order. The newest is replayed up to the first record that is cut short or fails
+ * its checksum, the tail of a write that a crash interrupted, and truncated there; an older
+ * segment was complete when the next one began, so a bad record in it throws instead.
+ *
+ * Readers take the same lock as writers; they see updates before those are durable.
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key> >
+class durableBST {
+
+public:
+	typedef balancedBST<Key, Value, Compare, Alloc> tree_type;
+
+private:
+	static_assert(is_trivially_copyable<Key>::value, "durableBST needs a trivially copyable Key");
+	static_assert(is_trivially_copyable<Value>::value, "durableBST needs a trivially copyable Value");
+
+	static const bool hasValues = !is_same<Value, avl_no_value>::value;
+	static const size_t insertBytes = 1 + sizeof(Key) + (hasValues ? sizeof(Value) : 0) + 4;
+	static const size_t deleteBytes = 1 + sizeof(Key) + 4;
+
+	string directory;			// where the log segments and the checkpoint live
+	chrono::microseconds interval;	// how long a record may wait for others before the sync
+	bool waitForSync;			// whether updates wait for their record to be synced
+	size_t checkpointBytes;		// segment size that starts a checkpoint, 0 for never
+
+	mutable mutex lock;			// guards everything below
+	condition_variable wake;	// signals the commit thread
+	mutable condition_variable committed;	// signals threads waiting for a sync
+	tree_type tree;				// the keys
+	int log;					// descriptor of the newest segment
+	uint64_t segment;			// number of the newest segment
+	uint64_t oldest;			// number of the oldest segment still on disk
+	vector<char> pending;		// records not yet written to the log
+	vector<char> spare;			// the previous batch's buffer, kept for its capacity
+	chrono::steady_clock::time_point batchStart;	// when the oldest pending record arrived
+	uint64_t appended;			// number of records appended so far
+	uint64_t durable;			// number of those that are synced (or in a checkpoint)
+	size_t logBytes;			// size of the newest segment, not counting pending
+	size_t syncCount;			// number of log syncs so far
+	size_t replayedCount;		// records replayed when the directory was opened
+	bool flushing;				// whether the commit thread is writing a batch
+	bool syncNow;				// whether a thread asked for a sync without waiting
+	bool stopping;				// whether the destructor asked the commit thread to end
+	bool failed;				// whether a log write failed; updates throw from then on
+	avl_checkpoint background;	// the latest background checkpoint
+	uint64_t coveredBelow;		// the segments numbered below this are in its image
+	bool inFlight;				// whether its result has not been collected yet
+	size_t checkpointCount;		// checkpoints completed, in either mode
+	size_t startFailures;		// automatic checkpoints that could not start
+	thread committer;			// the commit thread
+
+	string segment_path (uint64_t number) const {return directory + "/wal." + to_string(number) + ".log";};
+	string image_path () const {return directory + "/checkpoint.img";};
+
+	/**
+	 * @brief Loads the checkpoint, if there is one, and replays the segments onto it.
+	 */
+	void recover ();
+
+	/**
+	 * @brief Replays one segment, leaving it open as the log if it is the newest.
+	 *
+	 * @param number: (uint64_t) the segment number
+	 * @param newest: (bool) whether it is the newest segment
+	 */
+	void replay (uint64_t number, bool newest);
+
+	/**
+	 * @brief Creates the next segment and sends the records to it from then on.
+	 *
+	 * @param guard: (unique_lock<mutex>&) the held lock
+	 */
+	void rotate (unique_lock<mutex> &guard);
+
+	/**
+	 * @brief Deletes the segments numbered below a bound, oldest first.
+	 *
+	 * @param below: (uint64_t) the first segment to keep
+	 */
+	void drop_segments (uint64_t below);
+
+	/**
+	 * @brief Starts a background checkpoint with the lock held. See checkpoint_async().
+	 *
+	 * @param guard: (unique_lock<mutex>&) the held lock
+	 * @return bool: false if one is still running
+	 */
+	bool start_checkpoint (unique_lock<mutex> &guard);
+
+	/**
+	 * @brief Collects a finished background checkpoint, with the lock held, and deletes the
+	 * segments it covers if it succeeded.
+	 *
+	 * @param block: (bool) whether to wait for it to finish
+	 */
+	void finish_checkpoint (bool block);
+
+	/**
+	 * @brief Rebuilds the tree from a loaded checkpoint in O(n).
+	 *
+	 * @param image: (avl_frozen) the checkpoint
+	 */
+	void rebuild (const avl_frozen<Key, Value, Compare> &image, true_type);
+	void rebuild (const avl_frozen<Key, Value, Compare> &image, false_type);
+
+	/**
+	 * @brief Appends one record to pending and wakes the commit thread if it was idle.
+	 *
+	 * @param op: (avl_wal_op) the kind of record
+	 * @param key: (Key) the key
+	 * @param value: (Value) the value, written for inserts into maps
+	 */
+	void append (avl_wal_op op, const Key &key, const Value &value);
+
+	/**
+	 * @brief Waits until the first count records are durable. Throws runtime_error if the
+	 * log cannot be written.
+	 *
+	 * @param guard: (unique_lock<mutex>&) the held lock
+	 * @param count: (uint64_t) the number of records
+	 */
+	void wait_durable (unique_lock<mutex> &guard, uint64_t count) const;
+
+	/**
+	 * @brief Finishes an update: collects or starts a background checkpoint, then waits for
+	 * the sync if waitForSync is set.
+	 *
+	 * @param guard: (unique_lock<mutex>&) the held lock
+	 */
+	void commit (unique_lock<mutex> &guard);
+
+	/**
+	 * @brief Writes a checkpoint with the lock held. See checkpoint().
+	 *
+	 * @param guard: (unique_lock<mutex>&) the held lock
+	 */
+	void checkpoint_locked (unique_lock<mutex> &guard);
+
+	/**
+	 * @brief The commit thread: writes and syncs batches until the destructor stops it.
+	 */
+	void run_committer ();
+
+public:
+	/**
+	 * @brief Opens a durable tree in a directory, creating the directory if needed, and
+	 * recovers the tree from the checkpoint and the log segments found there. Throws runtime_error
+	 * if the files cannot be read or written, or were written for another Key or Value.
+	 *
+	 * @param path: (string) the directory
+	 * @param commitInterval: (chrono::microseconds) how long a record may wait for more
+	 *        records to share its sync; 0 syncs whatever has arrived as soon as possible
+	 * @param waitForSync: (bool) whether insertNode and deleteNode wait for their sync
+	 * @param checkpointBytes: (size_t) segment size that starts a background checkpoint,
+	 *        0 for never
+	 * @param compare: (Compare) the key ordering
+	 */
+	explicit durableBST (const string &path, chrono::microseconds commitInterval = chrono::microseconds(1000),
+		bool waitForSync = true, size_t checkpointBytes = (size_t)64 << 20, const Compare &compare = Compare());
+
+	/**
+	 * @brief Waits for a background checkpoint, syncs the records still pending and closes
+	 * the log. No new checkpoint is taken; the next open replays the log.
+	 */
+	~durableBST ();
+
+	durableBST (const durableBST &) = delete;
+	durableBST& operator= (const durableBST &) = delete;
+
+	/**
+	 * @brief Inserts a key, or does nothing if it is already there, like balancedBST.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to it
+	 * @return bool: true if the key was inserted
+	 */
+	bool insertNode (const Key &key, const Value &value = Value());
+
+	/**
+	 * @brief Deletes a key, or does nothing if it is not there.
+	 *
+	 * @param key: (Key) the key to delete
+	 * @return bool: true if the key was deleted
+	 */
+	bool deleteNode (const Key &key);
+
+	/**
+	 * @brief Checks if a key is in the tree.
+	 *
+	 * @param key: (Key) the key to look for
+	 * @return bool
+	 */
+	bool searchItem (const Key &key) const {lock_guard<mutex> guard(lock); return tree.searchItem(key);};
+
+	/**
+	 * @brief Copies the value mapped to a key.
+	 *
+	 * @param key: (Key) the key to look for
+	 * @param value: (Value&) receives the value if the key is present
+	 * @return bool: true if the key is present
+	 */
+	bool get (const Key &key, Value &value) const;
+
+	/**
+	 * @brief Runs fn on the tree with the lock held, for the queries durableBST does not
+	 * forward (iteration, ranges, rank). fn must not update the tree.
+	 *
+	 * @param fn: (Fn) called with a const tree_type&
+	 * @return whatever fn returns
+	 */
+	template <class Fn>
+	auto read (Fn fn) const -> decltype(fn(declval<const tree_type&>()))
+		{lock_guard<mutex> guard(lock); return fn(tree);};
+
+	/**
+	 * @brief Get the number of keys.
+	 *
+	 * @return size_t
+	 */
+	size_t treeNodeCount () const {lock_guard<mutex> guard(lock); return tree.treeNodeCount();};
+
+	/**
+	 * @brief Waits until every update made so far is durable. Without waitForSync this is
+	 * how a caller marks a point it cannot afford to lose; it does not wait out the interval.
+	 */
+	void sync ();
+
+	/**
+	 * @brief Writes the whole tree as checkpoint.img and empties the log, so the next open
+	 * loads the image instead of replaying the records. Updates wait while it runs, O(n),
+	 * and so does any background checkpoint that is still running. Throws runtime_error if
+	 * the image cannot be written; the log is then left as it was.
+	 */
+	void checkpoint () {unique_lock<mutex> guard(lock); checkpoint_locked(guard);};
+
+	/**
+	 * @brief Starts a checkpoint in a forked child and returns after the fork, so updates
+	 * wait only for the fork and for a new log segment to be created. The image holds the
+	 * tree as it was at the call. Throws runtime_error if fork fails.
+	 *
+	 * @return bool: false, and nothing started, if a background checkpoint is still running
+	 */
+	bool checkpoint_async () {unique_lock<mutex> guard(lock); return start_checkpoint(guard);};
+
+	/**
+	 * @brief Checks whether a background checkpoint is still running, collecting it if not.
+	 *
+	 * @return bool
+	 */
+	bool checkpoint_running () {lock_guard<mutex> guard(lock); finish_checkpoint(false); return inFlight;};
+
+	/**
+	 * @brief Counters for tuning: the size of the newest log segment, the number of syncs so
+	 * far (records per sync is the batch size group commit reached), the records replayed at
+	 * open, the checkpoints completed and the automatic ones that could not start (see
+	 * commit). For the last background checkpoint: whether it succeeded, its size, and the
+	 * pages fork had to copy while it was written.
+	 *
+	 * @return size_t, bool or uint64_t
+	 */
+	size_t log_bytes () const {lock_guard<mutex> guard(lock); return logBytes + pending.size();};
+	size_t syncs () const {lock_guard<mutex> guard(lock); return syncCount;};
+	size_t replayed () const {lock_guard<mutex> guard(lock); return replayedCount;};
+	size_t checkpoints () const {lock_guard<mutex> guard(lock); return checkpointCount;};
+	size_t checkpoint_start_failures () const {lock_guard<mutex> guard(lock); return startFailures;};
+	bool checkpoint_ok () const {lock_guard<mutex> guard(lock); return background.ok();};
+	uint64_t checkpoint_bytes () const {lock_guard<mutex> guard(lock); return background.bytes_written();};
+	uint64_t checkpoint_pages () const {lock_guard<mutex> guard(lock); return background.pages_copied();};
+};
+
+// the record sizes are odr-used by the ternaries that pick one
+template <class Key, class Value, class Compare, class Alloc>
+const size_t durableBST<Key, Value, Compare, Alloc>::insertBytes;
+template <class Key, class Value, class Compare, class Alloc>
+const size_t durableBST<Key, Value, Compare, Alloc>::deleteBytes;
+
+/**
+ * @brief Shorthands for durable maps and sets.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_durable_map = durableBST<Key, Value, Compare, Alloc>;
+
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key> >
+using avl_durable_set = durableBST<Key, avl_no_value, Compare, Alloc>;
+/* --- End of DURABLE TREE CLASS --- */
+
+/* --- DURABLE TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Syncs a file's data, or a directory's entries, to disk.
+ *
+ * @param fd The descriptor.
+ * @return bool True on success.
+ */
+inline bool avl_sync(int fd) {
+#if defined(__linux__)
+	return fdatasync(fd) == 0;
+#else
+	return fsync(fd) == 0;
+#endif
+}
+
+/**
+ * @brief Opens the directory, recovers the tree and starts the commit thread.
+ *
+ * @param path The directory.
+ * @param commitInterval The latency budget of a record.
+ * @param waitForSync Whether updates wait for their sync.
+ * @param checkpointBytes The segment size that starts a background checkpoint.
+ * @param compare The key ordering.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+durableBST<Key, Value, Compare, Alloc>::durableBST(const string &path, chrono::microseconds commitInterval,
+	bool waitForSync, size_t checkpointBytes, const Compare &compare)
+	: directory(path), interval(commitInterval), waitForSync(waitForSync), checkpointBytes(checkpointBytes),
+	tree(compare), log(-1), segment(0), oldest(0), appended(0), durable(0), logBytes(0), syncCount(0),
+	replayedCount(0), flushing(false), syncNow(false), stopping(false), failed(false), coveredBelow(0),
+	inFlight(false), checkpointCount(0), startFailures(0) {
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		throw runtime_error("durableBST: cannot create " + directory);
+	}
+
+	recover();
+	committer = thread(&durableBST::run_committer, this);
+}
+
+/**
+ * @brief Waits for a background checkpoint, stops the commit thread after its last batch and
+ * closes the log.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+durableBST<Key, Value, Compare, Alloc>::~durableBST() {
+	{
+		lock_guard<mutex> guard(lock);
+		finish_checkpoint(true);
+		stopping = true;
+	}
+	wake.notify_one();
+	committer.join();
+	close(log);
+}
+
+/**
+ * @brief Builds the tree from the sorted keys of a checkpoint.
+ *
+ * The image is in sorted order by position, so the keys, or key-value pairs, are copied out in
+ * order and handed to build_from_sorted, which builds a balanced tree without comparisons.
+ *
+ * @param image The loaded checkpoint.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::rebuild(const avl_frozen<Key, Value, Compare> &image, true_type) {
+	vector<Key> keys;
+	keys.reserve(image.size());
+	for (size_t i = 0; i < image.size(); i++) {
+		keys.push_back(image.key_at(i));
+	}
+	tree.build_from_sorted(keys.begin(), keys.end());
+}
+
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::rebuild(const avl_frozen<Key, Value, Compare> &image, false_type) {
+	vector<pair<Key, Value> > entries;
+	entries.reserve(image.size());
+	for (size_t i = 0; i < image.size(); i++) {
+		entries.push_back(make_pair(image.key_at(i), image.value_at(i)));
+	}
+	tree.build_from_sorted(entries.begin(), entries.end());
+}
+
+/**
+ * @brief Loads the checkpoint and replays the log segments.
+ *
+ * The segments are the files named wal.<number>.log, replayed in order of number. With none, the
+ * log starts at segment 1.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::recover() {
+	ifstream existing(image_path().c_str());
+	if (existing) {
+		existing.close();
+		rebuild(avl_frozen<Key, Value, Compare>::load(image_path()), integral_constant<bool, !hasValues>());
+	}
+
+	vector<uint64_t> numbers;
+	DIR *listing = opendir(directory.c_str());
+	if (listing == NULL) {
+		throw runtime_error("durableBST: cannot read " + directory);
+	}
+	while (dirent *entry = readdir(listing)) {
+		const char *name = entry->d_name;
+		if (strncmp(name, "wal.", 4) != 0 || name[4] < '0' || name[4] > '9') {
+			continue;
+		}
+		char *end;
+		uint64_t number = strtoull(name + 4, &end, 10);
+		if (strcmp(end, ".log") == 0 && number != 0) {
+			numbers.push_back(number);
+		}
+	}
+	closedir(listing);
+
+	sort(numbers.begin(), numbers.end());
+	if (numbers.empty()) {
+		numbers.push_back(1);
+	}
+	oldest = numbers.front();
+	for (size_t i = 0; i < numbers.size(); i++) {
+		replay(numbers[i], i + 1 == numbers.size());
+	}
+}
+
+/**
+ * @brief Replays one log segment.
+ *
+ * The segment is read whole and its records applied in order until one is cut short, has an
+ * unknown op or fails its checksum. The newest segment is then truncated after the last good
+ * record, so that new records follow it directly; a missing one is created with a fresh header.
+ * An older segment was complete before the next one was created, so a bad record in it is not
+ * the tail of an interrupted write, and recovery stops with an error instead.
+ *
+ * @param number The segment number.
+ * @param newest Whether it is the newest segment, which stays open as the log.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::replay(uint64_t number, bool newest) {
+	const string path = segment_path(number);
+
+	avl_wal_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, AVL_WAL_MAGIC, sizeof(header.magic));
+	header.version = AVL_WAL_VERSION;
+	header.byteOrder = AVL_IMAGE_BYTE_ORDER;
+	header.keyBytes = sizeof(Key);
+	header.valueBytes = hasValues ? sizeof(Value) : 0;
+
+	ifstream in(path.c_str(), ios::binary);
+	vector<char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	in.close();
+
+	if (newest) {
+		log = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (log < 0) {
+			throw runtime_error("durableBST: cannot open " + path);
+		}
+		segment = number;
+	}
+
+	if (bytes.size() < sizeof(header)) {
+		if (!newest) {
+			throw runtime_error("durableBST: " + path + " is cut short");
+		}
+		// A new segment, or one whose header a crash cut short; it holds no records either way.
+		if (ftruncate(log, 0) != 0 || !avl_write_all(log, reinterpret_cast<const char*>(&header), sizeof(header))
+			|| !avl_sync(log) || !avl_sync_path(directory)) {
+			throw runtime_error("durableBST: cannot write " + path);
+		}
+		logBytes = sizeof(header);
+		return;
+	}
+	if (memcmp(bytes.data(), &header, sizeof(header)) != 0) {
+		throw runtime_error("durableBST: " + path + " was written for another format, Key or Value");
+	}
+
+	size_t offset = sizeof(header);
+	while (offset < bytes.size()) {
+		const char *record = bytes.data() + offset;
+		size_t length = record[0] == AVL_WAL_INSERT ? insertBytes : record[0] == AVL_WAL_DELETE ? deleteBytes : 0;
+		if (length == 0 || length > bytes.size() - offset) {
+			break;
+		}
+
+		uint32_t checksum;
+		memcpy(&checksum, record + length - 4, 4);
+		if (checksum != (uint32_t)avl_checksum(record, length - 4)) {
+			break;
+		}
+
+		Key key;
+		memcpy(&key, record + 1, sizeof(Key));
+		if (record[0] == AVL_WAL_DELETE) {
+			tree.deleteNode(key);
+		} else {
+			Value value = Value();
+			if (hasValues) {
+				memcpy(&value, record + 1 + sizeof(Key), sizeof(Value));
+			}
+			tree.insertNode(key, value);
+		}
+		replayedCount++;
+		offset += length;
+	}
+
+	if (offset < bytes.size()) {
+		if (!newest) {
+			throw runtime_error("durableBST: " + path + " has a bad record");
+		}
+		if (ftruncate(log, offset) != 0 || !avl_sync(log)) {
+			throw runtime_error("durableBST: cannot truncate " + path);
+		}
+	}
+	if (newest) {
+		logBytes = offset;
+	}
+}
+
+/**
+ * @brief Encodes a record at the end of pending.
+ *
+ * @param op The kind of record.
+ * @param key The key.
+ * @param value The value.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::append(avl_wal_op op, const Key &key, const Value &value) {
+	if (pending.empty()) {
+		batchStart = chrono::steady_clock::now();
+		wake.notify_one();
+	}
+
+	size_t start = pending.size();
+	size_t length = op == AVL_WAL_INSERT ? insertBytes : deleteBytes;
+	pending.resize(start + length);
+
+	char *record = pending.data() + start;
+	record[0] = (char)op;
+	memcpy(record + 1, &key, sizeof(Key));
+	if (op == AVL_WAL_INSERT && hasValues) {
+		memcpy(record + 1 + sizeof(Key), &value, sizeof(Value));
+	}
+	uint32_t checksum = (uint32_t)avl_checksum(record, length - 4);
+	memcpy(record + length - 4, &checksum, 4);
+
+	appended++;
+	if (pending.size() >= AVL_WAL_BATCH_BYTES) {
+		wake.notify_one();
+	}
+}
+
+/**
+ * @brief Waits for the commit thread, or a checkpoint, to make count records durable.
+ *
+ * @param guard The held lock.
+ * @param count The number of records.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::wait_durable(unique_lock<mutex> &guard, uint64_t count) const {
+	committed.wait(guard, [this, count] {return durable >= count || failed;});
+	if (durable < count) {
+		throw runtime_error("durableBST: cannot write " + segment_path(segment));
+	}
+}
+
+/**
+ * @brief Finishes an update with the lock held.
+ *
+ * A background checkpoint that has finished is collected here, and one is started once the
+ * newest segment has grown past checkpointBytes; either way the update then waits for its sync
+ * as usual, since the records after the fork are only in the log. The update is already in the
+ * tree and in pending, so a checkpoint that cannot start (no new segment, no fork) must not
+ * make it throw: the failure is counted and the next commit tries again, as the segment is
+ * still past checkpointBytes.
+ *
+ * @param guard The held lock.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::commit(unique_lock<mutex> &guard) {
+	finish_checkpoint(false);
+	if (checkpointBytes != 0 && !inFlight && logBytes + pending.size() >= checkpointBytes) {
+		try {
+			start_checkpoint(guard);
+		} catch (const runtime_error &) {
+			startFailures++;
+		}
+	}
+	if (waitForSync) {
+		wait_durable(guard, appended);
+	}
+}
+
+/**
+ * @brief Inserts a key and logs it.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @return bool True if the key was inserted.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool durableBST<Key, Value, Compare, Alloc>::insertNode(const Key &key, const Value &value) {
+	unique_lock<mutex> guard(lock);
+	if (failed) {
+		throw runtime_error("durableBST: cannot write " + segment_path(segment));
+	}
+
+	size_t before = tree.treeNodeCount();
+	tree.insertNode(key, value);
+	bool inserted = tree.treeNodeCount() != before;
+	if (inserted) {
+		append(AVL_WAL_INSERT, key, value);
+	}
+
+	commit(guard);
+	return inserted;
+}
+
+/**
+ * @brief Deletes a key and logs it.
+ *
+ * @param key The key.
+ * @return bool True if the key was deleted.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool durableBST<Key, Value, Compare, Alloc>::deleteNode(const Key &key) {
+	unique_lock<mutex> guard(lock);
+	if (failed) {
+		throw runtime_error("durableBST: cannot write " + segment_path(segment));
+	}
+
+	size_t before = tree.treeNodeCount();
+	tree.deleteNode(key);
+	bool deleted = tree.treeNodeCount() != before;
+	if (deleted) {
+		append(AVL_WAL_DELETE, key, Value());
+	}
+
+	commit(guard);
+	return deleted;
+}
+
+/**
+ * @brief Copies the value mapped to a key.
+ *
+ * @param key The key.
+ * @param value Receives the value.
+ * @return bool True if the key is present.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool durableBST<Key, Value, Compare, Alloc>::get(const Key &key, Value &value) const {
+	lock_guard<mutex> guard(lock);
+	typename tree_type::const_iterator it = tree.find(key);
+	if (it == tree.end()) {
+		return false;
+	}
+	value = it->second;
+	return true;
+}
+
+/**
+ * @brief Asks the commit thread to sync now and waits for it.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::sync() {
+	unique_lock<mutex> guard(lock);
+	if (durable < appended) {
+		syncNow = true;
+		wake.notify_one();
+	}
+	wait_durable(guard, appended);
+}
+
+/**
+ * @brief Writes a checkpoint with the lock held.
+ *
+ * A background checkpoint still running is waited for first, so that it cannot rename an older
+ * image over this one. So is the commit thread, if it is writing a batch without the lock, so
+ * that the truncation below cannot cut its write in half. Every pending record is already in
+ * the tree, so the image covers them and they are dropped. balancedBST::save leaves either the
+ * old image or the complete new one after a crash; only then are the older segments deleted
+ * and the newest truncated to its header.
+ *
+ * @param guard The held lock.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::checkpoint_locked(unique_lock<mutex> &guard) {
+	finish_checkpoint(true);
+	committed.wait(guard, [this] {return !flushing;});
+
+	tree.save(image_path());
+	checkpointCount++;
+	drop_segments(segment);
+
+	if (ftruncate(log, sizeof(avl_wal_header)) != 0 || !avl_sync(log)) {
+		// The image is safe, and replaying the old records onto it changes nothing.
+		failed = true;
+		committed.notify_all();
+		throw runtime_error("durableBST: cannot truncate " + segment_path(segment));
+	}
+
+	pending.clear();
+	logBytes = sizeof(avl_wal_header);
+	durable = appended;
+	committed.notify_all();
+}
+
+/**
+ * @brief Creates the next segment and sends the records to it from then on.
+ *
+ * The commit thread is waited for, so that its batch lands in the old segment; records still
+ * pending go to the new one, after everything in the old. The new segment's header is synced,
+ * and the directory with it, before the old descriptor is closed.
+ *
+ * @param guard The held lock.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::rotate(unique_lock<mutex> &guard) {
+	committed.wait(guard, [this] {return !flushing;});
+
+	avl_wal_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, AVL_WAL_MAGIC, sizeof(header.magic));
+	header.version = AVL_WAL_VERSION;
+	header.byteOrder = AVL_IMAGE_BYTE_ORDER;
+	header.keyBytes = sizeof(Key);
+	header.valueBytes = hasValues ? sizeof(Value) : 0;
+
+	const string path = segment_path(segment + 1);
+	int next = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (next < 0 || !avl_write_all(next, reinterpret_cast<const char*>(&header), sizeof(header))
+		|| !avl_sync(next) || !avl_sync_path(directory)) {
+		if (next >= 0) {
+			close(next);
+		}
+		remove(path.c_str());
+		throw runtime_error("durableBST: cannot write " + path);
+	}
+
+	close(log);
+	log = next;
+	segment++;
+	logBytes = sizeof(header);
+}
+
+/**
+ * @brief Deletes the segments that a checkpoint covers, oldest first, so that a crash part way
+ * leaves a run of segments that still replays in order.
+ *
+ * @param below The first segment to keep.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::drop_segments(uint64_t below) {
+	// No directory sync: a segment that comes back after a crash is replayed over the image, harmlessly.
+	for (; oldest < below; oldest++) {
+		remove(segment_path(oldest).c_str());
+	}
+}
+
+/**
+ * @brief Starts a background checkpoint with the lock held.
+ *
+ * The log moves to a new segment first, so that the segments before it hold exactly the records
+ * in the tree at the fork; the child's image covers them, and the new segment holds the rest.
+ *
+ * @param guard The held lock.
+ * @return bool False if one is still running.
+ */
+template <class Key, class Value, class Compare, class Alloc>
+bool durableBST<Key, Value, Compare, Alloc>::start_checkpoint(unique_lock<mutex> &guard) {
+	finish_checkpoint(false);
+	if (inFlight) {
+		return false;
+	}
+
+	rotate(guard);
+	background = tree.checkpoint_async(image_path());
+	coveredBelow = segment;
+	inFlight = true;
+	return true;
+}
+
+/**
+ * @brief Collects a finished background checkpoint with the lock held.
+ *
+ * A failed one leaves the segments, and the previous image, as they were; the next checkpoint
+ * covers them.
+ *
+ * @param block Whether to wait for it.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::finish_checkpoint(bool block) {
+	if (!inFlight) {
+		return;
+	}
+	if (block) {
+		background.wait();
+	} else if (!background.done()) {
+		return;
+	}
+
+	inFlight = false;
+	if (background.ok()) {
+		checkpointCount++;
+		drop_segments(coveredBelow);
+	}
+}
+
+/**
+ * @brief The commit thread's loop.
+ *
+ * It sleeps until a record is pending, then until the oldest pending record is interval old, the
+ * buffer is full, a thread calls sync() or the tree is being destroyed. It then takes the whole
+ * buffer, writes and syncs it without the lock, so that updates go on filling the next batch, and
+ * marks every record in it durable. A failed write or sync is final: from then on updates throw,
+ * since the log may hold a torn record that recovery would stop at.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc>
+void durableBST<Key, Value, Compare, Alloc>::run_committer() {
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		wake.wait(guard, [this] {return stopping || !pending.empty();});
+		if (pending.empty()) {
+			return;
+		}
+
+		wake.wait_until(guard, batchStart + interval,
+			[this] {return stopping || syncNow || pending.size() >= AVL_WAL_BATCH_BYTES;});
+		syncNow = false;
+		if (pending.empty()) {
+			// A checkpoint took the batch meanwhile.
+			continue;
+		}
+
+		spare.clear();
+		pending.swap(spare);
+		uint64_t batchEnd = appended;
+		flushing = true;
+		guard.unlock();
+
+		bool ok = failed ? false : avl_write_all(log, spare.data(), spare.size()) && avl_sync(log);
+
+		guard.lock();
+		flushing = false;
+		if (ok) {
+			logBytes += spare.size();
+			durable = max(durable, batchEnd);
+			syncCount++;
+		} else {
+			failed = true;
+		}
+		committed.notify_all();
+	}
+}
+
+/* --- End of DURABLE TREE IMPLEMENTATION --- */
+
+#endif // AVLDURABLE_H
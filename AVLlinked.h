@@ -0,0 +1,524 @@
+/**
+ * @file AVLlinked.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains avl_linked_core, the AVL insert, delete and search shared by
+ * compactBST and mappedBST. Both keep a balance factor per node instead of a height and
+ * link their nodes by index or offset instead of by pointer, but they store the nodes in
+ * different places: a vector for compactBST, a mapped file for mappedBST. The core reaches
+ * the nodes only through a storage policy, so that a fix to the rebalancing is made once.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLLINKED_H
+#define AVLLINKED_H
+
+/* --- IMPORTS --- */
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- LINKED AVL CORE --- */
+/**
+ * @brief Balance factor of a node in a linked tree.
+ */
+enum avl_balance {
+	AVL_EVEN = 0,			// both subtrees have the same height
+	AVL_LEFT_HEAVY = 1,		// the left subtree is one taller
+	AVL_RIGHT_HEAVY = 2		// the right subtree is one taller
+};
+
+/**
+ * @brief The AVL algorithms of a tree whose nodes link to each other by a value of type Link,
+ * written once against a storage policy. Storage is the tree class itself, which makes
+ * avl_linked_core a friend and provides:
+ *
+ *     Storage::NIL                      the null link
+ *     Storage::key_type, mapped_type    the key and value types
+ *     node(i)                           the node behind a link, with data, left and right
+ *     balance(i), set_balance(i, b)     its avl_balance, stored wherever the tree likes
+ *     create_node(key, value)           a new leaf, even, counted
+ *     release_node(i)                   gives an unlinked node back, uncounted
+ *     writable(i)                       the node to change in place of i: i itself, or a
+ *                                       copy for a tree that must not change i
+ *     comp                              the key ordering
+ *
+ * Every node whose fields change is passed through writable() first, and the link to it is
+ * written again afterwards, so a copy-on-write storage gets path copying for free and an
+ * in-place one pays nothing. create_node and writable may move the nodes, so the core holds
+ * links across calls, never references.
+ *
+ * @tparam Link: the link type, an index or an offset
+ * @tparam Storage: the tree class, as above
+ */
+template <class Link, class Storage>
+struct avl_linked_core {
+
+	typedef typename Storage::key_type Key;
+	typedef typename Storage::mapped_type Value;
+
+	/**
+	 * @brief Inserts a key into a subtree. Does nothing if the key is already there.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the subtree
+	 * @param key: (Key) the key
+	 * @param value: (Value) the value mapped to the key
+	 * @param grew: (bool&) set to true if the subtree got taller
+	 * @return Link: the new root of the subtree
+	 */
+	static Link insert (Storage &s, Link i, const Key &key, const Value &value, bool &grew);
+
+	/**
+	 * @brief Removes a key from a subtree. Does nothing if the key is not there.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the subtree
+	 * @param key: (Key) the key
+	 * @param shrunk: (bool&) set to true if the subtree got shorter
+	 * @return Link: the new root of the subtree
+	 */
+	static Link erase (Storage &s, Link i, const Key &key, bool &shrunk);
+
+	/**
+	 * @brief Finds the node holding a key.
+	 *
+	 * @param s: (Storage) the tree
+	 * @param root: (Link) its root
+	 * @param key: (Key) the key to find
+	 * @return Link: the node, or NIL
+	 */
+	static Link lookup (const Storage &s, Link root, const Key &key);
+
+	/**
+	 * @brief Finds the height (leaf = 0, empty = -1) by following the taller child of each node,
+	 * in O(log n), since heights are not stored.
+	 *
+	 * @param s: (Storage) the tree
+	 * @param root: (Link) its root
+	 * @return int
+	 */
+	static int height (const Storage &s, Link root);
+
+private:
+	/**
+	 * @brief Points a node's left or right link at a child, through writable(), unless it
+	 * already points there.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the node
+	 * @param child: (Link) the new child
+	 * @return Link: the node, or the copy that replaced it
+	 */
+	static Link set_left (Storage &s, Link i, Link child);
+	static Link set_right (Storage &s, Link i, Link child);
+
+	/**
+	 * @brief Rotates a writable subtree whose left side is two levels taller than its right
+	 * side, or the mirror image. A single rotation when the taller child leans the same way
+	 * or not at all, a double rotation when it leans the other way.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the subtree
+	 * @param shorter: (bool&) set to true if the subtree ends up one level shorter than it
+	 * was before it became unbalanced, which is the case unless the child was even
+	 * @return Link: the new root of the subtree
+	 */
+	static Link fix_left_heavy (Storage &s, Link i, bool &shorter);
+	static Link fix_right_heavy (Storage &s, Link i, bool &shorter);
+
+	/**
+	 * @brief Updates a node's balance after its left or right subtree grew by one level,
+	 * rotating if it was already leaning that way.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the node
+	 * @param grew: (bool&) stays true if the node's subtree grew too
+	 * @return Link: the new root of the subtree
+	 */
+	static Link left_grew (Storage &s, Link i, bool &grew);
+	static Link right_grew (Storage &s, Link i, bool &grew);
+
+	/**
+	 * @brief Updates a node's balance after its left or right subtree shrank by one level,
+	 * rotating if it was leaning the other way.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the node
+	 * @param shrunk: (bool&) stays true if the node's subtree shrank too
+	 * @return Link: the new root of the subtree
+	 */
+	static Link left_shrunk (Storage &s, Link i, bool &shrunk);
+	static Link right_shrunk (Storage &s, Link i, bool &shrunk);
+
+	/**
+	 * @brief Unlinks the largest node of a subtree without releasing it.
+	 *
+	 * @param s: (Storage&) the tree
+	 * @param i: (Link) the subtree
+	 * @param removed: (Link&) set to the unlinked node
+	 * @param shrunk: (bool&) set to true if the subtree got shorter
+	 * @return Link: the new root of the subtree
+	 */
+	static Link remove_max (Storage &s, Link i, Link &removed, bool &shrunk);
+};
+/* --- End of LINKED AVL CORE --- */
+
+/* --- LINKED AVL CORE IMPLEMENTATION --- */
+
+/**
+ * @brief Points a node's left link at a child.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param child The new left child.
+ * @return Link The node, or its copy.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::set_left(Storage &s, Link i, Link child) {
+	if (s.node(i).left != child) {
+		i = s.writable(i);
+		s.node(i).left = child;
+	}
+	return i;
+}
+
+/**
+ * @brief Points a node's right link at a child, the mirror image of set_left.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param child The new right child.
+ * @return Link The node, or its copy.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::set_right(Storage &s, Link i, Link child) {
+	if (s.node(i).right != child) {
+		i = s.writable(i);
+		s.node(i).right = child;
+	}
+	return i;
+}
+
+/**
+ * @brief Rebalances a writable node whose left subtree is two levels taller than its right subtree.
+ *
+ * If the left child leans left or not at all, one rotation lifts it above the node. If it leans
+ * right, its right child m is lifted above both, and the new balances of the two depend on which
+ * way m leaned. After an insert the left child always leans, and the subtree is back to its old
+ * height. After a delete it can be even, and then the rotated subtree keeps the height it had.
+ * The children that move are made writable too; the links to them are all written again.
+ *
+ * @param s The tree.
+ * @param i The unbalanced node.
+ * @param shorter Set to true unless the left child was even.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::fix_left_heavy(Storage &s, Link i, bool &shorter) {
+	Link l = s.writable(s.node(i).left);
+	avl_balance bl = s.balance(l);
+
+	if (bl != AVL_RIGHT_HEAVY) {
+		s.node(i).left = s.node(l).right;
+		s.node(l).right = i;
+		s.set_balance(i, bl == AVL_EVEN ? AVL_LEFT_HEAVY : AVL_EVEN);
+		s.set_balance(l, bl == AVL_EVEN ? AVL_RIGHT_HEAVY : AVL_EVEN);
+		shorter = bl != AVL_EVEN;
+		return l;
+	}
+
+	Link m = s.writable(s.node(l).right);
+	avl_balance bm = s.balance(m);
+	s.node(l).right = s.node(m).left;
+	s.node(i).left = s.node(m).right;
+	s.node(m).left = l;
+	s.node(m).right = i;
+	s.set_balance(l, bm == AVL_RIGHT_HEAVY ? AVL_LEFT_HEAVY : AVL_EVEN);
+	s.set_balance(i, bm == AVL_LEFT_HEAVY ? AVL_RIGHT_HEAVY : AVL_EVEN);
+	s.set_balance(m, AVL_EVEN);
+	shorter = true;
+	return m;
+}
+
+/**
+ * @brief Rebalances a writable node whose right subtree is two levels taller, the mirror image of
+ * fix_left_heavy.
+ *
+ * @param s The tree.
+ * @param i The unbalanced node.
+ * @param shorter Set to true unless the right child was even.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::fix_right_heavy(Storage &s, Link i, bool &shorter) {
+	Link r = s.writable(s.node(i).right);
+	avl_balance br = s.balance(r);
+
+	if (br != AVL_LEFT_HEAVY) {
+		s.node(i).right = s.node(r).left;
+		s.node(r).left = i;
+		s.set_balance(i, br == AVL_EVEN ? AVL_RIGHT_HEAVY : AVL_EVEN);
+		s.set_balance(r, br == AVL_EVEN ? AVL_LEFT_HEAVY : AVL_EVEN);
+		shorter = br != AVL_EVEN;
+		return r;
+	}
+
+	Link m = s.writable(s.node(r).left);
+	avl_balance bm = s.balance(m);
+	s.node(r).left = s.node(m).right;
+	s.node(i).right = s.node(m).left;
+	s.node(m).right = r;
+	s.node(m).left = i;
+	s.set_balance(r, bm == AVL_LEFT_HEAVY ? AVL_RIGHT_HEAVY : AVL_EVEN);
+	s.set_balance(i, bm == AVL_RIGHT_HEAVY ? AVL_LEFT_HEAVY : AVL_EVEN);
+	s.set_balance(m, AVL_EVEN);
+	shorter = true;
+	return m;
+}
+
+/**
+ * @brief Updates a node after its left subtree grew.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param grew Stays true only if the node was even, since then its subtree grew as well.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::left_grew(Storage &s, Link i, bool &grew) {
+	i = s.writable(i);
+	switch (s.balance(i)) {
+		case AVL_RIGHT_HEAVY: s.set_balance(i, AVL_EVEN); grew = false; return i;
+		case AVL_EVEN: s.set_balance(i, AVL_LEFT_HEAVY); return i;
+		default: {
+			// An insert rotation always restores the old height.
+			bool shorter;
+			grew = false;
+			return fix_left_heavy(s, i, shorter);
+		}
+	}
+}
+
+/**
+ * @brief Updates a node after its right subtree grew, the mirror image of left_grew.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param grew Stays true only if the node was even.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::right_grew(Storage &s, Link i, bool &grew) {
+	i = s.writable(i);
+	switch (s.balance(i)) {
+		case AVL_LEFT_HEAVY: s.set_balance(i, AVL_EVEN); grew = false; return i;
+		case AVL_EVEN: s.set_balance(i, AVL_RIGHT_HEAVY); return i;
+		default: {
+			// An insert rotation always restores the old height.
+			bool shorter;
+			grew = false;
+			return fix_right_heavy(s, i, shorter);
+		}
+	}
+}
+
+/**
+ * @brief Updates a node after its left subtree shrank.
+ *
+ * A node that leaned left is now even and one shorter. An even node now leans right and keeps its
+ * height. A node that leaned right is now two off and is rotated.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param shrunk Stays true if the node's subtree is now shorter.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::left_shrunk(Storage &s, Link i, bool &shrunk) {
+	i = s.writable(i);
+	switch (s.balance(i)) {
+		case AVL_LEFT_HEAVY: s.set_balance(i, AVL_EVEN); return i;
+		case AVL_EVEN: s.set_balance(i, AVL_RIGHT_HEAVY); shrunk = false; return i;
+		default: return fix_right_heavy(s, i, shrunk);
+	}
+}
+
+/**
+ * @brief Updates a node after its right subtree shrank, the mirror image of left_shrunk.
+ *
+ * @param s The tree.
+ * @param i The node.
+ * @param shrunk Stays true if the node's subtree is now shorter.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::right_shrunk(Storage &s, Link i, bool &shrunk) {
+	i = s.writable(i);
+	switch (s.balance(i)) {
+		case AVL_RIGHT_HEAVY: s.set_balance(i, AVL_EVEN); return i;
+		case AVL_EVEN: s.set_balance(i, AVL_LEFT_HEAVY); shrunk = false; return i;
+		default: return fix_left_heavy(s, i, shrunk);
+	}
+}
+
+/**
+ * @brief Inserts a key into a subtree.
+ *
+ * The recursion works with links only. Creating the node can move every node, so no reference
+ * to one is held across the recursive call.
+ *
+ * @param s The tree.
+ * @param i The subtree, or NIL.
+ * @param key The key.
+ * @param value The value mapped to the key.
+ * @param grew Set to true if the subtree got taller.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::insert(Storage &s, Link i, const Key &key, const Value &value, bool &grew) {
+	if (i == Storage::NIL) {
+		grew = true;
+		return s.create_node(key, value);
+	}
+
+	if (s.comp(key, s.node(i).data)) {
+		Link left = insert(s, s.node(i).left, key, value, grew);
+		i = set_left(s, i, left);
+		return grew ? left_grew(s, i, grew) : i;
+	}
+	if (s.comp(s.node(i).data, key)) {
+		Link right = insert(s, s.node(i).right, key, value, grew);
+		i = set_right(s, i, right);
+		return grew ? right_grew(s, i, grew) : i;
+	}
+
+	// The key is already here.
+	grew = false;
+	return i;
+}
+
+/**
+ * @brief Removes a key from a subtree.
+ *
+ * A node with at most one child is replaced by that child. A node with two children takes over
+ * the key and value of the largest node of its left subtree, which is unlinked and released
+ * instead, as in balancedBST::deleteNode.
+ *
+ * @param s The tree.
+ * @param i The subtree, or NIL.
+ * @param key The key.
+ * @param shrunk Set to true if the subtree got shorter.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::erase(Storage &s, Link i, const Key &key, bool &shrunk) {
+	if (i == Storage::NIL) {
+		shrunk = false;
+		return Storage::NIL;
+	}
+
+	if (s.comp(key, s.node(i).data)) {
+		Link left = erase(s, s.node(i).left, key, shrunk);
+		i = set_left(s, i, left);
+		return shrunk ? left_shrunk(s, i, shrunk) : i;
+	}
+	if (s.comp(s.node(i).data, key)) {
+		Link right = erase(s, s.node(i).right, key, shrunk);
+		i = set_right(s, i, right);
+		return shrunk ? right_shrunk(s, i, shrunk) : i;
+	}
+
+	if (s.node(i).left == Storage::NIL || s.node(i).right == Storage::NIL) {
+		Link child = s.node(i).left != Storage::NIL ? s.node(i).left : s.node(i).right;
+		s.release_node(i);
+		shrunk = true;
+		return child;
+	}
+
+	Link removed;
+	Link left = remove_max(s, s.node(i).left, removed, shrunk);
+	i = s.writable(i);
+	s.node(i).left = left;
+	s.node(i).data = s.node(removed).data;
+	static_cast<avl_value<Value> &>(s.node(i)) = static_cast<avl_value<Value> &>(s.node(removed));
+	s.release_node(removed);
+	return shrunk ? left_shrunk(s, i, shrunk) : i;
+}
+
+/**
+ * @brief Unlinks the largest node of a subtree, putting its left child in its place.
+ *
+ * @param s The tree.
+ * @param i The subtree.
+ * @param removed Set to the unlinked node.
+ * @param shrunk Set to true if the subtree got shorter.
+ * @return Link The new root of the subtree.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::remove_max(Storage &s, Link i, Link &removed, bool &shrunk) {
+	if (s.node(i).right == Storage::NIL) {
+		removed = i;
+		shrunk = true;
+		return s.node(i).left;
+	}
+
+	Link right = remove_max(s, s.node(i).right, removed, shrunk);
+	i = set_right(s, i, right);
+	return shrunk ? right_shrunk(s, i, shrunk) : i;
+}
+
+/**
+ * @brief Finds the node holding a key with one walk down from the root.
+ *
+ * @param s The tree.
+ * @param root Its root.
+ * @param key The key to find.
+ * @return Link The node, or NIL.
+ */
+template <class Link, class Storage>
+Link avl_linked_core<Link, Storage>::lookup(const Storage &s, Link root, const Key &key) {
+	Link i = root;
+	while (i != Storage::NIL) {
+		const typename Storage::Node &node = s.node(i);
+		if (s.comp(key, node.data)) {
+			i = node.left;
+		}
+		else if (s.comp(node.data, key)) {
+			i = node.right;
+		}
+		else {
+			return i;
+		}
+	}
+	return Storage::NIL;
+}
+
+/**
+ * @brief Finds the height by walking down the taller side.
+ *
+ * The path that always takes the taller child, or either child of an even node, is a longest
+ * path, so its length is the height.
+ *
+ * @param s The tree.
+ * @param root Its root.
+ * @return int The height, or -1 when empty.
+ */
+template <class Link, class Storage>
+int avl_linked_core<Link, Storage>::height(const Storage &s, Link root) {
+	int h = -1;
+	for (Link i = root; i != Storage::NIL; h++) {
+		i = s.balance(i) == AVL_RIGHT_HEAVY ? s.node(i).right : s.node(i).left;
+	}
+	return h;
+}
+
+/* --- End of LINKED AVL CORE IMPLEMENTATION --- */
+
+#endif // AVLLINKED_H
@@ -0,0 +1,994 @@
+/**
+ * @file AVLmapped.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains mappedBST, an AVL tree that lives in a memory-mapped file.
+ * Its nodes are carved out of the file and link to each other by their offset in it, so
+ * the file holds the tree itself, not a copy: opening it again gives the tree back at once,
+ * with no rebuild, and the nodes are read from the page cache as the searches reach them.
+ *
+ *     avl_mapped_map<uint64_t, uint64_t> prices("prices.avl");   // creates or reopens it
+ *     prices.insertNode(7, 100);             // changes the mapped pages
+ *     prices.sync();                         // the checkpoint a crash rolls back to
+ *
+ * Keys and values are stored as raw bytes, so both must be trivially copyable.
+ * The file is mapped with mmap, so this file needs a POSIX system.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLMAPPED_H
+#define AVLMAPPED_H
+
+/* --- IMPORTS --- */
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AVLtrees.h"
+#include "AVLlinked.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- MAPPED TREE CLASS --- */
+/**
+ * @brief Format of the heap files. The version goes up whenever the node layout changes.
+ */
+static const char AVL_HEAP_MAGIC[8] = {'A', 'V', 'L', 'N', 'H', 'E', 'A', 'P'};
+static const uint32_t AVL_HEAP_VERSION = 2;
+
+/**
+ * @brief Size of a new heap file. Files grow by doubling and stay a multiple of it, and so
+ * of the page size.
+ */
+static const size_t AVL_HEAP_MIN_BYTES = 1 << 16;
+
+/**
+ * @brief A checkpoint of the tree, as sync() left it: the root and the free list it can be
+ * opened from. The header holds two, and sync() overwrites the older one, so a crash while
+ * one is written leaves the other.
+ */
+struct avl_heap_commit {
+	uint64_t sequence;		// syncs before this one; the valid commit with the higher one is current
+	uint64_t root;			// offset of the root, or 0
+	uint64_t freeList;		// offset of the first free node, or 0
+	uint64_t count;			// number of keys
+	uint64_t used;			// bytes from the start of the file to the end of the last node
+	uint64_t checksum;		// avl_checksum of the fields above
+};
+
+/**
+ * @brief The header at the start of a heap file: what the file was written for, and the
+ * last two commits.
+ */
+struct avl_heap_header {
+	char magic[8];			// AVL_HEAP_MAGIC
+	uint32_t version;		// AVL_HEAP_VERSION
+	uint32_t byteOrder;		// AVL_IMAGE_BYTE_ORDER as written
+	uint32_t keyBytes;		// sizeof(Key)
+	uint32_t valueBytes;	// sizeof(Value), or 0 for sets
+	uint32_t nodeBytes;		// sizeof(Node), which also fixes the layout of a node
+	uint32_t clean;			// 1 if no node changed since the current commit
+	avl_heap_commit commits[2];	// written in turn by sync()
+};
+
+/**
+ * @brief Offset of the first node: the header, rounded up to a cache line.
+ */
+static const uint64_t AVL_HEAP_FIRST = (sizeof(avl_heap_header) + AVL_IMAGE_ALIGN - 1) / AVL_IMAGE_ALIGN * AVL_IMAGE_ALIGN;
+
+/**
+ * @brief This class is an AVL tree whose nodes, and the header that roots them, are stored
+ * in one file mapped with MAP_SHARED. A link is the node's offset from the start of the
+ * file, and 0, the header's offset, is the null link; the mapping may move, the links do
+ * not. Freed nodes are kept on a free list, threaded through their left links, and reused
+ * by later inserts, and a full file doubles with ftruncate and is mapped again, so that
+ * iterators and searchValue pointers are invalidated by inserts, as in compactBST. The
+ * rebalancing is avl_linked_core's, the same code as compactBST's.
+ *
+ * Updates change the mapped pages, and the kernel writes them back when it likes, so the
+ * nodes that the last sync() wrote are never changed before the next one: an update that
+ * reaches one changes a copy of it instead, and of the nodes above it (writable(), path
+ * copying as in cowBST). Nodes allocated since the sync are changed in place, so each node
+ * is copied at most once between two syncs. sync() msyncs the file and then writes the new
+ * root, count and free list into the older of two checksummed commits in the header. A
+ * crash at any point leaves the last commit and every node it reaches intact, and opening
+ * the file rolls back to it: the nodes written after it are unreachable, and the free list,
+ * whose nodes later updates may have reused, is rebuilt from the nodes the root reaches in
+ * O(nodes). The clean flag in the header tells whether that walk is needed. Nodes unlinked
+ * since the last sync are reused only after the next, so between syncs the file can hold
+ * up to twice the tree. Updates that must survive a crash one by one belong in durableBST.
+ *
+ * One mappedBST at a time can have a file open: the constructor takes an exclusive flock.
+ * The file does not record Compare; it must be opened with the ordering it was built with.
+ *
+ * @tparam Key: the key type, ordered by Compare
+ * @tparam Value: the mapped value type (avl_no_value for sets)
+ * @tparam Compare: strict weak ordering on keys
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key> >
+class mappedBST {
+
+	static_assert(is_trivially_copyable<Key>::value, "mappedBST needs a trivially copyable Key");
+	static_assert(is_trivially_copyable<Value>::value, "mappedBST needs a trivially copyable Value");
+
+public:
+	// the null link
+	static const uint64_t NIL = 0;
+
+	typedef Key key_type;		// type of the keys
+	typedef Value mapped_type;	// type of the mapped values (avl_no_value for sets)
+
+private:
+	friend struct avl_linked_core<uint64_t, mappedBST>;
+	typedef avl_linked_core<uint64_t, mappedBST> Core;
+
+	// a node: the key, the balance factor in the padding after it, the value (nothing for sets)
+	// and the two links
+	struct Node : avl_value<Value> {
+		Key data;			// store data
+		uint8_t balance;	// which side is taller
+		uint64_t left;		// offset of the left subtree
+		uint64_t right;		// offset of the right subtree
+
+		Node (const Key &key, const Value &value) : avl_value<Value>(value), data(key), balance(0), left(NIL), right(NIL) {};
+	};
+
+	static const bool hasValues = !is_same<Value, avl_no_value>::value;
+
+	string path;				// the file
+	int file;					// its descriptor, which holds the flock
+	char *base;					// where it is mapped
+	size_t mapped;				// bytes mapped, the size of the file
+	Compare comp;				// key ordering
+	avl_heap_commit live;		// the tree as it is, and the sequence of the current commit
+	vector<uint64_t> fresh;		// a bit per node: allocated since the current commit
+	vector<uint64_t> retired;	// nodes of the current commit unlinked since
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Reaches the header and the nodes in the mapping.
+	 */
+	avl_heap_header& header () {return *reinterpret_cast<avl_heap_header*>(base);};
+	const avl_heap_header& header () const {return *reinterpret_cast<const avl_heap_header*>(base);};
+	Node& node (uint64_t at) {return *reinterpret_cast<Node*>(base + at);};
+	const Node& node (uint64_t at) const {return *reinterpret_cast<const Node*>(base + at);};
+
+	/**
+	 * @brief Reads and sets the bit of a node that says it was allocated since the current commit.
+	 */
+	bool is_fresh (uint64_t i) const
+		{uint64_t n = (i - AVL_HEAP_FIRST) / sizeof(Node); return n / 64 < fresh.size() && (fresh[n / 64] >> (n % 64) & 1);};
+	void set_fresh (uint64_t i);
+
+	/**
+	 * @brief Reads and writes the balance factor of a node.
+	 */
+	avl_balance balance (uint64_t i) const {return (avl_balance)node(i).balance;};
+	void set_balance (uint64_t i, avl_balance b) {node(i).balance = (uint8_t)b;};
+
+	/**
+	 * @brief Opens or creates the file, checks its header and maps it.
+	 *
+	 * @return void
+	 */
+	void open_heap ();
+
+	/**
+	 * @brief Unmaps and closes the file.
+	 *
+	 * @return void
+	 */
+	void close_heap ();
+
+	/**
+	 * @brief Changes the size of the file and maps it again. Throws runtime_error on failure.
+	 *
+	 * @param bytes: (size_t) the new size
+	 * @return void
+	 */
+	void resize (size_t bytes);
+
+	/**
+	 * @brief Picks the current commit of an opened file, and rolls back to it if the file was
+	 * not clean. Throws runtime_error if neither commit is valid or the nodes are corrupt.
+	 *
+	 * @return void
+	 */
+	void recover ();
+
+	/**
+	 * @brief Writes the live tree into the older commit and msyncs the header.
+	 *
+	 * @return bool: false if msync failed
+	 */
+	bool commit ();
+
+	/**
+	 * @brief Clears the clean flag before the first change after a sync.
+	 *
+	 * @return void
+	 */
+	void mark_dirty ();
+
+	/**
+	 * @brief Syncs the file, commits the tree and sets the clean flag, if there were changes.
+	 *
+	 * @return bool: false if msync failed
+	 */
+	bool flush ();
+
+	/**
+	 * @brief Takes a node from the free list, or from the end of the used bytes, growing the
+	 * file if it is full, and marks it fresh.
+	 *
+	 * @return uint64_t: the node's offset
+	 */
+	uint64_t allocate ();
+
+	/**
+	 * @brief Gives back an unlinked node: to the free list if it is fresh, or else to the
+	 * nodes retired until the next sync.
+	 *
+	 * @param i: (uint64_t) the node's offset
+	 * @return void
+	 */
+	void free_node (uint64_t i);
+
+	/**
+	 * @brief Allocates a node and puts a new node in it.
+	 *
+	 * @param key: (Key) the key
+	 * @param value: (Value) the value mapped to the key
+	 * @return uint64_t: the new node's offset
+	 */
+	uint64_t create_node (const Key &key, const Value &value);
+
+	/**
+	 * @brief Gives back the node of a removed key.
+	 *
+	 * @param i: (uint64_t) the node's offset
+	 * @return void
+	 */
+	void release_node (uint64_t i) {free_node(i); live.count--;};
+
+	/**
+	 * @brief The node to change in place of i: i itself if it is fresh, or else a fresh copy.
+	 *
+	 * @param i: (uint64_t) the node's offset
+	 * @return uint64_t: i, or the copy's offset
+	 */
+	uint64_t writable (uint64_t i);
+
+	/**
+	 * @brief Makes the nodes on the path to a key writable.
+	 *
+	 * @param i: (uint64_t) the subtree, which holds the key
+	 * @param key: (Key) the key
+	 * @param found: (uint64_t&) set to the writable node holding the key
+	 * @return uint64_t: the new root of the subtree
+	 */
+	uint64_t own_path (uint64_t i, const Key &key, uint64_t &found);
+
+	/* --- End of Helper Functions --- */
+
+public:
+	/**
+	 * @brief In-order iterator, as compactBST's: the ancestors still to be visited sit in a
+	 * fixed array of AVL_MAX_DEPTH offsets. Only the read-only one is used, since a value
+	 * changed through it would change the last commit; searchValue copies the node first.
+	 */
+	template <bool Const>
+	class mapped_iterator {
+
+		friend class mappedBST;
+		template <bool> friend class mapped_iterator;
+		typedef avl_entry<Key, Value, Const> Entry;
+		typedef typename conditional<Const, const char, char>::type Byte;
+		typedef typename conditional<Const, const Node, Node>::type Slot;
+
+		Byte * base;						// the mapping
+		uint64_t path[AVL_MAX_DEPTH];		// the current node and the ancestors it is left of
+		int depth;							// entries in path, 0 at the end
+
+		Slot* at (uint64_t i) const {return reinterpret_cast<Slot*>(base + i);};
+
+		// pushes i and its chain of left children
+		void descend (uint64_t i) {
+			while (i != NIL) {
+				path[depth++] = i;
+				i = at(i)->left;
+			}
+		};
+
+		mapped_iterator (Byte *mapping, uint64_t root) : base(mapping), depth(0) {descend(root);};
+
+	public:
+		typedef forward_iterator_tag iterator_category;
+		typedef typename Entry::value_type value_type;
+		typedef typename Entry::reference reference;
+		typedef typename Entry::pointer pointer;
+		typedef ptrdiff_t difference_type;
+
+		mapped_iterator () : base(nullptr), depth(0) {};
+		// const_iterator from iterator
+		mapped_iterator (const mapped_iterator<false> &other) : base(other.base), depth(other.depth)
+			{copy(other.path, other.path + other.depth, path);};
+
+		reference operator* () const {return Entry::get(at(path[depth - 1]));};
+		pointer operator-> () const {return Entry::arrow(at(path[depth - 1]));};
+
+		mapped_iterator& operator++ () {uint64_t right = at(path[--depth])->right; descend(right); return *this;};
+		mapped_iterator operator++ (int) {mapped_iterator before = *this; ++*this; return before;};
+
+		bool operator== (const mapped_iterator &other) const
+			{return depth == other.depth && (depth == 0 || path[depth - 1] == other.path[depth - 1]);};
+		bool operator!= (const mapped_iterator &other) const {return !(*this == other);};
+	};
+
+	typedef mapped_iterator<true> iterator;
+	typedef mapped_iterator<true> const_iterator;
+	typedef typename avl_entry<Key, Value, true>::value_type value_type;
+
+	/**
+	 * @brief Opens the tree stored in a file, or creates the file with an empty tree. Opening
+	 * maps the file and reads its header, whatever the number of keys. A file that changed
+	 * after its last sync, because its process crashed, is rolled back to that sync, which
+	 * walks its nodes once. Throws runtime_error if the file cannot be opened or mapped, is
+	 * open in another process, was written for another Key or Value, or is corrupt.
+	 *
+	 * @param path: (string) the file
+	 * @param compare: (Compare) the key ordering the file was built with
+	 */
+	explicit mappedBST (const string &path, const Compare &compare = Compare());
+
+	/**
+	 * @brief Syncs the file, if it changed since the last sync, and closes it.
+	 */
+	~mappedBST ();
+
+	mappedBST (const mappedBST &) = delete;
+	mappedBST& operator= (const mappedBST &) = delete;
+
+	/**
+	 * @brief Inserts a key, mapped to a value for maps. Does nothing if the key is already there.
+	 * Throws runtime_error if the file cannot grow.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 */
+	void insertNode (const Key &key, const Value &value = Value())
+		{mark_dirty(); bool grew; uint64_t root = Core::insert(*this, live.root, key, value, grew); live.root = root;};
+
+	/**
+	 * @brief Removes a key. Does nothing if the key is not there.
+	 *
+	 * @param key: (Key) the key to remove
+	 */
+	void deleteNode (const Key &key) {mark_dirty(); bool shrunk; uint64_t root = Core::erase(*this, live.root, key, shrunk); live.root = root;};
+
+	/**
+	 * @brief Checks whether a key is in the tree.
+	 *
+	 * @param key: (Key) the key to find
+	 * @return bool
+	 */
+	bool searchItem (const Key &key) const {return Core::lookup(*this, live.root, key) != NIL;};
+
+	/**
+	 * @brief Finds the value mapped to a key (maps only), copying its node and the nodes above
+	 * it first if the last sync wrote them. Writing through the pointer changes the file; call
+	 * sync() afterwards as after any update.
+	 *
+	 * @param key: (Key) the key to find
+	 * @return Value*: the value, or nullptr if the key is not in the tree
+	 */
+	Value* searchValue (const Key &key);
+
+	/**
+	 * @brief Get the number of keys.
+	 *
+	 * @return size_t
+	 */
+	size_t treeNodeCount () const {return (size_t)live.count;};
+	bool empty () const {return live.count == 0;};
+
+	/**
+	 * @brief Finds the height (leaf = 0, empty = -1) by following the taller child of each node.
+	 *
+	 * @return int
+	 */
+	int height () const {return Core::height(*this, live.root);};
+
+	/**
+	 * @brief Removes every key and shrinks the file back to AVL_HEAP_MIN_BYTES. The empty tree
+	 * is committed at once, as by sync(), since the nodes of the last commit are dropped.
+	 * Throws runtime_error if msync fails.
+	 *
+	 * @return void
+	 */
+	void clear ();
+
+	/**
+	 * @brief Grows the file to hold n keys in total, so that inserts up to n do not remap it.
+	 *
+	 * @param n: (size_t) the number of keys
+	 * @return void
+	 */
+	void reserve (size_t n);
+
+	/**
+	 * @brief The checkpoint: msyncs every changed page of the file, then commits the tree, so
+	 * that a crash before the next sync rolls the file back to this one. O(pages changed since
+	 * the last sync). Throws runtime_error if msync fails.
+	 *
+	 * @return void
+	 */
+	void sync () {if (!flush()) throw runtime_error("mappedBST: cannot sync " + path);};
+
+	/**
+	 * @brief Reports the memory the tree holds: the live nodes, and as extra the header, the
+	 * free nodes, the unused end of the file and the tree object. The file is one block, and
+	 * counts whether its pages are resident or not.
+	 *
+	 * @return avl_memory_usage
+	 */
+	avl_memory_usage memory_usage () const;
+
+	/* --- Iterator Functions --- */
+
+	const_iterator begin () const {return const_iterator(base, live.root);};
+	const_iterator end () const {return const_iterator();};
+
+	/* --- End of Iterator Functions --- */
+};
+/* --- End of MAPPED TREE CLASS --- */
+
+/* --- ALIASES --- */
+/**
+ * @brief mappedBST as a map and as a set.
+ */
+template <class Key, class Value, class Compare = less<Key> >
+using avl_mapped_map = mappedBST<Key, Value, Compare>;
+template <class Key, class Compare = less<Key> >
+using avl_mapped_set = mappedBST<Key, avl_no_value, Compare>;
+/* --- End of ALIASES --- */
+
+/* --- MAPPED TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Opens the file and maps it, closing it again if it is refused.
+ *
+ * @param path The file.
+ * @param compare The key ordering.
+ */
+template <class Key, class Value, class Compare>
+mappedBST<Key, Value, Compare>::mappedBST(const string &path, const Compare &compare)
+	: path(path), file(-1), base(nullptr), mapped(0), comp(compare), live() {
+	static_assert(sizeof(avl_heap_header) <= AVL_HEAP_FIRST, "mappedBST: the header overlaps the first node");
+	try {
+		open_heap();
+	}
+	catch (...) {
+		close_heap();
+		throw;
+	}
+}
+
+/**
+ * @brief Syncs and closes the file. A failed sync leaves the clean flag clear, so the next open
+ * rolls back to the last commit.
+ */
+template <class Key, class Value, class Compare>
+mappedBST<Key, Value, Compare>::~mappedBST() {
+	if (base != nullptr) {
+		flush();
+	}
+	close_heap();
+}
+
+/**
+ * @brief Opens or creates the file, checks its header and maps it.
+ *
+ * An empty file, new or not, gets AVL_HEAP_MIN_BYTES and a fresh header with a commit of the empty
+ * tree, synced at once, so that the file is valid before the first update. Any other file must
+ * start with a header written by this Key and Value layout on a machine of the same byte order,
+ * and is then opened from its current commit by recover().
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::open_heap() {
+	file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0) {
+		throw runtime_error("mappedBST: cannot open " + path);
+	}
+	if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+		throw runtime_error("mappedBST: " + path + " is already open, here or in another process");
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0) {
+		throw runtime_error("mappedBST: cannot read " + path);
+	}
+	bool fresh = info.st_size == 0;
+	if (fresh && ftruncate(file, AVL_HEAP_MIN_BYTES) != 0) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+	size_t bytes = fresh ? AVL_HEAP_MIN_BYTES : (size_t)info.st_size;
+	if (bytes < sizeof(avl_heap_header)) {
+		throw runtime_error("mappedBST: " + path + " is not a tree heap");
+	}
+
+	void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (mapping == MAP_FAILED) {
+		throw runtime_error("mappedBST: cannot map " + path);
+	}
+	base = static_cast<char *>(mapping);
+	mapped = bytes;
+
+	avl_heap_header expected;
+	memset(&expected, 0, sizeof(expected));
+	memcpy(expected.magic, AVL_HEAP_MAGIC, sizeof(expected.magic));
+	expected.version = AVL_HEAP_VERSION;
+	expected.byteOrder = AVL_IMAGE_BYTE_ORDER;
+	expected.keyBytes = sizeof(Key);
+	expected.valueBytes = hasValues ? sizeof(Value) : 0;
+	expected.nodeBytes = sizeof(Node);
+
+	avl_heap_header &h = header();
+	if (fresh) {
+		expected.clean = 1;
+		h = expected;
+		live.used = AVL_HEAP_FIRST;
+		if (!commit()) {
+			throw runtime_error("mappedBST: cannot write " + path);
+		}
+		return;
+	}
+
+	if (memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0 || h.version != expected.version) {
+		throw runtime_error("mappedBST: " + path + " is not a tree heap of this version");
+	}
+	if (h.byteOrder != expected.byteOrder || h.keyBytes != expected.keyBytes
+		|| h.valueBytes != expected.valueBytes || h.nodeBytes != expected.nodeBytes) {
+		throw runtime_error("mappedBST: " + path + " was written for another byte order, Key or Value");
+	}
+	recover();
+}
+
+/**
+ * @brief Picks the current commit and, if the file was not clean, rolls back to it.
+ *
+ * The current commit is the valid one with the higher sequence; the other may have been torn by
+ * a crash while it was written. A clean file is opened from it in O(1). Otherwise nodes changed
+ * after the commit may have been taken from its free list, so the free list is rebuilt: one
+ * walk from the root marks the nodes the commit reaches, checking that each link lands on a node
+ * and that no node is reached twice, and every other node below the commit's used bytes becomes
+ * free. The result is committed before the file is marked clean, so a crash during the roll back
+ * only makes the next open do it again.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::recover() {
+	const avl_heap_header &h = header();
+	const avl_heap_commit *current = nullptr;
+	for (int k = 0; k < 2; k++) {
+		const avl_heap_commit &c = h.commits[k];
+		if (c.checksum == avl_checksum(&c, offsetof(avl_heap_commit, checksum))
+			&& (current == nullptr || c.sequence > current->sequence)) {
+			current = &c;
+		}
+	}
+	if (current == nullptr) {
+		throw runtime_error("mappedBST: " + path + " has no valid commit");
+	}
+	live = *current;
+	if (live.used < AVL_HEAP_FIRST || live.used > mapped || (live.used - AVL_HEAP_FIRST) % sizeof(Node) != 0) {
+		throw runtime_error("mappedBST: " + path + " is cut short");
+	}
+	if (h.clean) {
+		return;
+	}
+
+	size_t slots = (live.used - AVL_HEAP_FIRST) / sizeof(Node);
+	vector<uint64_t> reached((slots + 63) / 64);
+	vector<uint64_t> pending;
+	uint64_t count = 0;
+	if (live.root != NIL) {
+		pending.push_back(live.root);
+	}
+	while (!pending.empty()) {
+		uint64_t i = pending.back();
+		pending.pop_back();
+		if (i < AVL_HEAP_FIRST || i >= live.used || (i - AVL_HEAP_FIRST) % sizeof(Node) != 0) {
+			throw runtime_error("mappedBST: " + path + " has a link outside its nodes");
+		}
+		uint64_t n = (i - AVL_HEAP_FIRST) / sizeof(Node);
+		if (reached[n / 64] >> (n % 64) & 1) {
+			throw runtime_error("mappedBST: " + path + " has a node reached twice");
+		}
+		reached[n / 64] |= (uint64_t)1 << (n % 64);
+		count++;
+		if (node(i).left != NIL) {
+			pending.push_back(node(i).left);
+		}
+		if (node(i).right != NIL) {
+			pending.push_back(node(i).right);
+		}
+	}
+	if (count != live.count) {
+		throw runtime_error("mappedBST: " + path + " holds another number of keys than it says");
+	}
+
+	live.freeList = NIL;
+	for (size_t n = slots; n-- > 0;) {
+		if (!(reached[n / 64] >> (n % 64) & 1)) {
+			uint64_t i = AVL_HEAP_FIRST + n * sizeof(Node);
+			node(i).left = live.freeList;
+			live.freeList = i;
+		}
+	}
+	if (msync(base, mapped, MS_SYNC) != 0 || !commit()) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+	header().clean = 1;
+	if (msync(base, sizeof(avl_heap_header), MS_SYNC) != 0) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+}
+
+/**
+ * @brief Unmaps and closes the file, which also drops the flock.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::close_heap() {
+	if (base != nullptr) {
+		munmap(base, mapped);
+		base = nullptr;
+	}
+	if (file >= 0) {
+		close(file);
+		file = -1;
+	}
+}
+
+/**
+ * @brief Resizes the file and the mapping.
+ *
+ * A larger file is extended before it is mapped, and a smaller one truncated after, so that no
+ * mapped page ever lies past the end of the file. Linux moves the mapping with mremap; elsewhere
+ * the file is mapped again and the old mapping dropped, both being views of the same pages.
+ * The links are offsets, so nothing in the file changes.
+ *
+ * @param bytes The new size.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::resize(size_t bytes) {
+	if (bytes > mapped && ftruncate(file, bytes) != 0) {
+		throw runtime_error("mappedBST: cannot grow " + path);
+	}
+
+#if defined(__linux__)
+	void *moved = mremap(base, mapped, bytes, MREMAP_MAYMOVE);
+#else
+	void *moved = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (moved != MAP_FAILED) {
+		munmap(base, mapped);
+	}
+#endif
+	if (moved == MAP_FAILED) {
+		throw runtime_error("mappedBST: cannot map " + path);
+	}
+
+	size_t before = mapped;
+	base = static_cast<char *>(moved);
+	mapped = bytes;
+	if (bytes < before) {
+		// A failure leaves the file longer than the mapping, which is harmless: the next open maps the
+		// unused end too.
+		int truncated = ftruncate(file, bytes);
+		(void)truncated;
+	}
+}
+
+/**
+ * @brief Writes the live tree, with the next sequence and its checksum, over the older commit,
+ * and msyncs the header.
+ *
+ * The sequence is only advanced once the commit is on disk, so a failed commit is retried in the
+ * same slot and never overwrites the current one.
+ *
+ * @return bool False if msync failed.
+ */
+template <class Key, class Value, class Compare>
+bool mappedBST<Key, Value, Compare>::commit() {
+	avl_heap_commit c = live;
+	c.sequence = live.sequence + 1;
+	c.checksum = avl_checksum(&c, offsetof(avl_heap_commit, checksum));
+	header().commits[c.sequence & 1] = c;
+	if (msync(base, sizeof(avl_heap_header), MS_SYNC) != 0) {
+		return false;
+	}
+	live.sequence = c.sequence;
+	return true;
+}
+
+/**
+ * @brief Clears the clean flag, and msyncs the header page, before the first change after a sync.
+ *
+ * The kernel may write a changed page back at any time, and the free list of the commit is in
+ * the nodes that inserts reuse, so the flag must be on disk before any node changes; later
+ * updates find it clear and cost nothing extra.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::mark_dirty() {
+	if (!header().clean) {
+		return;
+	}
+	header().clean = 0;
+	if (msync(base, sizeof(avl_heap_header), MS_SYNC) != 0) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+}
+
+/**
+ * @brief Writes back every changed page, commits the tree, then sets the clean flag.
+ *
+ * The commit reaches the disk only after the nodes it reaches, and once it is there no node is
+ * fresh any more. The nodes retired since the last commit are not reached by the new one, so
+ * they go on the free list now, and a second commit records that; a crash before it leaves the
+ * flag clear and the next open rebuilds the free list anyway.
+ *
+ * @return bool False if msync failed; the flag then stays clear.
+ */
+template <class Key, class Value, class Compare>
+bool mappedBST<Key, Value, Compare>::flush() {
+	if (header().clean) {
+		return true;
+	}
+	if (msync(base, mapped, MS_SYNC) != 0 || !commit()) {
+		return false;
+	}
+	fill(fresh.begin(), fresh.end(), 0);
+
+	if (!retired.empty()) {
+		for (size_t k = 0; k < retired.size(); k++) {
+			node(retired[k]).left = live.freeList;
+			live.freeList = retired[k];
+		}
+		retired.clear();
+		if (msync(base, mapped, MS_SYNC) != 0 || !commit()) {
+			return false;
+		}
+	}
+	header().clean = 1;
+	return msync(base, sizeof(avl_heap_header), MS_SYNC) == 0;
+}
+
+/**
+ * @brief Sets the fresh bit of a node, doubling the bitmap when the node is past its end.
+ *
+ * @param i The node's offset.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::set_fresh(uint64_t i) {
+	uint64_t n = (i - AVL_HEAP_FIRST) / sizeof(Node);
+	if (n / 64 >= fresh.size()) {
+		fresh.resize(max((size_t)(n / 64 + 1), 2 * fresh.size()));
+	}
+	fresh[n / 64] |= (uint64_t)1 << (n % 64);
+}
+
+/**
+ * @brief Takes a free node, or one after the last node.
+ *
+ * A full file doubles, which may move the mapping, so nothing in it is held across resize(). The
+ * free list only holds nodes that the current commit does not reach.
+ *
+ * @return uint64_t The node's offset.
+ */
+template <class Key, class Value, class Compare>
+uint64_t mappedBST<Key, Value, Compare>::allocate() {
+	uint64_t i = live.freeList;
+	if (i != NIL) {
+		live.freeList = node(i).left;
+	}
+	else {
+		if (live.used + sizeof(Node) > mapped) {
+			size_t bytes = mapped;
+			while (live.used + sizeof(Node) > bytes) {
+				bytes *= 2;
+			}
+			resize(bytes);
+		}
+		i = live.used;
+		live.used += sizeof(Node);
+	}
+	set_fresh(i);
+	return i;
+}
+
+/**
+ * @brief Frees a fresh node at once, and retires a node of the current commit until the next one.
+ *
+ * @param i The node's offset.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::free_node(uint64_t i) {
+	if (is_fresh(i)) {
+		node(i).left = live.freeList;
+		live.freeList = i;
+	}
+	else {
+		retired.push_back(i);
+	}
+}
+
+/**
+ * @brief Puts a new node in a fresh slot.
+ *
+ * @param key The key.
+ * @param value The value mapped to the key.
+ * @return uint64_t The new node's offset.
+ */
+template <class Key, class Value, class Compare>
+uint64_t mappedBST<Key, Value, Compare>::create_node(const Key &key, const Value &value) {
+	uint64_t i = allocate();
+	node(i) = Node(key, value);
+	live.count++;
+	return i;
+}
+
+/**
+ * @brief Copies a node of the current commit into a fresh slot and retires it.
+ *
+ * The node is copied out before allocate(), which may move the mapping. avl_linked_core writes
+ * the link to the copy into its parent, which it makes writable the same way.
+ *
+ * @param i The node's offset.
+ * @return uint64_t i if it is fresh, or the copy's offset.
+ */
+template <class Key, class Value, class Compare>
+uint64_t mappedBST<Key, Value, Compare>::writable(uint64_t i) {
+	if (is_fresh(i)) {
+		return i;
+	}
+	Node copy = node(i);
+	uint64_t j = allocate();
+	node(j) = copy;
+	free_node(i);
+	return j;
+}
+
+/**
+ * @brief Makes each node on the path to a key writable, top down, linking every copy to its parent.
+ *
+ * @param i The subtree.
+ * @param key The key, which is in the subtree.
+ * @param found Set to the writable node holding the key.
+ * @return uint64_t The new root of the subtree.
+ */
+template <class Key, class Value, class Compare>
+uint64_t mappedBST<Key, Value, Compare>::own_path(uint64_t i, const Key &key, uint64_t &found) {
+	i = writable(i);
+	if (comp(key, node(i).data)) {
+		uint64_t left = own_path(node(i).left, key, found);
+		node(i).left = left;
+	}
+	else if (comp(node(i).data, key)) {
+		uint64_t right = own_path(node(i).right, key, found);
+		node(i).right = right;
+	}
+	else {
+		found = i;
+	}
+	return i;
+}
+
+/**
+ * @brief Finds the value, and makes its node writable.
+ *
+ * The parent of a fresh node is fresh too, since linking the node wrote its parent, so only a
+ * node of the current commit needs the path copied.
+ *
+ * @param key The key to find.
+ * @return Value* The value, or nullptr.
+ */
+template <class Key, class Value, class Compare>
+Value* mappedBST<Key, Value, Compare>::searchValue(const Key &key) {
+	uint64_t i = Core::lookup(*this, live.root, key);
+	if (i == NIL) {
+		return nullptr;
+	}
+	mark_dirty();
+	if (!is_fresh(i)) {
+		uint64_t root = own_path(live.root, key, i);
+		live.root = root;
+	}
+	return &node(i).value;
+}
+
+/**
+ * @brief Commits the empty tree, then shrinks the file.
+ *
+ * The empty commit reaches no node, so it needs no msync of the nodes, and once it is on disk the
+ * file can lose them all.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::clear() {
+	live.root = NIL;
+	live.freeList = NIL;
+	live.count = 0;
+	live.used = AVL_HEAP_FIRST;
+	fresh.clear();
+	retired.clear();
+	if (!commit()) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+	header().clean = 1;
+	if (msync(base, sizeof(avl_heap_header), MS_SYNC) != 0) {
+		throw runtime_error("mappedBST: cannot write " + path);
+	}
+	if (mapped > AVL_HEAP_MIN_BYTES) {
+		resize(AVL_HEAP_MIN_BYTES);
+	}
+}
+
+/**
+ * @brief Grows the file to a multiple of AVL_HEAP_MIN_BYTES that holds n nodes after the header.
+ *
+ * @param n The number of keys.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void mappedBST<Key, Value, Compare>::reserve(size_t n) {
+	size_t bytes = AVL_HEAP_FIRST + n * sizeof(Node);
+	bytes = (bytes + AVL_HEAP_MIN_BYTES - 1) / AVL_HEAP_MIN_BYTES * AVL_HEAP_MIN_BYTES;
+	if (bytes > mapped) {
+		resize(bytes);
+	}
+}
+
+/**
+ * @brief Reports the memory held.
+ *
+ * @return avl_memory_usage The report.
+ */
+template <class Key, class Value, class Compare>
+avl_memory_usage mappedBST<Key, Value, Compare>::memory_usage() const {
+	size_t count = (size_t)live.count;
+	size_t held = mapped + sizeof(*this);
+	avl_memory_usage usage = {count, count * sizeof(Node), held - count * sizeof(Node), 1};
+	return usage;
+}
+
+/* --- End of MAPPED TREE IMPLEMENTATION --- */
+
+#endif // AVLMAPPED_H
@@ -0,0 +1,403 @@
+/**
+ * @file AVLpool.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains the avl_node_pool allocator.
+ * The pool carves tree nodes out of large contiguous slabs and keeps a free list
+ * of deleted nodes, so a tree does one system allocation per slab instead of one
+ * per key. Pass it as the Alloc parameter of any tree in AVLtrees.h:
+ * 
+ *     avl_map<uint64_t, uint64_t, less<uint64_t>, avl_node_pool<uint64_t> > tree;
+ * 
+ * @version 0.1
+ * @date 2024-04-14
+ * 
+ * @copyright MIT LICENSE (c) 2024
+ * 
+ */
+
+#ifndef AVLPOOL_H
+#define AVLPOOL_H
+
+/* --- IMPORTS --- */
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- SLAB ARENA CLASS --- */
+/**
+ * @brief This class owns the slabs and the free list behind an avl_node_pool.
+ * All the copies and rebinds of one pool share a single arena. Every slot has the
+ * same size, which is fixed by the first allocation. The arena is not thread-safe,
+ * just like the trees that use it.
+ */
+class avl_slab_arena {
+
+private:
+	// a free slot is reused to hold the link to the next free slot
+	struct FreeSlot {
+		FreeSlot * next;
+	};
+
+	// one contiguous slab taken from the system
+	struct Slab {
+		char * memory;		// start of the mapping or allocation
+		size_t bytes;		// size of the mapping or allocation
+		bool mapped;		// true if the slab came from mmap
+	};
+
+	size_t slabBytes;		// requested size of each slab
+	bool hugePages;			// back the slabs with transparent huge pages
+	size_t slotBytes;		// size of one slot, 0 until the first allocation
+	char * cursor;			// next unused byte in the newest slab
+	char * limit;			// end of the newest slab
+	FreeSlot * freeList;	// slots returned by deallocate
+	vector<Slab> slabs;		// every slab taken so far
+	size_t inUse;			// slots currently handed out
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Takes a new slab from the system and makes it the bump region.
+	 * 
+	 * @return void
+	 */
+	void grow ();
+
+	/**
+	 * @brief Returns every slab to the system.
+	 * 
+	 * @return void
+	 */
+	void free_slabs ();
+
+	/* --- End of Helper Functions --- */
+
+public:
+	// 2 MiB, the size of a transparent huge page on x86-64
+	static const size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+	// constructor
+	explicit avl_slab_arena (size_t slab_bytes, bool huge_pages)
+		: slabBytes(slab_bytes), hugePages(huge_pages), slotBytes(0),
+		  cursor(nullptr), limit(nullptr), freeList(nullptr), inUse(0) {};
+
+	// destructor
+	~avl_slab_arena () {free_slabs();};
+
+	avl_slab_arena (const avl_slab_arena &) = delete;
+	avl_slab_arena & operator= (const avl_slab_arena &) = delete;
+
+	/**
+	 * @brief Hands out one slot of the given size and alignment.
+	 * 
+	 * @param bytes: (size_t) the object size
+	 * @param align: (size_t) the object alignment
+	 * 
+	 * @return void*: the slot, or nullptr if the size does not match this arena's slots
+	 */
+	void * allocate (size_t bytes, size_t align);
+
+	/**
+	 * @brief Checks whether an object of the given size and alignment is served from the slots.
+	 * Always false before the first allocation fixes the slot size.
+	 * 
+	 * @param bytes: (size_t) the object size
+	 * @param align: (size_t) the object alignment
+	 * 
+	 * @return bool
+	 */
+	bool fits (size_t bytes, size_t align) const {return slotBytes != 0 && bytes <= slotBytes && slotBytes % align == 0 && align <= alignof(max_align_t);};
+
+	/**
+	 * @brief Puts a slot back on the free list.
+	 * 
+	 * @param slot: (void*) a slot returned by allocate
+	 * 
+	 * @return void
+	 */
+	void deallocate (void *slot) {FreeSlot *free = static_cast<FreeSlot*>(slot); free->next = freeList; freeList = free; inUse--;};
+
+	/**
+	 * @brief Drops every slot at once in O(number of slabs).
+	 * Objects still living in the slots are not destroyed.
+	 * 
+	 * @return void
+	 */
+	void release () {free_slabs(); cursor = limit = nullptr; freeList = nullptr; inUse = 0;};
+
+	/**
+	 * @brief Finds the number of slabs taken from the system so far.
+	 * 
+	 * @return size_t
+	 */
+	size_t slab_count () const {return slabs.size();};
+
+	/**
+	 * @brief Finds the number of bytes reserved from the system.
+	 * 
+	 * @return size_t
+	 */
+	size_t bytes_reserved () const;
+
+	/**
+	 * @brief Finds the number of slots currently handed out.
+	 * 
+	 * @return size_t
+	 */
+	size_t slots_in_use () const {return inUse;};
+};
+/* --- End of SLAB ARENA CLASS --- */
+
+/* --- NODE POOL ALLOCATOR CLASS --- */
+/**
+ * @brief A standard allocator that serves single-object allocations from an avl_slab_arena.
+ * Copies and rebinds share the arena, so the tree's rebound node allocator and the
+ * allocator returned by get_allocator() see the same slabs and statistics.
+ * Array allocations fall back to the global operator new.
+ */
+template <class T>
+class avl_node_pool {
+
+	template <class U> friend class avl_node_pool;
+
+private:
+	shared_ptr<avl_slab_arena> arena;	// slabs shared by every copy
+
+public:
+	typedef T value_type;
+
+	// 1 MiB slabs, or one huge page per slab when huge_pages is set
+	static const size_t DEFAULT_SLAB_BYTES = size_t(1) << 20;
+
+	// constructor
+	explicit avl_node_pool (size_t slab_bytes = DEFAULT_SLAB_BYTES, bool huge_pages = false)
+		: arena(make_shared<avl_slab_arena>(slab_bytes, huge_pages)) {};
+
+	// rebinding constructor, shares the arena of the other pool
+	template <class U>
+	avl_node_pool (const avl_node_pool<U> &other) : arena(other.arena) {};
+
+	/**
+	 * @brief Allocates n objects. Single objects come from the arena.
+	 * 
+	 * @param n: (size_t) the number of objects
+	 * 
+	 * @return T*
+	 */
+	T * allocate (size_t n);
+
+	/**
+	 * @brief Frees n objects allocated by allocate.
+	 * 
+	 * @param p: (T*) the objects
+	 * @param n: (size_t) the number of objects
+	 * 
+	 * @return void
+	 */
+	void deallocate (T *p, size_t n);
+
+	/**
+	 * @brief Drops every slot in O(number of slabs), if no other pool shares the arena.
+	 * Objects still living in the slots are not destroyed, so callers must only use this
+	 * for trivially destructible objects.
+	 * 
+	 * @return true if the slots were dropped, false if the arena is shared
+	 */
+	bool release () {if (arena.use_count() != 1) {return false;} arena->release(); return true;};
+
+	/**
+	 * @brief Gives read access to the shared arena, for its statistics.
+	 * 
+	 * @return const avl_slab_arena&
+	 */
+	const avl_slab_arena & stats () const {return *arena;};
+
+	template <class U>
+	bool operator== (const avl_node_pool<U> &other) const {return arena == other.arena;};
+
+	template <class U>
+	bool operator!= (const avl_node_pool<U> &other) const {return arena != other.arena;};
+};
+/* --- End of NODE POOL ALLOCATOR CLASS --- */
+
+/* --- SLAB ARENA IMPLEMENTATION --- */
+
+/**
+ * @brief Takes a new slab from the system and makes it the bump region.
+ * 
+ * With huge pages enabled the slab is rounded up to a whole number of 2 MiB pages, mapped
+ * with mmap, trimmed so that it starts on a 2 MiB boundary, and marked with
+ * MADV_HUGEPAGE. Otherwise, or if mmap fails, the slab comes from the global operator new.
+ * 
+ * @return void
+ */
+inline void avl_slab_arena::grow() {
+	Slab slab;
+	slab.bytes = slabBytes < slotBytes ? slotBytes : slabBytes;
+	slab.mapped = false;
+	slab.memory = nullptr;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (hugePages) {
+		// Round up to whole huge pages and over-map so the slab can be aligned.
+		size_t bytes = (slab.bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+		size_t mapped = bytes + HUGE_PAGE_BYTES;
+		void *raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (raw != MAP_FAILED) {
+			// Trim the unaligned head and the unused tail.
+			char *start = static_cast<char*>(raw);
+			char *aligned = reinterpret_cast<char*>((reinterpret_cast<size_t>(start) + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES);
+			if (aligned > start) {
+				munmap(start, aligned - start);
+			}
+			if (start + mapped > aligned + bytes) {
+				munmap(aligned + bytes, start + mapped - (aligned + bytes));
+			}
+
+			madvise(aligned, bytes, MADV_HUGEPAGE);
+			slab.memory = aligned;
+			slab.bytes = bytes;
+			slab.mapped = true;
+		}
+	}
+#endif
+
+	if (slab.memory == nullptr) {
+		slab.memory = static_cast<char*>(::operator new(slab.bytes));
+	}
+
+	slabs.push_back(slab);
+	cursor = slab.memory;
+	limit = slab.memory + slab.bytes / slotBytes * slotBytes;
+}
+
+/**
+ * @brief Returns every slab to the system.
+ * 
+ * @return void
+ */
+inline void avl_slab_arena::free_slabs() {
+	for (size_t i = 0; i < slabs.size(); i++) {
+#ifdef __linux__
+		if (slabs[i].mapped) {
+			munmap(slabs[i].memory, slabs[i].bytes);
+			continue;
+		}
+#endif
+		::operator delete(slabs[i].memory);
+	}
+	slabs.clear();
+}
+
+/**
+ * @brief Hands out one slot.
+ * 
+ * The first call fixes the slot size: the object size rounded up to its alignment, and at
+ * least large enough to hold a free-list link. Later calls take the most recently freed
+ * slot if there is one, and otherwise bump the cursor through the newest slab, taking a new
+ * slab when it runs out. A call with a larger size or a stricter alignment than the slots
+ * returns nullptr so the caller can fall back to the heap.
+ * 
+ * @param bytes The object size.
+ * @param align The object alignment.
+ * @return void* The slot, or nullptr.
+ */
+inline void * avl_slab_arena::allocate(size_t bytes, size_t align) {
+	// Fix the slot size on first use.
+	if (slotBytes == 0) {
+		size_t slot = bytes < sizeof(FreeSlot) ? sizeof(FreeSlot) : bytes;
+		slotBytes = (slot + align - 1) / align * align;
+	}
+
+	// Only objects that fit the slots are pooled.
+	if (!fits(bytes, align)) {
+		return nullptr;
+	}
+
+	inUse++;
+
+	// Reuse a freed slot first.
+	if (freeList != nullptr) {
+		FreeSlot *slot = freeList;
+		freeList = slot->next;
+		return slot;
+	}
+
+	// Otherwise bump through the newest slab.
+	if (cursor == limit) {
+		grow();
+	}
+	void *slot = cursor;
+	cursor += slotBytes;
+	return slot;
+}
+
+/**
+ * @brief Finds the number of bytes reserved from the system.
+ * 
+ * @return size_t
+ */
+inline size_t avl_slab_arena::bytes_reserved() const {
+	size_t bytes = 0;
+	for (size_t i = 0; i < slabs.size(); i++) {
+		bytes += slabs[i].bytes;
+	}
+	return bytes;
+}
+
+/* --- End of SLAB ARENA IMPLEMENTATION --- */
+
+/* --- NODE POOL ALLOCATOR IMPLEMENTATION --- */
+
+/**
+ * @brief Allocates n objects.
+ * 
+ * Single objects come from the shared arena. Arrays, and objects the arena cannot hold,
+ * come from the global operator new.
+ * 
+ * @param n The number of objects.
+ * @return T* The objects.
+ */
+template <class T>
+T * avl_node_pool<T>::allocate(size_t n) {
+	if (n == 1) {
+		void *slot = arena->allocate(sizeof(T), alignof(T));
+		if (slot != nullptr) {
+			return static_cast<T*>(slot);
+		}
+	}
+	return static_cast<T*>(::operator new(n * sizeof(T)));
+}
+
+/**
+ * @brief Frees n objects.
+ * 
+ * This mirrors allocate: a single object that fits the arena's slots goes back on the free
+ * list, anything else goes back to the global operator delete.
+ * 
+ * @param p The objects.
+ * @param n The number of objects.
+ * @return void
+ */
+template <class T>
+void avl_node_pool<T>::deallocate(T *p, size_t n) {
+	if (n == 1 && arena->fits(sizeof(T), alignof(T))) {
+		arena->deallocate(p);
+		return;
+	}
+	::operator delete(p);
+}
+
+/* --- End of NODE POOL ALLOCATOR IMPLEMENTATION --- */
+
+#endif // AVLPOOL_H
@@ -0,0 +1,631 @@
+/**
+ * @file AVLsharded.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains shardedBST, a front-end that spreads keys over several
+ * independent balancedBST shards, each behind its own lock. Threads that update
+ * different shards never wait for each other. Shards split the key space into
+ * ranges, which keeps ordered queries cheap, or by hash when order is not needed:
+ *
+ *     avl_sharded_map<uint64_t, uint64_t> prices(8);   // 8 shards
+ *     prices.insertNode(7, 100);                       // from any thread
+ *
+ *     avl_sharded_map<uint64_t, uint64_t>::scan all(prices);
+ *     for (auto entry : all) {...}                     // ascending keys, all shards merged
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLSHARDED_H
+#define AVLSHARDED_H
+
+/* --- IMPORTS --- */
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- SHARDED TREE CLASS --- */
+/**
+ * @brief How a shardedBST assigns keys to shards.
+ */
+enum avl_shard_mode {
+	AVL_SHARD_BY_RANGE,		// each shard holds one key range; boundaries move as the shards grow
+	AVL_SHARD_BY_HASH		// a key goes to shard hash(key) % shards; needs hash<Key>
+};
+
+/**
+ * @brief Fewest keys a range-sharded tree must hold before its boundaries are moved.
+ * Until then every key stays in the first shard.
+ */
+static const size_t AVL_SHARD_MIN_SPLIT = 4096;
+
+/**
+ * @brief This class partitions the keys over a fixed number of balancedBST shards.
+ * Every operation on one key locks only the shard that holds it. Scans lock every
+ * shard, in index order, and merge the shards with a k-way heap (in range mode the
+ * shards are already in order and are read one after another).
+ *
+ * In range mode shard i holds the keys in [bounds[i - 1], bounds[i]). When a shard
+ * grows past twice the average, all shards are locked, joined into one tree and split
+ * again into equal parts, which costs O(shards * log n). Hash mode never moves keys.
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key>,
+	avl_shard_mode Mode = AVL_SHARD_BY_RANGE>
+class shardedBST {
+
+public:
+	typedef balancedBST<Key, Value, Compare, Alloc> tree_type;
+
+private:
+	// one shard, padded so that two shards' locks do not share a cache line
+	struct Shard {
+		mutex lock;				// guards tree
+		tree_type tree;			// the keys of this shard
+		atomic<size_t> count;	// tree.treeNodeCount(), readable without the lock
+		char pad[64];
+
+		Shard (const Compare &compare, const Alloc &alloc) : tree(compare, alloc), count(0) {};
+	};
+
+	// the range boundaries, never changed once published
+	struct Layout {
+		vector<Key> bounds;		// shards - 1 keys, ascending; empty before the first split
+	};
+
+	vector<unique_ptr<Shard> > shards;		// the shards, in key order for range mode
+	Compare comp;							// key ordering
+	Alloc alloc;							// allocator for new trees
+	atomic<Layout*> layout;					// the current boundaries
+	vector<unique_ptr<Layout> > layouts;	// every layout ever published
+	atomic<size_t> limit;					// a shard larger than this triggers a balance check
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Finds the shard a key belongs to under a layout.
+	 *
+	 * @param key: (Key) the key
+	 * @param l: (Layout*) the boundaries (unused in hash mode)
+	 * @return size_t: the shard index
+	 */
+	size_t shard_of (const Key &key, const Layout *l) const
+		{return shard_of(key, l, integral_constant<bool, Mode == AVL_SHARD_BY_HASH>());};
+	size_t shard_of (const Key &key, const Layout *l, false_type) const;
+	size_t shard_of (const Key &key, const Layout *, true_type) const {return hash<Key>()(key) % shards.size();};
+
+	/**
+	 * @brief Locks the shard that holds a key.
+	 * In range mode the boundaries may move between finding the shard and locking it, so
+	 * the layout is checked again once the lock is held, and the search retried if it changed.
+	 *
+	 * @param key: (Key) the key
+	 * @param index: (size_t&) set to the shard index
+	 * @return unique_lock<mutex>: the held lock of the shard
+	 */
+	unique_lock<mutex> lock_shard (const Key &key, size_t &index) const;
+
+	/**
+	 * @brief Locks every shard, in index order.
+	 *
+	 * @return vector<unique_lock<mutex>>: the held locks
+	 */
+	vector<unique_lock<mutex> > lock_all () const;
+
+	/**
+	 * @brief Checks the shard sizes and moves the boundaries if one shard holds more
+	 * than twice the average. Called after an insert makes a shard larger than limit.
+	 *
+	 * @return void
+	 */
+	void rebalance ();
+
+	/* --- End of Helper Functions --- */
+
+public:
+	/**
+	 * @brief Construct a new shardedBST object.
+	 *
+	 * @param shardCount: (size_t) the number of shards; 0 means one per hardware thread
+	 * @param compare: (Compare) the key ordering
+	 * @param alloc: (Alloc) the allocator for every shard
+	 */
+	explicit shardedBST (size_t shardCount = 0, const Compare &compare = Compare(), const Alloc &alloc = Alloc());
+
+	shardedBST (const shardedBST &) = delete;
+	shardedBST& operator= (const shardedBST &) = delete;
+
+	/**
+	 * @brief Inserts a key into its shard.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 * @return bool: true if inserted, false if the key was already present
+	 */
+	bool insertNode (const Key &key, const Value &value = Value());
+
+	/**
+	 * @brief Deletes a key from its shard.
+	 *
+	 * @param key: (Key) the key to delete
+	 * @return bool: true if deleted, false if the key was missing
+	 */
+	bool deleteNode (const Key &key);
+
+	/**
+	 * @brief Checks whether a key is present.
+	 *
+	 * @param key: (Key) the key to look for
+	 * @return bool: true if the key is present
+	 */
+	bool searchItem (const Key &key) const {size_t i; unique_lock<mutex> guard = lock_shard(key, i); return shards[i]->tree.searchItem(key);};
+
+	/**
+	 * @brief Copies the value mapped to a key (maps only).
+	 *
+	 * @param key: (Key) the key to look for
+	 * @param value: (Value&) receives the value if the key is present
+	 * @return bool: true if the key is present
+	 */
+	bool get (const Key &key, Value &value) const;
+
+	/**
+	 * @brief Get the number of keys in all shards. Without outside synchronization the
+	 * result is only a snapshot of each shard at a slightly different time.
+	 *
+	 * @return size_t: the number of keys
+	 */
+	size_t treeNodeCount () const;
+
+	/**
+	 * @brief Get the number of shards.
+	 *
+	 * @return size_t: the shard count
+	 */
+	size_t shard_count () const {return shards.size();};
+
+	/**
+	 * @brief Get the number of keys in one shard.
+	 *
+	 * @param index: (size_t) the shard
+	 * @return size_t: the number of keys
+	 */
+	size_t shard_size (size_t index) const {return shards[index]->count.load(memory_order_relaxed);};
+
+	/**
+	 * @brief Removes every key from every shard.
+	 *
+	 * @return void
+	 */
+	void clear ();
+
+	/**
+	 * @brief An ordered scan over every shard, optionally limited to [lo, hi).
+	 * The scan holds every shard lock from construction to destruction, so it sees one
+	 * consistent state and blocks writers while it lives. Its iterator merges the shards'
+	 * in-order iterators with a binary heap of at most one entry per shard, or in range
+	 * mode just walks the shards in order.
+	 */
+	class scan {
+
+	private:
+		typedef typename tree_type::const_iterator shard_iterator;
+
+		// the remaining range of one shard
+		struct Cursor {
+			shard_iterator at;
+			shard_iterator end;
+		};
+
+		const shardedBST * tree;
+		vector<unique_lock<mutex> > locks;	// every shard, held for the whole scan
+		vector<Cursor> cursors;				// one per non-empty shard
+		vector<size_t> heap;				// cursors ordered by current key, smallest first
+		bool bounded;						// stop at hi
+		Key hi;								// exclusive upper bound if bounded
+
+		// heap order: the cursor with the smaller key wins, so compare reversed
+		struct Later {
+			const scan * owner;
+			bool operator() (size_t a, size_t b) const
+				{return owner->tree->comp(owner->cursors[b].at.key(), owner->cursors[a].at.key());};
+		};
+
+		/**
+		 * @brief Starts a cursor in every shard at the first key >= lo (or the first key).
+		 *
+		 * @param lo: (Key*) the inclusive lower bound, nullptr for none
+		 * @return void
+		 */
+		void open (const Key *lo);
+
+		/**
+		 * @brief Puts the cursor just stepped (the last heap entry) back into the heap, or
+		 * drops it if it ran off its shard or past hi.
+		 *
+		 * @return void
+		 */
+		void settle ();
+
+	public:
+		/**
+		 * @brief Forward iterator over the merged keys; the end iterator has no scan.
+		 */
+		class iterator {
+
+		private:
+			scan * owner;
+
+		public:
+			typedef typename shard_iterator::value_type value_type;
+			typedef typename shard_iterator::reference reference;
+			typedef typename shard_iterator::pointer pointer;
+			typedef ptrdiff_t difference_type;
+			typedef input_iterator_tag iterator_category;
+
+			explicit iterator (scan *s = nullptr) : owner(s != nullptr && s->heap.empty() ? nullptr : s) {};
+
+			reference operator* () const {return *owner->cursors[owner->heap.front()].at;};
+			pointer operator-> () const {return owner->cursors[owner->heap.front()].at.operator->();};
+
+			/**
+			 * @brief The key of the current element, for sets and maps alike.
+			 *
+			 * @return const Key&
+			 */
+			const Key & key () const {return owner->cursors[owner->heap.front()].at.key();};
+
+			iterator & operator++ () {if (!owner->advance()) owner = nullptr; return *this;};
+
+			bool operator== (const iterator &other) const {return owner == other.owner;};
+			bool operator!= (const iterator &other) const {return owner != other.owner;};
+		};
+
+		/**
+		 * @brief Locks every shard and starts a scan over all keys.
+		 *
+		 * @param t: (shardedBST&) the tree to scan
+		 */
+		explicit scan (const shardedBST &t) : tree(&t), locks(t.lock_all()), bounded(false), hi() {open(nullptr);};
+
+		/**
+		 * @brief Locks every shard and starts a scan over the keys in [lo, hi).
+		 *
+		 * @param t: (shardedBST&) the tree to scan
+		 * @param lo: (Key) the inclusive lower bound
+		 * @param hi: (Key) the exclusive upper bound
+		 */
+		scan (const shardedBST &t, const Key &lo, const Key &hi) : tree(&t), locks(t.lock_all()), bounded(true), hi(hi) {open(&lo);};
+
+		scan (const scan &) = delete;
+		scan& operator= (const scan &) = delete;
+
+		/**
+		 * @brief Moves to the next key. The scan can be walked only once.
+		 *
+		 * @return bool: false once every key has been visited
+		 */
+		bool advance ();
+
+		iterator begin () {return iterator(this);};
+		iterator end () {return iterator();};
+	};
+};
+
+/**
+ * @brief Shorthands for sharded maps and sets.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key>, avl_shard_mode Mode = AVL_SHARD_BY_RANGE>
+using avl_sharded_map = shardedBST<Key, Value, Compare, Alloc, Mode>;
+
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key>, avl_shard_mode Mode = AVL_SHARD_BY_RANGE>
+using avl_sharded_set = shardedBST<Key, avl_no_value, Compare, Alloc, Mode>;
+/* --- End of SHARDED TREE CLASS --- */
+
+/* --- SHARDED TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Construct a new shardedBST object with empty shards and no boundaries.
+ *
+ * @param shardCount The number of shards, 0 for one per hardware thread.
+ * @param compare The key ordering.
+ * @param alloc The allocator for every shard.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+shardedBST<Key, Value, Compare, Alloc, Mode>::shardedBST(size_t shardCount, const Compare &compare, const Alloc &alloc)
+	: comp(compare), alloc(alloc), layout(nullptr), limit(AVL_SHARD_MIN_SPLIT) {
+	if (shardCount == 0) {
+		shardCount = thread::hardware_concurrency();
+	}
+	if (shardCount == 0) {
+		shardCount = 1;
+	}
+
+	for (size_t i = 0; i < shardCount; i++) {
+		shards.push_back(unique_ptr<Shard>(new Shard(comp, alloc)));
+	}
+	layouts.push_back(unique_ptr<Layout>(new Layout()));
+	layout.store(layouts.back().get());
+}
+
+/**
+ * @brief Finds the range shard of a key: the number of boundaries not greater than it.
+ *
+ * @param key The key.
+ * @param l The boundaries.
+ * @return size_t The shard index.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+size_t shardedBST<Key, Value, Compare, Alloc, Mode>::shard_of(const Key &key, const Layout *l, false_type) const {
+	return upper_bound(l->bounds.begin(), l->bounds.end(), key, comp) - l->bounds.begin();
+}
+
+/**
+ * @brief Locks the shard that holds a key.
+ *
+ * Boundaries only change while every shard lock is held, so once the lock of the shard that the
+ * current layout names is held and the layout is still current, the key cannot move away. Old
+ * layouts are kept until the tree is destroyed, since a thread may still be searching one.
+ *
+ * @param key The key.
+ * @param index Set to the shard index.
+ * @return unique_lock<mutex> The held lock.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+unique_lock<mutex> shardedBST<Key, Value, Compare, Alloc, Mode>::lock_shard(const Key &key, size_t &index) const {
+	for (;;) {
+		Layout *seen = layout.load(memory_order_acquire);
+		index = shard_of(key, seen);
+		unique_lock<mutex> guard(shards[index]->lock);
+		if (Mode == AVL_SHARD_BY_HASH || layout.load(memory_order_acquire) == seen) {
+			return guard;
+		}
+	}
+}
+
+/**
+ * @brief Locks every shard, in index order.
+ *
+ * @return vector<unique_lock<mutex>> The held locks.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+auto shardedBST<Key, Value, Compare, Alloc, Mode>::lock_all() const -> vector<unique_lock<mutex> > {
+	vector<unique_lock<mutex> > locks;
+	locks.reserve(shards.size());
+	for (size_t i = 0; i < shards.size(); i++) {
+		locks.push_back(unique_lock<mutex>(shards[i]->lock));
+	}
+	return locks;
+}
+
+/**
+ * @brief Moves the boundaries so that every shard holds the same number of keys.
+ *
+ * Range shards hold consecutive key ranges, so all of them join into one tree in O(shards * log n),
+ * and that tree splits back at every (total / shards)-th key in the same time. No node is copied.
+ * Afterwards limit is set to twice the new average, so a tree that grows evenly is only checked
+ * each time it doubles.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+void shardedBST<Key, Value, Compare, Alloc, Mode>::rebalance() {
+	vector<unique_lock<mutex> > locks = lock_all();
+
+	size_t total = 0, largest = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		total += shards[i]->count.load(memory_order_relaxed);
+		largest = max(largest, shards[i]->count.load(memory_order_relaxed));
+	}
+	size_t shardCount = shards.size();
+	limit.store(max(AVL_SHARD_MIN_SPLIT, 2 * total / shardCount));
+
+	// Another thread may have balanced the shards already.
+	if (total < AVL_SHARD_MIN_SPLIT || shardCount == 1 || largest <= 2 * total / shardCount) {
+		return;
+	}
+
+	// Join every shard, in key order, into one tree.
+	tree_type all(comp, alloc);
+	for (size_t i = 0; i < shardCount; i++) {
+		all.join(shards[i]->tree);
+	}
+
+	// Cut it back into equal parts.
+	unique_ptr<Layout> next(new Layout());
+	for (size_t i = 0; i + 1 < shardCount; i++) {
+		size_t left = all.treeNodeCount();
+		Key bound = all.select(left / (shardCount - i)).key();
+
+		tree_type rest(comp, alloc);
+		all.split(bound, shards[i]->tree, rest);
+		all.join(rest);
+		shards[i]->count.store(shards[i]->tree.treeNodeCount(), memory_order_relaxed);
+		next->bounds.push_back(bound);
+	}
+	shards[shardCount - 1]->tree.join(all);
+	shards[shardCount - 1]->count.store(shards[shardCount - 1]->tree.treeNodeCount(), memory_order_relaxed);
+
+	layouts.push_back(move(next));
+	layout.store(layouts.back().get(), memory_order_release);
+}
+
+/**
+ * @brief Inserts a key into its shard, and checks the balance if the shard got too large.
+ *
+ * @param key The key.
+ * @param value The value.
+ * @return bool True if inserted, false if the key was already present.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+bool shardedBST<Key, Value, Compare, Alloc, Mode>::insertNode(const Key &key, const Value &value) {
+	size_t i, count;
+	{
+		unique_lock<mutex> guard = lock_shard(key, i);
+		tree_type &tree = shards[i]->tree;
+		count = tree.treeNodeCount();
+		tree.insertNode(key, value);
+		if (tree.treeNodeCount() == count) {
+			return false;
+		}
+		shards[i]->count.store(++count, memory_order_relaxed);
+	}
+
+	if (Mode == AVL_SHARD_BY_RANGE && count > limit.load(memory_order_relaxed)) {
+		rebalance();
+	}
+	return true;
+}
+
+/**
+ * @brief Deletes a key from its shard.
+ *
+ * @param key The key.
+ * @return bool True if deleted, false if the key was missing.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+bool shardedBST<Key, Value, Compare, Alloc, Mode>::deleteNode(const Key &key) {
+	size_t i;
+	unique_lock<mutex> guard = lock_shard(key, i);
+	tree_type &tree = shards[i]->tree;
+	size_t count = tree.treeNodeCount();
+	tree.deleteNode(key);
+	if (tree.treeNodeCount() == count) {
+		return false;
+	}
+	shards[i]->count.store(count - 1, memory_order_relaxed);
+	return true;
+}
+
+/**
+ * @brief Copies the value mapped to a key.
+ *
+ * @param key The key.
+ * @param value Receives the value if the key is present.
+ * @return bool True if the key is present.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+bool shardedBST<Key, Value, Compare, Alloc, Mode>::get(const Key &key, Value &value) const {
+	size_t i;
+	unique_lock<mutex> guard = lock_shard(key, i);
+	const Value *found = shards[i]->tree.searchValue(key);
+	if (found != nullptr) {
+		value = *found;
+	}
+	return found != nullptr;
+}
+
+/**
+ * @brief Adds up the shard sizes.
+ *
+ * @return size_t The number of keys.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+size_t shardedBST<Key, Value, Compare, Alloc, Mode>::treeNodeCount() const {
+	size_t total = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		total += shards[i]->count.load(memory_order_relaxed);
+	}
+	return total;
+}
+
+/**
+ * @brief Removes every key. The boundaries are kept.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+void shardedBST<Key, Value, Compare, Alloc, Mode>::clear() {
+	vector<unique_lock<mutex> > locks = lock_all();
+	for (size_t i = 0; i < shards.size(); i++) {
+		shards[i]->tree.clear();
+		shards[i]->count.store(0, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Starts a cursor in every shard and heaps them by their first key.
+ *
+ * @param lo The inclusive lower bound, or nullptr.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+void shardedBST<Key, Value, Compare, Alloc, Mode>::scan::open(const Key *lo) {
+	for (size_t i = 0; i < tree->shards.size(); i++) {
+		const tree_type &shard = tree->shards[i]->tree;
+		Cursor cursor = {lo == nullptr ? shard.begin() : shard.lower_bound(*lo), shard.end()};
+		if (cursor.at != cursor.end && !(bounded && !tree->comp(cursor.at.key(), hi))) {
+			cursors.push_back(cursor);
+			heap.push_back(cursors.size() - 1);
+		}
+	}
+
+	// Range shards are already in key order, so their cursors are simply used one after another.
+	if (Mode == AVL_SHARD_BY_HASH) {
+		Later later = {this};
+		make_heap(heap.begin(), heap.end(), later);
+	}
+}
+
+/**
+ * @brief Puts the cursor just stepped back into the heap, or drops it.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+void shardedBST<Key, Value, Compare, Alloc, Mode>::scan::settle() {
+	Later later = {this};
+	Cursor &cursor = cursors[heap.back()];
+	if (cursor.at == cursor.end || (bounded && !tree->comp(cursor.at.key(), hi))) {
+		heap.pop_back();
+	}
+	else {
+		push_heap(heap.begin(), heap.end(), later);
+	}
+}
+
+/**
+ * @brief Steps the cursor with the smallest key and restores the heap.
+ *
+ * @return bool False once every key has been visited.
+ */
+template <class Key, class Value, class Compare, class Alloc, avl_shard_mode Mode>
+bool shardedBST<Key, Value, Compare, Alloc, Mode>::scan::advance() {
+	if (heap.empty()) {
+		return false;
+	}
+
+	if (Mode == AVL_SHARD_BY_RANGE) {
+		Cursor &cursor = cursors[heap.front()];
+		++cursor.at;
+		if (cursor.at == cursor.end || (bounded && !tree->comp(cursor.at.key(), hi))) {
+			heap.erase(heap.begin());
+		}
+		return !heap.empty();
+	}
+
+	// Move the smallest cursor to the back, step it, and push it back if it still has keys.
+	Later later = {this};
+	pop_heap(heap.begin(), heap.end(), later);
+	++cursors[heap.back()].at;
+	settle();
+	return !heap.empty();
+}
+
+/* --- End of SHARDED TREE IMPLEMENTATION --- */
+
+#endif // AVLSHARDED_H
@@ -0,0 +1,368 @@
+/**
+ * @file AVLtasks.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains the avl_task_pool work-stealing thread pool.
+ * The pool runs fork-join parallelism: fork_join(f, g) runs f on the calling thread
+ * while g waits in the caller's queue, where an idle thread can steal it. Pass it to
+ * the parallel set operations of balancedBST in AVLtrees.h:
+ *
+ *     avl_task_pool pool(8);
+ *     a.union_with(b, pool);
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLTASKS_H
+#define AVLTASKS_H
+
+/* --- IMPORTS --- */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- TASK POOL CLASS --- */
+/**
+ * @brief This class is a fork-join thread pool with one task queue per thread.
+ * A thread pushes and pops tasks at the back of its own queue and steals from the
+ * front of the others, so stolen tasks are the oldest and usually the largest. A
+ * pool of n threads starts n - 1 workers; the thread that calls fork_join is the
+ * n-th. Threads that are not workers of the pool share one extra queue.
+ * Tasks must not throw.
+ */
+class avl_task_pool {
+
+private:
+	// a forked task, owned by the stack frame of the fork_join that pushed it
+	struct Task {
+		atomic<bool> done;		// set once run() has returned
+
+		Task () : done(false) {};
+		virtual ~Task () {};
+		virtual void run () = 0;
+	};
+
+	template <class Fn>
+	struct TaskOf : Task {
+		Fn &fn;
+
+		explicit TaskOf (Fn &f) : fn(f) {};
+		void run () {fn();};
+	};
+
+	// one thread's queue
+	struct Queue {
+		mutex lock;
+		deque<Task*> tasks;
+	};
+
+	// the pool and queue the current thread works for
+	struct Slot {
+		const avl_task_pool * pool;
+		size_t index;
+	};
+
+	vector<unique_ptr<Queue> > queues;	// one per worker, then the shared external queue
+	vector<thread> workers;				// the n - 1 background threads
+	atomic<bool> stopping;				// set by the destructor
+	atomic<size_t> queued;				// tasks waiting in any queue
+	mutex sleepLock;					// guards the wait on wake
+	condition_variable wake;			// idle workers sleep here
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Gets the slot of the current thread, which is only set on workers.
+	 *
+	 * @return Slot&: the thread's slot
+	 */
+	static Slot& current () {static thread_local Slot slot = {nullptr, 0}; return slot;};
+
+	/**
+	 * @brief Gets the index of the current thread's queue in this pool.
+	 *
+	 * @return size_t: the worker's own queue, or the shared queue for other threads
+	 */
+	size_t own_queue () const {return current().pool == this ? current().index : queues.size() - 1;};
+
+	/**
+	 * @brief Pushes a task at the back of a queue and wakes an idle worker.
+	 *
+	 * @param index: (size_t) the queue
+	 * @param task: (Task*) the task
+	 * @return void
+	 */
+	void push (size_t index, Task *task);
+
+	/**
+	 * @brief Pops a task from the back of a queue, but only if it is the given one.
+	 *
+	 * @param index: (size_t) the queue
+	 * @param task: (Task*) the task expected at the back
+	 * @return bool: true if the task was popped, false if another thread stole it
+	 */
+	bool pop_if (size_t index, Task *task);
+
+	/**
+	 * @brief Runs one task: the newest from the thread's own queue, or else the oldest
+	 * from another queue.
+	 *
+	 * @param index: (size_t) the thread's own queue
+	 * @return bool: true if a task was run
+	 */
+	bool run_one (size_t index);
+
+	/**
+	 * @brief The loop of a background worker.
+	 *
+	 * @param index: (size_t) the worker's queue
+	 * @return void
+	 */
+	void work (size_t index);
+
+	/* --- End of Helper Functions --- */
+
+public:
+	/**
+	 * @brief Construct a new avl_task_pool object and start its workers.
+	 *
+	 * @param threads: (unsigned) threads that run tasks, counting the caller of fork_join;
+	 * 0 means one per hardware thread
+	 */
+	explicit avl_task_pool (unsigned threads = 0);
+
+	/**
+	 * @brief Destroy the avl_task_pool object and join its workers.
+	 * Every fork_join must have returned.
+	 */
+	~avl_task_pool ();
+
+	avl_task_pool (const avl_task_pool &) = delete;
+	avl_task_pool& operator= (const avl_task_pool &) = delete;
+
+	/**
+	 * @brief Get the number of threads that run tasks, counting the caller.
+	 *
+	 * @return unsigned: the thread count
+	 */
+	unsigned thread_count () const {return (unsigned)workers.size() + 1;};
+
+	/**
+	 * @brief Runs f and g, possibly in parallel, and returns when both are done.
+	 * g is queued for stealing while f runs on this thread. If nobody took g, this
+	 * thread runs it too; otherwise it runs other queued tasks until g is done.
+	 *
+	 * @param f: (F) the first function, run on this thread
+	 * @param g: (G) the second function
+	 * @return void
+	 */
+	template <class F, class G>
+	void fork_join (F &&f, G &&g);
+};
+/* --- End of TASK POOL CLASS --- */
+
+/* --- TASK POOL IMPLEMENTATION --- */
+
+/**
+ * @brief Construct a new avl_task_pool object and start its workers.
+ *
+ * @param threads The number of threads, counting the caller of fork_join.
+ */
+inline avl_task_pool::avl_task_pool(unsigned threads) : stopping(false), queued(0) {
+	if (threads == 0) {
+		threads = thread::hardware_concurrency();
+	}
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	// One queue per worker plus the shared queue, all created before any worker starts.
+	for (unsigned i = 0; i < threads; i++) {
+		queues.push_back(unique_ptr<Queue>(new Queue()));
+	}
+	for (unsigned i = 0; i + 1 < threads; i++) {
+		workers.push_back(thread(&avl_task_pool::work, this, (size_t)i));
+	}
+}
+
+/**
+ * @brief Destroy the avl_task_pool object and join its workers.
+ */
+inline avl_task_pool::~avl_task_pool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping.store(true);
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+/**
+ * @brief Pushes a task at the back of a queue and wakes an idle worker.
+ *
+ * @param index The queue.
+ * @param task The task.
+ * @return void
+ */
+inline void avl_task_pool::push(size_t index, Task *task) {
+	{
+		lock_guard<mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+	queued.fetch_add(1);
+
+	// Taking the lock orders this against a worker that is about to sleep.
+	if (!workers.empty()) {
+		{
+			lock_guard<mutex> guard(sleepLock);
+		}
+		wake.notify_one();
+	}
+}
+
+/**
+ * @brief Pops a task from the back of a queue, but only if it is the given one.
+ *
+ * A fork_join pops its own task after f returns. Every fork_join nested inside f has finished
+ * by then and taken its task off this queue, so the task is at the back unless it was stolen.
+ *
+ * @param index The queue.
+ * @param task The task expected at the back.
+ * @return bool True if the task was popped.
+ */
+inline bool avl_task_pool::pop_if(size_t index, Task *task) {
+	lock_guard<mutex> guard(queues[index]->lock);
+	deque<Task*> &tasks = queues[index]->tasks;
+	if (tasks.empty() || tasks.back() != task) {
+		return false;
+	}
+	tasks.pop_back();
+	queued.fetch_sub(1);
+	return true;
+}
+
+/**
+ * @brief Runs one task.
+ *
+ * The thread's own queue is tried first, from the back. Then every other queue is tried from the
+ * front, starting after the thread's own so that the thieves spread out.
+ *
+ * @param index The thread's own queue.
+ * @return bool True if a task was run.
+ */
+inline bool avl_task_pool::run_one(size_t index) {
+	Task *task = nullptr;
+
+	// Newest task from the own queue.
+	{
+		lock_guard<mutex> guard(queues[index]->lock);
+		if (!queues[index]->tasks.empty()) {
+			task = queues[index]->tasks.back();
+			queues[index]->tasks.pop_back();
+		}
+	}
+
+	// Oldest task from another queue.
+	for (size_t i = 1; task == nullptr && i < queues.size(); i++) {
+		Queue &victim = *queues[(index + i) % queues.size()];
+		lock_guard<mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+		}
+	}
+
+	if (task == nullptr) {
+		return false;
+	}
+	queued.fetch_sub(1);
+	task->run();
+	task->done.store(true, memory_order_release);
+	return true;
+}
+
+/**
+ * @brief The loop of a background worker.
+ *
+ * The worker runs tasks while there are any and sleeps on the condition variable otherwise.
+ * The timed wait is only a safety net; push wakes a sleeper directly.
+ *
+ * @param index The worker's queue.
+ * @return void
+ */
+inline void avl_task_pool::work(size_t index) {
+	current().pool = this;
+	current().index = index;
+
+	while (!stopping.load()) {
+		if (run_one(index)) {
+			continue;
+		}
+
+		unique_lock<mutex> lock(sleepLock);
+		wake.wait_for(lock, chrono::milliseconds(10), [this]() {
+			return stopping.load() || queued.load() > 0;
+		});
+	}
+
+	current().pool = nullptr;
+}
+
+/**
+ * @brief Runs f and g, possibly in parallel, and returns when both are done.
+ *
+ * With a single thread there is nobody to steal g, so both run in turn without touching the
+ * queues.
+ *
+ * @param f The first function, run on this thread.
+ * @param g The second function.
+ * @return void
+ */
+template <class F, class G>
+void avl_task_pool::fork_join(F &&f, G &&g) {
+	if (workers.empty()) {
+		f();
+		g();
+		return;
+	}
+
+	size_t index = own_queue();
+	TaskOf<typename remove_reference<G>::type> task(g);
+	push(index, &task);
+
+	f();
+
+	// Nobody took g, so run it here.
+	if (pop_if(index, &task)) {
+		g();
+		return;
+	}
+
+	// g was stolen; help with other tasks until it is done.
+	while (!task.done.load(memory_order_acquire)) {
+		if (!run_one(index)) {
+			this_thread::yield();
+		}
+	}
+}
+
+/* --- End of TASK POOL IMPLEMENTATION --- */
+
+#endif // AVLTASKS_H
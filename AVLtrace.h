@@ -0,0 +1,427 @@
+/**
+ * @file AVLtrace.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains optional update tracing for balancedBST.
+ * avl_trace is a statistics policy (see avl_stats in AVLtrees.h) that records one
+ * avl_event per insert or delete into an avl_event_sink, a fixed-size lock-free ring
+ * buffer. An avl_event_writer drains the sink from a background thread and writes the
+ * events to a file in batches, so the tree never waits for I/O:
+ *
+ *     avl_event_sink<uint64_t> sink;
+ *     avl_event_writer<uint64_t> writer(sink, "trace.txt");
+ *     avl_set<uint64_t, less<uint64_t>, allocator<uint64_t>, avl_trace<uint64_t> > tree;
+ *     tree.set_stats(avl_trace<uint64_t>(&sink));
+ *     tree.insertNode(42);                            // one event, no I/O on this thread
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLTRACE_H
+#define AVLTRACE_H
+
+/* --- IMPORTS --- */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- EVENT SINK CLASS --- */
+/**
+ * @brief One traced update.
+ */
+template <class Key>
+struct avl_event {
+	avl_update op;				// insert or delete
+	Key key;					// the key passed to insertNode or deleteNode
+	unsigned rotations;			// rebalancing cases the update ran (a double rotation counts once)
+	unsigned long long nanos;	// steady_clock time when the update finished, in ns
+};
+
+/**
+ * @brief This class is a bounded multi-producer, multi-consumer ring buffer of events.
+ * Every slot carries a sequence number that tells producers and consumers whose turn it
+ * is, so push and pop each take one compare-and-swap on the shared position and never
+ * block. When the ring is full, push drops the event and counts it instead of waiting.
+ * The key is copied into a preallocated slot, so push allocates nothing as long as
+ * copying a Key does not.
+ */
+template <class Key>
+class avl_event_sink {
+
+private:
+	// one ring entry; sequence == position means free for that push, position + 1 means full
+	struct Slot {
+		atomic<size_t> sequence;
+		avl_event<Key> event;
+	};
+
+	unique_ptr<Slot[]> slots;	// the ring
+	size_t mask;				// capacity - 1; the capacity is a power of two
+	char pad0[64];
+	atomic<size_t> head;		// next position to push
+	char pad1[64];
+	atomic<size_t> tail;		// next position to pop
+	char pad2[64];
+	atomic<size_t> lost;		// events dropped because the ring was full
+
+public:
+	/**
+	 * @brief Construct a new avl_event_sink object.
+	 *
+	 * @param capacity: (size_t) the number of events it can hold, rounded up to a power of two
+	 */
+	explicit avl_event_sink (size_t capacity = 65536);
+
+	avl_event_sink (const avl_event_sink &) = delete;
+	avl_event_sink& operator= (const avl_event_sink &) = delete;
+
+	/**
+	 * @brief Adds an event. Safe to call from any number of threads.
+	 *
+	 * @param event: (avl_event) the event
+	 * @return bool: false if the ring was full and the event was dropped
+	 */
+	bool push (const avl_event<Key> &event);
+
+	/**
+	 * @brief Takes the oldest event.
+	 *
+	 * @param event: (avl_event&) receives the event
+	 * @return bool: false if the ring was empty
+	 */
+	bool pop (avl_event<Key> &event);
+
+	/**
+	 * @brief Takes up to max events, oldest first, appending them to out.
+	 *
+	 * @param out: (vector<avl_event>&) receives the events
+	 * @param max: (size_t) the most events to take
+	 * @return size_t: the number of events taken
+	 */
+	size_t drain (vector<avl_event<Key> > &out, size_t max);
+
+	/**
+	 * @brief Get the number of events dropped so far because the ring was full.
+	 *
+	 * @return size_t
+	 */
+	size_t dropped () const {return lost.load(memory_order_relaxed);};
+
+	/**
+	 * @brief Get the number of events the ring holds.
+	 *
+	 * @return size_t
+	 */
+	size_t capacity () const {return mask + 1;};
+};
+/* --- End of EVENT SINK CLASS --- */
+
+/* --- TRACE POLICY --- */
+/**
+ * @brief A statistics policy for balancedBST that sends one avl_event per insert or delete
+ * to a sink. It counts the rotations of the update in progress and ignores the other
+ * hooks. Without a sink (the default) it records nothing.
+ */
+template <class Key>
+struct avl_trace : avl_no_stats {
+	avl_event_sink<Key> * sink;		// where the events go, or nullptr
+	mutable unsigned rotations;		// rotations of the update in progress
+
+	explicit avl_trace (avl_event_sink<Key> *s = nullptr) : sink(s), rotations(0) {};
+
+	void rotation (avl_rotation) const {rotations++;};
+
+	template <class K>
+	void update_done (avl_update op, const K &key) const {
+		if (sink != nullptr) {
+			avl_event<Key> event = {op, key, rotations,
+				(unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()};
+			sink->push(event);
+		}
+		rotations = 0;
+	};
+};
+/* --- End of TRACE POLICY --- */
+
+/* --- EVENT WRITER CLASS --- */
+/**
+ * @brief This class drains a sink from a background thread and writes the events as text,
+ * one line per event: "nanos insert|delete key rotations". Each batch is formatted into
+ * one buffer and written with a single call. Destroying the writer writes whatever is left.
+ * Key must be printable with operator<<.
+ */
+template <class Key>
+class avl_event_writer {
+
+private:
+	avl_event_sink<Key> & sink;		// the events to write
+	ofstream file;					// the output when constructed with a path
+	ostream * out;					// the output
+	size_t batch;					// most events per write
+	chrono::milliseconds interval;	// sleep between polls when the sink is not full
+	atomic<bool> stopping;			// set by the destructor
+	atomic<size_t> count;			// events written so far
+	mutex sleepLock;				// guards the wait on wake
+	condition_variable wake;		// the destructor wakes the thread here
+	thread worker;					// the draining thread
+
+	/**
+	 * @brief Drains and writes at most one batch.
+	 *
+	 * @param events: (vector<avl_event>&) a reusable buffer
+	 * @return size_t: the number of events written
+	 */
+	size_t write_batch (vector<avl_event<Key> > &events);
+
+	/**
+	 * @brief The loop of the draining thread.
+	 *
+	 * @return void
+	 */
+	void run ();
+
+public:
+	/**
+	 * @brief Starts writing the sink's events to a stream.
+	 *
+	 * @param s: (avl_event_sink&) the sink to drain
+	 * @param output: (ostream&) the stream; it must outlive the writer
+	 * @param batchSize: (size_t) the most events per write
+	 * @param pollMs: (unsigned) how long to sleep when a poll found less than a full batch
+	 */
+	avl_event_writer (avl_event_sink<Key> &s, ostream &output, size_t batchSize = 4096, unsigned pollMs = 10)
+		: sink(s), out(&output), batch(batchSize), interval(pollMs), stopping(false), count(0) {worker = thread(&avl_event_writer::run, this);};
+
+	/**
+	 * @brief Starts writing the sink's events to a file, which is truncated first.
+	 *
+	 * @param s: (avl_event_sink&) the sink to drain
+	 * @param path: (string) the file
+	 * @param batchSize: (size_t) the most events per write
+	 * @param pollMs: (unsigned) how long to sleep when a poll found less than a full batch
+	 */
+	avl_event_writer (avl_event_sink<Key> &s, const string &path, size_t batchSize = 4096, unsigned pollMs = 10)
+		: sink(s), file(path.c_str()), out(&file), batch(batchSize), interval(pollMs), stopping(false), count(0)
+		{worker = thread(&avl_event_writer::run, this);};
+
+	/**
+	 * @brief Stops the thread after writing every event still in the sink.
+	 */
+	~avl_event_writer ();
+
+	avl_event_writer (const avl_event_writer &) = delete;
+	avl_event_writer& operator= (const avl_event_writer &) = delete;
+
+	/**
+	 * @brief Get the number of events written so far.
+	 *
+	 * @return size_t
+	 */
+	size_t written () const {return count.load(memory_order_relaxed);};
+};
+/* --- End of EVENT WRITER CLASS --- */
+
+/* --- EVENT SINK IMPLEMENTATION --- */
+
+/**
+ * @brief Construct a new avl_event_sink object with every slot free.
+ *
+ * @param capacity The number of events, rounded up to a power of two.
+ */
+template <class Key>
+avl_event_sink<Key>::avl_event_sink(size_t capacity) : head(0), tail(0), lost(0) {
+	size_t size = 2;
+	while (size < capacity) {
+		size *= 2;
+	}
+	slots.reset(new Slot[size]);
+	mask = size - 1;
+	for (size_t i = 0; i < size; i++) {
+		slots[i].sequence.store(i, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Adds an event.
+ *
+ * A producer claims a position by moving head forward with a compare-and-swap, but only once the
+ * slot's sequence shows that the consumer has emptied it. A sequence behind the position means the
+ * ring is full. After writing the event, the producer publishes it by setting the sequence to
+ * position + 1.
+ *
+ * @param event The event.
+ * @return bool False if the event was dropped.
+ */
+template <class Key>
+bool avl_event_sink<Key>::push(const avl_event<Key> &event) {
+	size_t pos = head.load(memory_order_relaxed);
+	Slot *slot;
+
+	for (;;) {
+		slot = &slots[pos & mask];
+		size_t sequence = slot->sequence.load(memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			lost.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+		else {
+			pos = head.load(memory_order_relaxed);
+		}
+	}
+
+	slot->event = event;
+	slot->sequence.store(pos + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * @brief Takes the oldest event.
+ *
+ * The mirror image of push: a consumer claims the slot at tail once its sequence is position + 1,
+ * copies the event out, and frees the slot for the push one lap later by setting the sequence to
+ * position + capacity.
+ *
+ * @param event Receives the event.
+ * @return bool False if the ring was empty.
+ */
+template <class Key>
+bool avl_event_sink<Key>::pop(avl_event<Key> &event) {
+	size_t pos = tail.load(memory_order_relaxed);
+	Slot *slot;
+
+	for (;;) {
+		slot = &slots[pos & mask];
+		size_t sequence = slot->sequence.load(memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+
+		if (diff == 0) {
+			if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			return false;
+		}
+		else {
+			pos = tail.load(memory_order_relaxed);
+		}
+	}
+
+	event = slot->event;
+	slot->sequence.store(pos + mask + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * @brief Takes up to max events.
+ *
+ * @param out Receives the events.
+ * @param max The most events to take.
+ * @return size_t The number of events taken.
+ */
+template <class Key>
+size_t avl_event_sink<Key>::drain(vector<avl_event<Key> > &out, size_t max) {
+	size_t taken = 0;
+	avl_event<Key> event;
+	while (taken < max && pop(event)) {
+		out.push_back(event);
+		taken++;
+	}
+	return taken;
+}
+
+/* --- End of EVENT SINK IMPLEMENTATION --- */
+
+/* --- EVENT WRITER IMPLEMENTATION --- */
+
+/**
+ * @brief Stops the thread after writing every event still in the sink.
+ */
+template <class Key>
+avl_event_writer<Key>::~avl_event_writer() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping.store(true);
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+/**
+ * @brief Drains and writes at most one batch.
+ *
+ * @param events A reusable buffer.
+ * @return size_t The number of events written.
+ */
+template <class Key>
+size_t avl_event_writer<Key>::write_batch(vector<avl_event<Key> > &events) {
+	events.clear();
+	size_t taken = sink.drain(events, batch);
+	if (taken == 0) {
+		return 0;
+	}
+
+	ostringstream text;
+	for (size_t i = 0; i < taken; i++) {
+		text << events[i].nanos << (events[i].op == AVL_INSERT ? " insert " : " delete ")
+			 << events[i].key << ' ' << events[i].rotations << '\n';
+	}
+	const string lines = text.str();
+	out->write(lines.data(), lines.size());
+	count.fetch_add(taken, memory_order_relaxed);
+	return taken;
+}
+
+/**
+ * @brief The loop of the draining thread.
+ *
+ * Full batches are written back to back. After a short batch the thread sleeps for the poll
+ * interval, or until the destructor wakes it, and then writes everything left before returning.
+ *
+ * @return void
+ */
+template <class Key>
+void avl_event_writer<Key>::run() {
+	vector<avl_event<Key> > events;
+	events.reserve(batch);
+
+	while (!stopping.load()) {
+		if (write_batch(events) == batch) {
+			continue;
+		}
+
+		unique_lock<mutex> lock(sleepLock);
+		wake.wait_for(lock, interval, [this]() {return stopping.load();});
+	}
+
+	while (write_batch(events) > 0) {}
+	out->flush();
+}
+
+/* --- End of EVENT WRITER IMPLEMENTATION --- */
+
+#endif // AVLTRACE_H
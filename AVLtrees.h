@@ -1,391 +1,2031 @@
 /**
  * @file AVLtrees.h
  * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
- * @brief This file contains the binaryTree, BST, and balancedBST classes.
+ * @brief This file contains the binaryTree, BST, and balancedBST class templates.
  * The binaryTree class is a base class for the BST and balancedBST classes.
  * This header file is used to generate an AVL balanced binary search tree.
- * @version 0.1
+ * The trees are templated on the key type, the mapped value type, the comparator
+ * and the allocator, and are header-only: the member definitions live in AVLtrees.tcc,
+ * which is included at the bottom of this file.
+ * @version 0.2
  * @date 2024-04-14
- * 
+ *
  * @copyright MIT LICENSE (c) 2024
- * 
+ *
  */
 
+#ifndef AVLTREES_H
+#define AVLTREES_H
+
 /* --- IMPORTS --- */
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <limits>
 /* --- End of IMPORTS --- */
 
 /* --- NAMESPACE --- */
 using namespace std;
 /* --- End of NAMESPACE --- */
 
-/* --- TYPEDEF --- */
-typedef char elemType; // "placeholder" for data type	
-/* --- End of TYPEDEF --- */
+/* --- VALUE STORAGE --- */
+/**
+ * @brief Placeholder value type used by sets, which store keys only.
+ */
+struct avl_no_value {};
+
+/**
+ * @brief Holds the mapped value of a tree node.
+ * Tree nodes inherit from this, so the set specialization below takes no space.
+ */
+template <class Value>
+struct avl_value {
+	Value value;		// mapped value
+
+	avl_value () : value() {};
+	explicit avl_value (const Value &v) : value(v) {};
+
+	const Value& mapped () const {return value;};
+};
+
+/**
+ * @brief Sets have no mapped value, so the node carries nothing extra.
+ */
+template <>
+struct avl_value<avl_no_value> {
+	avl_value () {};
+	explicit avl_value (const avl_no_value &) {};
+
+	avl_no_value mapped () const {return avl_no_value();};
+};
+/* --- End of VALUE STORAGE --- */
+
+/* --- ITERATORS --- */
+/**
+ * @brief Longest root-to-node path an AVL tree can have, counted in nodes.
+ * An AVL tree of height h holds at least fib(h + 3) - 1 nodes, so even 2^44 nodes
+ * (more than fit in a 48-bit address space) give a height below 62. Iterators keep
+ * the path in a fixed array of this size, so they never allocate.
+ */
+static const int AVL_MAX_DEPTH = 64;
+
+/**
+ * @brief Smallest pair of subtrees, in total nodes, that the parallel set operations
+ * still split into two tasks. Below it a task costs a few hundred microseconds at
+ * most, so forking it would cost more than it saves.
+ */
+static const size_t AVL_PARALLEL_GRAIN = 16384;
+
+/**
+ * @brief Visiting order of an avl_iterator.
+ */
+enum avl_order {
+	AVL_IN_ORDER,			// ascending keys (bidirectional)
+	AVL_REVERSE_ORDER,		// descending keys (bidirectional)
+	AVL_PRE_ORDER,			// root, left subtree, right subtree (forward)
+	AVL_POST_ORDER			// left subtree, right subtree, root (forward)
+};
+
+/**
+ * @brief Pointer-like wrapper so that it->first works when *it is a pair of references.
+ */
+template <class Ref>
+struct avl_arrow {
+	Ref ref;
+	const Ref * operator-> () const {return &ref;};
+};
+
+/**
+ * @brief What an iterator yields for a map: a pair of references to the node's key and value.
+ */
+template <class Key, class Value, bool Const>
+struct avl_entry {
+	typedef Key key_type;
+	typedef pair<Key, Value> value_type;
+	typedef pair<const Key&, typename conditional<Const, const Value&, Value&>::type> reference;
+	typedef avl_arrow<reference> pointer;
+
+	template <class Node>
+	static reference get (Node *node) {return reference(node->data, node->value);};
+	template <class Node>
+	static pointer arrow (Node *node) {pointer p = {get(node)}; return p;};
+};
+
+/**
+ * @brief What an iterator yields for a set: a const reference to the node's key.
+ */
+template <class Key, bool Const>
+struct avl_entry<Key, avl_no_value, Const> {
+	typedef Key key_type;
+	typedef Key value_type;
+	typedef const Key & reference;
+	typedef const Key * pointer;
+
+	template <class Node>
+	static reference get (Node *node) {return node->data;};
+	template <class Node>
+	static pointer arrow (Node *node) {return &node->data;};
+};
+
+/**
+ * @brief Iterator over the nodes of a tree in one of the avl_order orders.
+ * It stores the path from the root to the current node in a fixed array of
+ * AVL_MAX_DEPTH entries, so stepping never allocates. An empty path is the end.
+ *
+ * @tparam Node: the tree node type
+ * @tparam Entry: an avl_entry that turns a node into what the iterator yields
+ * @tparam Order: the visiting order
+ */
+template <class Node, class Entry, avl_order Order>
+class avl_iterator {
+
+	template <class N, class E, avl_order O> friend class avl_iterator;
+
+private:
+	Node * root;					// root of the tree, for stepping back from the end
+	Node * path[AVL_MAX_DEPTH];		// nodes from the root down to the current node
+	int depth;						// number of nodes on the path, 0 at the end
+
+	/* --- Helper Functions --- */
+
+	void push (Node *node) {assert(depth < AVL_MAX_DEPTH); path[depth++] = node;};
+	Node * pop () {return path[--depth];};
+	Node * top () const {return path[depth - 1];};
+
+	// push the node and its chain of left (or right) children
+	void push_leftmost (Node *node) {for (; node != nullptr; node = node->left) push(node);};
+	void push_rightmost (Node *node) {for (; node != nullptr; node = node->right) push(node);};
+
+	void next_in_order ();
+	void prev_in_order ();
+	void next_pre_order ();
+	void next_post_order ();
+	void push_first_post_order (Node *node);
+
+	/* --- End of Helper Functions --- */
+
+public:
+	typedef typename Entry::value_type value_type;
+	typedef typename Entry::reference reference;
+	typedef typename Entry::pointer pointer;
+	typedef ptrdiff_t difference_type;
+	typedef typename conditional<Order == AVL_IN_ORDER || Order == AVL_REVERSE_ORDER,
+		bidirectional_iterator_tag, forward_iterator_tag>::type iterator_category;
+
+	// constructor, the end iterator of an empty tree
+	avl_iterator () : root(nullptr), depth(0) {};
+
+	/**
+	 * @brief Creates the begin (first is true) or end iterator of the tree.
+	 *
+	 * @param treeRoot: (Node*) the root of the tree
+	 * @param first: (bool) position at the first node instead of the end
+	 */
+	avl_iterator (Node *treeRoot, bool first);
+
+	/**
+	 * @brief Creates an iterator from a root-to-node path.
+	 *
+	 * @param treeRoot: (Node*) the root of the tree
+	 * @param nodes: (Node* const*) the path, starting at the root
+	 * @param count: (int) the number of nodes on the path, 0 for the end
+	 */
+	avl_iterator (Node *treeRoot, Node * const *nodes, int count) : root(treeRoot), depth(count) {
+		for (int i = 0; i < depth; i++) {path[i] = nodes[i];}
+	};
+
+	// converts an iterator into a const_iterator
+	template <class OtherEntry>
+	avl_iterator (const avl_iterator<Node, OtherEntry, Order> &other) : root(other.root), depth(other.depth) {
+		for (int i = 0; i < depth; i++) {path[i] = other.path[i];}
+	};
+
+	reference operator* () const {return Entry::get(top());};
+	pointer operator-> () const {return Entry::arrow(top());};
+
+	/**
+	 * @brief The key of the current node, for sets and maps alike.
+	 *
+	 * @return const Key&
+	 */
+	const typename Entry::key_type & key () const {return top()->data;};
+
+	avl_iterator & operator++ ();
+	avl_iterator & operator-- ();
+	avl_iterator operator++ (int) {avl_iterator old(*this); ++*this; return old;};
+	avl_iterator operator-- (int) {avl_iterator old(*this); --*this; return old;};
+
+	template <class OtherEntry>
+	bool operator== (const avl_iterator<Node, OtherEntry, Order> &other) const
+		{return depth == other.depth && (depth == 0 || top() == other.top());};
+	template <class OtherEntry>
+	bool operator!= (const avl_iterator<Node, OtherEntry, Order> &other) const {return !(*this == other);};
+};
+
+/**
+ * @brief A begin/end pair, so a traversal can be used in a range-based for loop.
+ */
+template <class Iterator>
+class avl_range {
+
+private:
+	Iterator first;
+	Iterator last;
+
+public:
+	avl_range (const Iterator &begin, const Iterator &end) : first(begin), last(end) {};
+
+	Iterator begin () const {return first;};
+	Iterator end () const {return last;};
+};
+
+/**
+ * @brief A level-order traversal: level by level, left to right.
+ * The range owns the queue of the breadth-first walk, kept as a buffer of the nodes in visiting
+ * order. Stepping past a node appends its children, so a whole scan is O(n) and a step O(1)
+ * amortized, at one pointer per node visited. Its iterators are positions in the buffer, so
+ * copies can step on their own; they stay valid while the range lives and the tree is unchanged.
+ *
+ * @tparam Node: the tree node type
+ * @tparam Entry: an avl_entry that turns a node into what the iterator yields
+ */
+template <class Node, class Entry>
+class avl_level_range {
+
+private:
+	mutable vector<Node*> order;	// the nodes in level order, as far as the walk has gone
+	mutable size_t expanded;		// the nodes of order whose children are appended
+
+	// appends the children of the next node not yet expanded; false once every node is
+	bool expand () const {
+		if (expanded == order.size()) {return false;}
+		Node *node = order[expanded++];
+		if (node->left != nullptr) {order.push_back(node->left);}
+		if (node->right != nullptr) {order.push_back(node->right);}
+		return true;
+	};
+
+public:
+	class iterator {
+
+	private:
+		const avl_level_range * range;	// the range whose buffer this walks
+		size_t position;				// index in the buffer, npos at the end
+
+	public:
+		static const size_t npos = (size_t)-1;
+
+		typedef typename Entry::value_type value_type;
+		typedef typename Entry::reference reference;
+		typedef typename Entry::pointer pointer;
+		typedef ptrdiff_t difference_type;
+		typedef forward_iterator_tag iterator_category;
+
+		iterator () : range(nullptr), position(npos) {};
+		iterator (const avl_level_range *r, size_t p) : range(r), position(p) {};
+
+		reference operator* () const {return Entry::get(range->order[position]);};
+		pointer operator-> () const {return Entry::arrow(range->order[position]);};
+		const typename Entry::key_type & key () const {return range->order[position]->data;};
+
+		iterator & operator++ () {
+			position++;
+			while (position >= range->order.size() && range->expand()) {}
+			if (position >= range->order.size()) {position = npos;}
+			return *this;
+		};
+		iterator operator++ (int) {iterator old(*this); ++*this; return old;};
+
+		bool operator== (const iterator &other) const {return position == other.position;};
+		bool operator!= (const iterator &other) const {return position != other.position;};
+	};
+
+	/**
+	 * @brief Starts a walk of the tree with the given root.
+	 *
+	 * @param root: (Node*) the root of the tree, nullptr for an empty one
+	 */
+	explicit avl_level_range (Node *root) : expanded(0) {if (root != nullptr) {order.push_back(root);}};
+
+	iterator begin () const {return order.empty() ? end() : iterator(this, 0);};
+	iterator end () const {return iterator(this, iterator::npos);};
+};
+/* --- End of ITERATORS --- */
+
+/* --- STATISTICS POLICIES --- */
+/**
+ * @brief The rebalancing cases of balancedBST::balanceTree, named after the rotation
+ * functions (R_rotate pivots on the right child, L_rotate on the left).
+ */
+enum avl_rotation {
+	AVL_ROTATE_R,			// R_rotate alone
+	AVL_ROTATE_L,			// L_rotate alone
+	AVL_ROTATE_RL,			// RL_rotate: L_rotate on the right child, then R_rotate
+	AVL_ROTATE_LR,			// LR_rotate: R_rotate on the left child, then L_rotate
+	AVL_ROTATION_KINDS
+};
+
+/**
+ * @brief The kind of update that update_done reports.
+ */
+enum avl_update {
+	AVL_INSERT,
+	AVL_DELETE
+};
+
+/**
+ * @brief The default statistics policy of balancedBST: every hook is an empty inline
+ * function, so the compiler removes the calls and the tree does exactly the work it
+ * would do without them.
+ */
+struct avl_no_stats {
+	void comparison () const {};
+	void rotation (avl_rotation) const {};
+	void allocation () const {};
+	void retrace_step () const {};
+	template <class Key>
+	void update_done (avl_update, const Key &) const {};
+	void search_depth (int) const {};
+};
+
+/**
+ * @brief A statistics policy that counts what balancedBST does on its hot paths:
+ *
+ *     balancedBST<uint64_t, avl_no_value, less<uint64_t>, allocator<uint64_t>, avl_stats> tree;
+ *     ...
+ *     avl_stats s = tree.stats();
+ *     cout << s.comparisons << " comparisons, " << s.mean_search_depth() << " mean depth";
+ *
+ * Comparisons are the key comparisons made while walking the tree. A retrace step is a
+ * node on the way back up from an insert or delete whose subtree height changed below it;
+ * retraces[k] counts the updates that took k steps. depths[d] counts the lookups
+ * (searchItem, searchValue and find) that visited d nodes, hits and misses alike.
+ * Even const lookups update the counters (they are mutable), so a counted tree must not
+ * be read from several threads at once, nor passed to the parallel set operations.
+ */
+struct avl_stats {
+	mutable size_t comparisons;						// key comparisons
+	mutable size_t rotations[AVL_ROTATION_KINDS];	// rebalancing cases, by avl_rotation
+	mutable size_t allocations;						// nodes created
+	mutable size_t updates;							// inserts and deletes
+	mutable size_t retrace_steps;					// retrace steps over all updates
+	mutable size_t retraces[AVL_MAX_DEPTH + 1];		// updates by retrace length
+	mutable size_t searches;						// lookups
+	mutable size_t depths[AVL_MAX_DEPTH + 1];		// lookups by depth reached
+	mutable size_t current;							// retrace steps of the update in progress
+
+	avl_stats () {reset();};
+
+	void comparison () const {comparisons++;};
+	void rotation (avl_rotation kind) const {rotations[kind]++;};
+	void allocation () const {allocations++;};
+	void retrace_step () const {current++;};
+	template <class Key>
+	void update_done (avl_update, const Key &) const
+		{updates++; retrace_steps += current; retraces[min(current, (size_t)AVL_MAX_DEPTH)]++; current = 0;};
+	void search_depth (int depth) const {searches++; depths[min(depth, AVL_MAX_DEPTH)]++;};
+
+	/**
+	 * @brief Sets every counter to zero.
+	 *
+	 * @return void
+	 */
+	void reset () {*this = avl_stats(0);};
+
+	/**
+	 * @brief Get the total number of rotations; a double rotation counts once.
+	 *
+	 * @return size_t
+	 */
+	size_t rotation_count () const
+		{size_t total = 0; for (int i = 0; i < AVL_ROTATION_KINDS; i++) {total += rotations[i];} return total;};
+
+	/**
+	 * @brief Get the mean number of nodes visited per lookup.
+	 *
+	 * @return double: 0 if there were no lookups
+	 */
+	double mean_search_depth () const
+		{double total = 0; for (int d = 0; d <= AVL_MAX_DEPTH; d++) {total += (double)d * depths[d];} return searches == 0 ? 0 : total / searches;};
+
+	/**
+	 * @brief Get the mean retrace length per insert or delete.
+	 *
+	 * @return double: 0 if there were no updates
+	 */
+	double mean_retrace () const {return updates == 0 ? 0 : (double)retrace_steps / updates;};
+
+private:
+	// all zero
+	explicit avl_stats (int) : comparisons(0), rotations(), allocations(0), updates(0), retrace_steps(0),
+		retraces(), searches(0), depths(), current(0) {};
+};
+
+/**
+ * @brief What a tree's memory_usage() reports. Allocator headers are not counted, since
+ * their size depends on the allocator; blocks says how many there are to add them up.
+ */
+struct avl_memory_usage {
+	size_t keys;			// number of keys
+	size_t node_bytes;		// bytes of the nodes that hold keys
+	size_t extra_bytes;		// every other byte held: the tree object, side tables, unused capacity
+	size_t blocks;			// separate heap allocations
+
+	size_t total_bytes () const {return node_bytes + extra_bytes;};
+	double bytes_per_key () const {return keys == 0 ? 0.0 : (double)total_bytes() / keys;};
+};
+/* --- End of STATISTICS POLICIES --- */
+
+/* --- AUGMENTATION POLICIES --- */
+/**
+ * @brief The default augmentation policy of balancedBST: nodes keep no aggregate, so they
+ * are exactly as large as they would be without it.
+ */
+struct avl_no_augment {
+	typedef avl_no_value value_type;
+};
+
+/**
+ * @brief Augmentation policies keep, in every node, the aggregate of the keys and values of
+ * its subtree under a monoid: an associative combine with an identity. A policy defines
+ *
+ *     typedef ... value_type;                                  // the aggregate
+ *     static value_type identity ();                           // combine(identity(), a) == a
+ *     static value_type of (const Key &key, const Value &value);   // one element; sets get avl_no_value
+ *     static value_type combine (const value_type &a, const value_type &b);   // a's keys before b's
+ *
+ * combine need not be commutative; the elements are always combined in key order. The four
+ * below read the mapped value of maps and the key of sets:
+ *
+ *     avl_map<uint64_t, uint64_t, less<uint64_t>, allocator<uint64_t>, avl_no_stats, avl_sum<uint64_t> > prices;
+ *     ...
+ *     uint64_t total = prices.aggregate(100, 200);   // sum of the values of keys in [100, 200)
+ */
+template <class T>
+struct avl_sum {
+	typedef T value_type;
+	static T identity () {return T();};
+	template <class Key>
+	static T of (const Key &key, avl_no_value) {return key;};
+	template <class Key, class Value>
+	static T of (const Key &, const Value &value) {return value;};
+	static T combine (const T &a, const T &b) {return a + b;};
+};
+
+template <class T>
+struct avl_min {
+	typedef T value_type;
+	static T identity () {return numeric_limits<T>::max();};
+	template <class Key>
+	static T of (const Key &key, avl_no_value) {return key;};
+	template <class Key, class Value>
+	static T of (const Key &, const Value &value) {return value;};
+	static T combine (const T &a, const T &b) {return b < a ? b : a;};
+};
+
+template <class T>
+struct avl_max {
+	typedef T value_type;
+	static T identity () {return numeric_limits<T>::lowest();};
+	template <class Key>
+	static T of (const Key &key, avl_no_value) {return key;};
+	template <class Key, class Value>
+	static T of (const Key &, const Value &value) {return value;};
+	static T combine (const T &a, const T &b) {return a < b ? b : a;};
+};
+
+// counts the elements; count_range gives the same answer without keeping a field per node
+struct avl_count {
+	typedef size_t value_type;
+	static size_t identity () {return 0;};
+	template <class Key, class Value>
+	static size_t of (const Key &, const Value &) {return 1;};
+	static size_t combine (size_t a, size_t b) {return a + b;};
+};
+
+/**
+ * @brief Holds the aggregate of a tree node's subtree. Tree nodes inherit from this, so
+ * the avl_no_augment specialization below takes no space and costs nothing to refresh.
+ */
+template <class Augment>
+struct avl_aggregate {
+	typename Augment::value_type aggregate;		// Augment over the subtree rooted here
+
+	template <class Key, class Value>
+	avl_aggregate (const Key &key, const Value &value) : aggregate(Augment::of(key, value)) {};
+
+	// the aggregate of a subtree, identity() when empty
+	template <class Node>
+	static typename Augment::value_type of (const Node *node) {return node == nullptr ? Augment::identity() : node->aggregate;};
+
+	// recomputes a node's aggregate from its children's, in key order
+	template <class Node>
+	static void refresh (Node *node)
+		{node->aggregate = Augment::combine(Augment::combine(of(node->left), Augment::of(node->data, node->mapped())), of(node->right));};
+};
+
+template <>
+struct avl_aggregate<avl_no_augment> {
+	template <class Key, class Value>
+	avl_aggregate (const Key &, const Value &) {};
+
+	template <class Node>
+	static void refresh (Node *) {};
+};
+/* --- End of AUGMENTATION POLICIES --- */
+
+/* --- FROZEN INDEX CLASS --- */
+/**
+ * @brief Asks the CPU to start loading the cache line at an address. It never faults, so the
+ * address may lie past the end of an array. Compilers without the builtin skip the hint.
+ */
+#if defined(__GNUC__)
+#define AVL_PREFETCH(address) __builtin_prefetch((const void *)(address))
+#else
+#define AVL_PREFETCH(address) ((void)0)
+#endif
+
+/**
+ * @brief Format of the image files written by avl_frozen::save. The version goes up whenever
+ * the layout changes, and load refuses files of any other version.
+ */
+static const char AVL_IMAGE_MAGIC[8] = {'A', 'V', 'L', 'I', 'M', 'A', 'G', 'E'};
+static const uint32_t AVL_IMAGE_VERSION = 1;
+static const uint32_t AVL_IMAGE_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief Alignment of the arrays in an image file. It is one cache line, so a mapped index
+ * shares its cache lines exactly as the in-memory one does.
+ */
+static const size_t AVL_IMAGE_ALIGN = 64;
+
+/**
+ * @brief The fixed header at the start of an image file. Every field is in the byte order of
+ * the machine that wrote it; a reader with the other order sees a different byteOrder.
+ * The arrays follow at the given offsets, each with count + 1 entries (none if count is 0).
+ */
+struct avl_image_header {
+	char magic[8];				// AVL_IMAGE_MAGIC
+	uint32_t version;			// AVL_IMAGE_VERSION
+	uint32_t byteOrder;			// AVL_IMAGE_BYTE_ORDER as written
+	uint32_t keyBytes;			// sizeof(Key)
+	uint32_t valueBytes;		// sizeof(Value), or 0 for sets
+	uint64_t count;				// number of keys
+	uint64_t keyOffset;			// file offset of the key array
+	uint64_t valueOffset;		// file offset of the value array, or 0 for sets
+	uint64_t fileBytes;			// size of the whole file
+	uint64_t payloadChecksum;	// avl_checksum of the key array, then of the value array
+	uint64_t headerChecksum;	// avl_checksum of every field above
+};
+
+/**
+ * @brief A read-only view of a whole file. On POSIX systems the file is mapped with mmap,
+ * so a page is read from disk, or taken from the page cache, only when it is first touched.
+ * Elsewhere the file is read into memory. Throws runtime_error if the file cannot be read.
+ */
+class avl_image {
+
+private:
+	const char *bytes;		// the first byte of the file
+	size_t length;			// size of the file
+	bool mapped;			// true if bytes came from mmap
+
+public:
+	explicit avl_image (const string &path);
+	~avl_image ();
+	avl_image (const avl_image &) = delete;
+	avl_image& operator= (const avl_image &) = delete;
+
+	const char* data () const {return bytes;};
+	size_t size () const {return length;};
+};
+
+/**
+ * @brief A checkpoint being written by a child process, returned by
+ * balancedBST::checkpoint_async. fork() gives the child a copy-on-write snapshot of the
+ * whole process, so it writes the tree as it was at the fork while the parent goes on
+ * updating it; a page is copied only when one side writes to it. The child reports the
+ * bytes it wrote and the pages that were copied meanwhile, and exits. The destructor waits
+ * for it, so a checkpoint that goes out of scope is never left half-written.
+ */
+class avl_checkpoint {
+
+private:
+	template <class, class, class, class, class, class> friend class balancedBST;
+
+	int child;				// process id of the writer, or -1 once it has been reaped
+	int channel;			// read end of the pipe the writer reports through, or -1
+	bool succeeded;			// whether the image was written, synced and renamed into place
+	uint64_t bytes;			// size of the image
+	uint64_t pages;			// pages copied while the writer ran
+	double elapsed;			// seconds the writer took
+
+	/**
+	 * @brief Collects the writer's exit status and report once it has exited.
+	 *
+	 * @param block: (bool) whether to wait for it to exit
+	 */
+	void reap (bool block);
+
+public:
+	// a checkpoint that has finished without writing anything
+	avl_checkpoint () : child(-1), channel(-1), succeeded(false), bytes(0), pages(0), elapsed(0) {};
+	~avl_checkpoint () {reap(true);};
+
+	avl_checkpoint (const avl_checkpoint &) = delete;
+	avl_checkpoint& operator= (const avl_checkpoint &) = delete;
+	avl_checkpoint (avl_checkpoint &&other);
+	avl_checkpoint& operator= (avl_checkpoint &&other);
+
+	/**
+	 * @brief Checks, without waiting, whether the writer has finished.
+	 *
+	 * @return bool
+	 */
+	bool done () {reap(false); return child < 0;};
+
+	/**
+	 * @brief Waits for the writer to finish.
+	 *
+	 * @return bool: true if the image was written
+	 */
+	bool wait () {reap(true); return succeeded;};
+
+	/**
+	 * @brief Get the outcome and the writer's report, once done() is true: whether the image
+	 * is on disk, its size, how many pages fork had to copy while it was written (Linux only,
+	 * otherwise 0) and how long the writer took.
+	 *
+	 * @return bool, uint64_t or double
+	 */
+	bool ok () const {return succeeded;};
+	uint64_t bytes_written () const {return bytes;};
+	uint64_t pages_copied () const {return pages;};
+	double seconds () const {return elapsed;};
+};
+
+/**
+ * @brief This class is an immutable, pointer-free copy of a balancedBST, made by
+ * balancedBST::freeze(), for trees that are built once and then only searched.
+ * The keys sit in one array in Eytzinger (breadth-first) order: the root at index 1 and
+ * the children of index k at 2k and 2k + 1. A search is the same root-to-leaf walk as in
+ * the tree, but the next index is computed from the comparison instead of branched on,
+ * the top levels share a few cache lines, and the grandchildren several levels down are
+ * prefetched while the current level is compared. Positions in sorted order are mapped
+ * to and from array indices arithmetically, so lower_bound and rank need no extra array.
+ * Having no pointers, the arrays can be written to a file by save() and used in place by
+ * load(), which maps the file instead of reading it: no key is parsed or copied, so a loaded
+ * index answers its first query after a few page faults rather than after n inserts.
+ *
+ * @tparam Key: the key type, which must be copyable (trivially copyable for save and load)
+ * @tparam Value: the mapped value type (avl_no_value for sets)
+ * @tparam Compare: strict weak ordering on keys
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key> >
+class avl_frozen {
+
+private:
+	template <class, class, class, class, class, class> friend class balancedBST;
+
+	vector<Key> keys;		// Eytzinger order from index 1; keys[0] is a copy of the smallest key
+	vector<Value> values;	// the mapped values in the same order (empty for sets)
+	shared_ptr<const avl_image> image;	// the file a loaded index lives in, or null
+	const Key *imageKeys;	// the key array inside the image
+	const Value *imageValues;	// the value array inside the image (null for sets)
+	Compare comp;			// key ordering
+	size_t count;			// number of keys
+	int levels;				// number of levels of the implicit tree
+	size_t lastLevel;		// number of keys on the bottom level
+
+	/**
+	 * @brief Prepares the arrays for n keys; balancedBST::freeze then fills them.
+	 *
+	 * @param n: (size_t) the number of keys
+	 * @param smallest: (Key) the smallest key, used to fill the unused slot 0
+	 */
+	void reset (size_t n, const Key &smallest);
+
+	/**
+	 * @brief Sets count, levels and lastLevel for n keys.
+	 *
+	 * @param n: (size_t) the number of keys
+	 */
+	void shape (size_t n);
+
+	/**
+	 * @brief Get the arrays the index reads: its own, or the ones inside the image.
+	 *
+	 * @return const Key* or const Value*
+	 */
+	const Key* key_data () const {return image ? imageKeys : keys.data();};
+	const Value* value_data () const {return image ? imageValues : values.data();};
+
+	/**
+	 * @brief Fills in the header of an image of n keys: the format fields, the offsets and
+	 * the file size. The checksums are left 0 for image_checksums.
+	 *
+	 * @param n: (size_t) the number of keys
+	 * @return avl_image_header
+	 */
+	static avl_image_header image_header (size_t n);
+
+	/**
+	 * @brief Computes the payload checksum from the arrays, then the header checksum.
+	 *
+	 * @param header: (avl_image_header&) the header from image_header
+	 * @param keys: (const Key*) the key array, header.count + 1 entries
+	 * @param values: (const Value*) the value array, or nullptr for sets
+	 */
+	static void image_checksums (avl_image_header &header, const Key *keys, const Value *values);
+
+	/**
+	 * @brief Finds the array index of the first key >= key, or > key if Upper is set.
+	 *
+	 * @param key: (Key) the key to bound
+	 * @return size_t: the index, or 0 if there is no such key
+	 */
+	template <bool Upper>
+	size_t search (const Key &key) const;
+
+	/**
+	 * @brief Converts between positions in sorted order and array indices.
+	 *
+	 * @return size_t
+	 */
+	size_t position (size_t index) const;
+	size_t index (size_t position) const;
+
+public:
+	// an empty index
+	explicit avl_frozen (const Compare &compare = Compare())
+		: imageKeys(nullptr), imageValues(nullptr), comp(compare), count(0), levels(0), lastLevel(0) {};
+
+	/**
+	 * @brief Get the number of keys.
+	 *
+	 * @return size_t
+	 */
+	size_t size () const {return count;};
+	bool empty () const {return count == 0;};
+
+	/**
+	 * @brief Checks whether a key is in the index, in O(log n).
+	 *
+	 * @param key: (Key) the key to find
+	 * @return bool
+	 */
+	bool contains (const Key &key) const {size_t k = search<false>(key); return k != 0 && !comp(key, key_data()[k]);};
+
+	/**
+	 * @brief Finds the value mapped to a key (maps only).
+	 *
+	 * @param key: (Key) the key to find
+	 * @return const Value*: the value, or nullptr if the key is not in the index
+	 */
+	const Value* find (const Key &key) const
+		{size_t k = search<false>(key); return k != 0 && !comp(key, key_data()[k]) ? &value_data()[k] : nullptr;};
+
+	/**
+	 * @brief Finds the position, in sorted order, of the first key >= key, or > key for
+	 * upper_bound. Both return size() if there is no such key.
+	 *
+	 * @param key: (Key) the key to bound
+	 * @return size_t: a position for key_at and value_at
+	 */
+	size_t lower_bound (const Key &key) const {return position(search<false>(key));};
+	size_t upper_bound (const Key &key) const {return position(search<true>(key));};
+
+	/**
+	 * @brief Counts the keys that are less than the given key, in O(log n).
+	 * This is the same number as lower_bound(key).
+	 *
+	 * @param key: (Key) the key to rank
+	 * @return size_t
+	 */
+	size_t rank (const Key &key) const {return lower_bound(key);};
+
+	/**
+	 * @brief Get the key, or the value, at a position in sorted order, in O(1).
+	 *
+	 * @param position: (size_t) the 0-based position, less than size()
+	 * @return const Key& or const Value&
+	 */
+	const Key& key_at (size_t position) const {return key_data()[index(position)];};
+	const Value& value_at (size_t position) const {return value_data()[index(position)];};
+
+	/**
+	 * @brief Checks whether the index is served from a file mapped by load().
+	 *
+	 * @return bool
+	 */
+	bool mapped () const {return image != nullptr;};
+
+	/**
+	 * @brief Writes the index to a file as a versioned, checksummed image: a header and the
+	 * arrays exactly as they are in memory. The image is written to path + ".tmp", synced,
+	 * renamed over path and the directory synced, so neither a reader nor a crash sees half a
+	 * file. Throws runtime_error on failure.
+	 *
+	 * @param path: (string) the file to write
+	 */
+	void save (const string &path) const;
+
+	/**
+	 * @brief Opens an image written by save() and serves queries from it in place, in O(1)
+	 * apart from the checksum. The header is always checked; with verify the whole payload
+	 * is checksummed too, which reads the file once. Without it, startup costs a few page
+	 * faults and later queries fault in the pages they touch. The index keeps the file
+	 * mapped until the last copy of it is destroyed. Throws runtime_error if the file cannot
+	 * be read or is not an image of this Key and Value.
+	 *
+	 * @param path: (string) the file to open
+	 * @param verify: (bool) whether to checksum the keys and values
+	 * @param compare: (Compare) the ordering the image was saved with
+	 * @return avl_frozen
+	 */
+	static avl_frozen load (const string &path, bool verify = true, const Compare &compare = Compare());
+};
+/* --- End of FROZEN INDEX CLASS --- */
 
 /* --- BINARY TREE CLASS --- */
 /**
  * @brief This class generates a binary tree with insert, display, and traversal functions.
+ *
+ * @tparam Key: the key type, ordered by Compare
+ * @tparam Value: the mapped value type (avl_no_value for sets)
+ * @tparam Compare: strict weak ordering on keys
+ * @tparam Alloc: allocator, rebound to the node type
+ * @tparam Augment: augmentation policy, avl_no_augment (none) or a monoid such as avl_sum whose
+ * aggregate every node keeps for its subtree
  */
-class binaryTree { 
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key>, class Augment = avl_no_augment>
+class binaryTree {
+
+protected:
+	// binary tree node
+	struct TreeNode : avl_value<Value>, avl_aggregate<Augment> {
+		Key data; 			// store data
+		TreeNode * left; 	// link to left subtree
+		TreeNode * right;	// link to right subtree
+		int height;			// cached height of the subtree rooted here (leaf = 0)
+		size_t size;		// cached number of nodes in the subtree rooted here
+
+		TreeNode (const Key &key, const Value &value)
+			: avl_value<Value>(value), avl_aggregate<Augment>(key, value), data(key), left(nullptr), right(nullptr),
+			height(0), size(1) {};
+	};
+
+	// allocator rebound to the node type
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<TreeNode> NodeAlloc;
+	typedef allocator_traits<NodeAlloc> NodeAllocTraits;
+
+	Compare comp;			// key ordering
+	NodeAlloc nodeAlloc;	// node allocator
+
+
+private:
+	/* --- Helper Functions --- */
+	/**
+	 * @brief Inserts an element into the tree according to the binary search tree rules.
+	 * 
+	 * @param key: (Key) the element to be inserted
+	 * @param value: (Value) the value mapped to the key
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return TreeNode*: the root of the tree
+	 */
+	TreeNode * insertItem (const Key &key, const Value &value, TreeNode *root);
+
+	/**
+	 * @brief Deletes an element from the tree according to the binary search tree rules.
+	 * 
+	 * @param key: (Key) the element to be deleted
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return TreeNode*: the root of the tree
+	 */
+	TreeNode * deleteItem (const Key &key, TreeNode *root);
+
+	/**
+	 * @brief Finds the size of the tree.
+	 * In other words, finds the number of the nodes in the tree.
+	 * Reads the cached size, so this is O(1).
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return size_t
+	 */
+	size_t size (TreeNode *root) const {return root == nullptr ? 0 : root->size;};
+
+	/**
+	 * @brief Finds the height of the tree.
+	 * Reads the cached height, so this is O(1).
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return int
+	 */
+	int height (TreeNode *root) const {return root == nullptr ? -1 : root->height;};
+
+	/**
+	 * @brief Displays the tree in a tree-like structure.
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * @param int: the layer of the tree
+	 * 
+	 * @return void
+	 * 
+	 */
+	void display (TreeNode *root, int layer) const;
+
+	/* --- End of Helper Functions --- */
+
+	/* --- Traversal Helper Functions --- */
+
+	/**
+	 * @brief Traverses the tree in pre-order.
+	 * Visit the root, then the left subtree, and finally the right subtree.
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return void
+	 * 
+	 */
+	void pre_order (TreeNode *root) const;
+
+	/**
+	 * @brief Traverses the tree in in-order.
+	 * Visit the left subtree, then the root, and finally the right subtree.
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return void
+	 * 
+	 */
+	void in_order (TreeNode *root) const;
+
+	/**
+	 * @brief Traverses the tree in post-order.
+	 * Visit the left subtree, then the right subtree, and finally the root.
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return void
+	 * 
+	 */
+	void post_order (TreeNode *root) const;
+
+	/**
+	 * @brief Traverses the tree in level-order.
+	 * Visit the nodes level by level from left to right.
+	 * 
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return void
+	 * 
+	 */
+	void level_order (TreeNode *root) const;
+
+	/* --- End of Traversal Helper Functions --- */
+
+protected:
+	/**
+	 * @brief Recomputes the cached height, size and aggregate of a node from its children.
+	 * The children's cached values must already be up to date.
+	 * 
+	 * @param node: (TreeNode*) the node to update
+	 * 
+	 * @return void
+	 */
+	void update_node (TreeNode *node) const;
+
+	/**
+	 * @brief Allocates and constructs a new leaf node through the node allocator.
+	 * 
+	 * @param key: (Key) the key of the node
+	 * @param value: (Value) the value mapped to the key
+	 * 
+	 * @return TreeNode*: the new node
+	 */
+	TreeNode * create_node (const Key &key, const Value &value);
+
+	/**
+	 * @brief Destroys a single node and returns its memory to the node allocator.
+	 * 
+	 * @param node: (TreeNode*) the node to free
+	 * 
+	 * @return void
+	 */
+	void destroy_node (TreeNode *node);
+
+	/**
+	 * @brief Destroys every node of a subtree.
+	 * 
+	 * @param TreeNode*: the root of the subtree
+	 * 
+	 * @return void
+	 */
+	void destroy_tree (TreeNode *root);
+
+	/**
+	 * @brief Frees every node in bulk through the allocator's release(), when it has one.
+	 * Only used when the nodes are trivially destructible.
+	 * 
+	 * @return true if the allocator dropped all the nodes at once
+	 */
+	template <class A>
+	static auto release_nodes (A &alloc, int) -> decltype(alloc.release()) {return alloc.release();};
+	template <class A>
+	static bool release_nodes (A &, long) {return false;};
+
+	/**
+	 * @brief Key equivalence under the comparator.
+	 * 
+	 * @return true if neither key orders before the other
+	 */
+	bool equal (const Key &a, const Key &b) const {return !comp(a, b) && !comp(b, a);};
+
+public:
+	typedef Key key_type;		// type of the keys
+	typedef Value mapped_type;	// type of the mapped values (avl_no_value for sets)
+
+	// element type of the tree: the key for sets, a key-value pair for maps
+	typedef typename conditional<is_same<Value, avl_no_value>::value, Key, pair<Key, Value> >::type value_type;
+
+	// constructor
+	explicit binaryTree (const Compare &compare = Compare(), const Alloc &alloc = Alloc())
+		: comp(compare), nodeAlloc(alloc) {root = nullptr;};
+
+	// destructor
+	~binaryTree () {clear();};
+
+	// the tree owns its nodes, so it is move-only
+	binaryTree (const binaryTree &) = delete;
+	binaryTree & operator= (const binaryTree &) = delete;
+	binaryTree (binaryTree &&other)
+		: comp(other.comp), nodeAlloc(other.nodeAlloc) {root = other.root; other.root = nullptr;};
+
+	TreeNode * root;		// root of the tree
+
+	/**
+	 * @brief Removes every node from the tree.
+	 * With an allocator that can drop all its nodes at once (such as avl_node_pool) and
+	 * trivially destructible keys and values, this is O(1) in the number of nodes.
+	 * 
+	 * @return void
+	 */
+	void clear ();
+
+	/**
+	 * @brief Returns a copy of the allocator the tree was built with.
+	 * 
+	 * @return Alloc
+	 */
+	Alloc get_allocator () const {return Alloc(nodeAlloc);};
+
+	/**
+	 * @brief Inserts an element into the tree according to the binary search tree rules.
+	 * This is a wrapper function for the private insertItem function.
+	 * 
+	 * @param key: (Key) the element to be inserted
+	 * @param value: (Value) the value mapped to the key
+	 * 
+	 * @return void
+	 * 
+	 */
+	void insertItem (const Key &key, const Value &value = Value()) {root = insertItem(key, value, root);};
+
+	/**
+	 * @brief Deletes an element from the tree according to the binary search tree rules.
+	 * This is a wrapper function for the private deleteItem function.
+	 * 
+	 * @param key: (Key) the element to be deleted
+	 * 
+	 * @return void
+	 * 
+	 */
+	void deleteItem (const Key &key) {root = deleteItem(key, root);};
+
+	/**
+	 * @brief Finds the number of nodes in the tree.
+	 * This is a wrapper function for the private size function.
+	 * 
+	 * @return size_t
+	 */
+	size_t treeNodeCount() const {return size(root);};
+
+	/**
+	 * @brief Finds the height of the tree.
+	 * This is a wrapper function for the private height function.
+	 * 
+	 * @return int
+	 */
+	int height() const {return height(root);};
+
+	/**
+	 * @brief Finds the height of the tree.
+	 * This is a wrapper function for the private height function.
+	 * 
+	 * @return int
+	 */
+	int node_height(TreeNode *node) const {return height(node);};
+
+	/**
+	 * @brief Finds the number of nodes in a subtree.
+	 * This is a wrapper function for the private size function.
+	 * 
+	 * @return size_t
+	 */
+	size_t node_size(TreeNode *node) const {return size(node);};
+
+	/**
+	 * @brief Displays the tree in a tree-like structure.
+	 * This is a wrapper function for the private display function.
+	 * 
+	 */
+	void display() const {display(root, 0);};
+
+	/* --- Traversal Functions --- */
+
+	/**
+	 * @brief Traverses the tree in pre-order.
+	 * This is a wrapper function for the private pre_order function.
+	 * 
+	 */
+	void pre_order_Traversal() const {pre_order(root); cout << endl;};
+
+	/**
+	 * @brief Traverses the tree in in-order.
+	 * This is a wrapper function for the private in_order function.
+	 * 
+	 */
+	void in_order_Traversal() const {in_order(root); cout << endl;};
+
+	/**
+	 * @brief Traverses the tree in post-order.
+	 * This is a wrapper function for the private post_order function.
+	 * 
+	 */
+	void post_orderTraversal() const {post_order(root); cout << endl;};
+
+	/**
+	 * @brief Traverses the tree in level-order.
+	 * This is a wrapper function for the private level_order function.
+	 * 
+	 */
+	void level_order_Traversal() const {level_order(root); cout << endl;};
+	/* --- End of Traversal Functions --- */
+};
+
+/* --- BINARY SEARCH TREE (BST) CLASS --- */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key>, class Augment = avl_no_augment>
+class BST : public binaryTree<Key, Value, Compare, Alloc, Augment> {
+
+protected:
+	typedef binaryTree<Key, Value, Compare, Alloc, Augment> Base;
+	using typename Base::TreeNode;
+	using Base::comp;
+
+public:
+	using Base::root;
+	using Base::Base;
+
+private:
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Searches for an element in the tree.
+	 * This is a helper function for the searchItem function.
+	 * 
+	 * @param key: (Key) the element to be searched
+	 * @param TreeNode*: the root of the tree
+	 * 
+	 * @return TreeNode*: the node holding the key, or nullptr
+	 */
+  	TreeNode * search (const Key &key, TreeNode *root) const;
+
+	/* --- End of Helper Functions --- */
+
+public:
+
+	/**
+	 * @brief Searches for an element in the tree.
+	 * This is a wrapper function for the private search function.
+	 * 
+	 * @param key
+	 * @return true
+	 * @return false
+	 */
+  	bool searchItem (const Key &key) const {return search(key, root) != nullptr;};
+
+	/**
+	 * @brief Looks up the value mapped to a key.
+	 * 
+	 * @param key: (Key) the element to be searched
+	 * 
+	 * @return Value*: the mapped value, or nullptr if the key is not in the tree
+	 */
+	Value * searchValue (const Key &key) {TreeNode *node = search(key, root); return node == nullptr ? nullptr : &node->value;};
+
+	/**
+	 * @brief Inserts an element into the tree according to the binary search tree rules.
+	 * 
+	 * @param key: (Key) the element to be inserted
+	 * @param value: (Value) the value mapped to the key
+	 * 
+	 */
+  	void insertItem (const Key &key, const Value &value = Value()) {Base::insertItem(key, value);};
+
+	/**
+	 * @brief Deletes an element from the tree according to the binary search tree rules.
+	 * 
+	 * @param key: (Key) the element to be deleted
+	 * 
+	 */
+	void deleteItem (const Key &key) {Base::deleteItem(key);};
+};
+/* --- End of BINARY SEARCH TREE (BST) CLASS --- */
+
+/* --- AVL BALANCED BINARY SEARCH TREE (balancedBST) CLASS --- */
+/**
+ * @brief This class is the AVL tree. The first four parameters, and Augment, are those of binaryTree.
+ *
+ * @tparam Stats: statistics policy, avl_no_stats (no cost) or avl_stats (counts). It is a
+ * private base rather than a member, so the empty avl_no_stats does not make the tree larger.
+ * @tparam Augment: augmentation policy; with one, aggregate(lo, hi) combines a key range in
+ * O(log n), and every node refreshes its aggregate in O(1) wherever it refreshes its height
+ */
+template <class Key, class Value = avl_no_value, class Compare = less<Key>, class Alloc = allocator<Key>, class Stats = avl_no_stats,
+	class Augment = avl_no_augment>
+class balancedBST : public BST<Key, Value, Compare, Alloc, Augment>, private Stats {
+
+protected:
+	typedef BST<Key, Value, Compare, Alloc, Augment> Base;
+	typedef binaryTree<Key, Value, Compare, Alloc, Augment> Tree;
+	using typename Base::TreeNode;
+	using Base::comp;
+
+	// the statistics policy; its hooks are const so that lookups can report too
+	const Stats& counters () const {return *this;};
+
+public:
+	using Base::root;
+	using typename Base::value_type;
+
+	// iterators, see avl_iterator
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, false>, AVL_IN_ORDER> iterator;
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, true>, AVL_IN_ORDER> const_iterator;
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, false>, AVL_REVERSE_ORDER> reverse_iterator;
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, true>, AVL_REVERSE_ORDER> const_reverse_iterator;
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, true>, AVL_PRE_ORDER> pre_order_iterator;
+	typedef avl_iterator<TreeNode, avl_entry<Key, Value, true>, AVL_POST_ORDER> post_order_iterator;
+	typedef avl_level_range<TreeNode, avl_entry<Key, Value, true> > level_order_range_type;
+	typedef typename level_order_range_type::iterator level_order_iterator;
+
+	// constructor
+	explicit balancedBST (const Compare &compare = Compare(), const Alloc &alloc = Alloc())
+		: Base(compare, alloc) {};
+
+	/**
+	 * @brief Builds a perfectly height-balanced tree from a range of elements.
+	 * See build_from_sorted.
+	 * 
+	 * @param first: (InputIt) the first element (a key for sets, a key-value pair for maps)
+	 * @param last: (InputIt) one past the last element
+	 */
+	template <class InputIt>
+	balancedBST (InputIt first, InputIt last, const Compare &compare = Compare(), const Alloc &alloc = Alloc())
+		: Base(compare, alloc) {build_from_sorted(first, last);};
+
+private:
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Compares two keys with comp and reports the comparison to the statistics policy.
+	 * 
+	 * @return bool: comp(a, b)
+	 */
+	bool key_less (const Key &a, const Key &b) const {counters().comparison(); return comp(a, b);};
+
+	/**
+	 * @brief Creates a node through binaryTree::create_node and reports the allocation.
+	 * 
+	 * @return TreeNode*
+	 */
+	TreeNode* create_node (const Key &key, const Value &value) {counters().allocation(); return Tree::create_node(key, value);};
+
+	/**
+	 * @brief Finds the node holding a key, reporting the comparisons and the depth reached.
+	 * 
+	 * @param key: (Key) the key to find
+	 * @return TreeNode*: the node, or nullptr
+	 */
+	TreeNode* lookup (const Key &key) const;
+
+	/**
+	 * @brief This function calculates the AVL Balance Factor for the given node
+	 * 
+	 * @param node: (TreeNode*) the node to calculate the balance factor
+	 * @return int
+	 */
+  	int node_balance(TreeNode *node) const;
 
-protected:  
-	// binary tree node 
-	struct TreeNode {					
-		elemType data; 		// store data
-		TreeNode * left; 	// link to left subtree 
-		TreeNode * right;	// link to right subtree
-	};
-  	
+	/**
+	 * @brief This function does Right Rotation on the given node to
+	 * balance the AVL tree.
+	 * 
+	 * @param node: (TreeNode*) the node to rotate
+	 * @return TreeNode*
+	 */
+  	TreeNode* R_rotate(TreeNode *node);
 
-private:	
-	/* --- Helper Functions --- */
 	/**
-	 * @brief Inserts an element into the tree according to the binary search tree rules. 
+	 * @brief This function does Left Rotation on the given node to
+	 * balance the AVL tree.
 	 * 
-	 * @param key: (char) the element to be inserted
-	 * @param TreeNode*: the root of the tree
+	 * @param node: (TreeNode*) the node to rotate
+	 * @return TreeNode*
+	 */
+  	TreeNode* L_rotate(TreeNode *node);
+
+	/**
+	 * @brief This function does Right-Left Rotation on the given node to
+	 * balance the AVL tree.
 	 * 
-	 * @return TreeNode*: the root of the tree
+	 * @param node: (TreeNode*) the node to rotate
+	 * @return TreeNode*
 	 */
-	TreeNode * insertItem (const elemType key, TreeNode *root);
+	TreeNode* RL_rotate(TreeNode *node);
 
 	/**
-	 * @brief Deletes an element from the tree according to the binary search tree rules. 
+	 * @brief This function does Left-Right Rotation on the given node to
+	 * balance the AVL tree.
 	 * 
-	 * @param key: (char) the element to be deleted
-	 * @param TreeNode*: the root of the tree
+	 * @param node: (TreeNode*) the node to rotate
+	 * @return TreeNode*
+	 */
+	TreeNode* LR_rotate(TreeNode *node);
+
+	/**
+	 * @brief this function uses the balance factors to apply the
+	 * appropriate rotation to an unbalanced node.
+	 * A node is unbalanced if its balance factor is
+	 * greater than 1 or less than -1.
 	 * 
-	 * @return TreeNode*: the root of the tree
+	 * @param node: (TreeNode*) the node to balance
+	 * @return TreeNode*
 	 */
-	TreeNode * deleteItem (const elemType key, TreeNode *root);
+	TreeNode* balanceTree(TreeNode *node);
 
 	/**
-	 * @brief Finds the size of the tree.
-	 * In other words, finds the number of the nodes in the tree.
+	 * @brief This function traverses through all the nodes in the tree,
+	 * and prints out all the balance factors
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @param node
+	 */
+	void balanceFactors(TreeNode *node) const; // helper function for balanceFactors
+
+	/**
+	 * @brief Builds a perfectly height-balanced subtree from sorted, duplicate-free elements.
 	 * 
-	 * @return int 
+	 * @param first: (RandomIt) the first element
+	 * @param n: (size_t) the number of elements
+	 * @return TreeNode*: the root of the subtree
 	 */
-	int size (TreeNode *root) const;
+	template <class RandomIt>
+	TreeNode* build_balanced(RandomIt first, size_t n);
 
 	/**
-	 * @brief Finds the height of the tree.
+	 * @brief Builds the tree from a range, picking the copy-free path for random-access input.
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @param first: (It) the first element
+	 * @param last: (It) one past the last element
+	 */
+	template <class RandomIt>
+	void build_range(RandomIt first, RandomIt last, random_access_iterator_tag);
+	template <class InputIt>
+	void build_range(InputIt first, InputIt last, input_iterator_tag);
+
+	/**
+	 * @brief Sorts elements by key, keeping equal keys in their input order.
+	 * The first overload is an LSD radix sort, used for integral keys ordered by less<Key>.
 	 * 
-	 * @return int 
+	 * @param entries: (vector<value_type>) the elements to sort
 	 */
-	int height (TreeNode *root) const;
+	static void sort_entries(vector<value_type> &entries, true_type);
+	void sort_entries(vector<value_type> &entries, false_type) const;
 
 	/**
-	 * @brief Displays the tree in a tree-like structure.
+	 * @brief Records the root-to-node path to the k-th smallest key.
 	 * 
-	 * @param TreeNode*: the root of the tree
-	 * @param int: the layer of the tree
+	 * @param k: (size_t) the 0-based position
+	 * @param path: (TreeNode**) at least AVL_MAX_DEPTH entries to fill
+	 * @return int: the number of nodes on the path, 0 if k is out of range
+	 */
+	int select_path(size_t k, TreeNode **path) const;
+
+	/**
+	 * @brief Records the root-to-node path to the first key >= key, or > key if upper is set.
 	 * 
-	 * @return void
+	 * @param key: (Key) the key to bound
+	 * @param upper: (bool) find the first key greater than key instead
+	 * @param path: (TreeNode**) at least AVL_MAX_DEPTH entries to fill
+	 * @return int: the number of nodes on the path, 0 if there is no such key
+	 */
+	int bound_path(const Key &key, bool upper, TreeNode **path) const;
+
+	/**
+	 * @brief Records the root-to-node path to the given key.
 	 * 
+	 * @param key: (Key) the key to find
+	 * @param path: (TreeNode**) at least AVL_MAX_DEPTH entries to fill
+	 * @return int: the number of nodes on the path, 0 if the key is not in the tree
 	 */
-	void display (TreeNode *root, int layer) const;
+	int find_path(const Key &key, TreeNode **path) const;
 
-	/* --- End of Helper Functions --- */
+	/**
+	 * @brief Copies a subtree, in order, into the slots of a frozen index.
+	 *
+	 * @param node: (TreeNode*) the subtree
+	 * @param layout: (avl_frozen) an index of the tree's size, which places the positions
+	 * @param keys: (Key*) the key array to fill
+	 * @param values: (Value*) the value array to fill, or nullptr for sets
+	 * @param position: (size_t&) the sorted position of the next key, advanced past the subtree
+	 */
+	void freeze_nodes(const TreeNode *node, const avl_frozen<Key, Value, Compare> &layout, Key *keys, Value *values,
+		size_t &position) const;
 
-	/* --- Traversal Helper Functions --- */
+	/**
+	 * @brief Writes the tree as an image file, the same bytes as freeze().save(path), but
+	 * straight into a shared mapping of the file, without a frozen copy in memory. This is
+	 * what the child of checkpoint_async runs. Throws runtime_error on failure.
+	 *
+	 * @param path: (string) the file to write
+	 * @return uint64_t: the size of the file
+	 */
+	uint64_t write_image(const string &path) const;
 
 	/**
-	 * @brief Traverses the tree in pre-order.
-	 * Visit the root, then the left subtree, and finally the right subtree.
+	 * @brief Joins two subtrees and a middle node, all keys in left < mid < all keys in right.
+	 * Walks down the spine of the taller subtree and rebalances on the way back up, so the
+	 * cost is O(|height(left) - height(right)| + 1).
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @param left: (TreeNode*) the smaller keys
+	 * @param mid: (TreeNode*) the middle node, its links are overwritten
+	 * @param right: (TreeNode*) the larger keys
+	 * @return TreeNode*: the root of the joined tree
+	 */
+	TreeNode* join_nodes(TreeNode *left, TreeNode *mid, TreeNode *right);
+
+	/**
+	 * @brief Joins two subtrees, all keys in left < all keys in right, with no middle node.
 	 * 
-	 * @return void
+	 * @return TreeNode*: the root of the joined tree
+	 */
+	TreeNode* join2_nodes(TreeNode *left, TreeNode *right);
+
+	/**
+	 * @brief Splits a subtree around a key into the keys below it, the node holding it
+	 * (if any) and the keys above it. Every node is reused.
 	 * 
+	 * @param node: (TreeNode*) the subtree to split, consumed
+	 * @param key: (Key) the key to split at
+	 * @param left: (TreeNode*&) set to the keys less than key
+	 * @param found: (TreeNode*&) set to the detached node holding key, or nullptr
+	 * @param right: (TreeNode*&) set to the keys greater than key
 	 */
-	void pre_order (TreeNode *root) const;
+	void split_nodes(TreeNode *node, const Key &key, TreeNode *&left, TreeNode *&found, TreeNode *&right);
 
 	/**
-	 * @brief Traverses the tree in in-order.
-	 * Visit the left subtree, then the root, and finally the right subtree.
+	 * @brief Join-based set operations on two subtrees, both consumed. Nodes that end up in
+	 * the result are reused, the others are freed. On equal keys the node from a wins.
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @return TreeNode*: the root of the result
+	 */
+	TreeNode* union_nodes(TreeNode *a, TreeNode *b);
+	TreeNode* intersection_nodes(TreeNode *a, TreeNode *b);
+	TreeNode* difference_nodes(TreeNode *a, TreeNode *b);
+
+	/**
+	 * @brief The same set operations, with the two recursive calls forked onto a task pool.
+	 * Pairs of subtrees with fewer than grain nodes in total use the sequential versions.
 	 * 
-	 * @return void
+	 * @param pool: (Pool&) any pool with fork_join(f, g), such as avl_task_pool
+	 * @param grain: (size_t) the sequential cutoff
+	 * @return TreeNode*: the root of the result
+	 */
+	template <class Pool>
+	TreeNode* union_nodes(TreeNode *a, TreeNode *b, Pool &pool, size_t grain);
+	template <class Pool>
+	TreeNode* intersection_nodes(TreeNode *a, TreeNode *b, Pool &pool, size_t grain);
+	template <class Pool>
+	TreeNode* difference_nodes(TreeNode *a, TreeNode *b, Pool &pool, size_t grain);
+
+	/**
+	 * @brief Takes all the nodes of another tree, leaving it empty.
+	 * If the two trees' allocators are not interchangeable, the nodes are copied into this
+	 * tree's allocator (keeping their shape) and the originals freed.
 	 * 
+	 * @param other: (balancedBST&) the tree to empty
+	 * @return TreeNode*: the root of the taken nodes
 	 */
-	void in_order (TreeNode *root) const; 
+	TreeNode* adopt(balancedBST &other);
 
 	/**
-	 * @brief Traverses the tree in post-order.
-	 * Visit the left subtree, then the right subtree, and finally the root.
+	 * @brief Takes nodes that were allocated by another tree and already unlinked from it.
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @param owner: (balancedBST&) the tree whose allocator created the nodes
+	 * @param nodes: (TreeNode*) the root of the nodes
+	 * @return TreeNode*: the root of the nodes, owned by this tree's allocator
+	 */
+	TreeNode* adopt_from(balancedBST &owner, TreeNode *nodes);
+
+	/**
+	 * @brief Copies a subtree node by node, keeping its shape and cached values.
 	 * 
-	 * @return void
+	 * @return TreeNode*: the root of the copy
+	 */
+	TreeNode* clone_nodes(const TreeNode *node);
+
+	/**
+	 * @brief Gets the key of an element (a key for sets, a key-value pair for maps).
 	 * 
+	 * @return const Key&
 	 */
-	void post_order (TreeNode *root) const; 
+	static const Key& entry_key(const Key &key) {return key;};
+	static const Key& entry_key(const pair<Key, Value> &entry) {return entry.first;};
 
 	/**
-	 * @brief Traverses the tree in level-order.
-	 * Visit the nodes level by level from left to right.
+	 * @brief Creates a leaf node from an element (a key for sets, a key-value pair for maps).
 	 * 
-	 * @param TreeNode*: the root of the tree
+	 * @return TreeNode*
+	 */
+	TreeNode* create_entry(const Key &key) {return this->create_node(key, Value());};
+	TreeNode* create_entry(const pair<Key, Value> &entry) {return this->create_node(entry.first, entry.second);};
+
+	/* --- End of Helper Functions --- */
+
+	/**
+	 * @brief Inserts an element into the tree according to the AVL rules.
 	 * 
-	 * @return void
+	 * @param key
+	 * @param value
+	 * @param root
+	 * @return TreeNode*
+	 */
+	TreeNode* insertNode(const Key &key, const Value &value, TreeNode *root);
+
+	/**
+	 * @brief Deletes an element from the tree according to the AVL rules,
+	 * rebalancing every node on the way back up whose subtree got shorter.
 	 * 
+	 * @param key
+	 * @param root
+	 * @param shrunk: set to true if the height of the returned subtree went down
+	 * @return TreeNode*
 	 */
-	void level_order (TreeNode *root) const;
+	TreeNode* deleteNode(const Key &key, TreeNode *root, bool &shrunk);
+
+	/**
+	 * @brief Unlinks the largest node of a subtree, rebalancing on the way back up.
+	 * 
+	 * @param root
+	 * @param removed: set to the unlinked node
+	 * @param shrunk: set to true if the height of the returned subtree went down
+	 * @return TreeNode*
+	 */
+	TreeNode* removeMax(TreeNode *root, TreeNode *&removed, bool &shrunk);
+
+	/**
+	 * @brief Refreshes a node's height after one of its subtrees got shorter and rebalances it.
+	 * 
+	 * @param node
+	 * @param shrunk: set to true if the height of the returned subtree went down
+	 * @return TreeNode*
+	 */
+	TreeNode* retrace(TreeNode *node, bool &shrunk);
 
-	/* --- End of Traversal Helper Functions --- */
-		
 public:
-	// constructor
-	binaryTree () {root = nullptr;};
 
-	// destructor
-	~binaryTree () {delete root;};
+	/**
+	 * @brief Inserts an element into the tree according to the AVL rules.
+	 * 
+	 * @param key: (Key) the element to be inserted
+	 * @param value: (Value) the value mapped to the key
+	 * 
+	 */
+	void insertNode(const Key &key, const Value &value = Value()) {root = insertNode(key, value, root); counters().update_done(AVL_INSERT, key);};
 
-	TreeNode * root;		// root of the tree
-						
 	/**
-	 * @brief Inserts an element into the tree according to the binary search tree rules.
-	 * This is a wrapper function for the private insertItem function.
+	 * @brief Deletes an element from the tree according to the AVL rules.
 	 * 
-	 * @param key: (char) the element to be inserted
+	 * @param key: (Key) the element to be deleted
 	 * 
-	 * @return void
+	 */
+	void deleteNode(const Key &key) {bool shrunk; root = deleteNode(key, root, shrunk); counters().update_done(AVL_DELETE, key);};
+
+	/**
+	 * @brief Searches for an element in the tree, like BST::searchItem, but through the
+	 * statistics policy.
 	 * 
+	 * @param key: (Key) the element to be searched
+	 * @return bool: true if the key is in the tree
 	 */
-	void insertItem (const elemType key) {root = insertItem(key, root);};
+	bool searchItem (const Key &key) const {return lookup(key) != nullptr;};
 
 	/**
-	 * @brief Deletes an element from the tree according to the binary search tree rules.
-	 * This is a wrapper function for the private deleteItem function.
+	 * @brief Looks up the value mapped to a key, like BST::searchValue.
 	 * 
-	 * @param key: (char) the element to be deleted
+	 * @param key: (Key) the element to be searched
+	 * @return Value*: the mapped value, or nullptr if the key is not in the tree
+	 */
+	Value * searchValue (const Key &key) {TreeNode *node = lookup(key); return node == nullptr ? nullptr : &node->value;};
+
+	/**
+	 * @brief Replaces the contents of the tree with a perfectly height-balanced tree.
+	 * A strictly increasing random-access range is built in O(n) without copying.
+	 * Anything else is copied and sorted first (radix sort for integral keys under
+	 * less<Key>), and for equal keys only the first one is kept, like insertNode.
 	 * 
-	 * @return void
+	 * @param first: (InputIt) the first element (a key for sets, a key-value pair for maps)
+	 * @param last: (InputIt) one past the last element
 	 * 
 	 */
-	void deleteItem (const elemType key) {root = deleteItem(key, root);};
+	template <class InputIt>
+	void build_from_sorted(InputIt first, InputIt last);
+
+	/* --- Iterator Functions --- */
 
 	/**
-	 * @brief Finds the number of nodes in the tree.
-	 * This is a wrapper function for the private size function.
+	 * @brief In-order (ascending key) iterators. Stepping never allocates.
+	 * Any insert or delete invalidates every iterator.
 	 * 
-	 * @return int 
 	 */
-	int treeNodeCount() const {return size(root);};
+	iterator begin () {return iterator(root, true);};
+	iterator end () {return iterator(root, false);};
+	const_iterator begin () const {return const_iterator(root, true);};
+	const_iterator end () const {return const_iterator(root, false);};
+	const_iterator cbegin () const {return begin();};
+	const_iterator cend () const {return end();};
 
 	/**
-	 * @brief Finds the height of the tree.
-	 * This is a wrapper function for the private height function.
+	 * @brief Reverse in-order (descending key) iterators.
 	 * 
-	 * @return int 
 	 */
-	int height() const {return height(root);};	
+	reverse_iterator rbegin () {return reverse_iterator(root, true);};
+	reverse_iterator rend () {return reverse_iterator(root, false);};
+	const_reverse_iterator rbegin () const {return const_reverse_iterator(root, true);};
+	const_reverse_iterator rend () const {return const_reverse_iterator(root, false);};
 
 	/**
-	 * @brief Finds the height of the tree.
-	 * This is a wrapper function for the private height function.
+	 * @brief Pre-order traversal as a range: root, left subtree, right subtree.
 	 * 
-	 * @return int 
+	 * @return avl_range<pre_order_iterator>
 	 */
-	int node_height(TreeNode *node) const {return height(node);};	
+	avl_range<pre_order_iterator> pre_order_range () const
+		{return avl_range<pre_order_iterator>(pre_order_iterator(root, true), pre_order_iterator(root, false));};
 
 	/**
-	 * @brief Displays the tree in a tree-like structure.
-	 * This is a wrapper function for the private display function.
+	 * @brief Post-order traversal as a range: left subtree, right subtree, root.
 	 * 
+	 * @return avl_range<post_order_iterator>
 	 */
-	void display() const {display(root, 0);}; 		
-						
-	/* --- Traversal Functions --- */
+	avl_range<post_order_iterator> post_order_range () const
+		{return avl_range<post_order_iterator>(post_order_iterator(root, true), post_order_iterator(root, false));};
 
 	/**
-	 * @brief Traverses the tree in pre-order.
-	 * This is a wrapper function for the private pre_order function.
+	 * @brief Level-order traversal as a range: level by level, left to right.
+	 * It is a breadth-first walk whose queue the range owns, see avl_level_range.
 	 * 
+	 * @return level_order_range_type
 	 */
-	void pre_order_Traversal() const {pre_order(root); cout << endl;};
+	level_order_range_type level_order_range () const {return level_order_range_type(root);};
+
+	/* --- End of Iterator Functions --- */
+
+	/* --- Order Statistic Functions --- */
 
 	/**
-	 * @brief Traverses the tree in in-order.
-	 * This is a wrapper function for the private in_order function.
+	 * @brief Counts the keys that are less than the given key, in O(log n).
+	 * The key does not have to be in the tree.
 	 * 
+	 * @param key: (Key) the key to rank
+	 * @return size_t
 	 */
-	void in_order_Traversal() const {in_order(root); cout << endl;}; 
+	size_t rank (const Key &key) const;
 
 	/**
-	 * @brief Traverses the tree in post-order.
-	 * This is a wrapper function for the private post_order function.
+	 * @brief Finds the k-th smallest key (k = 0 is the smallest), in O(log n).
 	 * 
+	 * @param k: (size_t) the 0-based position
+	 * @return iterator: positioned at the key, or end() if k >= treeNodeCount()
 	 */
-	void post_orderTraversal() const {post_order(root); cout << endl;}; 	
-	
+	iterator select (size_t k) {TreeNode *path[AVL_MAX_DEPTH]; return iterator(root, path, select_path(k, path));};
+	const_iterator select (size_t k) const {TreeNode *path[AVL_MAX_DEPTH]; return const_iterator(root, path, select_path(k, path));};
+
 	/**
-	 * @brief Traverses the tree in level-order.
-	 * This is a wrapper function for the private level_order function.
+	 * @brief Counts the keys k with lo <= k < hi, in O(log n).
 	 * 
+	 * @param lo: (Key) the inclusive lower bound
+	 * @param hi: (Key) the exclusive upper bound
+	 * @return size_t
 	 */
-	void level_order_Traversal() const {level_order(root); cout << endl;};
-	/* --- End of Traversal Functions --- */
-};	
+	size_t count_range (const Key &lo, const Key &hi) const {return comp(lo, hi) ? rank(hi) - rank(lo) : 0;};
 
-/* --- BINARY SEARCH TREE (BST) CLASS --- */
-class BST : public binaryTree {
- 
-private:
-	/* --- Helper Functions --- */
+	/* --- End of Order Statistic Functions --- */
+
+	/* --- Aggregate Functions --- */
+	// These need an augmentation policy other than avl_no_augment.
 
 	/**
-	 * @brief Searches for an element in the tree.
-	 * This is a helper function for the searchItem function.
+	 * @brief Combines, in key order, the elements whose key k has lo <= k < hi, in O(log n):
+	 * one walk down to the first node in the range, then one walk down each side of it that
+	 * takes whole subtrees from their cached aggregates.
 	 * 
-	 * @param key: (char) the element to be searched
-	 * @param TreeNode*: the root of the tree
+	 * @param lo: (Key) the inclusive lower bound
+	 * @param hi: (Key) the exclusive upper bound
+	 * @return Augment::value_type: identity() if the range is empty
+	 */
+	typename Augment::value_type aggregate (const Key &lo, const Key &hi) const;
+
+	/**
+	 * @brief Combines every element, in O(1).
 	 * 
-	 * @return true 
-	 * @return false 
+	 * @return Augment::value_type: identity() if the tree is empty
 	 */
-  	bool search (const elemType key, TreeNode *root) const; 
+	typename Augment::value_type aggregate () const {return avl_aggregate<Augment>::of(root);};
 
-	/* --- End of Helper Functions --- */
+	/**
+	 * @brief Recomputes the aggregates on the path to a key, in O(log n). Values changed in
+	 * place, through searchValue, an iterator or for_each_in_range, are not seen by the
+	 * aggregates until their key is refreshed; inserts and deletes refresh by themselves.
+	 * 
+	 * @param key: (Key) the key whose value changed
+	 * @return bool: false if the key is not in the tree
+	 */
+	bool refresh (const Key &key);
 
-public:
+	/* --- End of Aggregate Functions --- */
+
+	/* --- Range Query Functions --- */
+	// All of these are a single iterative walk down the tree and never allocate.
 
 	/**
-	 * @brief Searches for an element in the tree.
-	 * This is a wrapper function for the private search function.
+	 * @brief Finds the element with the given key.
 	 * 
-	 * @param key 
-	 * @return true 
-	 * @return false 
+	 * @param key: (Key) the key to find
+	 * @return iterator: positioned at the key, or end() if it is not in the tree
 	 */
-  	bool searchItem (const elemType key){return search(key, root);};
+	iterator find (const Key &key) {TreeNode *path[AVL_MAX_DEPTH]; return iterator(root, path, find_path(key, path));};
+	const_iterator find (const Key &key) const {TreeNode *path[AVL_MAX_DEPTH]; return const_iterator(root, path, find_path(key, path));};
 
 	/**
-	 * @brief Inserts an element into the tree according to the binary search tree rules.
+	 * @brief Finds the first element whose key is not less than the given key.
 	 * 
-	 * @param key: (char) the element to be inserted
+	 * @param key: (Key) the key to bound
+	 * @return iterator: the first key >= key, or end()
+	 */
+	iterator lower_bound (const Key &key) {TreeNode *path[AVL_MAX_DEPTH]; return iterator(root, path, bound_path(key, false, path));};
+	const_iterator lower_bound (const Key &key) const {TreeNode *path[AVL_MAX_DEPTH]; return const_iterator(root, path, bound_path(key, false, path));};
+
+	/**
+	 * @brief Finds the first element whose key is greater than the given key.
 	 * 
+	 * @param key: (Key) the key to bound
+	 * @return iterator: the first key > key, or end()
 	 */
-  	void insertItem (const elemType key) {binaryTree::insertItem(key);}; 
+	iterator upper_bound (const Key &key) {TreeNode *path[AVL_MAX_DEPTH]; return iterator(root, path, bound_path(key, true, path));};
+	const_iterator upper_bound (const Key &key) const {TreeNode *path[AVL_MAX_DEPTH]; return const_iterator(root, path, bound_path(key, true, path));};
 
 	/**
-	 * @brief Deletes an element from the tree according to the binary search tree rules.
+	 * @brief Finds the range of elements equal to the given key (empty or one element).
 	 * 
-	 * @param key: (char) the element to be deleted
+	 * @param key: (Key) the key to find
+	 * @return pair<iterator, iterator>: lower_bound(key) and upper_bound(key)
+	 */
+	pair<iterator, iterator> equal_range (const Key &key) {return make_pair(lower_bound(key), upper_bound(key));};
+	pair<const_iterator, const_iterator> equal_range (const Key &key) const {return make_pair(lower_bound(key), upper_bound(key));};
+
+	/**
+	 * @brief Calls fn on every element whose key is in [lo, hi), in ascending order.
+	 * Runs in O(log n + k) for k elements. Maps pass fn a pair of references, so the
+	 * non-const version can update values in place.
 	 * 
+	 * @param lo: (Key) the inclusive lower bound
+	 * @param hi: (Key) the exclusive upper bound
+	 * @param fn: (Function) called with each element
 	 */
-	void deleteItem (const elemType key) {binaryTree::deleteItem(key);}; 
-}; 
-/* --- End of BINARY SEARCH TREE (BST) CLASS --- */
-			
-/* --- AVL BALANCED BINARY SEARCH TREE (balancedBST) CLASS --- */
-class balancedBST : public BST {
+	template <class Function>
+	void for_each_in_range (const Key &lo, const Key &hi, Function fn);
+	template <class Function>
+	void for_each_in_range (const Key &lo, const Key &hi, Function fn) const;
 
-private:
+	/* --- End of Range Query Functions --- */
 
-	/* --- Helper Functions --- */
+	/* --- Set Operation Functions --- */
+	// These move nodes between trees instead of reallocating them. The trees must use the
+	// same comparator; nodes are only moved when the allocators compare equal, otherwise
+	// they are copied once first.
 
 	/**
-	 * @brief This function calculates the AVL Balance Factor for the given node
+	 * @brief Appends every element of another tree, whose keys must all be greater than the
+	 * keys of this tree. The other tree is left empty. O(log n + log m).
 	 * 
-	 * @param node: (TreeNode*) the node to calculate the balance factor
-	 * @return int 
+	 * @param right: (balancedBST&) the tree with the larger keys
 	 */
-  	int node_balance(TreeNode *node);
+	void join (balancedBST &right) {TreeNode *r = adopt(right); root = join2_nodes(root, r);};
 
 	/**
-	 * @brief This function does Right Rotation on the given node to
-	 * balance the AVL tree.
+	 * @brief Appends a middle element and then every element of another tree, with
+	 * all keys of this tree < key < all keys of right. The other tree is left empty.
 	 * 
-	 * @param node: (TreeNode*) the node to rotate 
-	 * @return TreeNode* 
+	 * @param key: (Key) the middle key
+	 * @param value: (Value) the value mapped to the middle key
+	 * @param right: (balancedBST&) the tree with the larger keys
 	 */
-  	TreeNode* R_rotate(TreeNode *node);
+	void join (const Key &key, const Value &value, balancedBST &right)
+		{TreeNode *r = adopt(right); root = join_nodes(root, this->create_node(key, value), r);};
 
 	/**
-	 * @brief This function does Left Rotation on the given node to
-	 * balance the AVL tree.
+	 * @brief Moves the keys less than key into left and the rest into right, in O(log n).
+	 * This tree is left empty; left and right are cleared first.
 	 * 
-	 * @param node: (TreeNode*) the node to rotate
-	 * @return TreeNode* 
+	 * @param key: (Key) the key to split at
+	 * @param left: (balancedBST&) receives the keys < key
+	 * @param right: (balancedBST&) receives the keys >= key
+	 * @return bool: true if key itself was in the tree (it goes to right)
 	 */
-  	TreeNode* L_rotate(TreeNode *node);
+	bool split (const Key &key, balancedBST &left, balancedBST &right);
 
 	/**
-	 * @brief This function does Right-Left Rotation on the given node to
-	 * balance the AVL tree.
+	 * @brief Moves every element of other that is not already here into this tree.
+	 * Where both trees hold a key, this tree's element is kept. The other tree is left empty.
+	 * O(m log(n/m + 1)) for trees of sizes m <= n.
 	 * 
-	 * @param node: (TreeNode*) the node to rotate
-	 * @return TreeNode* 
+	 * @param other: (balancedBST&) the tree to merge in
 	 */
-	TreeNode* RL_rotate(TreeNode *node);
+	void union_with (balancedBST &other) {TreeNode *b = adopt(other); root = union_nodes(root, b);};
 
 	/**
-	 * @brief This function does Left-Right Rotation on the given node to
-	 * balance the AVL tree.
+	 * @brief Keeps only the keys that other also holds. The other tree is left empty.
+	 * O(m log(n/m + 1)).
 	 * 
-	 * @param node: (TreeNode*) the node to rotate
-	 * @return TreeNode* 
+	 * @param other: (balancedBST&) the tree to intersect with
 	 */
-	TreeNode* LR_rotate(TreeNode *node);
+	void intersection_with (balancedBST &other) {TreeNode *b = adopt(other); root = intersection_nodes(root, b);};
 
 	/**
-	 * @brief this function uses the balance factors to apply the
-	 * appropriate rotation to an unbalanced node.
-	 * A node is unbalanced if its balance factor is 
-	 * greater than 1 or less than -1.
+	 * @brief Removes every key that other holds. The other tree is left empty.
+	 * O(m log(n/m + 1)).
 	 * 
-	 * @param node: (TreeNode*) the node to balance
-	 * @return TreeNode* 
+	 * @param other: (balancedBST&) the keys to remove
 	 */
-	TreeNode* balanceTree(TreeNode *node);
+	void difference_with (balancedBST &other) {TreeNode *b = adopt(other); root = difference_nodes(root, b);};
 
 	/**
-	 * @brief This function traverses through all the nodes in the tree,
-	 * and prints out all the balance factors
+	 * @brief Parallel versions of union_with, intersection_with and difference_with.
+	 * Each level splits at the root key and runs the two halves as a fork_join on the
+	 * pool, down to subtrees of grain nodes. Nodes are freed from several threads at
+	 * once, so the allocator must be thread-safe (std::allocator is; avl_node_pool
+	 * is not). The tasks share the tree's one Stats object, whose counters (avl_stats,
+	 * avl_trace) are plain fields, so these overloads only compile with avl_no_stats.
+	 * Atomic counters would tax every sequential update, and splitting them per task
+	 * would change every hook's signature; to count a set operation, run the
+	 * sequential overload.
 	 * 
-	 * @param node 
+	 * @param other: (balancedBST&) the other tree, left empty
+	 * @param pool: (Pool&) any pool with fork_join(f, g), such as avl_task_pool
+	 * @param grain: (size_t) subtrees smaller than this in total run sequentially
 	 */
-	void balanceFactors(TreeNode *node); // helper function for balanceFactors
+	template <class Pool>
+	void union_with (balancedBST &other, Pool &pool, size_t grain = AVL_PARALLEL_GRAIN)
+		{TreeNode *b = adopt(other); root = union_nodes(root, b, pool, grain);};
+	template <class Pool>
+	void intersection_with (balancedBST &other, Pool &pool, size_t grain = AVL_PARALLEL_GRAIN)
+		{TreeNode *b = adopt(other); root = intersection_nodes(root, b, pool, grain);};
+	template <class Pool>
+	void difference_with (balancedBST &other, Pool &pool, size_t grain = AVL_PARALLEL_GRAIN)
+		{TreeNode *b = adopt(other); root = difference_nodes(root, b, pool, grain);};
 
-	/* --- End of Helper Functions --- */
+	/* --- End of Set Operation Functions --- */
+
+	/* --- Frozen Index Functions --- */
 
 	/**
-	 * @brief Inserts an element into the tree according to the AVL rules.
-	 * 
-	 * @param key 
-	 * @param root 
-	 * @return TreeNode* 
+	 * @brief Copies the keys and values into an avl_frozen, a read-only index in
+	 * Eytzinger order that searches faster than the tree, in O(n). The tree is unchanged,
+	 * and later updates to it do not reach the index.
+	 *
+	 * @return avl_frozen<Key, Value, Compare>
 	 */
-	TreeNode* insertNode(const elemType key, TreeNode *root);
+	avl_frozen<Key, Value, Compare> freeze () const;
 
-public:
+	/**
+	 * @brief Writes the tree to a file as a pointer-free image, in O(n), the same bytes as
+	 * freeze().save(path). On POSIX systems the keys go straight into a mapping of the file,
+	 * with no frozen copy in memory, and the file is synced before it is renamed into place.
+	 * Key and Value must be trivially copyable. Throws runtime_error on failure.
+	 *
+	 * @param path: (string) the file to write
+	 */
+	void save (const string &path) const;
 
 	/**
-	 * @brief Inserts an element into the tree according to the AVL rules.
+	 * @brief Maps an image written by save() as a read-only avl_frozen, with no per-key
+	 * work beyond the optional checksum. See avl_frozen::load.
+	 *
+	 * @param path: (string) the file to open
+	 * @param verify: (bool) whether to checksum the keys and values
+	 * @return avl_frozen<Key, Value, Compare>
+	 */
+	static avl_frozen<Key, Value, Compare> load (const string &path, bool verify = true)
+		{return avl_frozen<Key, Value, Compare>::load(path, verify);};
+
+	/**
+	 * @brief Starts writing the tree to an image file in a child process and returns at
+	 * once, so that updates can go on while the image is written. The image holds the tree
+	 * as it was at the call. Copy-on-write keeps the child's view fixed: each page the
+	 * parent writes meanwhile is copied once, which the returned handle reports along with
+	 * the bytes written. The image is synced before it is renamed over path, so once the
+	 * handle reports success it is on disk. Without fork (not POSIX) it writes the image
+	 * before it returns. Costs one fork, whose time grows with the process's memory.
+	 *
+	 * @param path: (string) the file to write
+	 * @return avl_checkpoint: poll done() or call wait() for the outcome
+	 */
+	avl_checkpoint checkpoint_async (const string &path) const;
+
+	/* --- End of Frozen Index Functions --- */
+
+	/* --- Statistics Functions --- */
+
+	/**
+	 * @brief Gets a copy of the counters of the statistics policy. With avl_no_stats it is
+	 * an empty object.
 	 * 
-	 * @param key: (char) the element to be inserted
+	 * @return Stats: the counters at this moment
+	 */
+	Stats stats () const {return counters();};
+
+	/**
+	 * @brief Starts counting again from zero.
 	 * 
 	 */
-	void insertNode(const elemType key) {cout << "Inserting: " << key << endl; root = balancedBST::insertNode(key, root);};
+	void reset_stats () {static_cast<Stats&>(*this) = Stats();};
 
 	/**
-	 * @brief Deletes an element from the tree according to the AVL rules.
+	 * @brief Replaces the statistics policy object, for policies that are configured when
+	 * they are built, such as an avl_trace attached to an event sink.
 	 * 
-	 * @param key: (char) the element to be deleted
+	 * @param policy: (Stats) the new policy
+	 */
+	void set_stats (const Stats &policy) {static_cast<Stats&>(*this) = policy;};
+
+	/**
+	 * @brief Reports the memory the tree holds: one node of sizeof(TreeNode) bytes per key,
+	 * each a separate allocation, plus the tree object.
 	 * 
+	 * @return avl_memory_usage
 	 */
-	void deleteNode(const elemType key) {cout << "Deleting: " << key << endl; binaryTree::deleteItem(key); root = balanceTree(root);};
+	avl_memory_usage memory_usage () const
+		{size_t n = this->node_size(root); avl_memory_usage usage = {n, n * sizeof(TreeNode), sizeof(*this), n}; return usage;};
+
+	/* --- End of Statistics Functions --- */
 
 	/**
 	 * @brief Displays the balance factors of all the nodes in the tree.
 	 * 
 	 */
-	void balanceFactors () {cout << "Balance Factors: " << endl; balanceFactors(root);};
-};
\ No newline at end of file
+	void balanceFactors () const {cout << "Balance Factors: " << endl; balanceFactors(root);};
+};
+/* --- End of AVL BALANCED BINARY SEARCH TREE (balancedBST) CLASS --- */
+
+/* --- ALIASES --- */
+/**
+ * @brief Ordered map from Key to Value backed by an AVL tree.
+ */
+template <class Key, class Value, class Compare = less<Key>, class Alloc = allocator<Key>, class Stats = avl_no_stats,
+	class Augment = avl_no_augment>
+using avl_map = balancedBST<Key, Value, Compare, Alloc, Stats, Augment>;
+
+/**
+ * @brief Ordered set of Key backed by an AVL tree.
+ */
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key>, class Stats = avl_no_stats,
+	class Augment = avl_no_augment>
+using avl_set = balancedBST<Key, avl_no_value, Compare, Alloc, Stats, Augment>;
+/* --- End of ALIASES --- */
+
+#include "AVLtrees.tcc"
+
+#endif // AVLTREES_H
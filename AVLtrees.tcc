@@ -0,0 +1,2946 @@
+/**
+ * @file AVLtrees.tcc
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This is the implementation file for the AVLtrees.h header file.
+ * It is included at the bottom of AVLtrees.h and should not be included directly.
+ * @version 0.2
+ * @date 2024-04-14
+ * 
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+/* --- IMPORTS --- */
+#include <stack>
+#include <iostream>
+#include <cmath>
+#include <queue>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+/* --- End of IMPORTS --- */
+
+/* --- BINARY TREE CLASS --- */
+
+/* --- Helper Functions --- */
+
+/**
+ * @brief Inserts an element into the tree according to the binary search tree rules. 
+ * 
+ * This function inserts a new node with a given key into the binary search tree. 
+ * If the key already exists in the tree, the function returns without inserting a new node.
+ * If the root is null, a new node is created as the root. Otherwise, the function traverses 
+ * the tree to find the correct location for the new node and inserts it as a child of the 
+ * appropriate parent node.
+ *
+ * @param key The key of the node to be inserted.
+ * @param value The value mapped to the key.
+ * @param root The root of the tree.
+ * @return TreeNode* The root of the tree after insertion.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+auto binaryTree<Key, Value, Compare, Alloc, Augment>::insertItem(const Key& key, const Value& value, TreeNode* root) -> TreeNode* {
+
+    // If the root is null, create a new node as root.
+    if (root == nullptr) {
+        return create_node(key, value);
+    }
+
+    // Initialize current node as root and parent as null.
+    TreeNode* current = root;
+    TreeNode* parent = nullptr;
+
+    // Remember the path so the cached heights and sizes can be fixed on the way back up.
+    stack<TreeNode*> path;
+
+    // Traverse the tree to find the correct location for the new node.
+    while (current != nullptr) {
+        parent = current;
+        path.push(current);
+        if (comp(key, current->data)) {
+            current = current->left;
+        } else if (comp(current->data, key)) {
+            current = current->right;
+        } else {
+            // Key already exists in the tree, so return without inserting.
+            return root;
+        }
+    }
+
+    // Create a new node.
+    TreeNode* newNode = create_node(key, value);
+
+    // Insert the new node as a child of the parent node.
+    if (comp(key, parent->data)) {
+        parent->left = newNode;
+    } else {
+        parent->right = newNode;
+    }
+
+    // Walk back up the path; every size on it grew by one.
+    while (!path.empty()) {
+        update_node(path.top());
+        path.pop();
+    }
+
+    // Return the root of the tree.
+    return root;
+}
+
+/**
+ * @brief Deletes an element from the tree according to the binary search tree rules. 
+ * 
+ * This function deletes a node from the binary search tree. If the node has two children, 
+ * it finds the largest node in the left subtree, replaces the node's data with the replacement's 
+ * data, updates the parent's child pointer, and deletes the replacement node. If the node has 
+ * one or no children, it updates the parent's child pointer and deletes the node. If the node 
+ * to be deleted is the root, it updates the root.
+ *
+ * @param key The key of the node to be deleted.
+ * @param root The root of the tree.
+ * @return TreeNode* The root of the tree after deletion.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+auto binaryTree<Key, Value, Compare, Alloc, Augment>::deleteItem(const Key& key, TreeNode* root) -> TreeNode* {
+    // Initialize current node as root and parent as null.
+    TreeNode* parent = nullptr;
+    TreeNode* current = root;
+
+    // Remember the path so the cached heights and sizes can be fixed afterwards.
+    stack<TreeNode*> path;
+
+    // Traverse the tree to find the node to be deleted and its parent.
+    while (current != nullptr && !equal(current->data, key)) {
+        parent = current;
+        path.push(current);
+        if (comp(key, current->data)) {
+            current = current->left;
+        } else {
+            current = current->right;
+        }
+    }
+
+    // If the node is not found, return the original root.
+    if (current == nullptr) {
+        return root;
+    }
+
+    // If the node has two children...
+    if (current->left != nullptr && current->right != nullptr) {
+        // Find the largest node in the left subtree.
+        TreeNode* replacement = current->left;
+        TreeNode* replacementParent = current;
+        path.push(current);
+
+        while (replacement->right != nullptr) {
+            replacementParent = replacement;
+            path.push(replacement);
+            replacement = replacement->right;
+        }
+
+        // Replace the node's data (and mapped value) with the replacement's.
+        static_cast<avl_value<Value>&>(*current) = static_cast<avl_value<Value>&>(*replacement);
+        current->data = replacement->data;
+
+        // Update the parent's child pointer.
+        if (replacementParent->left == replacement) {
+            replacementParent->left = replacement->left;
+        } else {
+            replacementParent->right = replacement->left;
+        }
+
+        // Delete the replacement node.
+        destroy_node(replacement);
+    }
+    // If the node has one or no children...
+    else {
+        // Get the node's child (if it exists).
+        TreeNode* child = (current->left != nullptr) ? current->left : current->right;
+
+        // If the node to be deleted is the root, update the root.
+        if (current == root) {
+            root = child;
+        }
+        // If the node to be deleted is a left child, update the parent's left child.
+        else if (current == parent->left) {
+            parent->left = child;
+        }
+        // If the node to be deleted is a right child, update the parent's right child.
+        else {
+            parent->right = child;
+        }
+
+        // Delete the node.
+        destroy_node(current);
+    }
+
+    // Recompute the cached heights and sizes along the path, bottom-up.
+    while (!path.empty()) {
+        update_node(path.top());
+        path.pop();
+    }
+
+    // Return the root of the tree.
+    return root;
+}
+
+/**
+ * @brief Recomputes the cached height, size and aggregate of a node from its children.
+ * 
+ * This function sets the node's height to one more than the taller of its two children, and its 
+ * size to one more than the sizes of its two children combined. An empty child counts as height 
+ * -1 and size 0, so a leaf ends up with height 0 and size 1. With an augmentation policy it also 
+ * recombines the node's aggregate from its children's. It only looks at the children's cached 
+ * values, so it runs in constant time; callers must update nodes bottom-up.
+ *
+ * @param node The node whose height and size to recompute.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::update_node(TreeNode* node) const {
+    int leftHeight = height(node->left);
+    int rightHeight = height(node->right);
+    node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    node->size = 1 + size(node->left) + size(node->right);
+    avl_aggregate<Augment>::refresh(node);
+}
+
+/**
+ * @brief Allocates and constructs a new leaf node.
+ * 
+ * This function takes memory for one node from the node allocator and constructs the node in 
+ * place with the given key and value. The new node has no children and a height of 0.
+ *
+ * @param key The key of the new node.
+ * @param value The value mapped to the key.
+ * @return TreeNode* The new node.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+auto binaryTree<Key, Value, Compare, Alloc, Augment>::create_node(const Key& key, const Value& value) -> TreeNode* {
+    TreeNode* node = NodeAllocTraits::allocate(nodeAlloc, 1);
+    NodeAllocTraits::construct(nodeAlloc, node, key, value);
+    return node;
+}
+
+/**
+ * @brief Destroys a single node.
+ * 
+ * This function runs the node's destructor and hands its memory back to the node allocator. 
+ * The node's children are not touched.
+ *
+ * @param node The node to free.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::destroy_node(TreeNode* node) {
+    NodeAllocTraits::destroy(nodeAlloc, node);
+    NodeAllocTraits::deallocate(nodeAlloc, node, 1);
+}
+
+/**
+ * @brief Destroys every node of a subtree.
+ * 
+ * This function frees all the nodes below and including the given root. It uses a stack to 
+ * visit the nodes, so it does not recurse even on a degenerate (list-shaped) tree.
+ *
+ * @param root The root of the subtree to free.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::destroy_tree(TreeNode* root) {
+    // If the root is null, there is nothing to free.
+    if (root == nullptr) {
+        return;
+    }
+
+    // Initialize a stack and push the root onto it.
+    stack<TreeNode*> stack;
+    stack.push(root);
+
+    // While there are nodes to free...
+    while (!stack.empty()) {
+        // Pop a node from the stack and push its children before freeing it.
+        TreeNode* node = stack.top();
+        stack.pop();
+
+        if (node->left != nullptr) {
+            stack.push(node->left);
+        }
+        if (node->right != nullptr) {
+            stack.push(node->right);
+        }
+
+        destroy_node(node);
+    }
+}
+
+/**
+ * @brief Removes every node from the tree.
+ * 
+ * If the nodes need no destructor and the allocator can drop everything it handed out in one 
+ * go, this asks the allocator to do so instead of visiting the nodes. Otherwise it frees the 
+ * nodes one by one. Either way the tree is empty afterwards.
+ *
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::clear() {
+    if (!(is_trivially_destructible<TreeNode>::value && release_nodes(nodeAlloc, 0))) {
+        destroy_tree(root);
+    }
+    root = nullptr;
+}
+
+/**
+ * @brief Displays the tree in a depth-first manner.
+ *
+ * This function displays the tree in a depth-first manner, also known as in-order traversal. 
+ * It uses recursion to traverse the tree. For each node, it first visits the right subtree, 
+ * then prints the node's data, and finally visits the left subtree. It continues until there 
+ * are no more nodes to visit (i.e., the node is null). The nodes are printed with spaces 
+ * between them to represent the level of each node in the tree.
+ *
+ * @param node The current node to display.
+ * @param level The level of the current node in the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::display(TreeNode* node, int level) const {
+    // If the node is null, there are no more nodes to visit, so return.
+    if (node == nullptr) {
+        return;
+    }
+
+    // Recursively visit the right subtree. Increase the level by 1.
+    display(node->right, level + 1);
+
+    // Print spaces for indentation. The number of spaces is twice the level of the node.
+    for (int i = 0; i < level; ++i) {
+        std::cout << "  ";
+    }
+
+    // Print the current node's data.
+    std::cout << node->data << std::endl;
+
+    // Recursively visit the left subtree. Increase the level by 1.
+    display(node->left, level + 1);
+}
+/*void binaryTree::display(TreeNode *root, int layer) const {
+    if (root == nullptr) {
+        return;
+    }
+
+    std::queue<TreeNode*> currentLevel, nextLevel;
+    currentLevel.push(root);
+
+    while (!currentLevel.empty()) {
+        TreeNode* currentNode = currentLevel.front();
+        currentLevel.pop();
+
+        if (currentNode) {
+            for (int j = 0; j < size(root->left) - layer; j++) {
+                cout << " ";
+            }
+            cout << currentNode->data << " ";
+            
+            nextLevel.push(currentNode->left);
+            nextLevel.push(currentNode->right);
+        }
+
+        if (currentLevel.empty()) {
+            cout << endl;
+            layer++;
+            swap(currentLevel, nextLevel);
+        }
+    }
+}*/
+
+/* --- End of Helper Functions --- */
+
+/* --- Traversal Helper Functions --- */
+
+/**
+ * @brief Traverses the tree in pre-order.
+ * 
+ * This function traverses the tree in pre-order, which means it visits the root, then the left 
+ * subtree, and finally the right subtree. It uses a stack to traverse the tree. For each node, 
+ * it prints the node's data and pushes the node's right child onto the stack, then moves to the 
+ * left child. It continues until there are no more nodes to visit (i.e., the stack is empty).
+ *
+ * @param root The root of the tree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::pre_order(TreeNode* root) const {
+    // If the root is null, the tree is empty, so return.
+    if (root == nullptr) {
+        return;
+    }
+
+    // Initialize a stack and push the root onto it.
+    stack<TreeNode*> stack;
+    stack.push(root);
+
+    // While there are nodes to visit...
+    while (!stack.empty()) {
+        // Pop a node from the stack.
+        TreeNode* node = stack.top();
+        stack.pop();
+
+        // Print the node's data.
+        cout << node->data << " ";
+
+        // If the node has a right child, push it onto the stack.
+        if (node->right != nullptr) {
+            stack.push(node->right);
+        }
+
+        // If the node has a left child, push it onto the stack.
+        if (node->left != nullptr) {
+            stack.push(node->left);
+        }
+    }
+}
+
+/**
+ * @brief Traverses the tree in in-order.
+ * 
+ * This function traverses the tree in in-order, which means it visits the left subtree, then the 
+ * root, and finally the right subtree. It uses a stack to traverse the tree. For each node, it 
+ * pushes the node onto the stack and moves to the left child. It continues until there are no 
+ * more nodes to visit (i.e., the stack is empty). The nodes are printed in order when they are 
+ * popped from the stack.
+ *
+ * @param root The root of the tree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::in_order(TreeNode* root) const {
+    // If the root is null, the tree is empty, so return.
+    if (root == nullptr) {
+        return;
+    }
+
+    // Initialize a stack and a current node.
+    stack<TreeNode*> stack;
+    TreeNode* current = root;
+
+    // While there are nodes to visit...
+    while (current != nullptr || !stack.empty()) {
+        // Push the current node onto the stack and move to the left child.
+        while (current != nullptr) {
+            stack.push(current);
+            current = current->left;
+        }
+
+        // Pop a node from the stack.
+        current = stack.top();
+        stack.pop();
+
+        // Print the node's data.
+        cout << current->data << " ";
+
+        // Move to the right child.
+        current = current->right;
+    }
+}
+
+/**
+ * @brief Traverses the tree in post-order.
+ * 
+ * This function traverses the tree in post-order, which means it visits the left subtree, then the 
+ * right subtree, and finally the root. It uses a stack to traverse the tree. For each node, it 
+ * pushes the node onto the stack and moves to the left child. It continues until there are no 
+ * more nodes to visit (i.e., the stack is empty). The nodes are printed in reverse order when 
+ * they are popped from the stack.
+ *
+ * @param root The root of the tree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::post_order(TreeNode* root) const {
+    // If the root is null, the tree is empty, so return.
+    if (root == nullptr) {
+        return;
+    }
+
+    // Initialize two stacks.
+    stack<TreeNode*> stack1;
+    stack<TreeNode*> stack2;
+
+    // Push the root onto the first stack.
+    stack1.push(root);
+
+    // While there are nodes to visit...
+    while (!stack1.empty()) {
+        // Pop a node from the first stack.
+        TreeNode* node = stack1.top();
+        stack1.pop();
+
+        // Push the node onto the second stack.
+        stack2.push(node);
+
+        // If the node has a left child, push it onto the first stack.
+        if (node->left != nullptr) {
+            stack1.push(node->left);
+        }
+
+        // If the node has a right child, push it onto the first stack.
+        if (node->right != nullptr) {
+            stack1.push(node->right);
+        }
+    }
+
+    // Print the nodes in reverse order.
+    while (!stack2.empty()) {
+        TreeNode* node = stack2.top();
+        stack2.pop();
+        cout << node->data << " ";
+    }
+}
+
+/**
+ * @brief Traverses the tree in level-order.
+ * 
+ * This function traverses the tree in level-order, which means it visits the nodes level by level 
+ * from left to right. It uses a queue to traverse the tree. For each node, it prints the node's 
+ * data and pushes the node's children onto the queue. It continues until there are no more nodes 
+ * to visit (i.e., the queue is empty).
+ *
+ * @param root The root of the tree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+void binaryTree<Key, Value, Compare, Alloc, Augment>::level_order(TreeNode* root) const {
+    // If the root is null, the tree is empty, so return.
+    if (root == nullptr) {
+        return;
+    }
+
+    // Initialize a queue and push the root onto it.
+    queue<TreeNode*> nodesQueue;
+    nodesQueue.push(root);
+
+    // While there are nodes to visit...
+    while (!nodesQueue.empty()) {
+        // Pop a node from the queue.
+        TreeNode* node = nodesQueue.front();
+        nodesQueue.pop();
+
+        // Print the node's data.
+        cout << node->data << " ";
+
+        // If the node has a left child, push it onto the queue.
+        if (node->left != nullptr) {
+            nodesQueue.push(node->left);
+        }
+
+        // If the node has a right child, push it onto the queue.
+        if (node->right != nullptr) {
+            nodesQueue.push(node->right);
+        }
+    }
+}
+
+/* --- End of Traversal Helper Functions --- */
+
+/* --- End of BINARY TREE CLASS --- */
+
+/* --- BINARY SEARCH TREE (BST) --- */
+
+/* --- HELPER FUNCTIONS --- */
+
+/**
+ * @brief Searches for an element in the tree.
+ * 
+ * This function searches for an element in the binary search tree. A search never backtracks, so 
+ * it just follows one pointer per level with no stack. For each node, it compares the node's data 
+ * with the key. If the key is less than the node's data, it moves to the left child. If the key is 
+ * greater than the node's data, it moves to the right child. If the key is equal to the node's 
+ * data, it returns the node. If it runs off the tree, the key is not found and it returns nullptr.
+ *
+ * @param key The key to search for.
+ * @param root The root of the tree.
+ * @return TreeNode* The node holding the key, or nullptr if the key is not found.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Augment>
+auto BST<Key, Value, Compare, Alloc, Augment>::search(const Key& key, TreeNode* root) const -> TreeNode* {
+    TreeNode* node = root;
+
+    while (node != nullptr) {
+        // If the key is less than the node's data, move to the left child.
+        if (comp(key, node->data)) {
+            node = node->left;
+        }
+        // If the key is greater than the node's data, move to the right child.
+        else if (comp(node->data, key)) {
+            node = node->right;
+        }
+        // Otherwise the key is equal to the node's data, so return the node.
+        else {
+            return node;
+        }
+    }
+
+    // If the key is not found, return nullptr.
+    return nullptr;
+}
+
+/* --- End of HELPER FUNCTIONS --- */
+
+/* --- End of BINARY SEARCH TREE (BST) --- */
+
+/* --- BALANCED BST --- */
+
+/* --- HELPER FUNCTIONS --- */
+
+/**
+ * @brief Finds the node holding a key.
+ *
+ * This is the same walk as BST::search, but every comparison goes through key_less and the number
+ * of nodes visited is reported to the statistics policy, hit or miss.
+ *
+ * @param key The key to find.
+ * @return TreeNode* The node holding the key, or nullptr if the key is not found.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::lookup(const Key& key) const -> TreeNode* {
+    TreeNode* node = root;
+    int depth = 0;
+
+    while (node != nullptr) {
+        depth++;
+
+        if (key_less(key, node->data)) {
+            node = node->left;
+        } else if (key_less(node->data, key)) {
+            node = node->right;
+        } else {
+            break;
+        }
+    }
+
+    counters().search_depth(depth);
+    return node;
+}
+
+/**
+ * @brief Calculates the balance factor of a node.
+ * 
+ * This function calculates the balance factor of a node in the AVL tree. The balance factor is 
+ * the height of the left subtree minus the height of the right subtree. It reads the cached heights 
+ * of the left and right subtrees and returns the difference, so it runs in constant time.
+ *
+ * @param node The node for which to calculate the balance factor.
+ * @return int The balance factor of the node.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+int balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::node_balance(TreeNode* node) const {
+    // Calculate the height of the left and right subtrees.
+    int leftHeight = this->node_height(node->left);
+    int rightHeight = this->node_height(node->right);
+
+    // Return the balance factor.
+    return leftHeight - rightHeight;
+}
+
+/**
+ * @brief Performs a right rotation on a subtree.
+ * 
+ * This function performs a right rotation on the subtree rooted at the given node. 
+ * It takes the left child of the node as the pivot, moves the pivot to the node's 
+ * position, and moves the node to the pivot's right child. This rotation is used when 
+ * the node has a left-heavy subtree. After the rotation, the pivot becomes the new 
+ * root of the subtree, and the node becomes the right child of the new root.
+ *
+ * @param node The root of the subtree to rotate.
+ * @return TreeNode* The new root of the subtree after the rotation.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::R_rotate(TreeNode* node) -> TreeNode* {
+    // Take the left child of the node as the pivot.
+    TreeNode *pivot = node->right;
+
+    // Move the pivot's right child to the node's left child.
+    node->right = pivot->left;
+
+    // Move the node to the pivot's right child.
+    pivot->left = node;
+
+    // The node is now below the pivot, so update its height first.
+    this->update_node(node);
+    this->update_node(pivot);
+
+    // Return the new root of the subtree.
+    return pivot;
+}
+
+/**
+ * @brief Performs a left rotation on a subtree.
+ * 
+ * This function performs a left rotation on the subtree rooted at the given node. 
+ * It takes the right child of the node as the pivot, moves the pivot to the node's 
+ * position, and moves the node to the pivot's left child. This rotation is used when 
+ * the node has a right-heavy subtree. After the rotation, the pivot becomes the new 
+ * root of the subtree, and the node becomes the left child of the new root.
+ *
+ * @param node The root of the subtree to rotate.
+ * @return TreeNode* The new root of the subtree after the rotation.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::L_rotate(TreeNode* node) -> TreeNode* {
+    // Take the right child of the node as the pivot.
+    TreeNode *pivot = node->left;
+
+    // Move the pivot's left child to the node's right child.
+    node->left = pivot->right;
+
+    // Move the node to the pivot's left child.
+    pivot->right = node;
+
+    // The node is now below the pivot, so update its height first.
+    this->update_node(node);
+    this->update_node(pivot);
+
+    // Return the new root of the subtree.
+    return pivot;
+}
+
+/**
+ * @brief Performs a right-left rotation on a subtree.
+ * 
+ * This function performs a right-left rotation on the subtree rooted at the given node. 
+ * It first performs a left rotation on the right child of the node, then performs a right 
+ * rotation on the node itself. This rotation is used when the right child of the node has 
+ * a left-heavy subtree. After the rotation, the right child becomes the new root of the 
+ * subtree, and the node becomes the left child of the new root.
+ *
+ * @param node The root of the subtree to rotate.
+ * @return TreeNode* The new root of the subtree after the rotation.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::RL_rotate(TreeNode* node) -> TreeNode* {
+    // Perform a left rotation on the right child of the node.
+    node->right = L_rotate(node->right);
+
+    // Perform a right rotation on the node.
+    return R_rotate(node);
+}
+
+/**
+ * @brief Performs a left-right rotation on a subtree.
+ * 
+ * This function performs a left-right rotation on the subtree rooted at the given node. 
+ * It first performs a right rotation on the left child of the node, then performs a left 
+ * rotation on the node itself. This rotation is used when the left child of the node has 
+ * a right-heavy subtree. After the rotation, the left child becomes the new root of the 
+ * subtree, and the node becomes the right child of the new root.
+ *
+ * @param node The root of the subtree to rotate.
+ * @return TreeNode* The new root of the subtree after the rotation.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::LR_rotate(TreeNode* node) -> TreeNode* {
+    // Perform a right rotation on the left child of the node.
+    node->left = R_rotate(node->left);
+
+    // Perform a left rotation on the node.
+    return L_rotate(node);
+}
+
+/**
+ * @brief Balances the tree at the given node.
+ * 
+ * This function checks the balance factor of the given node and performs the appropriate rotation(s) 
+ * to balance the tree. If the balance factor is greater than 1, it means the left subtree is heavier, 
+ * so it performs a right rotation. If the balance factor is less than -1, it means the right subtree 
+ * is heavier, so it performs a left rotation. If the balance factor is within the range [-1, 1], it 
+ * means the tree is already balanced, so it does nothing.
+ *
+ * @param node The node to balance.
+ * @return TreeNode* The new root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::balanceTree(TreeNode* node) -> TreeNode* {
+    // An empty subtree is always balanced.
+    if (node == nullptr) {
+        return node;
+    }
+
+    // Calculate the balance factor of the node.
+    int balance_Fact = node_balance(node);
+
+    // If the balance factor is greater than 1, the left subtree is heavier.
+    if (balance_Fact > 1) {
+        // If the left child is not right-heavy, perform a left rotation.
+        if (node_balance(node->left) >= 0) {
+            counters().rotation(AVL_ROTATE_L);
+            node = L_rotate(node);
+        } 
+        // Otherwise, perform a left-right rotation.
+        else {
+            counters().rotation(AVL_ROTATE_LR);
+            node = LR_rotate(node);
+        }
+    } 
+    // If the balance factor is less than -1, the right subtree is heavier.
+    else if (balance_Fact < -1) {
+        // If the balance factor of the right child is greater than 0, perform a right-left rotation.
+        if (node_balance(node->right) > 0) {
+            counters().rotation(AVL_ROTATE_RL);
+            node = RL_rotate(node);
+        } 
+        // Otherwise, perform a right rotation.
+        else {
+            counters().rotation(AVL_ROTATE_R);
+            node = R_rotate(node);
+        }
+    }
+
+    // Return the new root of the subtree.
+    return node;
+}
+
+/**
+ * @brief Prints the balance factors of all nodes in the tree.
+ * 
+ * This function performs an in-order traversal of the tree and prints the balance factor of each node. 
+ * It uses a stack to keep track of the nodes to visit. For each node, it pushes the node onto the stack 
+ * and moves to its left child. When it reaches a null child, it pops a node from the stack, prints the 
+ * node's data and balance factor, and moves to its right child. It continues until the stack is empty 
+ * and the current node is null.
+ *
+ * @param root The root of the tree.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::balanceFactors(TreeNode* root) const {
+    stack<TreeNode*> nodesStack;
+    TreeNode* currentNode = root;
+
+    while (currentNode != nullptr || !nodesStack.empty()) {
+        // Reach the left most Node of the currentNode
+        while (currentNode != nullptr) {
+            nodesStack.push(currentNode);
+            currentNode = currentNode->left;
+        }
+
+        // BackTrack from the empty subtree and visit the Node at the top of the stack; however, if the stack is empty you are done
+        currentNode = nodesStack.top();
+        nodesStack.pop();
+
+        int balanceFactor = node_balance(currentNode);
+        cout << currentNode->data << ":" << balanceFactor << " ";
+
+        // We have visited the node and its left subtree. Now, it's right subtree's turn
+        currentNode = currentNode->right; 
+    }
+
+    cout << endl;
+}
+
+/* --- End of HELPER FUNCTIONS --- */
+
+/**
+ * @brief Inserts a node into the tree.
+ *
+ * This function inserts a node with the given key into the tree rooted at the given node. 
+ * It uses recursion to find the appropriate position for the new node. If the tree is empty 
+ * (i.e., the node is null), it creates a new node with the key and returns it. If the key is 
+ * less than the node's data, it inserts the new node into the left subtree. If the key is 
+ * greater than the node's data, it inserts the new node into the right subtree. After each 
+ * insertion, it refreshes the node's cached height and balances the tree to ensure that the tree 
+ * remains an AVL tree. If the key is equal to the node's data, it does nothing, as duplicate keys 
+ * are not allowed in an AVL tree.
+ *
+ * @param key The key of the new node.
+ * @param value The value mapped to the key.
+ * @param node The root of the tree where the new node will be inserted.
+ * @return TreeNode* The new root of the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::insertNode(const Key& key, const Value& value, TreeNode *node) -> TreeNode* {
+    // If the tree is empty, create a new node with the key.
+    if (node == nullptr) {
+        return this->create_node(key, value);
+    }
+    // If the key is less than the node's data, insert the new node into the left subtree.
+    else if (key_less(key, node->data)) {
+        node->left = insertNode(key, value, node->left);
+    }
+    // If the key is greater than the node's data, insert the new node into the right subtree.
+    else if (key_less(node->data, key)) {
+        node->right = insertNode(key, value, node->right);
+    }
+    // The key is already in the tree, so nothing below this node changed.
+    else {
+        return node;
+    }
+
+    // Refresh the cached height now that a subtree may have grown, then rebalance. A node whose
+    // height changed is one more step of the retrace.
+    int oldHeight = node->height;
+    this->update_node(node);
+    if (node->height != oldHeight) {
+        counters().retrace_step();
+    }
+    node = balanceTree(node);
+
+    // Return the new root of the tree.
+    return node;
+}
+
+/**
+ * @brief Deletes a node from the tree.
+ *
+ * This function removes the node with the given key from the tree rooted at the given node, 
+ * using recursion to find it. A node with at most one child is replaced by that child. A node 
+ * with two children is replaced by the largest node of its left subtree, which is unlinked by 
+ * removeMax and moved into its place, so keys and values are never copied. On the way back up, 
+ * every node whose subtree got shorter has its height refreshed and is rebalanced. As soon as a 
+ * subtree keeps its height, no rotation can be needed above it, so the remaining ancestors only 
+ * refresh their cached size. If the key is not in the tree, nothing changes.
+ *
+ * @param key The key of the node to delete.
+ * @param node The root of the tree to delete from.
+ * @param shrunk Set to true if the height of the returned subtree went down.
+ * @return TreeNode* The new root of the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::deleteNode(const Key& key, TreeNode* node, bool& shrunk) -> TreeNode* {
+    // If the tree is empty, the key is not in it.
+    if (node == nullptr) {
+        shrunk = false;
+        return node;
+    }
+    // If the key is less than the node's data, delete from the left subtree.
+    else if (key_less(key, node->data)) {
+        node->left = deleteNode(key, node->left, shrunk);
+    }
+    // If the key is greater than the node's data, delete from the right subtree.
+    else if (key_less(node->data, key)) {
+        node->right = deleteNode(key, node->right, shrunk);
+    }
+    // If the node has two children, move the largest node of the left subtree into its place.
+    else if (node->left != nullptr && node->right != nullptr) {
+        TreeNode* replacement = nullptr;
+        TreeNode* left = removeMax(node->left, replacement, shrunk);
+        replacement->left = left;
+        replacement->right = node->right;
+        replacement->height = node->height;
+        this->destroy_node(node);
+        node = replacement;
+    }
+    // Otherwise replace the node with its only child (or with nothing).
+    else {
+        TreeNode* child = (node->left != nullptr) ? node->left : node->right;
+        this->destroy_node(node);
+        shrunk = true;
+        return child;
+    }
+
+    // If the subtree below kept its height, no rotation is needed here or above; only the 
+    // cached size has to follow.
+    if (!shrunk) {
+        this->update_node(node);
+        return node;
+    }
+
+    // Refresh the height and rebalance.
+    return retrace(node, shrunk);
+}
+
+/**
+ * @brief Unlinks the largest node of a subtree.
+ *
+ * This function follows right children down to the largest node, unlinks it by putting its 
+ * left child in its place, and hands it back through removed without freeing it. On the way 
+ * back up it rebalances like deleteNode, skipping the rotation checks once a subtree keeps its 
+ * height.
+ *
+ * @param node The root of the subtree.
+ * @param removed Set to the unlinked node.
+ * @param shrunk Set to true if the height of the returned subtree went down.
+ * @return TreeNode* The new root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::removeMax(TreeNode* node, TreeNode*& removed, bool& shrunk) -> TreeNode* {
+    // If there is no right child, this is the largest node.
+    if (node->right == nullptr) {
+        removed = node;
+        shrunk = true;
+        return node->left;
+    }
+
+    // Otherwise the largest node is in the right subtree.
+    node->right = removeMax(node->right, removed, shrunk);
+
+    // If the subtree below kept its height, no rotation is needed here or above; only the 
+    // cached size has to follow.
+    if (!shrunk) {
+        this->update_node(node);
+        return node;
+    }
+
+    // Refresh the height and rebalance.
+    return retrace(node, shrunk);
+}
+
+/**
+ * @brief Refreshes a node's height and rebalances it after a deletion below it.
+ *
+ * This function recomputes the node's cached height, applies a rotation if the node is now 
+ * unbalanced, and reports whether the resulting subtree is shorter than it was before the 
+ * deletion. If it is not, the caller can stop retracing.
+ *
+ * @param node The node to refresh.
+ * @param shrunk Set to true if the height of the returned subtree went down.
+ * @return TreeNode* The new root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::retrace(TreeNode* node, bool& shrunk) -> TreeNode* {
+    int oldHeight = node->height;
+
+    counters().retrace_step();
+    this->update_node(node);
+    node = balanceTree(node);
+
+    shrunk = node->height < oldHeight;
+    return node;
+}
+
+/* --- ORDER STATISTICS --- */
+
+/**
+ * @brief Counts the keys that are less than the given key.
+ *
+ * This function walks down from the root as if searching for the key. Every time it goes right, 
+ * the node and its whole left subtree are less than the key, so their count (read from the cached 
+ * subtree size) is added. The walk is one root-to-leaf path, so it is O(log n).
+ *
+ * @param key The key to rank.
+ * @return size_t The number of keys less than the key.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+size_t balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::rank(const Key& key) const {
+    size_t count = 0;
+    TreeNode* node = root;
+
+    while (node != nullptr) {
+        // The node and its left subtree are all less than the key, so count them and go right.
+        if (key_less(node->data, key)) {
+            count += this->node_size(node->left) + 1;
+            node = node->right;
+        }
+        // Otherwise the key is in the left subtree, if anywhere.
+        else {
+            node = node->left;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Combines the elements with keys in [lo, hi).
+ *
+ * This function walks down to the highest node whose key is in the range; every key in the range 
+ * is in its subtree. Below it, in its left subtree, a node whose key is at least lo is in the 
+ * range with its whole right subtree, which comes after whatever its left subtree still holds, so 
+ * the walk takes both and goes left; a node below lo is out with its left subtree, and the walk 
+ * goes right. The right subtree is the mirror image, with hi. Each walk combines O(log n) cached 
+ * aggregates, and keeps the elements in key order, so combine may be any associative function.
+ *
+ * @param lo The inclusive lower bound.
+ * @param hi The exclusive upper bound.
+ * @return Augment::value_type The aggregate, or identity() if the range is empty.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+typename Augment::value_type balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::aggregate(const Key& lo, const Key& hi) const {
+    static_assert(!is_same<Augment, avl_no_augment>::value, "balancedBST::aggregate needs an augmentation policy");
+    typedef avl_aggregate<Augment> Aggregate;
+
+    // Find the highest node in the range.
+    TreeNode* split = root;
+    while (split != nullptr) {
+        if (!key_less(split->data, hi)) {
+            split = split->left;
+        } else if (key_less(split->data, lo)) {
+            split = split->right;
+        } else {
+            break;
+        }
+    }
+    if (split == nullptr) {
+        return Augment::identity();
+    }
+
+    // The keys of the left subtree that are >= lo, gathered from the largest down.
+    typename Augment::value_type low = Augment::identity();
+    for (TreeNode* node = split->left; node != nullptr;) {
+        if (key_less(node->data, lo)) {
+            node = node->right;
+        } else {
+            low = Augment::combine(Augment::combine(Augment::of(node->data, node->mapped()), Aggregate::of(node->right)), low);
+            node = node->left;
+        }
+    }
+
+    // The keys of the right subtree that are < hi, gathered from the smallest up.
+    typename Augment::value_type high = Augment::identity();
+    for (TreeNode* node = split->right; node != nullptr;) {
+        if (key_less(node->data, hi)) {
+            high = Augment::combine(high, Augment::combine(Aggregate::of(node->left), Augment::of(node->data, node->mapped())));
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+
+    return Augment::combine(Augment::combine(low, Augment::of(split->data, split->mapped())), high);
+}
+
+/**
+ * @brief Recomputes the aggregates on the path to a key, bottom-up, after its value changed.
+ *
+ * @param key The key whose value changed.
+ * @return bool False if the key is not in the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+bool balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::refresh(const Key& key) {
+    TreeNode* path[AVL_MAX_DEPTH];
+    int depth = find_path(key, path);
+
+    for (int i = depth; i-- > 0;) {
+        this->update_node(path[i]);
+    }
+    return depth != 0;
+}
+
+/**
+ * @brief Records the path to the k-th smallest key.
+ *
+ * This function walks down from the root comparing k with the size of the left subtree. If k is 
+ * smaller, the key is on the left. If it is equal, it is this node. Otherwise it is on the right, 
+ * at position k minus the left subtree and the node. Each visited node is stored in the path so 
+ * the caller can build an iterator from it.
+ *
+ * @param k The 0-based position.
+ * @param path The array to fill, with room for AVL_MAX_DEPTH nodes.
+ * @return int The number of nodes on the path, or 0 if k is out of range.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+int balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::select_path(size_t k, TreeNode** path) const {
+    // Out of range positions give the end iterator.
+    if (k >= this->node_size(root)) {
+        return 0;
+    }
+
+    int depth = 0;
+    TreeNode* node = root;
+
+    while (true) {
+        path[depth++] = node;
+        size_t leftSize = this->node_size(node->left);
+
+        // The key is in the left subtree.
+        if (k < leftSize) {
+            node = node->left;
+        }
+        // The key is in the right subtree, past the left subtree and this node.
+        else if (k > leftSize) {
+            k -= leftSize + 1;
+            node = node->right;
+        }
+        // The key is this node.
+        else {
+            return depth;
+        }
+    }
+}
+
+/* --- End of ORDER STATISTICS --- */
+
+/* --- RANGE QUERIES --- */
+
+/**
+ * @brief Records the path to the first key that is not less than (or, for upper, greater than) 
+ * the given key.
+ *
+ * This function walks down from the root. Whenever the node's key qualifies, it is the best 
+ * candidate so far and the walk goes left to look for a smaller one; otherwise the walk goes 
+ * right. The path to the last candidate is a prefix of the walk, so the function just remembers 
+ * how deep the candidate was. It uses no stack beyond the caller's fixed array.
+ *
+ * @param key The key to bound.
+ * @param upper False for lower_bound (first key >= key), true for upper_bound (first key > key).
+ * @param path The array to fill, with room for AVL_MAX_DEPTH nodes.
+ * @return int The number of nodes on the path to the bound, or 0 if there is none.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+int balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::bound_path(const Key& key, bool upper, TreeNode** path) const {
+    int depth = 0;
+    int found = 0;
+    TreeNode* node = root;
+
+    while (node != nullptr) {
+        path[depth++] = node;
+
+        // The node qualifies if its key is >= key (lower) or > key (upper).
+        bool qualifies = upper ? key_less(key, node->data) : !key_less(node->data, key);
+        if (qualifies) {
+            found = depth;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Records the path to the node holding the given key.
+ *
+ * This is the same walk as BST::search, keeping each visited node.
+ *
+ * @param key The key to find.
+ * @param path The array to fill, with room for AVL_MAX_DEPTH nodes.
+ * @return int The number of nodes on the path, or 0 if the key is not in the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+int balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::find_path(const Key& key, TreeNode** path) const {
+    int depth = 0;
+    TreeNode* node = root;
+
+    while (node != nullptr) {
+        path[depth++] = node;
+
+        if (key_less(key, node->data)) {
+            node = node->left;
+        } else if (key_less(node->data, key)) {
+            node = node->right;
+        } else {
+            counters().search_depth(depth);
+            return depth;
+        }
+    }
+
+    counters().search_depth(depth);
+    return 0;
+}
+
+/**
+ * @brief Calls a function on every element whose key is in [lo, hi), in ascending order.
+ *
+ * This function finds the first key >= lo with one walk down the tree, then steps an in-order 
+ * iterator until the key reaches hi. Each step is amortized O(1), so the whole scan is 
+ * O(log n + k) for k visited keys, and it never allocates.
+ *
+ * @param lo The inclusive lower bound.
+ * @param hi The exclusive upper bound.
+ * @param fn The function to call with each element (a key for sets, a key-value pair for maps).
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class Function>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::for_each_in_range(const Key& lo, const Key& hi, Function fn) {
+    for (iterator it = lower_bound(lo), last = end(); it != last && key_less(it.key(), hi); ++it) {
+        fn(*it);
+    }
+}
+
+/**
+ * @brief Calls a function on every element whose key is in [lo, hi), in ascending order.
+ *
+ * This is the const version; maps pass their values as const references.
+ *
+ * @param lo The inclusive lower bound.
+ * @param hi The exclusive upper bound.
+ * @param fn The function to call with each element (a key for sets, a key-value pair for maps).
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class Function>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::for_each_in_range(const Key& lo, const Key& hi, Function fn) const {
+    for (const_iterator it = lower_bound(lo), last = end(); it != last && key_less(it.key(), hi); ++it) {
+        fn(*it);
+    }
+}
+
+/* --- End of RANGE QUERIES --- */
+
+/* --- SET OPERATIONS --- */
+
+/**
+ * @brief Joins two subtrees and a middle node.
+ *
+ * All keys in left must be less than the middle key, which must be less than all keys in right. 
+ * If the two subtrees differ in height by at most one, the middle node simply becomes their 
+ * parent. Otherwise the function walks down the inner spine of the taller subtree (the right 
+ * spine of left, or the left spine of right) until the heights match, attaches there, and 
+ * rebalances every node on the way back up. Each step up is one balanceTree call, so the cost is 
+ * proportional to the height difference.
+ *
+ * @param left The subtree with the smaller keys.
+ * @param mid The middle node; its links are overwritten.
+ * @param right The subtree with the larger keys.
+ * @return TreeNode* The root of the joined tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::join_nodes(TreeNode* left, TreeNode* mid, TreeNode* right) -> TreeNode* {
+    int leftHeight = this->node_height(left);
+    int rightHeight = this->node_height(right);
+
+    // The left subtree is too tall, so join into its right spine.
+    if (leftHeight > rightHeight + 1) {
+        left->right = join_nodes(left->right, mid, right);
+        this->update_node(left);
+        return balanceTree(left);
+    }
+
+    // The right subtree is too tall, so join into its left spine.
+    if (rightHeight > leftHeight + 1) {
+        right->left = join_nodes(left, mid, right->left);
+        this->update_node(right);
+        return balanceTree(right);
+    }
+
+    // The heights are close enough, so the middle node becomes the parent.
+    mid->left = left;
+    mid->right = right;
+    this->update_node(mid);
+    return mid;
+}
+
+/**
+ * @brief Joins two subtrees with no middle node.
+ *
+ * This function unlinks the largest node of the left subtree with removeMax and uses it as the 
+ * middle node for join_nodes.
+ *
+ * @param left The subtree with the smaller keys.
+ * @param right The subtree with the larger keys.
+ * @return TreeNode* The root of the joined tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::join2_nodes(TreeNode* left, TreeNode* right) -> TreeNode* {
+    // Joining with an empty tree changes nothing.
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+
+    // Borrow the largest node of the left subtree as the middle node.
+    TreeNode* mid = nullptr;
+    bool shrunk;
+    left = removeMax(left, mid, shrunk);
+    return join_nodes(left, mid, right);
+}
+
+/**
+ * @brief Splits a subtree around a key.
+ *
+ * This function walks down towards the key. Going left, the current node and its right subtree 
+ * belong above the key, so they are joined onto the right-hand result of the recursive split; 
+ * going right is the mirror image. The node holding the key, if any, is detached and returned 
+ * on its own. Every join on the way up is between trees whose heights grow along the path, so 
+ * the whole split is O(log n).
+ *
+ * @param node The subtree to split; it is consumed.
+ * @param key The key to split at.
+ * @param left Set to the keys less than key.
+ * @param found Set to the detached node holding key, or nullptr.
+ * @param right Set to the keys greater than key.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::split_nodes(TreeNode* node, const Key& key, TreeNode*& left, TreeNode*& found, TreeNode*& right) {
+    // An empty tree splits into two empty trees.
+    if (node == nullptr) {
+        left = right = found = nullptr;
+        return;
+    }
+
+    TreeNode* nodeLeft = node->left;
+    TreeNode* nodeRight = node->right;
+
+    // The key is in the left subtree; the node and its right subtree go to the right result.
+    if (key_less(key, node->data)) {
+        split_nodes(nodeLeft, key, left, found, right);
+        right = join_nodes(right, node, nodeRight);
+    }
+    // The key is in the right subtree; the node and its left subtree go to the left result.
+    else if (key_less(node->data, key)) {
+        split_nodes(nodeRight, key, left, found, right);
+        left = join_nodes(nodeLeft, node, left);
+    }
+    // The node holds the key, so detach it.
+    else {
+        node->left = node->right = nullptr;
+        this->update_node(node);
+        left = nodeLeft;
+        found = node;
+        right = nodeRight;
+    }
+}
+
+/**
+ * @brief Unites two subtrees.
+ *
+ * This function splits b around the root key of a, unites the left halves and the right halves 
+ * recursively, and joins the results back with a's root in the middle. If b also held the root 
+ * key, b's node is freed, so a's element wins. This is the join-based algorithm whose work is 
+ * O(m log(n/m + 1)) for sizes m <= n.
+ *
+ * @param a The first subtree, consumed.
+ * @param b The second subtree, consumed.
+ * @return TreeNode* The root of the union.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::union_nodes(TreeNode* a, TreeNode* b) -> TreeNode* {
+    // The union with an empty tree is the other tree.
+    if (a == nullptr) {
+        return b;
+    }
+    if (b == nullptr) {
+        return a;
+    }
+
+    // Split b around a's root key.
+    TreeNode *bLeft, *bFound, *bRight;
+    split_nodes(b, a->data, bLeft, bFound, bRight);
+    if (bFound != nullptr) {
+        this->destroy_node(bFound);
+    }
+
+    // Unite each side, then put a's root back in the middle.
+    TreeNode* aLeft = a->left;
+    TreeNode* aRight = a->right;
+    TreeNode* left = union_nodes(aLeft, bLeft);
+    TreeNode* right = union_nodes(aRight, bRight);
+    return join_nodes(left, a, right);
+}
+
+/**
+ * @brief Intersects two subtrees.
+ *
+ * This function splits b around the root key of a and intersects each side recursively. If b 
+ * held the root key, a's root is kept as the middle node and b's node is freed; otherwise a's 
+ * root is freed and the two sides are joined directly. When one side runs out, the rest of the 
+ * other side is freed.
+ *
+ * @param a The first subtree, consumed.
+ * @param b The second subtree, consumed.
+ * @return TreeNode* The root of the intersection.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::intersection_nodes(TreeNode* a, TreeNode* b) -> TreeNode* {
+    // Nothing survives an intersection with an empty tree.
+    if (a == nullptr || b == nullptr) {
+        this->destroy_tree(a);
+        this->destroy_tree(b);
+        return nullptr;
+    }
+
+    // Split b around a's root key.
+    TreeNode *bLeft, *bFound, *bRight;
+    split_nodes(b, a->data, bLeft, bFound, bRight);
+
+    // Intersect each side.
+    TreeNode* aLeft = a->left;
+    TreeNode* aRight = a->right;
+    TreeNode* left = intersection_nodes(aLeft, bLeft);
+    TreeNode* right = intersection_nodes(aRight, bRight);
+
+    // Keep a's root only if b held the same key.
+    if (bFound != nullptr) {
+        this->destroy_node(bFound);
+        return join_nodes(left, a, right);
+    }
+    this->destroy_node(a);
+    return join2_nodes(left, right);
+}
+
+/**
+ * @brief Removes the keys of one subtree from another.
+ *
+ * This function splits a around the root key of b, removes each side of b from the matching side 
+ * of a recursively, and joins what is left of a without a middle node. b's root is freed, and so 
+ * is a's node for the same key, if there was one.
+ *
+ * @param a The subtree to remove from, consumed.
+ * @param b The keys to remove, consumed.
+ * @return TreeNode* The root of the difference.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::difference_nodes(TreeNode* a, TreeNode* b) -> TreeNode* {
+    // Removing from an empty tree leaves nothing; removing nothing leaves a.
+    if (a == nullptr) {
+        this->destroy_tree(b);
+        return nullptr;
+    }
+    if (b == nullptr) {
+        return a;
+    }
+
+    // Split a around b's root key, and drop a's copy of that key.
+    TreeNode *aLeft, *aFound, *aRight;
+    split_nodes(a, b->data, aLeft, aFound, aRight);
+    if (aFound != nullptr) {
+        this->destroy_node(aFound);
+    }
+
+    // Remove each side, then join what is left.
+    TreeNode* bLeft = b->left;
+    TreeNode* bRight = b->right;
+    this->destroy_node(b);
+    TreeNode* left = difference_nodes(aLeft, bLeft);
+    TreeNode* right = difference_nodes(aRight, bRight);
+    return join2_nodes(left, right);
+}
+
+/**
+ * @brief Unites two subtrees in parallel.
+ *
+ * This is union_nodes with the two recursive calls run as a fork_join on the pool. The split and 
+ * the final join stay on the calling thread; they are O(log n), so the span of the whole 
+ * operation is O(log^2 n). Once both subtrees together hold fewer than grain nodes, the 
+ * sequential version takes over.
+ *
+ * @param a The first subtree, consumed.
+ * @param b The second subtree, consumed.
+ * @param pool The task pool.
+ * @param grain The sequential cutoff, in nodes.
+ * @return TreeNode* The root of the union.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class Pool>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::union_nodes(TreeNode* a, TreeNode* b, Pool& pool, size_t grain) -> TreeNode* {
+    static_assert(is_same<Stats, avl_no_stats>::value, "balancedBST: the parallel set operations need avl_no_stats");
+    // Small or empty inputs are not worth a task.
+    if (this->node_size(a) + this->node_size(b) < grain || a == nullptr || b == nullptr) {
+        return union_nodes(a, b);
+    }
+
+    // Split b around a's root key.
+    TreeNode *bLeft, *bFound, *bRight;
+    split_nodes(b, a->data, bLeft, bFound, bRight);
+    if (bFound != nullptr) {
+        this->destroy_node(bFound);
+    }
+
+    // Unite the two sides in parallel, then put a's root back in the middle.
+    TreeNode* aLeft = a->left;
+    TreeNode* aRight = a->right;
+    TreeNode *left, *right;
+    pool.fork_join([&]() { left = union_nodes(aLeft, bLeft, pool, grain); },
+                   [&]() { right = union_nodes(aRight, bRight, pool, grain); });
+    return join_nodes(left, a, right);
+}
+
+/**
+ * @brief Intersects two subtrees in parallel.
+ *
+ * This is intersection_nodes with the two recursive calls run as a fork_join on the pool, down 
+ * to subtrees of grain nodes.
+ *
+ * @param a The first subtree, consumed.
+ * @param b The second subtree, consumed.
+ * @param pool The task pool.
+ * @param grain The sequential cutoff, in nodes.
+ * @return TreeNode* The root of the intersection.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class Pool>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::intersection_nodes(TreeNode* a, TreeNode* b, Pool& pool, size_t grain) -> TreeNode* {
+    static_assert(is_same<Stats, avl_no_stats>::value, "balancedBST: the parallel set operations need avl_no_stats");
+    // Small or empty inputs are not worth a task.
+    if (this->node_size(a) + this->node_size(b) < grain || a == nullptr || b == nullptr) {
+        return intersection_nodes(a, b);
+    }
+
+    // Split b around a's root key.
+    TreeNode *bLeft, *bFound, *bRight;
+    split_nodes(b, a->data, bLeft, bFound, bRight);
+
+    // Intersect the two sides in parallel.
+    TreeNode* aLeft = a->left;
+    TreeNode* aRight = a->right;
+    TreeNode *left, *right;
+    pool.fork_join([&]() { left = intersection_nodes(aLeft, bLeft, pool, grain); },
+                   [&]() { right = intersection_nodes(aRight, bRight, pool, grain); });
+
+    // Keep a's root only if b held the same key.
+    if (bFound != nullptr) {
+        this->destroy_node(bFound);
+        return join_nodes(left, a, right);
+    }
+    this->destroy_node(a);
+    return join2_nodes(left, right);
+}
+
+/**
+ * @brief Removes the keys of one subtree from another in parallel.
+ *
+ * This is difference_nodes with the two recursive calls run as a fork_join on the pool, down to 
+ * subtrees of grain nodes.
+ *
+ * @param a The subtree to remove from, consumed.
+ * @param b The keys to remove, consumed.
+ * @param pool The task pool.
+ * @param grain The sequential cutoff, in nodes.
+ * @return TreeNode* The root of the difference.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class Pool>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::difference_nodes(TreeNode* a, TreeNode* b, Pool& pool, size_t grain) -> TreeNode* {
+    static_assert(is_same<Stats, avl_no_stats>::value, "balancedBST: the parallel set operations need avl_no_stats");
+    // Small or empty inputs are not worth a task.
+    if (this->node_size(a) + this->node_size(b) < grain || a == nullptr || b == nullptr) {
+        return difference_nodes(a, b);
+    }
+
+    // Split a around b's root key, and drop a's copy of that key.
+    TreeNode *aLeft, *aFound, *aRight;
+    split_nodes(a, b->data, aLeft, aFound, aRight);
+    if (aFound != nullptr) {
+        this->destroy_node(aFound);
+    }
+
+    // Remove the two sides in parallel, then join what is left.
+    TreeNode* bLeft = b->left;
+    TreeNode* bRight = b->right;
+    this->destroy_node(b);
+    TreeNode *left, *right;
+    pool.fork_join([&]() { left = difference_nodes(aLeft, bLeft, pool, grain); },
+                   [&]() { right = difference_nodes(aRight, bRight, pool, grain); });
+    return join2_nodes(left, right);
+}
+
+/**
+ * @brief Moves the keys less than key into left and the rest into right.
+ *
+ * This function splits the tree's nodes with split_nodes and puts the node holding the key, if 
+ * any, back at the front of the right part. This tree ends up empty.
+ *
+ * @param key The key to split at.
+ * @param left Receives the keys less than key.
+ * @param right Receives the keys greater than or equal to key.
+ * @return bool True if the key was in the tree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+bool balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::split(const Key& key, balancedBST& left, balancedBST& right) {
+    TreeNode *lower, *found, *upper;
+    split_nodes(root, key, lower, found, upper);
+    root = nullptr;
+
+    // The key's node starts the right part.
+    if (found != nullptr) {
+        upper = join_nodes(nullptr, found, upper);
+    }
+
+    left.clear();
+    right.clear();
+    left.root = left.adopt_from(*this, lower);
+    right.root = right.adopt_from(*this, upper);
+    return found != nullptr;
+}
+
+/**
+ * @brief Takes all the nodes of another tree, leaving it empty.
+ *
+ * @param other The tree to empty.
+ * @return TreeNode* The root of the taken nodes, owned by this tree's allocator.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::adopt(balancedBST& other) -> TreeNode* {
+    TreeNode* nodes = other.root;
+    other.root = nullptr;
+    return adopt_from(other, nodes);
+}
+
+/**
+ * @brief Takes ownership of nodes that were allocated by another tree.
+ *
+ * If the two allocators compare equal, either one can free the nodes, so they are taken as they 
+ * are. Otherwise they are copied into this tree's allocator, keeping their shape and cached 
+ * values, and the originals are freed through the other tree.
+ *
+ * @param owner The tree whose allocator created the nodes.
+ * @param nodes The root of the nodes; the caller must already have unlinked them from owner.
+ * @return TreeNode* The root of the nodes, owned by this tree's allocator.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::adopt_from(balancedBST& owner, TreeNode* nodes) -> TreeNode* {
+    // Same allocator (or interchangeable ones), so the nodes can simply move.
+    if (this->nodeAlloc == owner.nodeAlloc) {
+        return nodes;
+    }
+
+    // Otherwise copy them into this tree's allocator and free the originals.
+    TreeNode* copy = clone_nodes(nodes);
+    owner.destroy_tree(nodes);
+    return copy;
+}
+
+/**
+ * @brief Copies a subtree.
+ *
+ * This function copies every node recursively through this tree's allocator, keeping the shape 
+ * and the cached heights and sizes. The recursion follows the tree, so it is O(log n) deep.
+ *
+ * @param node The root of the subtree to copy.
+ * @return TreeNode* The root of the copy.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::clone_nodes(const TreeNode* node) -> TreeNode* {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    TreeNode* copy = this->create_node(node->data, node->mapped());
+    copy->left = clone_nodes(node->left);
+    copy->right = clone_nodes(node->right);
+    this->update_node(copy);
+    return copy;
+}
+
+/* --- End of SET OPERATIONS --- */
+
+/* --- BULK CONSTRUCTION --- */
+
+/**
+ * @brief Replaces the contents of the tree with a perfectly height-balanced tree.
+ *
+ * This function empties the tree and rebuilds it from the given range. The work is done by 
+ * build_range, which is chosen by the iterator category: random-access input that is already 
+ * strictly increasing is built in place, anything else is copied, sorted and deduplicated first.
+ *
+ * @param first The first element.
+ * @param last One past the last element.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class InputIt>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::build_from_sorted(InputIt first, InputIt last) {
+    // Start from an empty tree.
+    this->clear();
+
+    // Dispatch on the iterator category.
+    build_range(first, last, typename iterator_traits<InputIt>::iterator_category());
+}
+
+/**
+ * @brief Builds the tree from a random-access range.
+ *
+ * This function checks in one pass whether the keys are strictly increasing. If they are, the 
+ * tree is built straight from the range in O(n). If not, it falls back to the copying overload.
+ *
+ * @param first The first element.
+ * @param last One past the last element.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class RandomIt>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::build_range(RandomIt first, RandomIt last, random_access_iterator_tag) {
+    size_t n = last - first;
+
+    // Check that every key is strictly less than the next one.
+    for (size_t i = 1; i < n; i++) {
+        if (!comp(entry_key(first[i - 1]), entry_key(first[i]))) {
+            // Unsorted or duplicated keys, so copy and sort first.
+            build_range(first, last, input_iterator_tag());
+            return;
+        }
+    }
+
+    // Already sorted and duplicate-free, so build directly.
+    root = build_balanced(first, n);
+}
+
+/**
+ * @brief Builds the tree from any input range.
+ *
+ * This function copies the elements into a vector, sorts them by key (keeping equal keys in 
+ * input order), keeps only the first element of each run of equal keys, and builds the tree 
+ * from the result.
+ *
+ * @param first The first element.
+ * @param last One past the last element.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class InputIt>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::build_range(InputIt first, InputIt last, input_iterator_tag) {
+    // Copy the elements.
+    vector<value_type> entries(first, last);
+
+    // Sort them, with a radix sort when the keys are integers in their natural order.
+    typedef integral_constant<bool, is_integral<Key>::value && !is_same<Key, bool>::value && is_same<Compare, less<Key> >::value> UseRadix;
+    sort_entries(entries, UseRadix());
+
+    // Keep the first element of each run of equal keys.
+    entries.erase(unique(entries.begin(), entries.end(), [this](const value_type& a, const value_type& b) {
+        return this->equal(entry_key(a), entry_key(b));
+    }), entries.end());
+
+    root = build_balanced(entries.begin(), entries.size());
+}
+
+/**
+ * @brief Builds a perfectly height-balanced subtree from sorted, duplicate-free elements.
+ *
+ * This function makes the middle element the root and recursively builds the left and right 
+ * halves as its subtrees, so the two subtree sizes differ by at most one at every node. Each 
+ * element is visited once, so the build is O(n), and the recursion is only O(log n) deep. 
+ * Nodes are created in key order, so a pool allocator lays them out in key order too. The 
+ * cached heights are set bottom-up as the recursion returns.
+ *
+ * @param first The first element.
+ * @param n The number of elements.
+ * @return TreeNode* The root of the subtree.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+template <class RandomIt>
+auto balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::build_balanced(RandomIt first, size_t n) -> TreeNode* {
+    // An empty range gives an empty subtree.
+    if (n == 0) {
+        return nullptr;
+    }
+
+    // Build the left half, then the middle node, then the right half.
+    size_t mid = n / 2;
+    TreeNode* left = build_balanced(first, mid);
+    TreeNode* node = create_entry(first[mid]);
+    node->left = left;
+    node->right = build_balanced(first + (mid + 1), n - mid - 1);
+
+    // Both subtrees are complete, so the height can be set now.
+    this->update_node(node);
+    return node;
+}
+
+/**
+ * @brief Sorts elements by integral key with an LSD radix sort.
+ *
+ * This function sorts on one byte of the key per pass, from the least significant byte up, 
+ * using a counting sort into a second buffer. Signed keys have their sign bit flipped so that 
+ * negative keys sort first. Passes where every key has the same byte are skipped. Each pass is 
+ * stable, so equal keys stay in input order.
+ *
+ * @param entries The elements to sort.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::sort_entries(vector<value_type>& entries, true_type) {
+    typedef typename make_unsigned<Key>::type Bits;
+    const Bits signBit = is_signed<Key>::value ? Bits(Bits(1) << (sizeof(Key) * 8 - 1)) : Bits(0);
+    size_t n = entries.size();
+
+    vector<value_type> buffer(entries);
+    for (size_t shift = 0; shift < sizeof(Key) * 8; shift += 8) {
+        // Count how many keys have each value of this byte.
+        size_t counts[256] = {0};
+        for (size_t i = 0; i < n; i++) {
+            counts[((Bits(entry_key(entries[i])) ^ signBit) >> shift) & 0xFF]++;
+        }
+
+        // If every key has the same byte, this pass would not move anything.
+        if (n == 0 || counts[((Bits(entry_key(entries[0])) ^ signBit) >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        // Turn the counts into starting offsets.
+        size_t offset = 0;
+        for (size_t b = 0; b < 256; b++) {
+            size_t count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+
+        // Scatter into the buffer in order, then swap the buffers.
+        for (size_t i = 0; i < n; i++) {
+            buffer[counts[((Bits(entry_key(entries[i])) ^ signBit) >> shift) & 0xFF]++] = entries[i];
+        }
+        entries.swap(buffer);
+    }
+}
+
+/**
+ * @brief Sorts elements by key with the tree's comparator.
+ *
+ * This is the general case, a stable comparison sort, so equal keys stay in input order.
+ *
+ * @param entries The elements to sort.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::sort_entries(vector<value_type>& entries, false_type) const {
+    stable_sort(entries.begin(), entries.end(), [this](const value_type& a, const value_type& b) {
+        return comp(entry_key(a), entry_key(b));
+    });
+}
+
+/* --- End of BULK CONSTRUCTION --- */
+
+/* --- FROZEN INDEX --- */
+
+/**
+ * @brief Copies the tree into a frozen index.
+ *
+ * This function sizes the index for the tree and then walks the tree in order, so each key goes 
+ * to the array slot of its sorted position. The slot 0 that the search never reads is filled with 
+ * the smallest key, so Key does not need a default constructor.
+ *
+ * @return avl_frozen<Key, Value, Compare> The index.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+avl_frozen<Key, Value, Compare> balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::freeze() const {
+    avl_frozen<Key, Value, Compare> frozen(comp);
+
+    if (root != nullptr) {
+        const TreeNode* smallest = root;
+        while (smallest->left != nullptr) {
+            smallest = smallest->left;
+        }
+
+        frozen.reset(this->node_size(root), smallest->data);
+        size_t position = 0;
+        freeze_nodes(root, frozen, frozen.keys.data(), frozen.values.empty() ? nullptr : frozen.values.data(), position);
+    }
+
+    return frozen;
+}
+
+/**
+ * @brief Copies a subtree into the arrays of a frozen index.
+ *
+ * An in-order walk: the left subtree, then this node at the next sorted position, then the right 
+ * subtree. The recursion is as deep as the tree, which is below AVL_MAX_DEPTH. The arrays may be 
+ * an avl_frozen's own or the ones inside an image file being written.
+ *
+ * @param node The subtree.
+ * @param layout An index of the tree's size.
+ * @param keys The key array.
+ * @param values The value array, or nullptr for sets.
+ * @param position The sorted position of the next key.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::freeze_nodes(const TreeNode* node, const avl_frozen<Key, Value, Compare>& layout,
+                                                                  Key* keys, Value* values, size_t& position) const {
+    if (node == nullptr) {
+        return;
+    }
+
+    freeze_nodes(node->left, layout, keys, values, position);
+
+    size_t k = layout.index(position++);
+    keys[k] = node->data;
+    if (values != nullptr) {
+        values[k] = node->mapped();
+    }
+
+    freeze_nodes(node->right, layout, keys, values, position);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Measures the memory that this process no longer shares with any other.
+ *
+ * After fork every page is shared until one side writes to it; then the writer gets a copy, and 
+ * the page the other side keeps is no longer shared either. Linux sums these pages in 
+ * /proc/self/smaps_rollup, which is read with plain system calls, since the caller may be the 
+ * child of a process with other threads.
+ *
+ * @return long The private kilobytes, or 0 where they cannot be read.
+ */
+inline long avl_private_kb() {
+    int fd = open("/proc/self/smaps_rollup", O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    char text[4096];
+    ssize_t length = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (length <= 0) {
+        return 0;
+    }
+    text[length] = '\0';
+
+    // Sum the Private_Clean and Private_Dirty lines.
+    long total = 0;
+    for (const char* line = text; line != nullptr; line = strchr(line, '\n')) {
+        line += *line == '\n';
+        if (strncmp(line, "Private_", 8) == 0) {
+            total += strtol(strchr(line, ':') + 1, nullptr, 10);
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Writes a whole buffer to a descriptor, retrying short and interrupted writes.
+ *
+ * @param fd The descriptor.
+ * @param data The bytes.
+ * @param bytes How many there are.
+ * @return bool True if everything was written.
+ */
+inline bool avl_write_all(int fd, const char *data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t written = write(fd, data, bytes);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        bytes -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * @brief Syncs a file, or a directory's entries, to disk by name.
+ *
+ * @param path The file or directory.
+ * @return bool True on success.
+ */
+inline bool avl_sync_path(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief Gets the directory a file is in, whose entries must be synced after a rename.
+ *
+ * @param path The file.
+ * @return string The directory.
+ */
+inline string avl_directory_of(const string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+/**
+ * @brief Writes the tree as an image file through a shared mapping.
+ *
+ * The file is sized first, so the padding reads as zeros, and mapped; the walk of freeze() then 
+ * writes each key straight to its Eytzinger slot in the page cache. The checksums are computed 
+ * over the mapped arrays, and the file is synced, renamed into place and its directory synced, 
+ * as in avl_frozen::save.
+ *
+ * @param path The file to write.
+ * @return uint64_t The size of the file.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+uint64_t balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::write_image(const string& path) const {
+    typedef avl_frozen<Key, Value, Compare> Frozen;
+    const size_t n = this->node_size(root);
+    Frozen layout(comp);
+    layout.shape(n);
+    avl_image_header header = Frozen::image_header(n);
+
+    const string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw runtime_error("balancedBST::write_image: cannot write " + path);
+    }
+
+    char* file = nullptr;
+    if (ftruncate(fd, header.fileBytes) == 0) {
+        void* raw = mmap(nullptr, header.fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        file = raw == MAP_FAILED ? nullptr : static_cast<char*>(raw);
+    }
+    if (file == nullptr) {
+        close(fd);
+        remove(temporary.c_str());
+        throw runtime_error("balancedBST::write_image: cannot map " + temporary);
+    }
+
+    Key* keys = reinterpret_cast<Key*>(file + header.keyOffset);
+    Value* values = header.valueOffset == 0 ? nullptr : reinterpret_cast<Value*>(file + header.valueOffset);
+    if (root != nullptr) {
+        const TreeNode* smallest = root;
+        while (smallest->left != nullptr) {
+            smallest = smallest->left;
+        }
+        keys[0] = smallest->data;
+        if (values != nullptr) {
+            values[0] = Value();
+        }
+
+        size_t position = 0;
+        freeze_nodes(root, layout, keys, values, position);
+    }
+
+    Frozen::image_checksums(header, keys, values);
+    memcpy(file, &header, sizeof(header));
+
+    bool ok = fsync(fd) == 0;
+    munmap(file, header.fileBytes);
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0 || !avl_sync_path(avl_directory_of(path))) {
+        remove(temporary.c_str());
+        throw runtime_error("balancedBST::write_image: cannot write " + path);
+    }
+
+    return header.fileBytes;
+}
+#endif
+
+/**
+ * @brief Writes the tree as an image file.
+ *
+ * @param path The file to write.
+ * @return void
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+void balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::save(const string& path) const {
+    static_assert(is_trivially_copyable<Key>::value, "balancedBST::save needs a trivially copyable Key");
+    static_assert(is_trivially_copyable<Value>::value, "balancedBST::save needs a trivially copyable Value");
+#if defined(__unix__) || defined(__APPLE__)
+    write_image(path);
+#else
+    freeze().save(path);
+#endif
+}
+
+/**
+ * @brief Forks a child that writes the tree as an image.
+ *
+ * The child only runs write_image, measures its private memory before and after, sends its 
+ * report down a pipe and leaves with _exit, so that nothing of the parent's (destructors, atexit 
+ * handlers, buffered output) runs twice. Other threads of the parent do not exist in the child; 
+ * the child takes no lock they might have held, other than the allocator's, which fork resets. 
+ * The output mapping is gone before the second measurement, so the private pages it counts are 
+ * the ones copy-on-write duplicated, plus the few the child dirtied itself (its stack, the path 
+ * strings).
+ *
+ * @param path The file to write.
+ * @return avl_checkpoint The handle of the child.
+ */
+template <class Key, class Value, class Compare, class Alloc, class Stats, class Augment>
+avl_checkpoint balancedBST<Key, Value, Compare, Alloc, Stats, Augment>::checkpoint_async(const string& path) const {
+    static_assert(is_trivially_copyable<Key>::value, "balancedBST::checkpoint_async needs a trivially copyable Key");
+    static_assert(is_trivially_copyable<Value>::value, "balancedBST::checkpoint_async needs a trivially copyable Value");
+    avl_checkpoint checkpoint;
+
+#if defined(__unix__) || defined(__APPLE__)
+    int channel[2];
+    if (pipe(channel) != 0) {
+        throw runtime_error("balancedBST::checkpoint_async: cannot create a pipe");
+    }
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(channel[0]);
+        close(channel[1]);
+        throw runtime_error("balancedBST::checkpoint_async: cannot fork");
+    }
+
+    if (child == 0) {
+        close(channel[0]);
+        int status = 1;
+        try {
+            auto start = chrono::steady_clock::now();
+            long before = avl_private_kb();
+            uint64_t report[3];
+            report[0] = write_image(path);
+            long copied = avl_private_kb() - before;
+            report[1] = copied <= 0 ? 0 : (uint64_t)copied * 1024 / sysconf(_SC_PAGESIZE);
+            report[2] = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            if (write(channel[1], report, sizeof(report)) == (ssize_t)sizeof(report)) {
+                status = 0;
+            }
+        } catch (...) {
+        }
+        _exit(status);
+    }
+
+    close(channel[1]);
+    checkpoint.child = child;
+    checkpoint.channel = channel[0];
+#else
+    auto start = chrono::steady_clock::now();
+    avl_frozen<Key, Value, Compare> frozen = freeze();
+    frozen.save(path);
+    avl_image_header header = avl_frozen<Key, Value, Compare>::image_header(frozen.size());
+    checkpoint.succeeded = true;
+    checkpoint.bytes = header.fileBytes;
+    checkpoint.elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#endif
+
+    return checkpoint;
+}
+
+/* --- End of FROZEN INDEX --- */
+
+/* --- End of BALANCED BST --- */
+
+/* --- FROZEN INDEX CLASS --- */
+
+/**
+ * @brief Finds the index of the highest set bit, the depth of an Eytzinger index.
+ *
+ * @param x A nonzero number.
+ * @return int floor(log2(x)).
+ */
+inline int avl_floor_log2(size_t x) {
+#if defined(__GNUC__)
+    return (int)(sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(x);
+#else
+    int bit = -1;
+    while (x != 0) {
+        x >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Counts the zero bits below the lowest set bit.
+ *
+ * @param x A nonzero number.
+ * @return int The number of trailing zeros.
+ */
+inline int avl_trailing_zeros(size_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int zeros = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        zeros++;
+    }
+    return zeros;
+#endif
+}
+
+/**
+ * @brief Rounds down to a power of two, at least 1.
+ *
+ * @param x A number.
+ * @return size_t The largest power of two <= x, or 1.
+ */
+constexpr size_t avl_power_of_two_below(size_t x) {
+    return x < 2 ? 1 : 2 * avl_power_of_two_below(x / 2);
+}
+
+/**
+ * @brief Sizes the arrays for n keys.
+ *
+ * The implicit tree is complete: every level is full except the bottom one, which is filled from 
+ * the left. So n alone fixes its shape, given by the number of levels and of bottom-level keys.
+ * An index that was loaded from an image lets go of it and uses its own arrays again.
+ *
+ * @param n The number of keys.
+ * @param smallest The smallest key.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void avl_frozen<Key, Value, Compare>::reset(size_t n, const Key& smallest) {
+    keys.assign(n + 1, smallest);
+    values.clear();
+    if (!is_same<Value, avl_no_value>::value) {
+        values.resize(n + 1);
+    }
+
+    image.reset();
+    shape(n);
+}
+
+/**
+ * @brief Sets the shape of the implicit tree for n keys.
+ *
+ * @param n The number of keys.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void avl_frozen<Key, Value, Compare>::shape(size_t n) {
+    count = n;
+    levels = n == 0 ? 0 : avl_floor_log2(n) + 1;
+    lastLevel = n == 0 ? 0 : n - (((size_t)1 << (levels - 1)) - 1);
+}
+
+/**
+ * @brief Finds the index of the first key >= key (or > key).
+ *
+ * The walk starts at the root, index 1, and moves to 2k when the key is on the left and to 
+ * 2k + 1 when it is on the right, so the comparison result is simply added to 2k and the 
+ * loop has no data-dependent branch. Its only branch is the loop test, which the CPU predicts 
+ * well, and the loop always runs for as many levels as the tree has.
+ *
+ * While comparing at index k the function prefetches index k * L, where L keys fill one cache 
+ * line: those are the first descendants log2(L) levels down, so their line is on its way before 
+ * the walk gets there.
+ *
+ * When the walk falls off the bottom, the bits of k record the turns taken, a 1 for each 
+ * right turn. The answer is the last node where the walk turned left, which is found by 
+ * dropping the trailing 1 bits and then one more. If the walk never turned left, that is 0.
+ *
+ * @param key The key to bound.
+ * @return size_t The index, or 0 if there is none.
+ */
+template <class Key, class Value, class Compare>
+template <bool Upper>
+size_t avl_frozen<Key, Value, Compare>::search(const Key& key) const {
+    static const size_t lookahead = avl_power_of_two_below(64 / sizeof(Key));
+    const Key* base = key_data();
+    size_t k = 1;
+
+    while (k <= count) {
+        AVL_PREFETCH((uintptr_t)base + k * lookahead * sizeof(Key));
+        // Go right past keys < key (or <= key for an upper bound).
+        k = 2 * k + (size_t)(Upper ? !comp(key, base[k]) : comp(base[k], key));
+    }
+
+    return k >> (avl_trailing_zeros(~k) + 1);
+}
+
+/**
+ * @brief Converts an array index to its position in sorted order.
+ *
+ * In a perfect tree with h levels, the node t places from the left on level d has the in-order 
+ * position (2t + 1) * 2^(h - 1 - d) - 1. The bottom level of the real tree is cut short: its 
+ * nodes take the even positions, and the missing ones would have come after the first 
+ * 2 * lastLevel positions, so positions past that are shifted down by the missing nodes.
+ *
+ * @param index An array index, or 0.
+ * @return size_t The position, or size() for index 0.
+ */
+template <class Key, class Value, class Compare>
+size_t avl_frozen<Key, Value, Compare>::position(size_t index) const {
+    if (index == 0) {
+        return count;
+    }
+
+    int depth = avl_floor_log2(index);
+    size_t full = ((2 * (index - ((size_t)1 << depth)) + 1) << (levels - 1 - depth)) - 1;
+
+    return full < 2 * lastLevel ? full : (full + 2 * lastLevel - 1) / 2;
+}
+
+/**
+ * @brief Converts a position in sorted order to its array index, the inverse of position().
+ *
+ * @param position A position less than size().
+ * @return size_t The array index.
+ */
+template <class Key, class Value, class Compare>
+size_t avl_frozen<Key, Value, Compare>::index(size_t position) const {
+    size_t full = position < 2 * lastLevel ? position : 2 * position - 2 * lastLevel + 1;
+
+    // full + 1 = (2t + 1) * 2^zeros, where zeros is the distance from the bottom level.
+    int zeros = avl_trailing_zeros(full + 1);
+    int depth = levels - 1 - zeros;
+
+    return ((size_t)1 << depth) + ((full + 1) >> (zeros + 1));
+}
+
+/**
+ * @brief Hashes a block of bytes for the image checksums.
+ *
+ * The bytes are taken eight at a time as words, each mixed into the hash with one multiply 
+ * and one shift, so checksumming runs at several gigabytes per second. It catches torn and 
+ * corrupted files; it is not meant to resist deliberate tampering. Passing the hash of one 
+ * block as the seed of the next chains blocks together.
+ *
+ * @param data The bytes.
+ * @param bytes How many there are.
+ * @param seed The starting hash.
+ * @return uint64_t The hash.
+ */
+inline uint64_t avl_checksum(const void* data, size_t bytes, uint64_t seed = 0) {
+    static const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t hash = (seed ^ bytes) * multiplier;
+
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+    }
+
+    // The last few bytes make up one more word.
+    uint64_t word = 0;
+    for (size_t shift = 0; i < bytes; i++, shift += 8) {
+        word |= (uint64_t)p[i] << shift;
+    }
+    hash = (hash ^ word) * multiplier;
+
+    return hash ^ (hash >> 29);
+}
+
+/**
+ * @brief Rounds a file offset up to the array alignment.
+ *
+ * @param offset The offset.
+ * @return uint64_t The next multiple of AVL_IMAGE_ALIGN.
+ */
+inline uint64_t avl_image_align(uint64_t offset) {
+    return (offset + AVL_IMAGE_ALIGN - 1) / AVL_IMAGE_ALIGN * AVL_IMAGE_ALIGN;
+}
+
+/**
+ * @brief Opens a file and maps it, or reads it, into memory.
+ *
+ * The mapping is private to this process and read-only, so the pages stay shared with the page 
+ * cache and with every other process that maps the same file. The descriptor is closed at once; 
+ * the mapping keeps the file alive by itself.
+ *
+ * @param path The file.
+ */
+inline avl_image::avl_image(const string& path) : bytes(nullptr), length(0), mapped(false) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("avl_image: cannot open " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw runtime_error("avl_image: cannot stat " + path);
+    }
+
+    length = (size_t)info.st_size;
+    if (length > 0) {
+        void* raw = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (raw == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("avl_image: cannot map " + path);
+        }
+        bytes = static_cast<const char*>(raw);
+        mapped = true;
+    }
+    close(fd);
+#else
+    ifstream in(path.c_str(), ios::binary | ios::ate);
+    if (!in) {
+        throw runtime_error("avl_image: cannot open " + path);
+    }
+
+    length = (size_t)in.tellg();
+    char* buffer = new char[length + 1];
+    in.seekg(0);
+    if (!in.read(buffer, length)) {
+        delete[] buffer;
+        throw runtime_error("avl_image: cannot read " + path);
+    }
+    bytes = buffer;
+#endif
+}
+
+/**
+ * @brief Unmaps, or frees, the file.
+ */
+inline avl_image::~avl_image() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) {
+        munmap(const_cast<char*>(bytes), length);
+    }
+#else
+    delete[] bytes;
+#endif
+}
+
+/**
+ * @brief Takes over another checkpoint's child.
+ *
+ * @param other The checkpoint, left finished.
+ */
+inline avl_checkpoint::avl_checkpoint(avl_checkpoint&& other)
+    : child(other.child), channel(other.channel), succeeded(other.succeeded), bytes(other.bytes),
+      pages(other.pages), elapsed(other.elapsed) {
+    other.child = -1;
+    other.channel = -1;
+}
+
+/**
+ * @brief Waits for this checkpoint's child, then takes over another's.
+ *
+ * @param other The checkpoint, left finished.
+ * @return avl_checkpoint& This checkpoint.
+ */
+inline avl_checkpoint& avl_checkpoint::operator=(avl_checkpoint&& other) {
+    if (this != &other) {
+        reap(true);
+        child = other.child;
+        channel = other.channel;
+        succeeded = other.succeeded;
+        bytes = other.bytes;
+        pages = other.pages;
+        elapsed = other.elapsed;
+        other.child = -1;
+        other.channel = -1;
+    }
+    return *this;
+}
+
+/**
+ * @brief Collects the writer once it has exited.
+ *
+ * The writer succeeded only if it exited with status 0 and its whole report is in the pipe. A
+ * report is a few bytes, far below the pipe's buffer, so the writer never blocks on it and it is
+ * read after the exit.
+ *
+ * @param block Whether to wait for the writer.
+ * @return void
+ */
+inline void avl_checkpoint::reap(bool block) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (child < 0) {
+        return;
+    }
+
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(child, &status, block ? 0 : WNOHANG);
+    } while (result < 0 && errno == EINTR);
+    if (result == 0) {
+        return;
+    }
+
+    uint64_t report[3] = {0, 0, 0};
+    succeeded = result == child && WIFEXITED(status) && WEXITSTATUS(status) == 0
+                && read(channel, report, sizeof(report)) == (ssize_t)sizeof(report);
+    bytes = report[0];
+    pages = report[1];
+    elapsed = report[2] / 1e9;
+
+    close(channel);
+    child = -1;
+    channel = -1;
+#else
+    (void)block;
+#endif
+}
+
+/**
+ * @brief Lays out an image of n keys.
+ *
+ * Each array starts on the next AVL_IMAGE_ALIGN boundary after what comes before it. An empty 
+ * index has no arrays, and a set no value array, so its valueOffset stays 0.
+ *
+ * @param n The number of keys.
+ * @return avl_image_header The header, without its checksums.
+ */
+template <class Key, class Value, class Compare>
+avl_image_header avl_frozen<Key, Value, Compare>::image_header(size_t n) {
+    const bool hasValues = !is_same<Value, avl_no_value>::value;
+    const size_t slots = n == 0 ? 0 : n + 1;
+
+    avl_image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AVL_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = AVL_IMAGE_VERSION;
+    header.byteOrder = AVL_IMAGE_BYTE_ORDER;
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = hasValues ? sizeof(Value) : 0;
+    header.count = n;
+    header.keyOffset = avl_image_align(sizeof(header));
+    header.valueOffset = hasValues ? avl_image_align(header.keyOffset + slots * sizeof(Key)) : 0;
+    header.fileBytes = hasValues ? header.valueOffset + slots * sizeof(Value) : header.keyOffset + slots * sizeof(Key);
+
+    return header;
+}
+
+/**
+ * @brief Checksums the arrays of an image, and then the header itself.
+ *
+ * @param header The header.
+ * @param keys The key array.
+ * @param values The value array, or nullptr for sets.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void avl_frozen<Key, Value, Compare>::image_checksums(avl_image_header& header, const Key* keys, const Value* values) {
+    const size_t slots = header.count == 0 ? 0 : header.count + 1;
+
+    header.payloadChecksum = avl_checksum(keys, slots * sizeof(Key));
+    if (header.valueBytes != 0) {
+        header.payloadChecksum = avl_checksum(values, slots * sizeof(Value), header.payloadChecksum);
+    }
+    header.headerChecksum = avl_checksum(&header, offsetof(avl_image_header, headerChecksum));
+}
+
+/**
+ * @brief Writes the index to an image file.
+ *
+ * The header is filled in first, with the checksums of the arrays and then of the header itself. 
+ * The file is written in one pass: header, zero padding up to the key array, the keys, padding, 
+ * and the values. An empty index writes no arrays. It goes to path + ".tmp", which is synced, 
+ * renamed over path and its directory synced, as balancedBST::write_image does, so a crash leaves 
+ * either the old image or the new one.
+ *
+ * @param path The file to write.
+ * @return void
+ */
+template <class Key, class Value, class Compare>
+void avl_frozen<Key, Value, Compare>::save(const string& path) const {
+    static_assert(is_trivially_copyable<Key>::value, "avl_frozen::save needs a trivially copyable Key");
+    static_assert(is_trivially_copyable<Value>::value, "avl_frozen::save needs a trivially copyable Value");
+    const bool hasValues = !is_same<Value, avl_no_value>::value;
+    const size_t slots = count == 0 ? 0 : count + 1;
+    avl_image_header header = image_header(count);
+    image_checksums(header, key_data(), value_data());
+
+    static const char zeros[AVL_IMAGE_ALIGN] = {};
+    const string temporary = path + ".tmp";
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw runtime_error("avl_frozen::save: cannot write " + path);
+    }
+    bool ok = avl_write_all(fd, reinterpret_cast<const char*>(&header), sizeof(header))
+        && avl_write_all(fd, zeros, header.keyOffset - sizeof(header))
+        && avl_write_all(fd, reinterpret_cast<const char*>(key_data()), slots * sizeof(Key));
+    if (hasValues) {
+        ok = ok && avl_write_all(fd, zeros, header.valueOffset - (header.keyOffset + slots * sizeof(Key)))
+            && avl_write_all(fd, reinterpret_cast<const char*>(value_data()), slots * sizeof(Value));
+    }
+    ok = fsync(fd) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0 || !avl_sync_path(avl_directory_of(path))) {
+        remove(temporary.c_str());
+        throw runtime_error("avl_frozen::save: cannot write " + path);
+    }
+#else
+    ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(zeros, header.keyOffset - sizeof(header));
+    out.write(reinterpret_cast<const char*>(key_data()), slots * sizeof(Key));
+    if (hasValues) {
+        out.write(zeros, header.valueOffset - (header.keyOffset + slots * sizeof(Key)));
+        out.write(reinterpret_cast<const char*>(value_data()), slots * sizeof(Value));
+    }
+    out.close();
+
+    if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        throw runtime_error("avl_frozen::save: cannot write " + path);
+    }
+#endif
+}
+
+/**
+ * @brief Opens an image file as an index.
+ *
+ * Every header field is checked against this Key and Value and against the file size before 
+ * anything is read from the arrays, so a truncated or foreign file is refused instead of read 
+ * past its end. The index then points into the mapping; only the shape is computed, from count.
+ *
+ * @param path The file to open.
+ * @param verify Whether to checksum the keys and values as well as the header.
+ * @param compare The ordering.
+ * @return avl_frozen<Key, Value, Compare> The index.
+ */
+template <class Key, class Value, class Compare>
+avl_frozen<Key, Value, Compare> avl_frozen<Key, Value, Compare>::load(const string& path, bool verify, const Compare& compare) {
+    static_assert(is_trivially_copyable<Key>::value, "avl_frozen::load needs a trivially copyable Key");
+    static_assert(is_trivially_copyable<Value>::value, "avl_frozen::load needs a trivially copyable Value");
+    const bool hasValues = !is_same<Value, avl_no_value>::value;
+
+    shared_ptr<const avl_image> file = make_shared<avl_image>(path);
+    auto fail = [&path](const char* reason) {
+        throw runtime_error("avl_frozen::load: " + path + ": " + reason);
+    };
+
+    avl_image_header header;
+    if (file->size() < sizeof(header)) {
+        fail("too short for an image header");
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, AVL_IMAGE_MAGIC, sizeof(header.magic)) != 0) {
+        fail("not an image file");
+    }
+    if (header.headerChecksum != avl_checksum(&header, offsetof(avl_image_header, headerChecksum))) {
+        fail("header checksum mismatch");
+    }
+    if (header.version != AVL_IMAGE_VERSION) {
+        fail("unsupported image version");
+    }
+    if (header.byteOrder != AVL_IMAGE_BYTE_ORDER) {
+        fail("written with another byte order");
+    }
+    if (header.keyBytes != sizeof(Key) || header.valueBytes != (hasValues ? sizeof(Value) : 0)) {
+        fail("key or value size does not match");
+    }
+    if (header.fileBytes != file->size()) {
+        fail("file size does not match the header");
+    }
+
+    // Bound count by the file size first, so the array sizes below cannot overflow.
+    const uint64_t slots = header.count == 0 ? 0 : header.count + 1;
+    if (header.count >= file->size() || header.keyOffset > file->size()
+        || slots > (file->size() - header.keyOffset) / sizeof(Key)) {
+        fail("key array out of bounds");
+    }
+    if (hasValues && (header.valueOffset > file->size()
+        || slots > (file->size() - header.valueOffset) / sizeof(Value))) {
+        fail("value array out of bounds");
+    }
+
+    const char* keyStart = file->data() + header.keyOffset;
+    const char* valueStart = file->data() + header.valueOffset;
+    if ((uintptr_t)keyStart % alignof(Key) != 0 || (hasValues && (uintptr_t)valueStart % alignof(Value) != 0)) {
+        fail("misaligned arrays");
+    }
+
+    if (verify) {
+        uint64_t checksum = avl_checksum(keyStart, slots * sizeof(Key));
+        if (hasValues) {
+            checksum = avl_checksum(valueStart, slots * sizeof(Value), checksum);
+        }
+        if (checksum != header.payloadChecksum) {
+            fail("payload checksum mismatch");
+        }
+    }
+
+    avl_frozen frozen(compare);
+    frozen.image = file;
+    frozen.imageKeys = reinterpret_cast<const Key*>(keyStart);
+    frozen.imageValues = hasValues ? reinterpret_cast<const Value*>(valueStart) : nullptr;
+    frozen.shape(header.count);
+
+    return frozen;
+}
+
+/* --- End of FROZEN INDEX CLASS --- */
+
+/* --- ITERATORS --- */
+
+/**
+ * @brief Creates the begin or end iterator of a tree.
+ *
+ * The end iterator has an empty path. The begin iterator walks from the root to the first node 
+ * of its order: the leftmost node for in-order, the rightmost for reverse in-order, the root for 
+ * pre-order, and the first leaf reached by preferring left children for post-order.
+ *
+ * @param treeRoot The root of the tree.
+ * @param first True for the begin iterator, false for the end iterator.
+ */
+template <class Node, class Entry, avl_order Order>
+avl_iterator<Node, Entry, Order>::avl_iterator(Node* treeRoot, bool first) : root(treeRoot), depth(0) {
+    // The end iterator, or the begin iterator of an empty tree.
+    if (!first || root == nullptr) {
+        return;
+    }
+
+    if (Order == AVL_IN_ORDER) {
+        push_leftmost(root);
+    } else if (Order == AVL_REVERSE_ORDER) {
+        push_rightmost(root);
+    } else if (Order == AVL_POST_ORDER) {
+        push_first_post_order(root);
+    } else {
+        push(root);
+    }
+}
+
+/**
+ * @brief Moves to the next node in the iterator's order.
+ *
+ * @return avl_iterator& This iterator.
+ */
+template <class Node, class Entry, avl_order Order>
+auto avl_iterator<Node, Entry, Order>::operator++() -> avl_iterator& {
+    if (Order == AVL_IN_ORDER) {
+        next_in_order();
+    } else if (Order == AVL_REVERSE_ORDER) {
+        prev_in_order();
+    } else if (Order == AVL_PRE_ORDER) {
+        next_pre_order();
+    } else {
+        next_post_order();
+    }
+    return *this;
+}
+
+/**
+ * @brief Moves to the previous node in key order (in-order and reverse in-order only).
+ *
+ * Stepping back from the end lands on the last node.
+ *
+ * @return avl_iterator& This iterator.
+ */
+template <class Node, class Entry, avl_order Order>
+auto avl_iterator<Node, Entry, Order>::operator--() -> avl_iterator& {
+    static_assert(Order == AVL_IN_ORDER || Order == AVL_REVERSE_ORDER, "only in-order iterators are bidirectional");
+
+    if (Order == AVL_IN_ORDER) {
+        // Stepping back from the end lands on the largest key.
+        if (depth == 0) {
+            push_rightmost(root);
+        } else {
+            prev_in_order();
+        }
+    } else {
+        // Stepping back from the end lands on the smallest key.
+        if (depth == 0) {
+            push_leftmost(root);
+        } else {
+            next_in_order();
+        }
+    }
+    return *this;
+}
+
+/**
+ * @brief Moves to the in-order successor.
+ *
+ * If the current node has a right subtree, the successor is the leftmost node of that subtree. 
+ * Otherwise it is the nearest ancestor whose left subtree holds the current node, found by 
+ * popping the path while we are coming up from a right child. If there is no such ancestor, the 
+ * path empties and the iterator becomes the end.
+ *
+ * @return void
+ */
+template <class Node, class Entry, avl_order Order>
+void avl_iterator<Node, Entry, Order>::next_in_order() {
+    Node* node = top();
+
+    // Go down into the right subtree, if there is one.
+    if (node->right != nullptr) {
+        push_leftmost(node->right);
+        return;
+    }
+
+    // Otherwise climb until we come up from a left child.
+    Node* child = pop();
+    while (depth > 0 && top()->right == child) {
+        child = pop();
+    }
+}
+
+/**
+ * @brief Moves to the in-order predecessor.
+ *
+ * This is the mirror image of next_in_order: the rightmost node of the left subtree, or else 
+ * the nearest ancestor whose right subtree holds the current node.
+ *
+ * @return void
+ */
+template <class Node, class Entry, avl_order Order>
+void avl_iterator<Node, Entry, Order>::prev_in_order() {
+    Node* node = top();
+
+    // Go down into the left subtree, if there is one.
+    if (node->left != nullptr) {
+        push_rightmost(node->left);
+        return;
+    }
+
+    // Otherwise climb until we come up from a right child.
+    Node* child = pop();
+    while (depth > 0 && top()->left == child) {
+        child = pop();
+    }
+}
+
+/**
+ * @brief Moves to the next node in pre-order.
+ *
+ * If the current node has a child, the next node is its left child, or else its right child. 
+ * Otherwise the function climbs until it comes up from a left child whose parent has a right 
+ * child, and moves to that right child. If there is none, the path empties and the iterator 
+ * becomes the end.
+ *
+ * @return void
+ */
+template <class Node, class Entry, avl_order Order>
+void avl_iterator<Node, Entry, Order>::next_pre_order() {
+    Node* node = top();
+
+    // Go down, left child first.
+    if (node->left != nullptr) {
+        push(node->left);
+        return;
+    }
+    if (node->right != nullptr) {
+        push(node->right);
+        return;
+    }
+
+    // Climb until a parent has a right subtree we have not visited yet.
+    Node* child = pop();
+    while (depth > 0) {
+        Node* parent = top();
+        if (parent->left == child && parent->right != nullptr) {
+            push(parent->right);
+            return;
+        }
+        child = pop();
+    }
+}
+
+/**
+ * @brief Pushes the path to the first node of a subtree in post-order.
+ *
+ * That node is the first leaf reached by going left whenever possible and right otherwise.
+ *
+ * @param node The root of the subtree.
+ * @return void
+ */
+template <class Node, class Entry, avl_order Order>
+void avl_iterator<Node, Entry, Order>::push_first_post_order(Node* node) {
+    while (node != nullptr) {
+        push(node);
+        node = (node->left != nullptr) ? node->left : node->right;
+    }
+}
+
+/**
+ * @brief Moves to the next node in post-order.
+ *
+ * The next node is the parent, unless we are coming up from a left child and the parent also 
+ * has a right subtree; then it is the first post-order node of that right subtree.
+ *
+ * @return void
+ */
+template <class Node, class Entry, avl_order Order>
+void avl_iterator<Node, Entry, Order>::next_post_order() {
+    Node* child = pop();
+
+    // After the root comes the end.
+    if (depth == 0) {
+        return;
+    }
+
+    // Visit the parent's right subtree before the parent itself.
+    Node* parent = top();
+    if (parent->left == child && parent->right != nullptr) {
+        push_first_post_order(parent->right);
+    }
+}
+
+/* --- End of ITERATORS --- */
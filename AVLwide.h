@@ -0,0 +1,1113 @@
+/**
+ * @file AVLwide.h
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains wideBST, a B+ tree for small integer keys with the same interface
+ * as balancedBST. Each node holds one cache line of sorted keys (8 for 64-bit keys, 16 for
+ * 32-bit keys, 64 for char), and the position of a key inside a node is found with one
+ * SIMD compare per 16 or 32 bytes instead of a chain of dependent branches. The tree is
+ * 3 to 5 times shallower than an AVL tree with the same keys:
+ *
+ *     avl_wide_set<uint32_t> ids;
+ *     ids.insertNode(7);
+ *     bool found = ids.searchItem(7);
+ *
+ *     avl_fast_set<uint32_t> any;     // wideBST for small integer keys, balancedBST otherwise
+ *
+ * AVX2 is used when the CPU has it, checked once at run time, then SSE2, then plain C++.
+ *
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+#ifndef AVLWIDE_H
+#define AVLWIDE_H
+
+/* --- IMPORTS --- */
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "AVLtrees.h"
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AVL_WIDE_X86
+#include <immintrin.h>
+#endif
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- NODE SEARCH --- */
+/**
+ * @brief Size of the key array of a wideBST node, one cache line.
+ */
+static const size_t AVL_CACHE_LINE = 64;
+
+/**
+ * @brief Tells whether wideBST can hold a key type: an integer type of 1, 2, 4 or 8 bytes,
+ * other than bool, ordered by less<Key>.
+ */
+template <class Key, class Compare = less<Key> >
+struct avl_wide_eligible : integral_constant<bool,
+	is_integral<Key>::value && !is_same<Key, bool>::value && is_same<Compare, less<Key> >::value &&
+	(sizeof(Key) == 1 || sizeof(Key) == 2 || sizeof(Key) == 4 || sizeof(Key) == 8)> {};
+
+/**
+ * @brief Counts the keys of a node that are less than x. The node holds
+ * AVL_CACHE_LINE / sizeof(Key) keys in ascending order, with the unused slots set to
+ * the largest Key, so the keys that are less than x always form a prefix and the
+ * unused slots never count. Each version compares the whole line at once.
+ *
+ * @param keys: (const Key*) the node's key array
+ * @param x: (Key) the key to place
+ * @return unsigned: the number of keys < x, the position of the first key >= x
+ */
+template <class Key>
+unsigned avl_count_less_scalar (const Key *keys, Key x) {
+	unsigned count = 0;
+	for (size_t i = 0; i < AVL_CACHE_LINE / sizeof(Key); i++) {
+		count += keys[i] < x;
+	}
+	return count;
+}
+
+#ifdef AVL_WIDE_X86
+/**
+ * @brief The SSE2 and AVX2 compares for each key width. x86 only compares signed lanes,
+ * so unsigned keys and x are first shifted into the signed range by flipping the top bit,
+ * which keeps their order. There is no 64-bit compare in SSE2.
+ */
+template <size_t Width>
+struct avl_lanes;
+
+template <>
+struct avl_lanes<1> {
+	static __m128i splat (uint64_t x) {return _mm_set1_epi8((char)x);};
+	static __m128i greater (__m128i a, __m128i b) {return _mm_cmpgt_epi8(a, b);};
+	__attribute__((target("avx2"))) static __m256i splat256 (uint64_t x) {return _mm256_set1_epi8((char)x);};
+	__attribute__((target("avx2"))) static __m256i greater256 (__m256i a, __m256i b) {return _mm256_cmpgt_epi8(a, b);};
+};
+
+template <>
+struct avl_lanes<2> {
+	static __m128i splat (uint64_t x) {return _mm_set1_epi16((short)x);};
+	static __m128i greater (__m128i a, __m128i b) {return _mm_cmpgt_epi16(a, b);};
+	__attribute__((target("avx2"))) static __m256i splat256 (uint64_t x) {return _mm256_set1_epi16((short)x);};
+	__attribute__((target("avx2"))) static __m256i greater256 (__m256i a, __m256i b) {return _mm256_cmpgt_epi16(a, b);};
+};
+
+template <>
+struct avl_lanes<4> {
+	static __m128i splat (uint64_t x) {return _mm_set1_epi32((int)x);};
+	static __m128i greater (__m128i a, __m128i b) {return _mm_cmpgt_epi32(a, b);};
+	__attribute__((target("avx2"))) static __m256i splat256 (uint64_t x) {return _mm256_set1_epi32((int)x);};
+	__attribute__((target("avx2"))) static __m256i greater256 (__m256i a, __m256i b) {return _mm256_cmpgt_epi32(a, b);};
+};
+
+template <>
+struct avl_lanes<8> {
+	__attribute__((target("avx2"))) static __m256i splat256 (uint64_t x) {return _mm256_set1_epi64x((long long)x);};
+	__attribute__((target("avx2"))) static __m256i greater256 (__m256i a, __m256i b) {return _mm256_cmpgt_epi64(a, b);};
+};
+
+/**
+ * @brief The top bit of a lane, flipped in unsigned keys before a signed compare.
+ */
+template <class Key>
+uint64_t avl_sign_flip () {return is_signed<Key>::value ? 0 : (uint64_t)1 << (8 * sizeof(Key) - 1);}
+
+/**
+ * @brief avl_count_less_scalar with SSE2: four 16-byte compares. The byte masks of the
+ * lanes that are less than x are joined into one 64-bit mask, whose run of low 1 bits
+ * is the prefix, so its length in bytes divided by the key size is the count.
+ */
+template <class Key>
+unsigned avl_count_less_sse2 (const Key *keys, Key x, true_type) {
+	typedef avl_lanes<sizeof(Key)> Lanes;
+	__m128i flip = Lanes::splat(avl_sign_flip<Key>());
+	__m128i probe = _mm_xor_si128(Lanes::splat((uint64_t)x), flip);
+	uint64_t mask = 0;
+	for (size_t i = 0; i < AVL_CACHE_LINE; i += 16) {
+		__m128i line = _mm_xor_si128(_mm_loadu_si128((const __m128i *)((const char *)keys + i)), flip);
+		mask |= (uint64_t)(unsigned)_mm_movemask_epi8(Lanes::greater(probe, line)) << i;
+	}
+	return mask == ~(uint64_t)0 ? AVL_CACHE_LINE / sizeof(Key) : __builtin_ctzll(~mask) / sizeof(Key);
+}
+
+template <class Key>
+unsigned avl_count_less_sse2 (const Key *keys, Key x, false_type) {return avl_count_less_scalar(keys, x);}
+
+/**
+ * @brief avl_count_less_scalar with AVX2: two 32-byte compares, for every key width.
+ */
+template <class Key>
+__attribute__((target("avx2"))) unsigned avl_count_less_avx2 (const Key *keys, Key x) {
+	typedef avl_lanes<sizeof(Key)> Lanes;
+	__m256i flip = Lanes::splat256(avl_sign_flip<Key>());
+	__m256i probe = _mm256_xor_si256(Lanes::splat256((uint64_t)x), flip);
+	__m256i low = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)keys), flip);
+	__m256i high = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)((const char *)keys + 32)), flip);
+	uint64_t mask = (uint64_t)(unsigned)_mm256_movemask_epi8(Lanes::greater256(probe, low)) |
+		(uint64_t)(unsigned)_mm256_movemask_epi8(Lanes::greater256(probe, high)) << 32;
+	return mask == ~(uint64_t)0 ? AVL_CACHE_LINE / sizeof(Key) : __builtin_ctzll(~mask) / sizeof(Key);
+}
+
+/**
+ * @brief Checks once whether the CPU has AVX2.
+ *
+ * @return bool
+ */
+inline bool avl_cpu_has_avx2 () {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+#endif
+
+/**
+ * @brief Counts the keys of a node that are less than x with the widest compare the CPU has.
+ *
+ * @param keys: (const Key*) the node's key array
+ * @param x: (Key) the key to place
+ * @return unsigned: the number of keys < x
+ */
+template <class Key>
+unsigned avl_count_less (const Key *keys, Key x) {
+#ifdef AVL_WIDE_X86
+	if (avl_cpu_has_avx2()) {
+		return avl_count_less_avx2(keys, x);
+	}
+	return avl_count_less_sse2(keys, x, integral_constant<bool, sizeof(Key) < 8>());
+#else
+	return avl_count_less_scalar(keys, x);
+#endif
+}
+/* --- End of NODE SEARCH --- */
+
+/* --- CACHE LINE ALLOCATOR --- */
+/**
+ * @brief Allocator that starts every block on a cache line, so that a wideBST node's key
+ * array is one line and not two. It over-allocates by one line through operator new and
+ * keeps the original pointer just before the block.
+ */
+template <class T>
+struct avl_line_allocator {
+	typedef T value_type;
+
+	avl_line_allocator () {};
+	template <class U>
+	avl_line_allocator (const avl_line_allocator<U> &) {};
+
+	T* allocate (size_t n) {
+		char *raw = static_cast<char *>(::operator new(n * sizeof(T) + AVL_CACHE_LINE));
+		char *block = raw + AVL_CACHE_LINE - (uintptr_t)raw % AVL_CACHE_LINE;
+		reinterpret_cast<char **>(block)[-1] = raw;
+		return reinterpret_cast<T *>(block);
+	};
+
+	void deallocate (T *p, size_t) {::operator delete(reinterpret_cast<char **>(p)[-1]);};
+};
+
+template <class T, class U>
+bool operator== (const avl_line_allocator<T> &, const avl_line_allocator<U> &) {return true;}
+template <class T, class U>
+bool operator!= (const avl_line_allocator<T> &, const avl_line_allocator<U> &) {return false;}
+/* --- End of CACHE LINE ALLOCATOR --- */
+
+/* --- WIDE TREE CLASS --- */
+/**
+ * @brief The mapped values of a leaf, in the same slots as its keys. Sets store none.
+ */
+template <class Value, size_t Slots>
+struct avl_wide_values {
+	Value values[Slots];
+
+	Value& value (size_t slot) {return values[slot];};
+	void copy_value (size_t to, const avl_wide_values &from, size_t slot) {values[to] = from.values[slot];};
+	void set_value (size_t slot, const Value &value) {values[slot] = value;};
+};
+
+template <size_t Slots>
+struct avl_wide_values<avl_no_value, Slots> {
+	avl_no_value& value (size_t) {static avl_no_value none; return none;};
+	void copy_value (size_t, const avl_wide_values &, size_t) {};
+	void set_value (size_t, const avl_no_value &) {};
+};
+
+/**
+ * @brief This class is a B+ tree with one cache line of keys per node, for integer keys
+ * (see avl_wide_eligible). All keys are in the leaves, which are linked in order for
+ * iteration. An inner node with c children holds c - 1 separators; separator i is at
+ * least every key under child i and less than every key under child i + 1. Nodes
+ * other than the root are kept at least half full by borrowing from and merging with
+ * their neighbours.
+ *
+ * @tparam Key: the key type, an integer type of 1, 2, 4 or 8 bytes
+ * @tparam Value: the mapped value type (avl_no_value for sets)
+ * @tparam Alloc: allocator, rebound to the node types
+ */
+template <class Key, class Value = avl_no_value, class Alloc = avl_line_allocator<Key> >
+class wideBST {
+
+	static_assert(avl_wide_eligible<Key>::value, "wideBST needs an integer key of 1, 2, 4 or 8 bytes");
+
+public:
+	// keys per node
+	static const size_t SLOTS = AVL_CACHE_LINE / sizeof(Key);
+
+private:
+	// fewest keys or separators in a node other than the root
+	static const size_t MIN_SLOTS = SLOTS / 2;
+
+	// the part that leaves and inner nodes share; the keys come first, on their own line
+	struct Node {
+		Key keys[SLOTS];	// ascending; unused slots hold the largest Key
+		size_t count;		// keys in a leaf, separators in an inner node
+		bool leaf;			// true for leaves
+
+		explicit Node (bool isLeaf) : count(0), leaf(isLeaf) {fill(keys, keys + SLOTS, numeric_limits<Key>::max());};
+	};
+
+	struct Inner : Node {
+		Node * children[SLOTS + 1];		// count + 1 of them are in use
+
+		Inner () : Node(false) {};
+	};
+
+	struct Leaf : Node, avl_wide_values<Value, SLOTS> {
+		Leaf * next;		// the leaf with the next larger keys
+
+		Leaf () : Node(true), next(nullptr) {};
+	};
+
+	// what iterators show avl_entry in place of a node
+	struct Slot {
+		const Key &data;
+		Value &value;
+	};
+
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<Leaf> LeafAlloc;
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<Inner> InnerAlloc;
+
+	Node * root;			// nullptr when empty
+	size_t items;			// number of keys
+	LeafAlloc leafAlloc;	// leaf allocator
+	InnerAlloc innerAlloc;	// inner node allocator
+
+	/* --- Helper Functions --- */
+
+	/**
+	 * @brief Creates and frees nodes through the allocators.
+	 */
+	Leaf* create_leaf ();
+	Inner* create_inner ();
+	void destroy_node (Node *node);
+
+	/**
+	 * @brief Frees a subtree.
+	 *
+	 * @param node: (Node*) the subtree
+	 * @return void
+	 */
+	void clear (Node *node);
+
+	/**
+	 * @brief Sets the unused key slots of a node back to the largest Key.
+	 *
+	 * @param node: (Node*) the node
+	 * @return void
+	 */
+	static void pad (Node *node) {fill(node->keys + node->count, node->keys + SLOTS, numeric_limits<Key>::max());};
+
+	/**
+	 * @brief Inserts a key into a subtree. A node that overflows is split in two, and the new
+	 * right half is passed back for the caller to link in.
+	 *
+	 * @param node: (Node*) the subtree
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 * @param split: (Node*&) set to the new right half if node was split, else nullptr
+	 * @param separator: (Key&) set to the largest key left in node when it was split
+	 * @return bool: false if the key was already there
+	 */
+	bool insert (Node *node, Key key, const Value &value, Node *&split, Key &separator);
+
+	/**
+	 * @brief Removes a key from a subtree, refilling any child that drops below half full.
+	 *
+	 * @param node: (Node*) the subtree
+	 * @param key: (Key) the key to remove
+	 * @return bool: false if the key was not there
+	 */
+	bool erase (Node *node, Key key);
+
+	/**
+	 * @brief Refills child i of an inner node after it dropped below MIN_SLOTS, by taking one
+	 * entry from a neighbour that can spare it or else merging with a neighbour.
+	 *
+	 * @param parent: (Inner*) the node whose child underflowed
+	 * @param i: (size_t) the child's index
+	 * @return void
+	 */
+	void refill (Inner *parent, size_t i);
+
+	/**
+	 * @brief Moves one entry into child i from its left or right neighbour, updating the
+	 * separator between them.
+	 *
+	 * @return void
+	 */
+	void borrow_left (Inner *parent, size_t i);
+	void borrow_right (Inner *parent, size_t i);
+
+	/**
+	 * @brief Merges child i + 1 of an inner node into child i and frees it.
+	 *
+	 * @param parent: (Inner*) the node whose children are merged
+	 * @param i: (size_t) the index of the left child
+	 * @return void
+	 */
+	void merge (Inner *parent, size_t i);
+
+	/**
+	 * @brief Finds the leaf and slot of the first key >= key.
+	 *
+	 * @param key: (Key) the key to bound
+	 * @param slot: (size_t&) set to the slot, which may be the leaf's count
+	 * @return Leaf*: the leaf, or nullptr if the tree is empty
+	 */
+	Leaf* descend (Key key, size_t &slot) const;
+
+	/* --- End of Helper Functions --- */
+
+public:
+	/**
+	 * @brief Iterator over the keys in ascending order, walking the linked leaves.
+	 * It yields what avl_entry yields for balancedBST: a key for sets and a pair of
+	 * references for maps.
+	 */
+	template <bool Const>
+	class wide_iterator {
+
+		friend class wideBST;
+		template <bool> friend class wide_iterator;
+		typedef avl_entry<Key, Value, Const> Entry;
+
+		Leaf * leaf;	// nullptr at the end
+		size_t slot;	// position in the leaf
+
+		wide_iterator (Leaf *l, size_t s) : leaf(l), slot(s) {
+			if (leaf != nullptr && slot == leaf->count) {
+				leaf = leaf->next;
+				slot = 0;
+			}
+		};
+
+	public:
+		typedef forward_iterator_tag iterator_category;
+		typedef typename Entry::value_type value_type;
+		typedef typename Entry::reference reference;
+		typedef typename Entry::pointer pointer;
+		typedef ptrdiff_t difference_type;
+
+		wide_iterator () : leaf(nullptr), slot(0) {};
+		// const_iterator from iterator
+		wide_iterator (const wide_iterator<false> &other) : leaf(other.leaf), slot(other.slot) {};
+
+		reference operator* () const {Slot s = {leaf->keys[slot], leaf->value(slot)}; return Entry::get(&s);};
+		pointer operator-> () const {Slot s = {leaf->keys[slot], leaf->value(slot)}; return Entry::arrow(&s);};
+
+		wide_iterator& operator++ () {
+			if (++slot == leaf->count) {
+				leaf = leaf->next;
+				slot = 0;
+			}
+			return *this;
+		};
+		wide_iterator operator++ (int) {wide_iterator before = *this; ++*this; return before;};
+
+		bool operator== (const wide_iterator &other) const {return leaf == other.leaf && slot == other.slot;};
+		bool operator!= (const wide_iterator &other) const {return !(*this == other);};
+	};
+
+	typedef wide_iterator<false> iterator;
+	typedef wide_iterator<true> const_iterator;
+	typedef typename avl_entry<Key, Value, true>::value_type value_type;
+
+	// constructor
+	explicit wideBST (const Alloc &alloc = Alloc())
+		: root(nullptr), items(0), leafAlloc(alloc), innerAlloc(alloc) {};
+
+	/**
+	 * @brief Copies another tree, key by key.
+	 *
+	 * @param other: (wideBST) the tree to copy
+	 */
+	wideBST (const wideBST &other);
+	wideBST& operator= (const wideBST &other);
+
+	/**
+	 * @brief Takes the nodes of another tree, which is left empty.
+	 *
+	 * @param other: (wideBST) the tree to move from
+	 */
+	wideBST (wideBST &&other);
+	wideBST& operator= (wideBST &&other);
+
+	// destructor
+	~wideBST () {clear();};
+
+	/**
+	 * @brief Inserts a key, mapped to a value for maps. Does nothing if the key is already there.
+	 *
+	 * @param key: (Key) the key to insert
+	 * @param value: (Value) the value mapped to the key
+	 */
+	void insertNode (const Key &key, const Value &value = Value());
+
+	/**
+	 * @brief Removes a key. Does nothing if the key is not there.
+	 *
+	 * @param key: (Key) the key to remove
+	 */
+	void deleteNode (const Key &key);
+
+	/**
+	 * @brief Checks whether a key is in the tree.
+	 *
+	 * @param key: (Key) the key to find
+	 * @return bool
+	 */
+	bool searchItem (const Key &key) const {size_t slot; Leaf *leaf = descend(key, slot); return leaf != nullptr && slot < leaf->count && leaf->keys[slot] == key;};
+
+	/**
+	 * @brief Finds the value mapped to a key (maps only).
+	 *
+	 * @param key: (Key) the key to find
+	 * @return Value*: the value, or nullptr if the key is not in the tree
+	 */
+	Value* searchValue (const Key &key)
+		{size_t slot; Leaf *leaf = descend(key, slot); return leaf != nullptr && slot < leaf->count && leaf->keys[slot] == key ? &leaf->value(slot) : nullptr;};
+
+	/**
+	 * @brief Get the number of keys.
+	 *
+	 * @return size_t
+	 */
+	size_t treeNodeCount () const {return items;};
+	bool empty () const {return items == 0;};
+
+	/**
+	 * @brief Get the height: the number of levels below the root, 0 for a single leaf and
+	 * -1 for an empty tree, as for balancedBST.
+	 *
+	 * @return int
+	 */
+	int height () const;
+
+	/**
+	 * @brief Removes every key.
+	 *
+	 * @return void
+	 */
+	void clear () {clear(root); root = nullptr; items = 0;};
+
+	/* --- Iterator Functions --- */
+
+	iterator begin () {size_t slot; return iterator(descend(numeric_limits<Key>::min(), slot), 0);};
+	iterator end () {return iterator();};
+	const_iterator begin () const {size_t slot; return const_iterator(descend(numeric_limits<Key>::min(), slot), 0);};
+	const_iterator end () const {return const_iterator();};
+
+	/**
+	 * @brief Finds the element with the given key.
+	 *
+	 * @param key: (Key) the key to find
+	 * @return iterator: positioned at the key, or end() if it is not in the tree
+	 */
+	iterator find (const Key &key) {iterator it = lower_bound(key); return it != end() && it.leaf->keys[it.slot] == key ? it : end();};
+	const_iterator find (const Key &key) const {const_iterator it = lower_bound(key); return it != end() && it.leaf->keys[it.slot] == key ? it : end();};
+
+	/**
+	 * @brief Finds the first element whose key is not less than the given key.
+	 *
+	 * @param key: (Key) the key to bound
+	 * @return iterator: the first key >= key, or end()
+	 */
+	iterator lower_bound (const Key &key) {size_t slot; Leaf *leaf = descend(key, slot); return iterator(leaf, slot);};
+	const_iterator lower_bound (const Key &key) const {size_t slot; Leaf *leaf = descend(key, slot); return const_iterator(leaf, slot);};
+
+	/* --- End of Iterator Functions --- */
+};
+/* --- End of WIDE TREE CLASS --- */
+
+/* --- ALIASES --- */
+/**
+ * @brief wideBST as a set and as a map.
+ */
+template <class Key, class Alloc = avl_line_allocator<Key> >
+using avl_wide_set = wideBST<Key, avl_no_value, Alloc>;
+template <class Key, class Value, class Alloc = avl_line_allocator<Key> >
+using avl_wide_map = wideBST<Key, Value, Alloc>;
+
+/**
+ * @brief A set or map that picks its backend from the key type: wideBST for the small
+ * integer keys of avl_wide_eligible, balancedBST for everything else. Code that sticks to
+ * the calls both have (insertNode, deleteNode, searchItem, searchValue, find, lower_bound,
+ * iteration, treeNodeCount, height, clear) works with either.
+ */
+template <class Key, class Compare = less<Key> >
+using avl_fast_set = typename conditional<avl_wide_eligible<Key, Compare>::value,
+	wideBST<Key>, balancedBST<Key, avl_no_value, Compare> >::type;
+template <class Key, class Value, class Compare = less<Key> >
+using avl_fast_map = typename conditional<avl_wide_eligible<Key, Compare>::value,
+	wideBST<Key, Value>, balancedBST<Key, Value, Compare> >::type;
+/* --- End of ALIASES --- */
+
+/* --- WIDE TREE IMPLEMENTATION --- */
+
+/**
+ * @brief Creates an empty leaf.
+ *
+ * @return Leaf* The leaf.
+ */
+template <class Key, class Value, class Alloc>
+typename wideBST<Key, Value, Alloc>::Leaf* wideBST<Key, Value, Alloc>::create_leaf() {
+	Leaf *leaf = allocator_traits<LeafAlloc>::allocate(leafAlloc, 1);
+	allocator_traits<LeafAlloc>::construct(leafAlloc, leaf);
+	return leaf;
+}
+
+/**
+ * @brief Creates an empty inner node.
+ *
+ * @return Inner* The node.
+ */
+template <class Key, class Value, class Alloc>
+typename wideBST<Key, Value, Alloc>::Inner* wideBST<Key, Value, Alloc>::create_inner() {
+	Inner *inner = allocator_traits<InnerAlloc>::allocate(innerAlloc, 1);
+	allocator_traits<InnerAlloc>::construct(innerAlloc, inner);
+	return inner;
+}
+
+/**
+ * @brief Frees one node, through the allocator of its kind.
+ *
+ * @param node The node.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::destroy_node(Node *node) {
+	if (node->leaf) {
+		Leaf *leaf = static_cast<Leaf *>(node);
+		allocator_traits<LeafAlloc>::destroy(leafAlloc, leaf);
+		allocator_traits<LeafAlloc>::deallocate(leafAlloc, leaf, 1);
+	}
+	else {
+		Inner *inner = static_cast<Inner *>(node);
+		allocator_traits<InnerAlloc>::destroy(innerAlloc, inner);
+		allocator_traits<InnerAlloc>::deallocate(innerAlloc, inner, 1);
+	}
+}
+
+/**
+ * @brief Frees a subtree, children first.
+ *
+ * @param node The subtree, or nullptr.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::clear(Node *node) {
+	if (node == nullptr) {
+		return;
+	}
+	if (!node->leaf) {
+		Inner *inner = static_cast<Inner *>(node);
+		for (size_t i = 0; i <= inner->count; i++) {
+			clear(inner->children[i]);
+		}
+	}
+	destroy_node(node);
+}
+
+/**
+ * @brief Copies another tree by inserting its keys in order.
+ *
+ * @param other The tree to copy.
+ */
+template <class Key, class Value, class Alloc>
+wideBST<Key, Value, Alloc>::wideBST(const wideBST &other)
+	: root(nullptr), items(0), leafAlloc(other.leafAlloc), innerAlloc(other.innerAlloc) {
+	*this = other;
+}
+
+/**
+ * @brief Replaces the contents with a copy of another tree.
+ *
+ * @param other The tree to copy.
+ * @return wideBST& This tree.
+ */
+template <class Key, class Value, class Alloc>
+wideBST<Key, Value, Alloc>& wideBST<Key, Value, Alloc>::operator=(const wideBST &other) {
+	if (this != &other) {
+		clear();
+		for (const_iterator it = other.begin(); it != other.end(); ++it) {
+			insertNode(it.leaf->keys[it.slot], it.leaf->value(it.slot));
+		}
+	}
+	return *this;
+}
+
+/**
+ * @brief Takes the nodes of another tree.
+ *
+ * @param other The tree to move from, left empty.
+ */
+template <class Key, class Value, class Alloc>
+wideBST<Key, Value, Alloc>::wideBST(wideBST &&other)
+	: root(other.root), items(other.items), leafAlloc(other.leafAlloc), innerAlloc(other.innerAlloc) {
+	other.root = nullptr;
+	other.items = 0;
+}
+
+/**
+ * @brief Frees this tree's nodes and takes those of another tree.
+ *
+ * @param other The tree to move from, left empty.
+ * @return wideBST& This tree.
+ */
+template <class Key, class Value, class Alloc>
+wideBST<Key, Value, Alloc>& wideBST<Key, Value, Alloc>::operator=(wideBST &&other) {
+	if (this != &other) {
+		clear();
+		swap(root, other.root);
+		swap(items, other.items);
+	}
+	return *this;
+}
+
+/**
+ * @brief Walks down to the leaf where a key is or would be.
+ *
+ * Each inner node sends the key to child i, where i is the number of separators less than the key:
+ * separator i is the first that is >= key, so the key can only be under child i. In the leaf the
+ * same count is the slot of the first key >= key. Each step is one avl_count_less on one cache line.
+ *
+ * @param key The key to bound.
+ * @param slot Set to the slot in the leaf.
+ * @return Leaf* The leaf, or nullptr if the tree is empty.
+ */
+template <class Key, class Value, class Alloc>
+typename wideBST<Key, Value, Alloc>::Leaf* wideBST<Key, Value, Alloc>::descend(Key key, size_t &slot) const {
+	Node *node = root;
+	if (node == nullptr) {
+		slot = 0;
+		return nullptr;
+	}
+
+	while (!node->leaf) {
+		node = static_cast<Inner *>(node)->children[avl_count_less(node->keys, key)];
+	}
+
+	slot = avl_count_less(node->keys, key);
+	return static_cast<Leaf *>(node);
+}
+
+/**
+ * @brief Counts the levels below the root by following the first children.
+ *
+ * @return int The height, or -1 when empty.
+ */
+template <class Key, class Value, class Alloc>
+int wideBST<Key, Value, Alloc>::height() const {
+	if (root == nullptr) {
+		return -1;
+	}
+
+	int levels = 0;
+	for (Node *node = root; !node->leaf; node = static_cast<Inner *>(node)->children[0]) {
+		levels++;
+	}
+	return levels;
+}
+
+/**
+ * @brief Inserts a key, growing a new root when the old one splits.
+ *
+ * @param key The key to insert.
+ * @param value The value mapped to the key.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::insertNode(const Key &key, const Value &value) {
+	if (root == nullptr) {
+		root = create_leaf();
+	}
+
+	Node *split = nullptr;
+	Key separator = Key();
+	if (!insert(root, key, value, split, separator)) {
+		return;
+	}
+	items++;
+
+	// The root was split: the two halves become the children of a new root.
+	if (split != nullptr) {
+		Inner *top = create_inner();
+		top->keys[0] = separator;
+		top->children[0] = root;
+		top->children[1] = split;
+		top->count = 1;
+		root = top;
+	}
+}
+
+/**
+ * @brief Inserts a key into a subtree, splitting full nodes on the way back up.
+ *
+ * In a leaf, the key goes to the slot of the first key >= key, after the others move right. A full
+ * leaf is first split into two halves of SLOTS / 2 keys, and the key goes to the half it belongs
+ * in, so both halves end at least half full. The largest key of the left half becomes the new
+ * separator.
+ *
+ * In an inner node, the key goes down to its child. If the child split, its separator and new
+ * right half are added next to it. A full inner node has no room for them, so SLOTS + 1 separators
+ * are laid out in a scratch array and divided: the lower SLOTS / 2 stay, the next one moves up to
+ * the parent as the separator, and the rest go to a new right node.
+ *
+ * @param node The subtree.
+ * @param key The key to insert.
+ * @param value The value mapped to the key.
+ * @param split Set to the new right half, or nullptr.
+ * @param separator Set to the separator for the new right half.
+ * @return bool False if the key was already there.
+ */
+template <class Key, class Value, class Alloc>
+bool wideBST<Key, Value, Alloc>::insert(Node *node, Key key, const Value &value, Node *&split, Key &separator) {
+	size_t i = avl_count_less(node->keys, key);
+
+	if (node->leaf) {
+		Leaf *leaf = static_cast<Leaf *>(node);
+		if (i < leaf->count && leaf->keys[i] == key) {
+			return false;
+		}
+
+		// A full leaf gives its upper half to a new leaf first.
+		Leaf *target = leaf;
+		if (leaf->count == SLOTS) {
+			Leaf *right = create_leaf();
+			for (size_t j = MIN_SLOTS; j < SLOTS; j++) {
+				right->keys[j - MIN_SLOTS] = leaf->keys[j];
+				right->copy_value(j - MIN_SLOTS, *leaf, j);
+			}
+			right->count = SLOTS - MIN_SLOTS;
+			leaf->count = MIN_SLOTS;
+			pad(leaf);
+			right->next = leaf->next;
+			leaf->next = right;
+
+			if (i > MIN_SLOTS) {
+				target = right;
+				i -= MIN_SLOTS;
+			}
+			split = right;
+		}
+
+		for (size_t j = target->count; j > i; j--) {
+			target->keys[j] = target->keys[j - 1];
+			target->copy_value(j, *target, j - 1);
+		}
+		target->keys[i] = key;
+		target->set_value(i, value);
+		target->count++;
+
+		if (split != nullptr) {
+			separator = leaf->keys[leaf->count - 1];
+		}
+		return true;
+	}
+
+	Inner *inner = static_cast<Inner *>(node);
+	Node *childSplit = nullptr;
+	Key childSeparator = Key();
+	if (!insert(inner->children[i], key, value, childSplit, childSeparator)) {
+		return false;
+	}
+	if (childSplit == nullptr) {
+		return true;
+	}
+
+	// Room left: shift the separators and children after i and link the new half in.
+	if (inner->count < SLOTS) {
+		for (size_t j = inner->count; j > i; j--) {
+			inner->keys[j] = inner->keys[j - 1];
+			inner->children[j + 1] = inner->children[j];
+		}
+		inner->keys[i] = childSeparator;
+		inner->children[i + 1] = childSplit;
+		inner->count++;
+		return true;
+	}
+
+	// Full: lay out all SLOTS + 1 separators and SLOTS + 2 children, then divide them.
+	Key keys[SLOTS + 1];
+	Node *children[SLOTS + 2];
+	for (size_t j = 0, from = 0; j <= SLOTS; j++) {
+		keys[j] = j == i ? childSeparator : inner->keys[from++];
+	}
+	for (size_t j = 0, from = 0; j <= SLOTS + 1; j++) {
+		children[j] = j == i + 1 ? childSplit : inner->children[from++];
+	}
+
+	Inner *right = create_inner();
+	inner->count = MIN_SLOTS;
+	copy(keys, keys + MIN_SLOTS, inner->keys);
+	copy(children, children + MIN_SLOTS + 1, inner->children);
+	pad(inner);
+
+	right->count = SLOTS - MIN_SLOTS;
+	copy(keys + MIN_SLOTS + 1, keys + SLOTS + 1, right->keys);
+	copy(children + MIN_SLOTS + 1, children + SLOTS + 2, right->children);
+
+	separator = keys[MIN_SLOTS];
+	split = right;
+	return true;
+}
+
+/**
+ * @brief Removes a key, dropping a root that is left with one child or no keys.
+ *
+ * @param key The key to remove.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::deleteNode(const Key &key) {
+	if (root == nullptr || !erase(root, key)) {
+		return;
+	}
+	items--;
+
+	if (root->count == 0) {
+		Node *old = root;
+		root = root->leaf ? nullptr : static_cast<Inner *>(root)->children[0];
+		destroy_node(old);
+	}
+}
+
+/**
+ * @brief Removes a key from a subtree.
+ *
+ * The key is removed from its leaf by moving the keys after it left. On the way back up, a child
+ * left with fewer than MIN_SLOTS entries is refilled from a neighbour.
+ *
+ * @param node The subtree.
+ * @param key The key to remove.
+ * @return bool False if the key was not there.
+ */
+template <class Key, class Value, class Alloc>
+bool wideBST<Key, Value, Alloc>::erase(Node *node, Key key) {
+	size_t i = avl_count_less(node->keys, key);
+
+	if (node->leaf) {
+		Leaf *leaf = static_cast<Leaf *>(node);
+		if (i >= leaf->count || leaf->keys[i] != key) {
+			return false;
+		}
+
+		for (size_t j = i + 1; j < leaf->count; j++) {
+			leaf->keys[j - 1] = leaf->keys[j];
+			leaf->copy_value(j - 1, *leaf, j);
+		}
+		leaf->count--;
+		leaf->set_value(leaf->count, Value());
+		pad(leaf);
+		return true;
+	}
+
+	Inner *inner = static_cast<Inner *>(node);
+	if (!erase(inner->children[i], key)) {
+		return false;
+	}
+	if (inner->children[i]->count < MIN_SLOTS) {
+		refill(inner, i);
+	}
+	return true;
+}
+
+/**
+ * @brief Refills an underfull child.
+ *
+ * A neighbour with more than MIN_SLOTS entries gives one; otherwise the child and a neighbour have
+ * at most 2 * MIN_SLOTS - 1 entries between them (plus the separator for inner nodes), which fits
+ * in one node, so they are merged.
+ *
+ * @param parent The node whose child underflowed.
+ * @param i The child's index.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::refill(Inner *parent, size_t i) {
+	if (i > 0 && parent->children[i - 1]->count > MIN_SLOTS) {
+		borrow_left(parent, i);
+	}
+	else if (i < parent->count && parent->children[i + 1]->count > MIN_SLOTS) {
+		borrow_right(parent, i);
+	}
+	else if (i > 0) {
+		merge(parent, i - 1);
+	}
+	else {
+		merge(parent, i);
+	}
+}
+
+/**
+ * @brief Moves the last entry of the left neighbour to the front of child i.
+ *
+ * For leaves the key itself moves, and the separator becomes the neighbour's new largest key. For
+ * inner nodes the entries rotate through the parent: the parent's separator comes down in front of
+ * the neighbour's last child, and the neighbour's last separator goes up in its place.
+ *
+ * @param parent The node whose child underflowed.
+ * @param i The child's index, at least 1.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::borrow_left(Inner *parent, size_t i) {
+	Node *left = parent->children[i - 1];
+	Node *child = parent->children[i];
+
+	if (child->leaf) {
+		Leaf *from = static_cast<Leaf *>(left);
+		Leaf *to = static_cast<Leaf *>(child);
+		for (size_t j = to->count; j > 0; j--) {
+			to->keys[j] = to->keys[j - 1];
+			to->copy_value(j, *to, j - 1);
+		}
+		to->keys[0] = from->keys[from->count - 1];
+		to->copy_value(0, *from, from->count - 1);
+		to->count++;
+		from->count--;
+		from->set_value(from->count, Value());
+		pad(from);
+		parent->keys[i - 1] = from->keys[from->count - 1];
+		return;
+	}
+
+	Inner *from = static_cast<Inner *>(left);
+	Inner *to = static_cast<Inner *>(child);
+	for (size_t j = to->count; j > 0; j--) {
+		to->keys[j] = to->keys[j - 1];
+	}
+	for (size_t j = to->count + 1; j > 0; j--) {
+		to->children[j] = to->children[j - 1];
+	}
+	to->keys[0] = parent->keys[i - 1];
+	to->children[0] = from->children[from->count];
+	to->count++;
+	parent->keys[i - 1] = from->keys[from->count - 1];
+	from->count--;
+	pad(from);
+}
+
+/**
+ * @brief Moves the first entry of the right neighbour to the end of child i, the mirror image of
+ * borrow_left.
+ *
+ * @param parent The node whose child underflowed.
+ * @param i The child's index, less than parent->count.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::borrow_right(Inner *parent, size_t i) {
+	Node *child = parent->children[i];
+	Node *right = parent->children[i + 1];
+
+	if (child->leaf) {
+		Leaf *to = static_cast<Leaf *>(child);
+		Leaf *from = static_cast<Leaf *>(right);
+		to->keys[to->count] = from->keys[0];
+		to->copy_value(to->count, *from, 0);
+		to->count++;
+		for (size_t j = 1; j < from->count; j++) {
+			from->keys[j - 1] = from->keys[j];
+			from->copy_value(j - 1, *from, j);
+		}
+		from->count--;
+		from->set_value(from->count, Value());
+		pad(from);
+		parent->keys[i] = to->keys[to->count - 1];
+		return;
+	}
+
+	Inner *to = static_cast<Inner *>(child);
+	Inner *from = static_cast<Inner *>(right);
+	to->keys[to->count] = parent->keys[i];
+	to->children[to->count + 1] = from->children[0];
+	to->count++;
+	parent->keys[i] = from->keys[0];
+	for (size_t j = 1; j < from->count; j++) {
+		from->keys[j - 1] = from->keys[j];
+	}
+	for (size_t j = 1; j <= from->count; j++) {
+		from->children[j - 1] = from->children[j];
+	}
+	from->count--;
+	pad(from);
+}
+
+/**
+ * @brief Merges child i + 1 into child i.
+ *
+ * Leaves are concatenated and relinked. Inner nodes are concatenated with the parent's separator
+ * between them, since it bounds the left node's last child. Either way the parent loses separator
+ * i and child i + 1, and the merged node inherits the bound that separator i + 1 gave child i + 1.
+ *
+ * @param parent The node whose children are merged.
+ * @param i The index of the left child.
+ * @return void
+ */
+template <class Key, class Value, class Alloc>
+void wideBST<Key, Value, Alloc>::merge(Inner *parent, size_t i) {
+	Node *left = parent->children[i];
+	Node *right = parent->children[i + 1];
+
+	if (left->leaf) {
+		Leaf *to = static_cast<Leaf *>(left);
+		Leaf *from = static_cast<Leaf *>(right);
+		for (size_t j = 0; j < from->count; j++) {
+			to->keys[to->count + j] = from->keys[j];
+			to->copy_value(to->count + j, *from, j);
+		}
+		to->count += from->count;
+		to->next = from->next;
+	}
+	else {
+		Inner *to = static_cast<Inner *>(left);
+		Inner *from = static_cast<Inner *>(right);
+		to->keys[to->count] = parent->keys[i];
+		copy(from->keys, from->keys + from->count, to->keys + to->count + 1);
+		copy(from->children, from->children + from->count + 1, to->children + to->count + 1);
+		to->count += from->count + 1;
+	}
+	destroy_node(right);
+
+	for (size_t j = i + 1; j < parent->count; j++) {
+		parent->keys[j - 1] = parent->keys[j];
+		parent->children[j] = parent->children[j + 1];
+	}
+	parent->count--;
+	pad(parent);
+}
+
+/* --- End of WIDE TREE IMPLEMENTATION --- */
+
+#endif // AVLWIDE_H
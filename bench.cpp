@@ -0,0 +1,1589 @@
+/**
+ * @file bench.cpp
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file contains the benchmark driver for the AVLtrees lib.
+ * Its core suite compares avl_set with std::set on sorted, reverse and random inserts,
+ * lookup hits and misses, deletes, in-order traversal and a mixed workload, at every
+ * power of ten from 10^3 keys up. Beyond that it times insert and lookup on avl_map against std::map for 64-bit integer and
+ * string keys, compares the default heap allocator with avl_node_pool, and compares
+ * bulk construction with inserting one key at a time, and runs an insert/delete churn
+ * workload that tracks tree height and lookup latency, and times the traversal iterators
+ * and the order statistic, range and aggregate queries, and times the set operations, sequential and
+ * on 1 to 16 threads, and times concurrent lookups on cowBST and on a mutex-guarded avl_map
+ * while one writer updates the tree, and times concurrentBST with a quick check of its final
+ * contents, and times inserts and merged scans on shardedBST, and measures what a
+ * cowBST snapshot costs to take and to keep, and times fork-based background checkpoints
+ * and a tree stored in a memory-mapped file, and prints the avl_stats counters of the
+ * sorted and random insert orders.
+ * Every row reports ns/op, ops/s, heap allocations per op where they are counted, and the
+ * peak resident set size of the process. A table goes to stderr and the same rows go to
+ * stdout as JSON, one row per line so that two runs can be diffed.
+ * Build and run it with "make bench", which writes bench.json.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+/* --- IMPORTS --- */
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "AVLtrees.h"
+#include "AVLpool.h"
+#include "AVLtasks.h"
+#include "AVLcow.h"
+#include "AVLconcurrent.h"
+#include "AVLsharded.h"
+#include "AVLtrace.h"
+#include "AVLwide.h"
+#include "AVLcompact.h"
+#include "AVLdurable.h"
+#include "AVLmapped.h"
+#include <thread>
+#include <mutex>
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- HELPERS --- */
+
+// keeps the optimizer from discarding lookup results
+static volatile size_t sink;
+
+// number of calls to the global operator new; the task pool allocates from several threads
+static atomic<size_t> allocations(0);
+
+/**
+ * @brief Counts every heap allocation made by the program.
+ */
+void * operator new(size_t bytes) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(bytes);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+/**
+ * @brief Returns the seconds elapsed since the given time point.
+ */
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// one result row, as written to the JSON output
+struct Result {
+    string name;
+    size_t n;
+    size_t ops;
+    double sec;
+    long long allocs;   // heap allocations, -1 if the row does not count them
+    long peakKb;        // peak resident set size when the row finished
+};
+
+static vector<Result> results;
+
+/**
+ * @brief Resets the peak resident set size, so that the next rows report their own peak
+ * instead of the largest one so far. Only Linux supports it; elsewhere the peak only grows.
+ */
+static void reset_peak_rss() {
+    ofstream clear("/proc/self/clear_refs");
+    clear << "5" << flush;
+}
+
+/**
+ * @brief Returns the peak resident set size in KiB, from /proc when available.
+ */
+static long peak_rss_kb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+static void write_json_string(ostream& out, const string& text) {
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') {
+            out << '\\';
+        }
+        out << text[i];
+    }
+    out << '"';
+}
+
+/**
+ * @brief Writes every recorded row as one JSON document.
+ */
+static void write_json(ostream& out, size_t maxKeys) {
+    out << "{\"benchmark\": \"AVLtrees\", \"max_keys\": " << maxKeys << ", \"results\": [" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "  {\"name\": ";
+        write_json_string(out, r.name);
+        out << ", \"n\": " << r.n << ", \"ops\": " << r.ops
+            << fixed << setprecision(2) << ", \"ns_per_op\": " << r.sec * 1e9 / r.ops
+            << setprecision(0) << ", \"ops_per_sec\": " << r.ops / r.sec << ", \"allocs_per_op\": ";
+        if (r.allocs < 0) {
+            out << "null";
+        } else {
+            out << setprecision(4) << (double)r.allocs / r.ops;
+        }
+        out << ", \"peak_rss_kb\": " << r.peakKb << "}" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]}" << endl;
+}
+
+/**
+ * @brief Prints one result row in ns/op and Mops/s.
+ */
+static void report(const string& name, size_t n, size_t ops, double sec) {
+    Result r = {name, n, ops, sec, -1, peak_rss_kb()};
+    results.push_back(r);
+    cerr << left << setw(28) << name << right << setw(10) << n
+         << setw(12) << fixed << setprecision(1) << sec * 1e9 / ops << " ns/op"
+         << setw(10) << setprecision(2) << ops / sec / 1e6 << " Mops/s" << endl;
+}
+
+/**
+ * @brief Prints one result row in ns/op and heap allocations per op.
+ */
+static void report_allocs(const string& name, size_t n, size_t ops, double sec, size_t allocs) {
+    Result r = {name, n, ops, sec, (long long)allocs, peak_rss_kb()};
+    results.push_back(r);
+    cerr << left << setw(28) << name << right << setw(10) << n
+         << setw(12) << fixed << setprecision(1) << sec * 1e9 / ops << " ns/op"
+         << setw(10) << setprecision(4) << (double)allocs / ops << " allocs/op"
+         << setw(10) << r.peakKb / 1024 << " MiB peak" << endl;
+}
+
+// the same operations under one name for avl_set, avl_wide_set, avl_compact_set and std::set
+static void tree_insert(avl_set<uint64_t>& tree, uint64_t key) { tree.insertNode(key); }
+static void tree_insert(avl_wide_set<uint64_t>& tree, uint64_t key) { tree.insertNode(key); }
+static void tree_insert(avl_compact_set<uint64_t>& tree, uint64_t key) { tree.insertNode(key); }
+static void tree_insert(set<uint64_t>& tree, uint64_t key) { tree.insert(key); }
+static bool tree_contains(const avl_set<uint64_t>& tree, uint64_t key) { return tree.searchItem(key); }
+static bool tree_contains(const avl_wide_set<uint64_t>& tree, uint64_t key) { return tree.searchItem(key); }
+static bool tree_contains(const avl_compact_set<uint64_t>& tree, uint64_t key) { return tree.searchItem(key); }
+static bool tree_contains(const set<uint64_t>& tree, uint64_t key) { return tree.count(key) != 0; }
+static void tree_erase(avl_set<uint64_t>& tree, uint64_t key) { tree.deleteNode(key); }
+static void tree_erase(avl_wide_set<uint64_t>& tree, uint64_t key) { tree.deleteNode(key); }
+static void tree_erase(avl_compact_set<uint64_t>& tree, uint64_t key) { tree.deleteNode(key); }
+static void tree_erase(set<uint64_t>& tree, uint64_t key) { tree.erase(key); }
+
+// memory_usage() for the trees that report it
+static void print_memory(const string& label, const avl_set<uint64_t>& tree) {
+    avl_memory_usage m = tree.memory_usage();
+    cerr << "    " << label << " memory: " << fixed << setprecision(1) << m.bytes_per_key() << " bytes/key + "
+         << m.blocks << " malloc headers" << endl;
+}
+static void print_memory(const string& label, const avl_compact_set<uint64_t>& tree) {
+    avl_memory_usage m = tree.memory_usage();
+    cerr << "    " << label << " memory: " << fixed << setprecision(1) << m.bytes_per_key() << " bytes/key + "
+         << m.blocks << " malloc headers" << endl;
+}
+static void print_memory(const string& label, const avl_mapped_set<uint64_t>& tree) {
+    avl_memory_usage m = tree.memory_usage();
+    cerr << "    " << label << " memory: " << fixed << setprecision(1) << m.bytes_per_key() << " bytes/key of file"
+         << endl;
+}
+template <class Tree>
+static void print_memory(const string&, const Tree&) {}
+
+/**
+ * @brief Times one insert order on an empty tree, counting allocations and peak memory.
+ *
+ * @param name: (string) the row label
+ * @param keys: (vector<uint64_t>) the keys, in insertion order
+ */
+template <class Tree>
+static void time_inserts(const string& name, const vector<uint64_t>& keys) {
+    reset_peak_rss();
+    Tree tree;
+    size_t before = allocations;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree_insert(tree, keys[i]);
+    }
+    report_allocs(name, keys.size(), keys.size(), seconds_since(start), allocations - before);
+}
+
+/**
+ * @brief Runs the core suite on one tree type: sorted, reverse and random inserts, lookup
+ * hits and misses, random deletes, one in-order traversal, and a mixed workload of 50%
+ * lookups, 25% inserts and 25% deletes over twice as many keys as the tree holds.
+ *
+ * @param label: (string) the tree type, the prefix of every row
+ * @param keys: (vector<uint64_t>) distinct even keys in random order
+ */
+template <class Tree>
+static void run_core_one(const string& label, const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+    time_inserts<Tree>(label + " insert sorted", sorted);
+    reverse(sorted.begin(), sorted.end());
+    time_inserts<Tree>(label + " insert reverse", sorted);
+    sorted = vector<uint64_t>();
+    time_inserts<Tree>(label + " insert random", keys);
+
+    reset_peak_rss();
+    Tree tree;
+    for (size_t i = 0; i < n; i++) {
+        tree_insert(tree, keys[i]);
+    }
+
+    print_memory(label, tree);
+
+    // Look the keys up in a different order than they were inserted; odd keys are all misses.
+    size_t before = allocations;
+    auto start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i = n; i-- > 0;) {
+        found += tree_contains(tree, keys[i]);
+    }
+    report_allocs(label + " lookup hit", n, n, seconds_since(start), allocations - before);
+
+    before = allocations;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        found += tree_contains(tree, keys[i] | 1);
+    }
+    report_allocs(label + " lookup miss", n, n, seconds_since(start), allocations - before);
+    sink = found;
+
+    before = allocations;
+    start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (uint64_t key : tree) {
+        sum += key;
+    }
+    report_allocs(label + " traverse", n, n, seconds_since(start), allocations - before);
+    sink = sum;
+
+    mt19937_64 rng(11);
+    before = allocations;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = rng();
+        uint64_t key = keys[(r >> 8) % n] | ((r >> 4) & 1);
+        switch (r & 3) {
+            case 0: tree_insert(tree, key); break;
+            case 1: tree_erase(tree, key); break;
+            default: found += tree_contains(tree, key);
+        }
+    }
+    report_allocs(label + " mixed", n, n, seconds_since(start), allocations - before);
+    sink = found;
+
+    before = allocations;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        tree_erase(tree, keys[i]);
+    }
+    report_allocs(label + " delete random", n, n, seconds_since(start), allocations - before);
+}
+
+/**
+ * @brief Runs the core suite on avl_set, avl_wide_set, avl_compact_set and std::set with the same keys.
+ *
+ * @param keys: (vector<uint64_t>) distinct even keys in random order
+ */
+static void run_core(const vector<uint64_t>& keys) {
+    run_core_one<avl_set<uint64_t> >("avl_set", keys);
+    run_core_one<avl_wide_set<uint64_t> >("avl_wide_set", keys);
+    run_core_one<avl_compact_set<uint64_t> >("avl_compact", keys);
+    run_core_one<set<uint64_t> >("std::set", keys);
+}
+
+/**
+ * @brief Freezes an avl_set into an avl_frozen index and times hits, misses, lower_bound and
+ * rank on both, plus std::lower_bound on a sorted vector as the baseline. It runs at every
+ * size up to 10^7 keys, where the tree's nodes are far larger than the last-level cache and
+ * the index, which holds only the keys, is several times smaller.
+ *
+ * @param keys: (vector<uint64_t>) distinct even keys in random order
+ */
+static void run_frozen(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    avl_set<uint64_t> tree;
+    for (size_t i = 0; i < n; i++) {
+        tree.insertNode(keys[i]);
+    }
+
+    auto start = chrono::steady_clock::now();
+    avl_frozen<uint64_t> frozen = tree.freeze();
+    report("avl_set freeze", n, n, seconds_since(start));
+
+    // The same probes for every structure: hits in reverse insertion order, then misses.
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = n; i-- > 0;) {
+        found += frozen.contains(keys[i]);
+    }
+    report("frozen lookup hit", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        found += frozen.contains(keys[i] | 1);
+    }
+    report("frozen lookup miss", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        found += frozen.key_at(frozen.lower_bound(keys[i] | 1) % n);
+    }
+    report("frozen lower_bound", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        found += frozen.rank(keys[i]);
+    }
+    report("frozen rank", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        found += tree.rank(keys[i]);
+    }
+    report("avl_set rank", n, n, seconds_since(start));
+
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+    start = chrono::steady_clock::now();
+    for (size_t i = n; i-- > 0;) {
+        found += binary_search(sorted.begin(), sorted.end(), keys[i]);
+    }
+    report("sorted vector lookup hit", n, n, seconds_since(start));
+    sink = found;
+
+    cerr << "    index: " << fixed << setprecision(1) << (double)(n + 1) * sizeof(uint64_t) / (1 << 20)
+         << " MiB of keys, no pointers" << endl;
+}
+
+/**
+ * @brief Saves an avl_set as an image file and times opening it again with load, with and
+ * without the payload checksum, against rebuilding the tree by inserting every key. The
+ * rows give ns per key for all three, so load shows up as a fraction of a nanosecond.
+ * The file is in the page cache, so the lookups on the mapped index fault in pages without
+ * reading the disk; a cold start would add the disk reads of the pages the lookups touch.
+ */
+static void run_image(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    const string path = "/tmp/avl_bench.img";
+    avl_set<uint64_t> tree;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        tree.insertNode(keys[i]);
+    }
+    report("avl_set rebuild by insert", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    tree.save(path);
+    report("image save", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    avl_frozen<uint64_t> verified = avl_set<uint64_t>::load(path);
+    report("image load verified", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    avl_frozen<uint64_t> mapped = avl_set<uint64_t>::load(path, false);
+    report("image load", n, n, seconds_since(start));
+
+    size_t found = verified.size();
+    start = chrono::steady_clock::now();
+    for (size_t i = n; i-- > 0;) {
+        found += mapped.contains(keys[i]);
+    }
+    report("mapped lookup hit", n, n, seconds_since(start));
+    sink = found;
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Inserts the keys in sorted and in random order into an avl_set counted by avl_stats,
+ * looks every key up, and prints what the counters saw per operation. The rows time the
+ * counted tree, so they also show what the counting costs against the core suite.
+ *
+ * @param keys: (vector<uint64_t>) distinct keys in random order
+ */
+static void run_stats(const vector<uint64_t>& keys) {
+    typedef avl_set<uint64_t, less<uint64_t>, allocator<uint64_t>, avl_stats> Counted;
+    size_t n = keys.size();
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+
+    for (int order = 0; order < 2; order++) {
+        const vector<uint64_t>& input = order == 0 ? sorted : keys;
+        string name = order == 0 ? "avl_stats sorted" : "avl_stats random";
+        Counted tree;
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(input[i]);
+        }
+        report(name + " insert", n, n, seconds_since(start));
+        avl_stats s = tree.stats();
+        cerr << "    per insert: " << fixed << setprecision(2) << (double)s.comparisons / n << " comparisons, "
+             << (double)s.rotation_count() / n << " rotations (R " << s.rotations[AVL_ROTATE_R] << ", L "
+             << s.rotations[AVL_ROTATE_L] << ", RL " << s.rotations[AVL_ROTATE_RL] << ", LR " << s.rotations[AVL_ROTATE_LR]
+             << "), retrace " << s.mean_retrace() << endl;
+
+        tree.reset_stats();
+        start = chrono::steady_clock::now();
+        size_t found = 0;
+        for (size_t i = 0; i < n; i++) {
+            found += tree.searchItem(keys[i]);
+        }
+        report(name + " lookup", n, n, seconds_since(start));
+        sink = found;
+        s = tree.stats();
+        cerr << "    per lookup: " << (double)s.comparisons / n << " comparisons, depth " << s.mean_search_depth()
+             << " (height " << tree.height() << ")" << endl;
+    }
+}
+
+/**
+ * @brief Inserts and then deletes the keys in an avl_set traced by avl_trace, with a writer
+ * thread draining the events to /dev/null, and prints how many events were written and dropped.
+ * Against the core suite's avl_set rows it shows what tracing costs the updating thread.
+ *
+ * @param keys: (vector<uint64_t>) distinct keys in random order
+ */
+static void run_trace(const vector<uint64_t>& keys) {
+    typedef avl_set<uint64_t, less<uint64_t>, allocator<uint64_t>, avl_trace<uint64_t> > Traced;
+    size_t n = keys.size();
+    avl_event_sink<uint64_t> events;
+    size_t written;
+    {
+        avl_event_writer<uint64_t> writer(events, "/dev/null");
+        Traced tree;
+        tree.set_stats(avl_trace<uint64_t>(&events));
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(keys[i]);
+        }
+        report("avl_trace insert", n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.deleteNode(keys[i]);
+        }
+        report("avl_trace erase", n, n, seconds_since(start));
+        while (writer.written() + events.dropped() < 2 * n) {
+            this_thread::yield();
+        }
+        written = writer.written();
+    }
+    cerr << "    events: " << written << " written, " << events.dropped() << " dropped (ring of "
+         << events.capacity() << ")" << endl;
+}
+
+/**
+ * @brief Times insert, find and clear on one tree type, counting heap allocations.
+ *
+ * @param name: (string) the row label
+ * @param tree: (Tree) an empty tree
+ * @param keys: (vector<uint64_t>) the keys to insert, in insertion order
+ */
+template <class Tree>
+static void run_alloc(const string& name, Tree& tree, const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+
+    size_t before = allocations;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        tree.insertNode(keys[i], i);
+    }
+    report_allocs(name + " insert", n, n, seconds_since(start), allocations - before);
+
+    // Look the keys up in a different order than they were inserted.
+    before = allocations;
+    start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i = n; i-- > 0;) {
+        found += tree.searchItem(keys[i]);
+    }
+    report_allocs(name + " find", n, n, seconds_since(start), allocations - before);
+    sink = found;
+
+    start = chrono::steady_clock::now();
+    tree.clear();
+    report_allocs(name + " clear", n, n, seconds_since(start), 0);
+}
+
+/**
+ * @brief Compares the heap allocator with avl_node_pool, with and without huge pages.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert, in insertion order
+ */
+static void run_pool(const vector<uint64_t>& keys) {
+    typedef avl_node_pool<uint64_t> Pool;
+
+    avl_map<uint64_t, uint64_t> heap;
+    run_alloc("heap", heap, keys);
+
+    avl_map<uint64_t, uint64_t, less<uint64_t>, Pool> pool;
+    run_alloc("pool", pool, keys);
+
+    avl_map<uint64_t, uint64_t, less<uint64_t>, Pool> huge(less<uint64_t>(), Pool(avl_slab_arena::HUGE_PAGE_BYTES, true));
+    run_alloc("pool+thp", huge, keys);
+}
+
+/**
+ * @brief Compares build_from_sorted with one insertNode per key, on sorted and shuffled keys.
+ *
+ * @param keys: (vector<uint64_t>) the keys, in random order
+ */
+static void run_build(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+
+    const vector<uint64_t>* inputs[] = {&sorted, &keys};
+    const char* names[] = {"sorted", "random"};
+
+    for (int i = 0; i < 2; i++) {
+        const vector<uint64_t>& input = *inputs[i];
+
+        auto start = chrono::steady_clock::now();
+        {
+            avl_set<uint64_t> tree;
+            for (size_t j = 0; j < n; j++) {
+                tree.insertNode(input[j]);
+            }
+            sink = tree.height();
+        }
+        report(string("insertNode ") + names[i], n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        {
+            avl_set<uint64_t> tree(input.begin(), input.end());
+            sink = tree.height();
+        }
+        report(string("build_from_sorted ") + names[i], n, n, seconds_since(start));
+    }
+}
+
+/**
+ * @brief Runs a 50/50 insert/delete churn and reports throughput, the largest height seen
+ * and the p99 latency of lookups sampled during the run.
+ *
+ * @param name: (string) the row label
+ * @param n: (size_t) the number of keys the tree starts with
+ * @param ops: (size_t) the number of insert/delete operations
+ * @param avlErase: (bool) delete with deleteNode, or with the plain BST deleteItem
+ */
+static void run_churn_one(const string& name, size_t n, size_t ops, bool avlErase) {
+    mt19937_64 rng(7);
+    uint64_t universe = 2 * n;
+
+    vector<uint64_t> initial(n);
+    for (size_t i = 0; i < n; i++) {
+        initial[i] = rng() % universe;
+    }
+    avl_set<uint64_t> tree(initial.begin(), initial.end());
+
+    vector<double> samples;
+    samples.reserve(ops / 64 + 1);
+    int maxHeight = tree.height();
+    size_t found = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t key = rng() % universe;
+        if (rng() & 1) {
+            tree.insertNode(key);
+        } else if (avlErase) {
+            tree.deleteNode(key);
+        } else {
+            tree.deleteItem(key);
+        }
+
+        // Sample a lookup and the height every 64 operations.
+        if ((i & 63) == 0) {
+            uint64_t probe = rng() % universe;
+            auto lookup = chrono::steady_clock::now();
+            found += tree.searchItem(probe);
+            samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - lookup).count());
+
+            if (tree.height() > maxHeight) {
+                maxHeight = tree.height();
+            }
+        }
+    }
+    double sec = seconds_since(start);
+    sink = found;
+
+    sort(samples.begin(), samples.end());
+    double p99 = samples.empty() ? 0.0 : samples[samples.size() * 99 / 100];
+
+    report(name, n, ops, sec);
+    cerr << "    max height " << maxHeight << ", p99 lookup " << fixed << setprecision(1) << p99 << " ns" << endl;
+}
+
+/**
+ * @brief Runs the churn workload with the AVL delete and with the plain BST delete.
+ *
+ * @param n: (size_t) the number of keys the tree starts with; 10n operations are run
+ */
+static void run_churn(size_t n) {
+    run_churn_one("churn deleteNode", n, 10 * n, true);
+    run_churn_one("churn BST deleteItem", n, 10 * n, false);
+}
+
+/**
+ * @brief Times one full pass over a range, summing the keys.
+ */
+template <class Range>
+static void time_scan(const string& name, const Range& range, size_t n) {
+    auto start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (const uint64_t& key : range) {
+        sum += key;
+    }
+    report(name, n, n, seconds_since(start));
+    sink = sum;
+}
+
+/**
+ * @brief Times every traversal order of avl_set, and in-order iteration of std::set.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_traverse(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    avl_set<uint64_t> tree;
+    for (size_t i = 0; i < n; i++) {
+        tree.insertNode(keys[i]);
+    }
+    set<uint64_t> reference(keys.begin(), keys.end());
+
+    time_scan("scan in-order", tree, n);
+    time_scan("scan reverse", avl_range<avl_set<uint64_t>::const_reverse_iterator>(tree.rbegin(), tree.rend()), n);
+    time_scan("scan pre-order", tree.pre_order_range(), n);
+    time_scan("scan post-order", tree.post_order_range(), n);
+    time_scan("scan level-order", tree.level_order_range(), n);
+    time_scan("scan std::set", reference, n);
+}
+
+/**
+ * @brief Times treeNodeCount, rank, select and count_range.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_order_stats(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    avl_set<uint64_t> tree(keys.begin(), keys.end());
+    size_t total = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += tree.treeNodeCount();
+    }
+    report("treeNodeCount", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += tree.rank(keys[i]);
+    }
+    report("rank", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += *tree.select(keys[i] % n);
+    }
+    report("select", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i + 1 < n; i++) {
+        total += tree.count_range(keys[i], keys[i + 1]);
+    }
+    report("count_range", n, n, seconds_since(start));
+
+    sink = total;
+}
+
+/**
+ * @brief Times find, lower_bound and 100-key range scans on avl_set and std::set.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_range(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    avl_set<uint64_t> tree(keys.begin(), keys.end());
+    set<uint64_t> reference(keys.begin(), keys.end());
+    vector<uint64_t> sorted(reference.begin(), reference.end());
+    uint64_t total = 0;
+
+    size_t before = allocations;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += tree.find(keys[i]) != tree.end();
+    }
+    report_allocs("find", n, n, seconds_since(start), allocations - before);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += *tree.lower_bound(keys[i] - 1);
+    }
+    report("lower_bound", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        total += *reference.lower_bound(keys[i] - 1);
+    }
+    report("std::set lower_bound", n, n, seconds_since(start));
+
+    // Scan 100 keys from a random starting key.
+    size_t scans = n / 100;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < scans; i++) {
+        size_t first = keys[i] % (sorted.size() - 100);
+        tree.for_each_in_range(sorted[first], sorted[first + 100], [&total](uint64_t key) {
+            total += key;
+        });
+    }
+    report("for_each_in_range (100)", n, scans * 100, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < scans; i++) {
+        size_t first = keys[i] % (sorted.size() - 100);
+        for (auto it = reference.lower_bound(sorted[first]); *it < sorted[first + 100]; ++it) {
+            total += *it;
+        }
+    }
+    report("std::set range (100)", n, scans * 100, seconds_since(start));
+
+    sink = total;
+}
+
+/**
+ * @brief Times an avl_map that keeps the sum of its values in every node (avl_sum) against a
+ * plain one: inserting the keys in random order, which shows what refreshing the aggregate on
+ * the insert path and in the rotations costs, and then summing the values of 1000 random key
+ * ranges of n / 100 keys each with aggregate, in O(log n), and with for_each_in_range, in
+ * O(log n + k).
+ *
+ * @param keys: (vector<uint64_t>) distinct keys in random order
+ */
+static void run_aggregate(const vector<uint64_t>& keys) {
+    typedef avl_map<uint64_t, uint64_t, less<uint64_t>, allocator<uint64_t>, avl_no_stats, avl_sum<uint64_t> > summed_map;
+    size_t n = keys.size();
+    avl_map<uint64_t, uint64_t> plain;
+    summed_map summed;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        plain.insertNode(keys[i], i);
+    }
+    report("avl_map insert", n, n, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        summed.insertNode(keys[i], i);
+    }
+    report("avl_sum map insert", n, n, seconds_since(start));
+
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+    size_t width = max(n / 100, (size_t)1), queries = 1000;
+    uint64_t total = 0;
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++) {
+        size_t first = keys[i % n] % (n - width + 1);
+        total += summed.aggregate(sorted[first], first + width < n ? sorted[first + width] : UINT64_MAX);
+    }
+    report("aggregate (n / 100 keys)", n, queries, seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < queries; i++) {
+        size_t first = keys[i % n] % (n - width + 1);
+        plain.for_each_in_range(sorted[first], first + width < n ? sorted[first + width] : UINT64_MAX,
+            [&total](pair<const uint64_t&, uint64_t&> entry) {total += entry.second;});
+    }
+    report("for_each_in_range sum", n, queries, seconds_since(start));
+
+    sink = total;
+}
+
+/**
+ * @brief Times union_with, intersection_with and difference_with against the same result built
+ * by inserting or deleting the smaller tree's keys one at a time, for a second tree of n / 100
+ * keys and of n keys. Tree building is not timed.
+ *
+ * @param keys: (vector<uint64_t>) the keys of the first tree
+ */
+static void run_set_ops(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    mt19937_64 rng(7);
+
+    for (size_t m : {n / 100, n}) {
+        // Half of the second tree's keys also appear in the first.
+        vector<uint64_t> other(m);
+        for (size_t i = 0; i < m; i++) {
+            other[i] = i % 2 ? keys[rng() % n] : rng();
+        }
+        string suffix = " m=" + to_string(m);
+
+        {
+            avl_set<uint64_t> a(keys.begin(), keys.end()), b(other.begin(), other.end());
+            auto start = chrono::steady_clock::now();
+            a.union_with(b);
+            report("union_with" + suffix, n, n + m, seconds_since(start));
+            sink = a.treeNodeCount();
+        }
+        {
+            avl_set<uint64_t> a(keys.begin(), keys.end());
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < m; i++) {
+                a.insertNode(other[i]);
+            }
+            report("union by insertNode" + suffix, n, n + m, seconds_since(start));
+            sink = a.treeNodeCount();
+        }
+        {
+            avl_set<uint64_t> a(keys.begin(), keys.end()), b(other.begin(), other.end());
+            auto start = chrono::steady_clock::now();
+            a.intersection_with(b);
+            report("intersection_with" + suffix, n, n + m, seconds_since(start));
+            sink = a.treeNodeCount();
+        }
+        {
+            avl_set<uint64_t> a(keys.begin(), keys.end()), b(other.begin(), other.end());
+            auto start = chrono::steady_clock::now();
+            a.difference_with(b);
+            report("difference_with" + suffix, n, n + m, seconds_since(start));
+            sink = a.treeNodeCount();
+        }
+        {
+            avl_set<uint64_t> a(keys.begin(), keys.end());
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < m; i++) {
+                a.deleteNode(other[i]);
+            }
+            report("difference by deleteNode" + suffix, n, n + m, seconds_since(start));
+            sink = a.treeNodeCount();
+        }
+    }
+}
+
+/**
+ * @brief Times union_with, intersection_with and difference_with on an avl_task_pool of 1, 2, 4,
+ * 8 and 16 threads, for two trees of n keys each. The speedup is relative to the sequential
+ * overloads; it can only reach the number of cores the machine actually has.
+ *
+ * @param keys: (vector<uint64_t>) the keys of the first tree
+ */
+static void run_parallel_set_ops(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    mt19937_64 rng(11);
+    vector<uint64_t> other(n);
+    for (size_t i = 0; i < n; i++) {
+        other[i] = i % 2 ? keys[rng() % n] : rng();
+    }
+
+    const char* names[] = {"union_with", "intersection_with", "difference_with"};
+    for (int op = 0; op < 3; op++) {
+        double sequential = 0;
+        for (unsigned threads : {0u, 1u, 2u, 4u, 8u, 16u}) {
+            avl_set<uint64_t> a(keys.begin(), keys.end()), b(other.begin(), other.end());
+            avl_task_pool pool(threads == 0 ? 1 : threads);
+
+            auto start = chrono::steady_clock::now();
+            if (threads == 0) {
+                op == 0 ? a.union_with(b) : op == 1 ? a.intersection_with(b) : a.difference_with(b);
+            }
+            else {
+                op == 0 ? a.union_with(b, pool) : op == 1 ? a.intersection_with(b, pool) : a.difference_with(b, pool);
+            }
+            double sec = seconds_since(start);
+            sink = a.treeNodeCount();
+
+            if (threads == 0) {
+                sequential = sec;
+                report(string(names[op]) + " sequential", n, 2 * n, sec);
+                continue;
+            }
+            report(string(names[op]) + " " + to_string(threads) + " threads", n, 2 * n, sec);
+            cerr << "    speedup " << fixed << setprecision(2) << sequential / sec << "x" << endl;
+        }
+    }
+}
+
+/**
+ * @brief Runs reader threads for a fixed time while one writer keeps deleting and reinserting
+ * keys, and prints the total lookup rate and the writer's update rate.
+ *
+ * @param name: (string) the row name
+ * @param n: (size_t) the number of keys in the tree
+ * @param readers: (unsigned) the number of reader threads
+ * @param lookup: (Lookup) called as lookup(state, key) on a reader thread; state comes from
+ * makeState() on that thread
+ * @param makeState: (MakeState) creates per-thread reader state
+ * @param update: (Update) called as update(i) by the writer
+ */
+template <class MakeState, class Lookup, class Update>
+static void time_readers(const string& name, size_t n, unsigned readers, MakeState makeState, Lookup lookup, Update update) {
+    const double seconds = 0.25;
+    atomic<bool> stop(false);
+    atomic<size_t> lookups(0);
+    size_t updates = 0;
+
+    vector<thread> threads;
+    for (unsigned t = 0; t < readers; t++) {
+        threads.push_back(thread([&, t]() {
+            auto state = makeState();
+            mt19937_64 rng(t);
+            size_t done = 0, found = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                for (int i = 0; i < 256; i++) {
+                    found += lookup(state, rng() % n);
+                }
+                done += 256;
+            }
+            lookups += done;
+            sink = found;
+        }));
+    }
+
+    auto start = chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        update(updates++);
+    }
+    stop = true;
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    double sec = seconds_since(start);
+
+    cerr << left << setw(28) << name + " " + to_string(readers) + "r" << right << setw(10) << n
+         << setw(12) << fixed << setprecision(2) << lookups / sec / 1e6 << " Mreads/s"
+         << setw(10) << setprecision(3) << updates / sec / 1e6 << " Mwrites/s" << endl;
+}
+
+/**
+ * @brief Times lookups from 1, 2, 4 and 8 threads while one writer deletes and reinserts keys,
+ * on cowBST and on an avl_map guarded by one mutex. The keys are 0 to n - 1.
+ *
+ * @param n: (size_t) the number of keys
+ */
+static void run_concurrent_reads(size_t n) {
+    for (unsigned readers : {1u, 2u, 4u, 8u}) {
+        avl_cow_map<uint64_t, uint64_t> cow;
+        for (size_t i = 0; i < n; i++) {
+            cow.insertNode(i, i);
+        }
+        typedef avl_cow_map<uint64_t, uint64_t>::reader Reader;
+        time_readers("cowBST get", n, readers,
+            [&cow]() { return unique_ptr<Reader>(new Reader(cow)); },
+            [](unique_ptr<Reader>& reader, uint64_t key) { uint64_t value = 0; return reader->get(key, value); },
+            [&cow, n](size_t i) { uint64_t key = (i * 7919) % n; cow.deleteNode(key); cow.insertNode(key, i); });
+    }
+
+    for (unsigned readers : {1u, 2u, 4u, 8u}) {
+        avl_map<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(i, i);
+        }
+        mutex lock;
+        time_readers("mutex avl_map get", n, readers,
+            []() { return 0; },
+            [&tree, &lock](int, uint64_t key) { lock_guard<mutex> guard(lock); return tree.searchValue(key) != nullptr; },
+            [&tree, &lock, n](size_t i) { uint64_t key = (i * 7919) % n; lock_guard<mutex> guard(lock); tree.deleteNode(key); tree.insertNode(key, i); });
+    }
+}
+
+/**
+ * @brief Times taking a cowBST snapshot, then holds one while n / 10 updates run and reports
+ * how many replaced nodes it keeps alive per update, and how long a full scan of it takes.
+ * The keys are 0 to n - 1.
+ *
+ * @param n: (size_t) the number of keys
+ */
+static void run_snapshots(size_t n) {
+    typedef avl_cow_map<uint64_t, uint64_t> Tree;
+    Tree cow;
+    for (size_t i = 0; i < n; i++) {
+        cow.insertNode(i, i);
+    }
+
+    const size_t takes = 10000;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < takes; i++) {
+        Tree::snapshot_view frozen = cow.snapshot();
+        sink = frozen.size();
+    }
+    report("cowBST snapshot", n, takes, seconds_since(start));
+
+    Tree::snapshot_view frozen = cow.snapshot();
+    size_t before = cow.pending_reclaim();
+    size_t updates = n / 10;
+    for (size_t i = 0; i < updates; i++) {
+        uint64_t key = (i * 7919) % n;
+        cow.deleteNode(key);
+        cow.insertNode(key, i);
+    }
+    size_t kept = cow.pending_reclaim() - before;
+
+    start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    frozen.for_each([&sum](pair<const uint64_t&, const uint64_t&> entry) { sum += entry.second; });
+    report("cowBST snapshot scan", n, n, seconds_since(start));
+    if (sum != (uint64_t)n * (n - 1) / 2) {
+        cerr << "cowBST snapshot changed under updates" << endl;
+        exit(1);
+    }
+    cerr << "    " << kept << " nodes kept for " << 2 * updates << " updates (" << fixed << setprecision(1)
+         << (double)kept / (2 * updates) << " per update, tree has " << n << ")" << endl;
+}
+
+/**
+ * @brief Runs 2n random inserts, deletes and lookups split over 1, 2, 4 and 8 threads on
+ * concurrentBST, and checks the final contents as a quick sanity check.
+ * This is not a linearizability test, since it only compares end states; that test is
+ * test_concurrent.cpp, run by "make test". Each thread owns the keys k with k % threads == its index, so the outcome of every one of
+ * its operations is known exactly and is checked as it runs. A second, small key range is shared
+ * by all threads; for it each thread counts its successful inserts minus deletes, and the totals
+ * must match what is left in the tree. Afterwards the tree must hold exactly the expected keys
+ * and be a valid AVL tree. A failure exits the benchmark with status 1.
+ * The same operations are then timed on an avl_set behind one mutex.
+ *
+ * @param n: (size_t) half the number of operations, and the size of the key space
+ */
+static void run_concurrent_updates(size_t n) {
+    const size_t shared = 64;
+
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        avl_concurrent_set<uint64_t> tree;
+        size_t ops = 2 * n / threads;
+        vector<vector<char> > owned(threads, vector<char>(n / threads + 1, 0));
+        vector<vector<long> > net(threads, vector<long>(shared, 0));
+        atomic<bool> failed(false);
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned id = 0; id < threads; id++) {
+            workers.push_back(thread([&, id]() {
+                avl_concurrent_set<uint64_t>::session s(tree);
+                mt19937_64 rng(id + 1);
+                bool ok = true;
+                for (size_t i = 0; i < ops; i++) {
+                    uint64_t r = rng();
+                    // one operation in eight goes to the shared keys
+                    if (r % 8 == 0) {
+                        uint64_t key = (r >> 8) % shared;
+                        if ((r >> 4) & 1) {
+                            net[id][key] += s.insertNode(key);
+                        }
+                        else {
+                            net[id][key] -= s.deleteNode(key);
+                        }
+                        continue;
+                    }
+
+                    size_t slot = (r >> 8) % owned[id].size();
+                    uint64_t key = shared + slot * threads + id;
+                    switch ((r >> 4) % 3) {
+                        case 0:
+                            ok &= s.insertNode(key) == !owned[id][slot];
+                            owned[id][slot] = 1;
+                            break;
+                        case 1:
+                            ok &= s.deleteNode(key) == (bool)owned[id][slot];
+                            owned[id][slot] = 0;
+                            break;
+                        default:
+                            ok &= s.searchItem(key) == (bool)owned[id][slot];
+                    }
+                }
+                if (!ok) {
+                    failed = true;
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        report("concurrentBST " + to_string(threads) + " threads", n, ops * threads, seconds_since(start));
+
+        // Compare the final tree with the oracle.
+        vector<uint64_t> expected;
+        for (uint64_t key = 0; key < shared; key++) {
+            long total = 0;
+            for (unsigned id = 0; id < threads; id++) {
+                total += net[id][key];
+            }
+            failed = failed || total < 0 || total > 1;
+            if (total == 1) {
+                expected.push_back(key);
+            }
+        }
+        for (size_t slot = 0; slot < owned[0].size(); slot++) {
+            for (unsigned id = 0; id < threads; id++) {
+                if (owned[id][slot]) {
+                    expected.push_back(shared + slot * threads + id);
+                }
+            }
+        }
+        vector<uint64_t> actual;
+        tree.for_each([&actual](uint64_t key) { actual.push_back(key); });
+        if (failed || actual != expected || tree.treeNodeCount() != expected.size() || !tree.validate()) {
+            cerr << "concurrentBST stress test FAILED with " << threads << " threads" << endl;
+            exit(1);
+        }
+    }
+
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        avl_set<uint64_t> tree;
+        mutex lock;
+        size_t ops = 2 * n / threads;
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned id = 0; id < threads; id++) {
+            workers.push_back(thread([&, id]() {
+                mt19937_64 rng(id + 1);
+                for (size_t i = 0; i < ops; i++) {
+                    uint64_t r = rng();
+                    uint64_t key = (r >> 8) % n;
+                    lock_guard<mutex> guard(lock);
+                    switch ((r >> 4) % 3) {
+                        case 0: tree.insertNode(key); break;
+                        case 1: tree.deleteNode(key); break;
+                        default: sink = tree.searchItem(key);
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        report("mutex avl_set " + to_string(threads) + " threads", n, ops * threads, seconds_since(start));
+    }
+}
+
+/**
+ * @brief Times n random inserts split over 1, 2, 4 and 8 threads on a shardedBST with one shard
+ * per thread, in range and hash mode, then one merged scan over all shards.
+ * The range-mode tree starts with no boundaries and has to find them by rebalancing.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+template <avl_shard_mode Mode>
+static void run_sharded_one(const string& name, const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        avl_sharded_set<uint64_t, less<uint64_t>, allocator<uint64_t>, Mode> tree(threads);
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned id = 0; id < threads; id++) {
+            workers.push_back(thread([&, id]() {
+                for (size_t i = id; i < n; i += threads) {
+                    tree.insertNode(keys[i]);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        report(name + " insert " + to_string(threads) + " shards", n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        uint64_t sum = 0;
+        {
+            typename avl_sharded_set<uint64_t, less<uint64_t>, allocator<uint64_t>, Mode>::scan all(tree);
+            for (auto it = all.begin(); it != all.end(); ++it) {
+                sum += *it;
+            }
+        }
+        sink = sum;
+        report(name + " scan " + to_string(threads) + " shards", n, tree.treeNodeCount(), seconds_since(start));
+    }
+}
+
+/**
+ * @brief Removes the files of a durableBST directory, and the directory.
+ */
+static void remove_durable(const string& dir) {
+    if (DIR* listing = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(listing)) {
+            if (strncmp(entry->d_name, "wal.", 4) == 0) {
+                remove((dir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(listing);
+    }
+    remove((dir + "/checkpoint.img").c_str());
+    rmdir(dir.c_str());
+}
+
+/**
+ * @brief Times durableBST: inserting the keys without waiting for the syncs, reopening the
+ * directory by replaying the log and by loading a checkpoint, and then, at commit intervals
+ * from 0 to 10 ms, inserts from 64 threads that each wait for their sync and from one thread
+ * that does not. Those rows use a fixed number of inserts, since a sync costs far more than
+ * the tree does; the records per sync they print is the batch size group commit reached.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_durable(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    const string dir = "/tmp/avl_bench_durable";
+    remove_durable(dir);
+
+    {
+        avl_durable_set<uint64_t> tree(dir, chrono::microseconds(1000), false, 0);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(keys[i]);
+        }
+        tree.sync();
+        report("durable insert no wait", n, n, seconds_since(start));
+    }
+
+    auto start = chrono::steady_clock::now();
+    {
+        avl_durable_set<uint64_t> tree(dir, chrono::microseconds(1000), false, 0);
+        report("durable open, log replay", n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        tree.checkpoint();
+        report("durable checkpoint", n, n, seconds_since(start));
+    }
+
+    start = chrono::steady_clock::now();
+    {
+        avl_durable_set<uint64_t> tree(dir, chrono::microseconds(1000), false, 0);
+        report("durable open, checkpoint", n, n, seconds_since(start));
+    }
+
+    const unsigned writers = 64;
+    const size_t perWriter = 32, unwaited = min(n, (size_t)20000);
+    for (long micros : {0L, 100L, 1000L, 10000L}) {
+        remove_durable(dir);
+        avl_durable_set<uint64_t> tree(dir, chrono::microseconds(micros), true, 0);
+        size_t syncsBefore = tree.syncs();
+
+        start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (unsigned t = 0; t < writers; t++) {
+            threads.push_back(thread([&tree, &keys, t, perWriter]() {
+                for (size_t i = 0; i < perWriter; i++) {
+                    tree.insertNode(keys[(t * perWriter + i) % keys.size()]);
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        report("durable " + to_string(micros) + " us, 64 waiting", n, writers * perWriter, seconds_since(start));
+        cerr << "    " << fixed << setprecision(1)
+             << (double)(writers * perWriter) / max(tree.syncs() - syncsBefore, (size_t)1) << " records per sync" << endl;
+
+        // One thread that does not wait: the interval bounds what a crash can lose instead.
+        remove_durable(dir);
+        avl_durable_set<uint64_t> unsynced(dir, chrono::microseconds(micros), false, 0);
+        syncsBefore = unsynced.syncs();
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < unwaited; i++) {
+            unsynced.insertNode(keys[i]);
+        }
+        unsynced.sync();
+        report("durable " + to_string(micros) + " us, no wait", n, unwaited, seconds_since(start));
+        cerr << "    " << fixed << setprecision(1)
+             << (double)unwaited / max(unsynced.syncs() - syncsBefore, (size_t)1) << " records per sync" << endl;
+    }
+
+    remove_durable(dir);
+}
+
+/**
+ * @brief Times checkpoint_async against save on an avl_map: how long the fork stalls the
+ * caller, how many updates the parent makes while the child writes the image, and how long
+ * the child takes. The updates overwrite values in place, one key after another in random
+ * order, so each write to an untouched page makes fork copy it; the pages copied, printed
+ * under the rows, are what the snapshot cost in memory. The first pass makes no updates,
+ * which gives the copies the child needs for itself. On a single core the child and the
+ * parent share it, so the child's time includes the updates.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_checkpoint(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    const string path = "/tmp/avl_bench_checkpoint.img";
+    avl_map<uint64_t, uint64_t> tree;
+    for (size_t i = 0; i < n; i++) {
+        tree.insertNode(keys[i], i);
+    }
+
+    auto start = chrono::steady_clock::now();
+    tree.save(path);
+    report("avl_map save", n, n, seconds_since(start));
+
+    for (bool updating : {false, true}) {
+        const string label = updating ? "checkpoint busy" : "checkpoint idle";
+        start = chrono::steady_clock::now();
+        avl_checkpoint checkpoint = tree.checkpoint_async(path);
+        report(label + " fork", n, 1, seconds_since(start));
+
+        size_t updates = 0;
+        auto updateStart = chrono::steady_clock::now();
+        while (updating && !checkpoint.done()) {
+            for (size_t i = 0; i < 1024; i++, updates++) {
+                tree.find(keys[updates % n])->second = updates;
+            }
+        }
+        if (updating) {
+            report(label + " parent", n, updates, seconds_since(updateStart));
+        }
+
+        checkpoint.wait();
+        report(label + " child", n, n, checkpoint.seconds());
+        cerr << "    " << (checkpoint.ok() ? "" : "failed, ") << checkpoint.bytes_written() << " bytes written, "
+             << checkpoint.pages_copied() << " pages copied" << endl;
+    }
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Times mappedBST: inserting the keys into a set stored in a file, the file growing as
+ * it goes, syncing it, and opening it again after a child process changed it and died without
+ * a sync, which rolls it back to the sync by walking every node. Then opening it again cleanly,
+ * which maps it and checks its header whatever the number of keys, and looking every key up
+ * and deleting every key in the reopened tree; the first delete to reach a node copies it.
+ * The file is in the page cache, so the lookups after reopening fault pages in without
+ * reading the disk; the avl_set rebuild by insert row is what reopening replaces.
+ *
+ * @param keys: (vector<uint64_t>) distinct keys in random order
+ */
+static void run_mapped(const vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    const string path = "/tmp/avl_bench_heap.avl";
+    remove(path.c_str());
+
+    {
+        avl_mapped_set<uint64_t> tree(path);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(keys[i]);
+        }
+        report("mapped heap insert", n, n, seconds_since(start));
+        print_memory("mapped heap", tree);
+
+        start = chrono::steady_clock::now();
+        tree.sync();
+        report("mapped heap sync", n, n, seconds_since(start));
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        // _exit skips the destructor, and so its sync.
+        avl_mapped_set<uint64_t> crashed(path);
+        crashed.deleteNode(keys[0]);
+        _exit(0);
+    }
+    waitpid(child, nullptr, 0);
+    auto start = chrono::steady_clock::now();
+    {
+        avl_mapped_set<uint64_t> tree(path);
+        report("mapped heap recover", n, 1, seconds_since(start));
+    }
+
+    start = chrono::steady_clock::now();
+    {
+        avl_mapped_set<uint64_t> tree(path);
+        report("mapped heap reopen", n, 1, seconds_since(start));
+
+        size_t found = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = n; i-- > 0;) {
+            found += tree.searchItem(keys[i]);
+        }
+        report("mapped heap lookup hit", n, n, seconds_since(start));
+        sink = found;
+
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.deleteNode(keys[i]);
+        }
+        report("mapped heap delete", n, n, seconds_since(start));
+    }
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Runs the shardedBST benchmark in range and hash mode.
+ *
+ * @param keys: (vector<uint64_t>) the keys to insert
+ */
+static void run_sharded(const vector<uint64_t>& keys) {
+    run_sharded_one<AVL_SHARD_BY_RANGE>("sharded range", keys);
+    run_sharded_one<AVL_SHARD_BY_HASH>("sharded hash", keys);
+}
+
+/**
+ * @brief Times inserting every key, then looking every key up, on avl_map and std::map.
+ *
+ * @param label: (string) the key type, used in the row names
+ * @param keys: (vector<K>) the keys to insert, in insertion order
+ */
+template <class K>
+static void run(const string& label, const vector<K>& keys) {
+    size_t n = keys.size();
+
+    // avl_map
+    {
+        avl_map<K, uint64_t> tree;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insertNode(keys[i], i);
+        }
+        report("avl_map insert " + label, n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        size_t found = 0;
+        for (size_t i = 0; i < n; i++) {
+            found += tree.searchItem(keys[i]);
+        }
+        report("avl_map find " + label, n, n, seconds_since(start));
+        sink = found;
+    }
+
+    // std::map
+    {
+        map<K, uint64_t> tree;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            tree.insert(make_pair(keys[i], (uint64_t)i));
+        }
+        report("std::map insert " + label, n, n, seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        size_t found = 0;
+        for (size_t i = 0; i < n; i++) {
+            found += tree.count(keys[i]);
+        }
+        report("std::map find " + label, n, n, seconds_since(start));
+        sink = found;
+    }
+}
+
+/* --- End of HELPERS --- */
+
+/* --- MAIN --- */
+/**
+ * @brief Runs the core suite at 10^3 keys and every power of ten up to the given maximum,
+ * and the other benchmarks from 10^4 up to 10^6 keys at most.
+ * The table goes to stderr and the JSON to stdout.
+ *
+ * @param argc
+ * @param argv: argv[1] is the largest key count (default 10000000)
+ * @return int: 0 represents normal process termination.
+ */
+int main(int argc, char* argv[]) {
+    size_t maxKeys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    const size_t extendedMin = 10000, extendedMax = 1000000;
+
+    mt19937_64 rng(42);
+    for (size_t n = 1000; n <= maxKeys; n *= 10) {
+        // Distinct even keys, so that key | 1 is never present.
+        vector<uint64_t> ints(n);
+        for (size_t i = 0; i < n; i++) {
+            ints[i] = rng() & ~(uint64_t)1;
+        }
+        sort(ints.begin(), ints.end());
+        ints.erase(unique(ints.begin(), ints.end()), ints.end());
+        while (ints.size() < n) {
+            ints.push_back(ints.back() + 2);
+        }
+        shuffle(ints.begin(), ints.end(), rng);
+
+        run_core(ints);
+        run_frozen(ints);
+        run_image(ints);
+        if (n < extendedMin || n > extendedMax) {
+            cerr << endl;
+            continue;
+        }
+
+        vector<string> strings(n);
+        for (size_t i = 0; i < n; i++) {
+            strings[i] = "key:" + to_string(ints[i]);
+        }
+
+        run("uint64", ints);
+        run("string", strings);
+        run_pool(ints);
+        run_build(ints);
+        run_churn(n);
+        run_traverse(ints);
+        run_stats(ints);
+        run_trace(ints);
+        run_order_stats(ints);
+        run_range(ints);
+        run_aggregate(ints);
+        run_set_ops(ints);
+        run_parallel_set_ops(ints);
+        run_concurrent_reads(n);
+        run_snapshots(n);
+        run_concurrent_updates(n);
+        run_sharded(ints);
+        run_durable(ints);
+        run_checkpoint(ints);
+        run_mapped(ints);
+        cerr << endl;
+    }
+
+    write_json(cout, maxKeys);
+    return 0;
+}
+
+/* --- End of MAIN --- */
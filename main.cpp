@@ -29,10 +29,11 @@ using namespace std;
  */
 int main() {
 
-    balancedBST* tree = new balancedBST();
+    balancedBST<char>* tree = new balancedBST<char>();
 
     // Insert a single letter in to the tree
     for (int i = 0; i < 26; i++) {
+        cout << "Inserting: " << (char)(i+97) << endl;
         tree->insertNode((char)i+97);
     }
 
@@ -64,7 +65,9 @@ int main() {
     tree->balanceFactors();
 
     // Delete the single letter from the tree
+    cout << "Deleting: a" << endl;
     tree->deleteNode('a');
+    cout << "Deleting: a" << endl;
     tree->deleteNode('a');
 
     // Display the tree
@@ -0,0 +1,190 @@
+/**
+ * @file test_aggregate.cpp
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file tests the augmentation policies and aggregate(). Four trees, with avl_sum,
+ * avl_min, avl_max and a policy that concatenates keys, take the same random inserts and deletes
+ * as a std::map, and their range aggregates are compared with sums, minimums, maximums and
+ * strings computed from it. Concatenation is not commutative, so it also checks that aggregate
+ * combines in key order. Then refresh, split, join, difference_with and build_from_sorted must
+ * keep the aggregates right.
+ * Build and run it with "make test".
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+/* --- IMPORTS --- */
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <limits>
+#include <algorithm>
+#include "AVLtrees.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- HELPERS --- */
+
+/**
+ * @brief A policy whose combine is not commutative: the keys of a range as "k1,k2,...".
+ */
+struct avl_concat {
+    typedef string value_type;
+    static string identity () {return "";};
+    template <class K, class V>
+    static string of (const K &key, const V &) {return to_string(key) + ",";};
+    static string combine (const string &a, const string &b) {return a + b;};
+};
+
+typedef avl_map<int, long, less<int>, allocator<int>, avl_no_stats, avl_sum<long> > sum_map;
+typedef avl_set<int, less<int>, allocator<int>, avl_stats, avl_min<int> > min_set;
+typedef avl_map<int, int, less<int>, allocator<int>, avl_no_stats, avl_max<int> > max_map;
+typedef avl_set<int, less<int>, allocator<int>, avl_no_stats, avl_concat> concat_set;
+
+static int failures = 0;
+
+/**
+ * @brief Reports a failed check.
+ */
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+/**
+ * @brief Sums the values of the model's keys in [lo, hi).
+ */
+static long model_sum(const map<int, long>& model, int lo, int hi) {
+    long sum = 0;
+    for (map<int, long>::const_iterator it = model.lower_bound(lo); it != model.end() && it->first < hi; ++it) {
+        sum += it->second;
+    }
+    return sum;
+}
+
+/* --- End of HELPERS --- */
+
+/* --- TESTS --- */
+
+/**
+ * @brief Random inserts and deletes, with range aggregates checked every 97 updates.
+ */
+static void test_ranges(sum_map& sums, map<int, long>& model) {
+    mt19937 rng(9);
+    min_set mins;
+    max_map maxes;
+    concat_set keys;
+
+    for (int step = 0; step < 20000; step++) {
+        int key = rng() % 2000;
+        if (rng() % 3) {
+            long value = rng() % 1000;
+            model.insert(make_pair(key, value));
+            sums.insertNode(key, value);
+            mins.insertNode(key);
+            maxes.insertNode(key, (int)value);
+            keys.insertNode(key);
+        }
+        else {
+            model.erase(key);
+            sums.deleteNode(key);
+            mins.deleteNode(key);
+            maxes.deleteNode(key);
+            keys.deleteNode(key);
+        }
+
+        if (step % 97 != 0) {
+            continue;
+        }
+        for (int t = 0; t < 20; t++) {
+            // ranges that start or end outside the keys, and empty and reversed ones
+            int lo = (int)(rng() % 2100) - 50;
+            int hi = (int)(rng() % 2100) - 50;
+            int low = numeric_limits<int>::max();
+            int high = numeric_limits<int>::lowest();
+            string joined;
+            for (map<int, long>::iterator it = model.lower_bound(lo); it != model.end() && it->first < hi; ++it) {
+                low = min(low, it->first);
+                high = max(high, (int)it->second);
+                joined += to_string(it->first) + ",";
+            }
+            check(sums.aggregate(lo, hi) == model_sum(model, lo, hi), "avl_sum over a range");
+            check(mins.aggregate(lo, hi) == low, "avl_min over a range");
+            check(maxes.aggregate(lo, hi) == high, "avl_max over a range");
+            check(keys.aggregate(lo, hi) == joined, "a non-commutative policy over a range, in key order");
+        }
+    }
+    check(sums.aggregate() == model_sum(model, numeric_limits<int>::min(), numeric_limits<int>::max()),
+        "aggregate() of the whole tree");
+}
+
+/**
+ * @brief refresh after a change in place, then split, join, difference_with and
+ * build_from_sorted.
+ */
+static void test_structure(sum_map& sums, map<int, long>& model) {
+    const int all = numeric_limits<int>::max();
+    int first = model.begin()->first;
+    *sums.searchValue(first) += 5;
+    model[first] += 5;
+    check(sums.refresh(first), "refresh finds the key");
+    check(sums.aggregate() == model_sum(model, -1, all), "refresh after a change in place");
+    check(!sums.refresh(-7), "refresh of a missing key");
+
+    sum_map left, right;
+    sums.split(1000, left, right);
+    check(left.aggregate() == model_sum(model, -1, 1000), "split keeps the left aggregate");
+    check(right.aggregate() == model_sum(model, 1000, all), "split keeps the right aggregate");
+    left.join(right);
+    check(left.aggregate() == model_sum(model, -1, all), "join combines the aggregates");
+
+    sum_map odd;
+    map<int, long> even;
+    for (map<int, long>::iterator it = model.begin(); it != model.end(); ++it) {
+        if (it->first % 2) {
+            odd.insertNode(it->first, it->second);
+        }
+        else {
+            even.insert(*it);
+        }
+    }
+    left.difference_with(odd);
+    check(left.aggregate() == model_sum(even, -1, all), "difference_with keeps the aggregate");
+    check(left.aggregate(100, 900) == model_sum(even, 100, 900), "difference_with keeps range aggregates");
+
+    vector<pair<int, long> > sorted(model.begin(), model.end());
+    sum_map built;
+    built.build_from_sorted(sorted.begin(), sorted.end());
+    check(built.aggregate() == model_sum(model, -1, all), "build_from_sorted sets the aggregates");
+    check(built.aggregate(500, 1500) == model_sum(model, 500, 1500), "build_from_sorted range aggregates");
+}
+
+/* --- End of TESTS --- */
+
+/* --- MAIN --- */
+
+/**
+ * @brief Runs the tests.
+ *
+ * @return int: 0 if every check passed
+ */
+int main() {
+    sum_map sums;
+    map<int, long> model;
+    test_ranges(sums, model);
+    test_structure(sums, model);
+
+    cout << (failures == 0 ? "aggregate: all checks passed" : "aggregate: checks FAILED") << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+/* --- End of MAIN --- */
@@ -0,0 +1,329 @@
+/**
+ * @file test_concurrent.cpp
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file is a linearizability stress test for concurrentBST. Every thread hammers the
+ * same small range of keys with inserts, deletes, lookups and value reads, so lookups race the
+ * rotations and the routing-node unlinks that the updates cause. Each operation is recorded with
+ * its result and with the logical time it was invoked and returned, and afterwards the history of
+ * every key is checked against a sequential map: some order of the operations that respects
+ * real time must give every operation the result it got. The check is the Wing and Gong search
+ * with Lowe's memoization, run per key, which is enough since every operation touches one key.
+ * Once the threads have stopped, the tree must also be a valid AVL tree holding what the
+ * histories say.
+ * Build and run it with "make test". An optional argument scales the operations per thread.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+/* --- IMPORTS --- */
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include "AVLconcurrent.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- HISTORY --- */
+
+/**
+ * @brief The operations a thread runs.
+ */
+enum op_kind {
+    OP_INSERT,      // insertNode(key, value)
+    OP_DELETE,      // deleteNode(key)
+    OP_SEARCH,      // searchItem(key)
+    OP_GET          // get(key, value)
+};
+
+/**
+ * @brief One operation as it ran: what it was, what it returned and when.
+ */
+struct Operation {
+    uint64_t key;           // the key
+    op_kind kind;           // the call
+    uint64_t value;         // the value inserted, or the value get read
+    bool result;            // what the call returned
+    uint64_t invoked;       // logical time before the call
+    uint64_t returned;      // logical time after it returned
+};
+
+// Logical clock. An operation whose return stamp is below another's invoke stamp finished
+// before the other started.
+static atomic<uint64_t> ticks(0);
+
+/**
+ * @brief Applies an operation to the sequential model of one key.
+ *
+ * @param op: (Operation) the operation
+ * @param state: (uint64_t) the value mapped to the key, 0 when it is absent
+ * @param next: (uint64_t&) set to the state after the operation
+ * @return bool: whether the operation gets its recorded result in this state
+ */
+static bool apply(const Operation& op, uint64_t state, uint64_t& next) {
+    next = state;
+    switch (op.kind) {
+        case OP_INSERT:
+            if (op.result) {
+                next = op.value;
+            }
+            return op.result == (state == 0);
+        case OP_DELETE:
+            next = 0;
+            return op.result == (state != 0);
+        case OP_SEARCH:
+            return op.result == (state != 0);
+        default:
+            return op.result ? state == op.value : state == 0;
+    }
+}
+
+/**
+ * @brief Checks that the history of one key is linearizable, starting from an absent key.
+ *
+ * The calls and returns are put on one list in time order. The search walks it, linearizing a
+ * call whenever the model accepts it and removing it with its return from the list; meeting a
+ * return whose call is still on the list means the last choice was wrong, and the search backs
+ * up. A set of (linearized operations, state) pairs already tried cuts repeated work.
+ *
+ * @param ops: (vector<Operation>) the operations on the key
+ * @return bool: true if some order that respects real time gives every result
+ */
+static bool linearizable(const vector<Operation>& ops) {
+    size_t n = ops.size();
+    const size_t none = 2 * n + 1;
+    const size_t head = 2 * n;
+
+    // events in time order: index 2i is the call of ops[i] and 2i + 1 its return
+    vector<pair<uint64_t, size_t> > order;
+    for (size_t i = 0; i < n; i++) {
+        order.push_back(make_pair(ops[i].invoked, 2 * i));
+        order.push_back(make_pair(ops[i].returned, 2 * i + 1));
+    }
+    sort(order.begin(), order.end());
+
+    vector<size_t> next(2 * n + 1), prev(2 * n + 1);
+    size_t last = head;
+    for (size_t k = 0; k < order.size(); k++) {
+        next[last] = order[k].second;
+        prev[order[k].second] = last;
+        last = order[k].second;
+    }
+    next[last] = none;
+
+    vector<uint64_t> linearized((n + 63) / 64, 0);
+    unordered_set<string> tried;
+    vector<pair<size_t, uint64_t> > calls;     // linearized calls and the state before each
+    uint64_t state = 0;
+
+    size_t e = next[head];
+    while (next[head] != none) {
+        if (e % 2 == 0) {
+            size_t i = e / 2;
+            uint64_t after;
+            if (apply(ops[i], state, after)) {
+                linearized[i / 64] ^= (uint64_t)1 << (i % 64);
+                string seen((const char *)linearized.data(), linearized.size() * 8);
+                seen.append((const char *)&after, sizeof(after));
+                if (tried.insert(seen).second) {
+                    calls.push_back(make_pair(e, state));
+                    state = after;
+                    // take the call and its return off the list
+                    next[prev[e]] = next[e];
+                    prev[next[e]] = prev[e];
+                    next[prev[e + 1]] = next[e + 1];
+                    if (next[e + 1] != none) {
+                        prev[next[e + 1]] = prev[e + 1];
+                    }
+                    e = next[head];
+                    continue;
+                }
+                linearized[i / 64] ^= (uint64_t)1 << (i % 64);
+            }
+            e = next[e];
+        }
+        else {
+            if (calls.empty()) {
+                return false;
+            }
+            e = calls.back().first;
+            state = calls.back().second;
+            calls.pop_back();
+            linearized[e / 2 / 64] ^= (uint64_t)1 << (e / 2 % 64);
+            // put the return back, then the call
+            if (next[e + 1] != none) {
+                prev[next[e + 1]] = e + 1;
+            }
+            next[prev[e + 1]] = e + 1;
+            prev[next[e]] = e;
+            next[prev[e]] = e;
+            e = next[e];
+        }
+    }
+    return true;
+}
+
+/* --- End of HISTORY --- */
+
+/* --- TESTS --- */
+
+static int failures = 0;
+
+/**
+ * @brief Reports a failed check.
+ */
+static void fail(const string& what) {
+    cerr << "FAILED: " << what << endl;
+    failures++;
+}
+
+/**
+ * @brief Feeds the checker histories with known answers, so that a checker that accepts
+ * everything cannot pass the stress test.
+ */
+static void test_checker() {
+    // two inserts that both succeed, one after the other, with no delete between them
+    vector<Operation> twice = {{1, OP_INSERT, 5, true, 0, 1}, {1, OP_INSERT, 6, true, 2, 3}};
+    // the same two inserts overlapping a delete: insert, delete, insert works
+    vector<Operation> overlapped = {{1, OP_INSERT, 5, true, 0, 3}, {1, OP_DELETE, 0, true, 1, 5}, {1, OP_INSERT, 6, true, 2, 4}};
+    // a read of a value that was never inserted
+    vector<Operation> invented = {{1, OP_INSERT, 5, true, 0, 1}, {1, OP_GET, 7, true, 2, 3}};
+    // a lookup that misses a key inserted before it began and never deleted (a lost update)
+    vector<Operation> lost = {{1, OP_INSERT, 5, true, 0, 1}, {1, OP_SEARCH, 0, false, 2, 3}, {1, OP_DELETE, 0, true, 4, 5}};
+    // a delete that claims success while a concurrent delete also succeeded, with one insert before
+    vector<Operation> doubled = {{1, OP_INSERT, 5, true, 0, 1}, {1, OP_DELETE, 0, true, 2, 5}, {1, OP_DELETE, 0, true, 3, 4}};
+
+    if (linearizable(twice) || !linearizable(overlapped) || linearizable(invented)
+        || linearizable(lost) || linearizable(doubled)) {
+        fail("the history checker gives a wrong answer on a known history");
+    }
+}
+
+/**
+ * @brief Runs threads on one concurrentBST map over keys [0, keys), records every operation, and
+ * checks the histories and the final tree.
+ *
+ * Inserted values are unique, so a get that reads a value tells which insert it saw. After the
+ * threads stop, one more get per key, later than everything, records what the tree holds.
+ *
+ * @param threads: (unsigned) the number of threads
+ * @param keys: (uint64_t) the size of the shared key range
+ * @param ops: (size_t) operations per thread
+ */
+static void test_history(unsigned threads, uint64_t keys, size_t ops) {
+    avl_concurrent_map<uint64_t, uint64_t> tree;
+    vector<vector<Operation> > logs(threads);
+
+    vector<thread> workers;
+    for (unsigned id = 0; id < threads; id++) {
+        workers.push_back(thread([&, id]() {
+            avl_concurrent_map<uint64_t, uint64_t>::session s(tree);
+            mt19937_64 rng(id * 7919 + keys);
+            vector<Operation> &log = logs[id];
+            log.reserve(ops);
+            for (size_t i = 0; i < ops; i++) {
+                uint64_t r = rng();
+                Operation op = {r % keys, OP_SEARCH, 0, false, 0, 0};
+                switch ((r >> 32) % 10) {
+                    case 0: case 1: case 2: op.kind = OP_INSERT; op.value = ((uint64_t)id + 1) << 40 | (i + 1); break;
+                    case 3: case 4: case 5: op.kind = OP_DELETE; break;
+                    case 6: case 7: op.kind = OP_SEARCH; break;
+                    default: op.kind = OP_GET;
+                }
+
+                op.invoked = ticks.fetch_add(1);
+                switch (op.kind) {
+                    case OP_INSERT: op.result = s.insertNode(op.key, op.value); break;
+                    case OP_DELETE: op.result = s.deleteNode(op.key); break;
+                    case OP_SEARCH: op.result = s.searchItem(op.key); break;
+                    default: op.result = s.get(op.key, op.value);
+                }
+                op.returned = ticks.fetch_add(1);
+                log.push_back(op);
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    string label = to_string(threads) + " threads on " + to_string(keys) + " keys";
+    if (!tree.validate()) {
+        fail(label + ": not a valid AVL tree once quiescent");
+    }
+
+    // the histories, with what the quiescent tree holds as a last get on every key
+    vector<vector<Operation> > histories(keys);
+    for (unsigned id = 0; id < threads; id++) {
+        for (size_t i = 0; i < logs[id].size(); i++) {
+            histories[logs[id][i].key].push_back(logs[id][i]);
+        }
+    }
+    size_t present = 0;
+    {
+        avl_concurrent_map<uint64_t, uint64_t>::session s(tree);
+        for (uint64_t key = 0; key < keys; key++) {
+            Operation op = {key, OP_GET, 0, false, 0, 0};
+            op.invoked = ticks.fetch_add(1);
+            op.result = s.get(key, op.value);
+            op.returned = ticks.fetch_add(1);
+            histories[key].push_back(op);
+            present += op.result;
+        }
+    }
+    size_t listed = 0;
+    tree.for_each([&listed](pair<const uint64_t&, const uint64_t&>) { listed++; });
+    if (listed != present || tree.treeNodeCount() != present) {
+        fail(label + ": for_each and treeNodeCount disagree with get");
+    }
+
+    size_t operations = 0;
+    for (uint64_t key = 0; key < keys; key++) {
+        operations += histories[key].size();
+        if (!linearizable(histories[key])) {
+            fail(label + ": the history of key " + to_string(key) + " is not linearizable");
+        }
+    }
+    cout << label << ": " << operations << " operations linearizable, height " << tree.height() << endl;
+}
+
+/* --- End of TESTS --- */
+
+/* --- MAIN --- */
+
+/**
+ * @brief Checks the checker, then runs the stress test on small, medium and larger key ranges,
+ * where the small ones make every thread collide on the same keys and the larger ones make the
+ * tree deep enough for double rotations and routing nodes with two children.
+ *
+ * @param argc: (int) 1 or 2
+ * @param argv: (char**) optionally the operations per thread (default 20000)
+ * @return int: 0 if every check passed
+ */
+int main(int argc, char** argv) {
+    size_t ops = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+
+    test_checker();
+    for (unsigned threads : {2u, 4u, 8u}) {
+        for (uint64_t keys : {4u, 32u, 256u}) {
+            test_history(threads, keys, ops);
+        }
+    }
+
+    cout << (failures == 0 ? "concurrentBST: all linearizability checks passed" : "concurrentBST: checks FAILED") << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+/* --- End of MAIN --- */
@@ -0,0 +1,671 @@
+/**
+ * @file test_recovery.cpp
+ * @author Ozgur Tuna Ozturk (ozturk_ozgur@wheatoncollege.edu)
+ * @brief This file tests that durableBST and mappedBST come back from a crash with the state they
+ * promise. Each test runs random updates on the tree and on a std::map model, crashes or damages
+ * the files, then reopens them and compares. A crash is a forked child that leaves with _exit,
+ * skipping every destructor, or that is killed with SIGKILL at a random time.
+ * For durableBST it covers torn tails of the newest log segment, a crash after acknowledged
+ * writes, replaying a log that a checkpoint already holds, a bad record in an older segment, a
+ * crash while checkpoint_async runs, a stale image left half written, and an automatic
+ * checkpoint that cannot start. For mappedBST it covers
+ * a crash before and after sync(), SIGKILL at random times between syncs, and clear() followed by
+ * a crash.
+ * Build and run it with "make test". The files go to a fresh directory under /tmp.
+ * @version 0.1
+ * @date 2024-04-14
+ *
+ * @copyright MIT LICENSE (c) 2024
+ *
+ */
+
+/* --- IMPORTS --- */
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "AVLdurable.h"
+#include "AVLmapped.h"
+/* --- End of IMPORTS --- */
+
+/* --- NAMESPACE --- */
+using namespace std;
+/* --- End of NAMESPACE --- */
+
+/* --- HELPERS --- */
+
+typedef avl_durable_map<uint32_t, uint64_t> durable_map;
+typedef avl_mapped_map<uint32_t, uint64_t> mapped_map;
+typedef map<uint32_t, uint64_t> model;
+
+static int failures = 0;
+
+/**
+ * @brief Reports a failed check.
+ */
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+/**
+ * @brief Runs fn and tells whether it threw runtime_error.
+ */
+template <class Fn>
+static bool throws(Fn fn) {
+    try {
+        fn();
+    }
+    catch (const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Lists the files of a directory, without "." and "..".
+ */
+static vector<string> files(const string& dir) {
+    vector<string> names;
+    DIR *listing = opendir(dir.c_str());
+    while (listing != NULL) {
+        dirent *entry = readdir(listing);
+        if (entry == NULL) {
+            closedir(listing);
+            break;
+        }
+        if (string(entry->d_name) != "." && string(entry->d_name) != "..") {
+            names.push_back(entry->d_name);
+        }
+    }
+    return names;
+}
+
+/**
+ * @brief Deletes a directory and the files in it.
+ */
+static void remove_dir(const string& dir) {
+    vector<string> names = files(dir);
+    for (size_t i = 0; i < names.size(); i++) {
+        remove((dir + "/" + names[i]).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+/**
+ * @brief Gets the numbers of the log segments in a durableBST directory, in order.
+ */
+static vector<uint64_t> segments(const string& dir) {
+    vector<string> names = files(dir);
+    vector<uint64_t> numbers;
+    for (size_t i = 0; i < names.size(); i++) {
+        unsigned long long number;
+        char tail;
+        if (sscanf(names[i].c_str(), "wal.%llu.lo%c", &number, &tail) == 2 && tail == 'g') {
+            numbers.push_back(number);
+        }
+    }
+    sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+/**
+ * @brief Reads a whole file.
+ */
+static string read_file(const string& path) {
+    ifstream in(path.c_str(), ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Replaces a file with the given bytes.
+ */
+static void write_file(const string& path, const string& bytes) {
+    ofstream out(path.c_str(), ios::binary | ios::trunc);
+    out << bytes;
+}
+
+/**
+ * @brief Runs random inserts and deletes on keys below 500, on the tree and on the model, and
+ * checks that each returns what the model says. With tree null only the model changes, which
+ * replays the same stream of updates for a model alone.
+ */
+static void updates(durable_map* tree, model& expected, mt19937& rng, size_t ops) {
+    for (size_t i = 0; i < ops; i++) {
+        uint32_t key = rng() % 500;
+        if (rng() % 3) {
+            bool fresh = expected.insert(make_pair(key, (uint64_t)rng())).second;
+            if (tree) {
+                check(tree->insertNode(key, expected[key]) == fresh, "durableBST insertNode result");
+            }
+        }
+        else {
+            bool present = expected.erase(key) == 1;
+            if (tree) {
+                check(tree->deleteNode(key) == present, "durableBST deleteNode result");
+            }
+        }
+    }
+}
+
+/**
+ * @brief Tells whether a durableBST holds exactly the model.
+ */
+static bool same(const durable_map& tree, const model& expected) {
+    return tree.read([&expected](const durable_map::tree_type& t) {
+        model found;
+        for (auto entry : t) {
+            found[entry.first] = entry.second;
+        }
+        return found == expected;
+    });
+}
+
+/**
+ * @brief Tells whether a mappedBST holds exactly the model.
+ */
+static bool same(mapped_map& tree, const model& expected) {
+    if (tree.treeNodeCount() != expected.size()) {
+        return false;
+    }
+    model::const_iterator it = expected.begin();
+    for (auto entry : tree) {
+        if (it == expected.end() || entry.first != it->first || entry.second != it->second) {
+            return false;
+        }
+        ++it;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs one random update on a mappedBST and on its model: an insert, a delete or a
+ * change of a value in place. With tree null only the model changes, which replays the same
+ * stream of updates for a model alone.
+ */
+static void step(mt19937& rng, mapped_map* tree, model& expected, uint64_t i) {
+    uint32_t key = rng() % 20000;
+    int op = rng() % 4;
+    if (op < 2) {
+        expected.insert(make_pair(key, i));
+        if (tree) {
+            tree->insertNode(key, i);
+        }
+    }
+    else if (op == 2) {
+        expected.erase(key);
+        if (tree) {
+            tree->deleteNode(key);
+        }
+    }
+    else {
+        model::iterator it = expected.find(key);
+        uint64_t *value = tree ? tree->searchValue(key) : nullptr;
+        if (it != expected.end()) {
+            it->second = i;
+            if (tree) {
+                *value = i;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Waits for a child and tells whether it died of SIGKILL.
+ */
+static bool killed(pid_t child) {
+    int status;
+    waitpid(child, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+}
+
+/* --- End of HELPERS --- */
+
+/* --- DURABLE TESTS --- */
+
+/**
+ * @brief Reopening replays the log; a checkpoint empties it; many threads share syncs.
+ */
+static void test_wal_replay(const string& dir, model& expected, mt19937& rng) {
+    {
+        durable_map tree(dir, chrono::microseconds(0));
+        updates(&tree, expected, rng, 2000);
+    }
+    {
+        durable_map tree(dir);
+        check(tree.replayed() > 0 && same(tree, expected), "durableBST replays its log on open");
+        tree.checkpoint();
+        check(tree.log_bytes() == sizeof(avl_wal_header), "durableBST checkpoint empties the log");
+        updates(&tree, expected, rng, 1000);
+    }
+    {
+        durable_map tree(dir, chrono::microseconds(1000));
+        vector<thread> writers;
+        for (uint32_t t = 0; t < 4; t++) {
+            writers.push_back(thread([&tree, t]() {
+                for (uint32_t i = 0; i < 50; i++) {
+                    tree.insertNode(1000 + t * 100 + i, i);
+                }
+            }));
+        }
+        for (size_t t = 0; t < writers.size(); t++) {
+            writers[t].join();
+        }
+        for (uint32_t t = 0; t < 4; t++) {
+            for (uint32_t i = 0; i < 50; i++) {
+                expected[1000 + t * 100 + i] = i;
+            }
+        }
+    }
+    durable_map tree(dir);
+    check(same(tree, expected), "durableBST keeps updates from several threads");
+    check(throws([&dir]() { avl_durable_set<uint64_t> other(dir); }), "durableBST rejects a log of another Key");
+}
+
+/**
+ * @brief A newest segment that ends in garbage, a record cut short or a record with a bad
+ * checksum is replayed up to its last good record and truncated there.
+ */
+static void test_torn_tail(const string& dir, model& expected, mt19937& rng) {
+    {
+        durable_map tree(dir);
+        updates(&tree, expected, rng, 200);
+        // a known last record, which the bad checksum below destroys
+        tree.insertNode(999, 1);
+    }
+    string log = dir + "/wal." + to_string(segments(dir).back()) + ".log";
+    const string intact = read_file(log);
+    const size_t record = 1 + sizeof(uint32_t) + sizeof(uint64_t) + 4;
+    expected[999] = 1;
+
+    write_file(log, intact + "\x01garbage");
+    {
+        durable_map tree(dir);
+        check(same(tree, expected) && read_file(log) == intact, "durableBST truncates garbage after the last record");
+    }
+    write_file(log, intact + intact.substr(sizeof(avl_wal_header), record - 3));
+    {
+        durable_map tree(dir);
+        check(same(tree, expected) && read_file(log) == intact, "durableBST truncates a record cut short");
+    }
+    write_file(log, intact.substr(0, intact.size() - 1) + (char)(intact[intact.size() - 1] ^ 1));
+    expected.erase(999);
+    {
+        durable_map tree(dir);
+        check(same(tree, expected) && read_file(log) == intact.substr(0, intact.size() - record),
+            "durableBST truncates a last record with a bad checksum");
+        updates(&tree, expected, rng, 100);
+        tree.sync();
+    }
+    durable_map tree(dir);
+    check(same(tree, expected), "durableBST appends after a truncated tail");
+}
+
+/**
+ * @brief Updates acknowledged before a crash survive it.
+ */
+static void test_crash_after_ack(const string& dir, model& expected) {
+    pid_t child = fork();
+    if (child == 0) {
+        durable_map tree(dir, chrono::microseconds(2000), true, 0);
+        for (uint32_t key = 5000; key < 5100; key++) {
+            tree.insertNode(key, key);
+        }
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    for (uint32_t key = 5000; key < 5100; key++) {
+        expected[key] = key;
+    }
+    durable_map tree(dir);
+    check(same(tree, expected), "durableBST keeps acknowledged updates through a crash");
+}
+
+/**
+ * @brief A crash between writing a checkpoint and deleting the log it covers leaves records the
+ * image already holds; replaying them over the image gives the same tree.
+ */
+static void test_replay_over_checkpoint(const string& dir, model& expected) {
+    string log = dir + "/wal." + to_string(segments(dir).back()) + ".log";
+    const string covered = read_file(log);
+    {
+        durable_map tree(dir);
+        tree.checkpoint();
+    }
+    write_file(log, covered);
+
+    durable_map tree(dir);
+    check(tree.replayed() > 0, "durableBST replays a log that the checkpoint holds");
+    check(same(tree, expected), "durableBST replay over a checkpoint gives the same tree");
+}
+
+/**
+ * @brief A crash while checkpoint_async runs. The process dies with the child running or not yet
+ * collected, so the image is the old one or the new one and the covered segments may still be
+ * there; the updates made while the child ran must survive either way. A pipe, inherited by the child of
+ * checkpoint_async, tells when that child has finished too.
+ */
+static void test_crash_during_checkpoint(const string& dir, model& expected, mt19937& rng) {
+    int fds[2];
+    check(pipe(fds) == 0, "pipe");
+    {
+        durable_map tree(dir, chrono::microseconds(0));
+        for (uint32_t key = 0; key < 100000; key++) {
+            tree.insertNode(10000 + key, key);
+            expected[10000 + key] = key;
+        }
+    }
+
+    uint32_t seed = rng();
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        durable_map tree(dir, chrono::microseconds(0));
+        model junk = expected;
+        mt19937 same_rng(seed);
+        tree.checkpoint_async();
+        updates(&tree, junk, same_rng, 500);
+        _exit(0);
+    }
+    close(fds[1]);
+    int status;
+    waitpid(child, &status, 0);
+    char byte;
+    while (read(fds[0], &byte, 1) > 0) {
+    }
+    close(fds[0]);
+
+    mt19937 same_rng(seed);
+    updates(nullptr, expected, same_rng, 500);
+
+    {
+        durable_map tree(dir);
+        check(same(tree, expected), "durableBST recovers from a crash during checkpoint_async");
+    }
+
+    // an image cut short by a crash was never renamed over checkpoint.img, so it is ignored
+    write_file(dir + "/checkpoint.img.tmp", "AVL half an image");
+    {
+        durable_map tree(dir);
+        check(same(tree, expected), "durableBST ignores a half-written image");
+        check(tree.checkpoint_async(), "durableBST starts a checkpoint over a stale temporary image");
+        while (tree.checkpoint_running()) {
+            usleep(1000);
+        }
+        check(tree.checkpoint_ok(), "durableBST checkpoint_async succeeds");
+        check(segments(dir).size() == 1, "durableBST drops the covered segments");
+    }
+    durable_map tree(dir);
+    check(same(tree, expected), "durableBST reopens after checkpoint_async");
+}
+
+/**
+ * @brief An older segment was complete when the next began, so a bad record in it is damage,
+ * not a torn tail, and opening the directory throws.
+ */
+static void test_bad_older_segment(const string& dir, model& expected, mt19937& rng) {
+    {
+        durable_map tree(dir, chrono::microseconds(0), true, 0);
+        updates(&tree, expected, rng, 100);
+        // the child of checkpoint_async fails on a directory in the image's place, which keeps
+        // the older segment
+        mkdir((dir + "/checkpoint.img.tmp").c_str(), 0755);
+        tree.checkpoint_async();
+        while (tree.checkpoint_running()) {
+            usleep(1000);
+        }
+        check(!tree.checkpoint_ok(), "durableBST reports a failed checkpoint");
+        updates(&tree, expected, rng, 100);
+    }
+    rmdir((dir + "/checkpoint.img.tmp").c_str());
+    vector<uint64_t> numbers = segments(dir);
+    check(numbers.size() >= 2, "durableBST keeps the segments of a failed checkpoint");
+
+    string older = dir + "/wal." + to_string(numbers.front()) + ".log";
+    string bytes = read_file(older);
+    {
+        durable_map tree(dir);
+        check(same(tree, expected), "durableBST replays every segment");
+    }
+    string damaged = bytes;
+    damaged[sizeof(avl_wal_header) + 2] ^= 1;
+    write_file(older, damaged);
+    check(throws([&dir]() { durable_map tree(dir); }), "durableBST throws on a bad record in an older segment");
+    write_file(older, bytes.substr(0, bytes.size() - 3));
+    check(throws([&dir]() { durable_map tree(dir); }), "durableBST throws on an older segment cut short");
+    write_file(older, bytes);
+}
+
+/**
+ * @brief An automatic checkpoint that cannot start must not fail the update that triggered it;
+ * it is counted and tried again by later updates. A directory in the place of the next segment
+ * makes the segment rotation fail.
+ */
+static void test_checkpoint_start_failure(const string& dir, model& expected, mt19937& rng) {
+    const string blocker = dir + "/wal." + to_string(segments(dir).back() + 1) + ".log";
+    {
+        durable_map tree(dir, chrono::microseconds(0), true, 4096);
+        // not empty, so that the rotation's clean-up cannot remove it
+        mkdir(blocker.c_str(), 0755);
+        write_file(blocker + "/keep", "x");
+        bool threw = throws([&]() { updates(&tree, expected, rng, 1000); });
+        check(!threw, "durableBST updates do not throw when a checkpoint cannot start");
+        check(tree.checkpoint_start_failures() > 0, "durableBST counts checkpoints that could not start");
+        check(same(tree, expected), "durableBST keeps the updates whose checkpoint could not start");
+
+        remove((blocker + "/keep").c_str());
+        rmdir(blocker.c_str());
+        size_t before = tree.checkpoints();
+        updates(&tree, expected, rng, 50);
+        while (tree.checkpoint_running()) {
+            usleep(1000);
+        }
+        check(tree.checkpoints() > before, "durableBST retries the checkpoint on a later update");
+    }
+    durable_map tree(dir);
+    check(same(tree, expected), "durableBST reopens after a checkpoint that could not start");
+}
+
+/* --- End of DURABLE TESTS --- */
+
+/* --- MAPPED TESTS --- */
+
+/**
+ * @brief Reopening gives the tree of the last sync; updates after it, or a crash after them,
+ * are rolled back.
+ */
+static void test_mapped_reopen(const string& path) {
+    mt19937 rng(5);
+    model synced;
+    {
+        mapped_map tree(path);
+        for (uint64_t i = 0; i < 50000; i++) {
+            step(rng, &tree, synced, i);
+        }
+        check(same(tree, synced), "mappedBST matches the model");
+        check(throws([&path]() { mapped_map other(path); }), "mappedBST refuses a second open");
+    }
+    {
+        mapped_map tree(path);
+        check(same(tree, synced), "mappedBST reopens with the tree it closed with");
+        tree.insertNode(1u << 31, 5);
+        synced[1u << 31] = 5;
+        tree.sync();
+        *tree.searchValue(1u << 31) = 6;
+        tree.insertNode(7u << 28, 7);
+    }
+    {
+        mapped_map tree(path);
+        synced[1u << 31] = 6;
+        synced[7u << 28] = 7;
+        check(same(tree, synced), "mappedBST syncs when it closes");
+    }
+
+    // crash with updates after the last sync
+    pid_t child = fork();
+    if (child == 0) {
+        mapped_map tree(path);
+        tree.insertNode(3, 3);
+        tree.deleteNode(synced.begin()->first);
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    {
+        mapped_map tree(path);
+        check(same(tree, synced), "mappedBST rolls back to the last sync after a crash");
+    }
+
+    // crash right after a sync
+    child = fork();
+    if (child == 0) {
+        mapped_map tree(path);
+        tree.insertNode(3, 3);
+        tree.sync();
+        _exit(0);
+    }
+    waitpid(child, &status, 0);
+    synced.insert(make_pair(3u, (uint64_t)3));
+    {
+        mapped_map tree(path);
+        check(same(tree, synced), "mappedBST keeps a sync made before a crash");
+    }
+    check(throws([&path]() { avl_mapped_set<uint64_t> other(path); }), "mappedBST rejects a heap of another Key");
+}
+
+/**
+ * @brief SIGKILL at random times while a child updates and syncs. The child reports each sync
+ * down a pipe, so the tree must be the one at the last reported sync or the next.
+ */
+static void test_mapped_kill(const string& path) {
+    model synced;
+    {
+        mapped_map tree(path);
+        tree.clear();
+        mt19937 rng(1);
+        for (uint64_t i = 0; i < 20000; i++) {
+            step(rng, &tree, synced, i);
+        }
+    }
+
+    mt19937 timing(11);
+    for (int round = 0; round < 20; round++) {
+        int fds[2];
+        check(pipe(fds) == 0, "pipe");
+        pid_t child = fork();
+        if (child == 0) {
+            close(fds[0]);
+            mapped_map tree(path);
+            mt19937 rng(5000 + round);
+            model junk = synced;
+            for (;;) {
+                for (uint64_t i = 0; i < 200; i++) {
+                    step(rng, &tree, junk, i);
+                }
+                tree.sync();
+                char byte = 1;
+                if (write(fds[1], &byte, 1) != 1) {
+                    _exit(1);
+                }
+            }
+        }
+        close(fds[1]);
+        usleep(1000 * (timing() % 60));
+        kill(child, SIGKILL);
+        check(killed(child), "the child dies of SIGKILL");
+        size_t syncs = 0;
+        char byte;
+        while (read(fds[0], &byte, 1) == 1) {
+            syncs++;
+        }
+        close(fds[0]);
+
+        model last = synced;
+        mt19937 rng(5000 + round);
+        for (size_t s = 0; s < syncs; s++) {
+            for (uint64_t i = 0; i < 200; i++) {
+                step(rng, nullptr, last, i);
+            }
+        }
+        model next = last;
+        for (uint64_t i = 0; i < 200; i++) {
+            step(rng, nullptr, next, i);
+        }
+
+        mapped_map tree(path);
+        bool atLast = same(tree, last);
+        check(atLast || same(tree, next), "mappedBST is at the last sync or the next after SIGKILL");
+        synced = atLast ? last : next;
+    }
+
+    // clear commits at once, so a crash after it leaves an empty tree
+    pid_t child = fork();
+    if (child == 0) {
+        mapped_map tree(path);
+        tree.clear();
+        tree.insertNode(5, 5);
+        raise(SIGKILL);
+    }
+    check(killed(child), "the child dies of SIGKILL");
+    mapped_map tree(path);
+    check(tree.empty(), "mappedBST keeps a clear made before a crash");
+}
+
+/* --- End of MAPPED TESTS --- */
+
+/* --- MAIN --- */
+
+/**
+ * @brief Runs every test in a fresh directory under /tmp and deletes it afterwards. An
+ * unexpected exception counts as a failure.
+ *
+ * @return int: 0 if every check passed
+ */
+int main() {
+    const string base = "/tmp/avl_test_recovery." + to_string(getpid());
+    const string dir = base + "/durable";
+    const string heap = base + "/tree.heap";
+    mkdir(base.c_str(), 0755);
+
+    mt19937 rng(3);
+    model expected;
+    try {
+        test_wal_replay(dir, expected, rng);
+        test_torn_tail(dir, expected, rng);
+        test_crash_after_ack(dir, expected);
+        test_replay_over_checkpoint(dir, expected);
+        test_crash_during_checkpoint(dir, expected, rng);
+        test_bad_older_segment(dir, expected, rng);
+        test_checkpoint_start_failure(dir, expected, rng);
+        test_mapped_reopen(heap);
+        test_mapped_kill(heap);
+    }
+    catch (const exception& e) {
+        // a recovery that throws where it should not
+        check(false, e.what());
+    }
+
+    remove_dir(dir);
+    remove(heap.c_str());
+    rmdir(base.c_str());
+
+    cout << (failures == 0 ? "durableBST, mappedBST: all recovery checks passed" : "durableBST, mappedBST: checks FAILED") << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+/* --- End of MAIN --- */